@@ -0,0 +1,1011 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "ArchiveIndex.h"
+#include "Archiver.h"
+#include "SeekableGzip.h"
+#include "TarArchive.h"
+#include "ZipArchive.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <FindDirectory.h>
+#include <OS.h>
+
+#include <zlib.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: reading TAR stream
+//
+//----------------------------------------------------------------------------
+
+enum
+{
+	READER_PLAIN,		// uncompressed TAR, data is skipped with lseek()
+	READER_GZIP,		// inflated by zlib, start of each gzip member is remembered
+	READER_TOOL			// decompressed by tool writing to pipe
+};
+
+//---------------------------------------------------
+//	Uncompressed TAR stream, from any of sources above
+//---------------------------------------------------
+struct index_reader
+{
+	int			type;
+	int			fd;
+	uint64		position;		// uncompressed
+	uint64		compressed;		// compressed bytes used by zlib
+
+	z_stream	stream;
+	uint8		*input;
+	bool		ended;			// gzip member ended, next one starts at compressed
+	bool		eof;			// last read found end of stream right where it started (not in the middle of data)
+
+	// blocks (gzip members) header may be in - current one and one before it
+	uint64		blockOffset[2];
+	uint64		blockStart[2];
+
+	seekable_gzip_table	table;		// if gzip is seekable, blocks can be skipped without inflating them
+
+	int			archive_fd;		// read by tool
+	thread_id	tool;
+};
+
+//---------------------------------------------------
+//	Read exactly size bytes of uncompressed stream
+//---------------------------------------------------
+static status_t
+reader_read( index_reader *reader, void *buffer, size_t size)
+{
+	if( reader->type != READER_GZIP)
+	{
+		uint8 *data = (uint8*)buffer;
+		while( size > 0)
+		{
+			ssize_t bytes = read( reader->fd, data, size);
+			if( bytes < 0 && errno == EINTR)
+				continue;
+			if( bytes < 0)
+				return errno;
+			if( bytes == 0)
+			{
+				reader->eof = data == (uint8*)buffer;
+				return B_BAD_DATA;
+			}
+			data += bytes;
+			size -= bytes;
+			reader->position += bytes;
+		}
+		return B_OK;
+	}
+
+	z_stream *stream = &reader->stream;
+	stream->next_out = (Bytef*)buffer;
+	stream->avail_out = size;
+	while( stream->avail_out > 0)
+	{
+		if( stream->avail_in == 0)
+		{
+			ssize_t bytes = read( reader->fd, reader->input, ARCHIVE_INDEX_BUFFER_SIZE);
+			if( bytes < 0 && errno == EINTR)
+				continue;
+			if( bytes < 0)
+				return errno;
+			if( bytes == 0)
+			{
+				reader->eof = reader->ended && stream->avail_out == size;
+				return B_BAD_DATA;
+			}
+			stream->next_in = reader->input;
+			stream->avail_in = bytes;
+		}
+
+		// next gzip member - new block starts here
+		if( reader->ended)
+		{
+			inflateReset( stream);
+			reader->ended = false;
+			reader->blockOffset[0] = reader->blockOffset[1];
+			reader->blockStart[0] = reader->blockStart[1];
+			reader->blockOffset[1] = reader->compressed;
+			reader->blockStart[1] = reader->position + (size - stream->avail_out);
+		}
+
+		uInt avail_in = stream->avail_in;
+		uInt avail_out = stream->avail_out;
+		int result = inflate( stream, Z_NO_FLUSH);
+		reader->compressed += avail_in - stream->avail_in;
+		if( result == Z_STREAM_END)
+			reader->ended = true;
+		else if( result != Z_OK && !( result == Z_BUF_ERROR && avail_out != stream->avail_out))
+			return B_BAD_DATA;
+	}
+	reader->position += size;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Start reading at the beginning of block (gzip member) - at compressed offset, which is uncompressed start
+//---------------------------------------------------
+static status_t
+reader_seek_block( index_reader *reader, uint64 offset, uint64 start)
+{
+	if( lseek( reader->fd, offset, SEEK_SET) < 0)
+		return errno;
+
+	inflateReset( &reader->stream);
+	reader->stream.avail_in = 0;
+	reader->ended = false;
+	reader->compressed = offset;
+	reader->position = start;
+	reader->blockOffset[0] = reader->blockOffset[1] = offset;
+	reader->blockStart[0] = reader->blockStart[1] = start;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Skip size bytes of uncompressed stream (member's data)
+//---------------------------------------------------
+static status_t
+reader_skip( index_reader *reader, uint64 size, uint8 *buffer)
+{
+	if( reader->type == READER_PLAIN)
+	{
+		if( lseek( reader->fd, size, SEEK_CUR) < 0)
+			return errno;
+		reader->position += size;
+		return B_OK;
+	}
+
+	// seekable gzip - blocks which are skipped whole are not inflated
+	if( reader->type == READER_GZIP && reader->table.count > 0)
+	{
+		uint64 target = reader->position + size;
+		int32 block = seekable_gzip_find_block( &reader->table, target);
+		if( reader->table.uncompressed[block] > reader->position)
+		{
+			status_t status = reader_seek_block( reader, reader->table.compressed[block], reader->table.uncompressed[block]);
+			if( status != B_OK)
+				return status;
+			size = target - reader->position;
+		}
+	}
+
+	while( size > 0)
+	{
+		size_t chunk = size < ARCHIVE_INDEX_BUFFER_SIZE ? size : ARCHIVE_INDEX_BUFFER_SIZE;
+		status_t status = reader_read( reader, buffer, chunk);
+		if( status != B_OK)
+			return status;
+		size -= chunk;
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Tool which decompresses data starting with given magic bytes, NULL if it's not compressed
+//	(or it's gzip, which is inflated by zlib)
+//---------------------------------------------------
+const char *
+archive_decompressor( const uint8 *magic, size_t size)
+{
+	if( size >= 3 && !memcmp( magic, "BZh", 3))
+		return "/bin/bzip2";
+	if( size >= 4 && !memcmp( magic, "\x28\xb5\x2f\xfd", 4))
+		return "/bin/zstd";
+	if( size >= 6 && !memcmp( magic, "\xfd" "7zXZ\0", 6))
+		return "/bin/xz";
+	if( size >= 4 && !memcmp( magic, "LZIP", 4))
+		return "/bin/lzip";
+	return NULL;
+}
+
+//---------------------------------------------------
+//	Open archive for reading uncompressed TAR stream
+//---------------------------------------------------
+static status_t
+reader_open( index_reader *reader, const char *path)
+{
+	memset( reader, 0, sizeof( *reader));
+	reader->type = READER_PLAIN;
+	reader->archive_fd = -1;
+	reader->tool = -1;
+	reader->fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( reader->fd < 0)
+		return errno;
+
+	uint8 magic[6];
+	ssize_t magicSize = read( reader->fd, magic, sizeof( magic));
+	lseek( reader->fd, 0, SEEK_SET);
+
+	const char *decompressor = magicSize > 0 ? archive_decompressor( magic, magicSize) : NULL;
+	if( magicSize >= 2 && magic[0] == 0x1f && magic[1] == 0x8b)
+	{
+		reader->type = READER_GZIP;
+		reader->input = (uint8*)malloc( ARCHIVE_INDEX_BUFFER_SIZE);
+		if( reader->input == NULL || inflateInit2( &reader->stream, 15 + 16) != Z_OK)
+		{
+			free( reader->input);
+			close( reader->fd);
+			return B_NO_MEMORY;
+		}
+		seekable_gzip_read_table( reader->fd, &reader->table);
+	}
+	else if( decompressor != NULL)
+	{
+		// tool reads archive and writes TAR to pipe (made under launch_tool()'s lock, so other tools don't inherit it)
+		int fds[2];
+		status_t status = make_pipe( fds);
+		if( status != B_OK)
+		{
+			close( reader->fd);
+			return status;
+		}
+
+		const char *arg_v[] = { decompressor, "-d", "-c", NULL };
+		reader->tool = launch_tool( 3, arg_v, reader->fd, fds[1]);
+		close( fds[1]);
+		if( reader->tool < B_OK)
+		{
+			close( fds[0]);
+			close( reader->fd);
+			return reader->tool;
+		}
+		resume_thread( reader->tool);
+
+		reader->archive_fd = reader->fd;
+		reader->fd = fds[0];
+		reader->type = READER_TOOL;
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Close archive, wait for tool - returns B_BAD_DATA if tool failed
+//---------------------------------------------------
+static status_t
+reader_close( index_reader *reader)
+{
+	if( reader->type == READER_GZIP)
+	{
+		inflateEnd( &reader->stream);
+		free( reader->input);
+		seekable_gzip_free_table( &reader->table);
+	}
+	close( reader->fd);
+
+	// rest of output isn't needed, tool quits when it can't write anymore
+	status_t result = B_OK;
+	if( reader->tool >= B_OK)
+	{
+		wait_for_thread( reader->tool, &result);
+		close( reader->archive_fd);
+	}
+	return result != B_OK ? B_BAD_DATA : B_OK;
+}
+
+//---------------------------------------------------
+//	Block (gzip member) in which next byte of stream is
+//---------------------------------------------------
+static void
+reader_block( index_reader *reader, uint64 *offset, uint64 *start)
+{
+	// gzip member just ended, next one starts where reader is
+	if( reader->type == READER_GZIP && reader->ended)
+	{
+		*offset = reader->compressed;
+		*start = reader->position;
+		return;
+	}
+
+	int block = reader->position < reader->blockStart[1] ? 0 : 1;
+	*offset = reader->blockOffset[block];
+	*start = reader->blockStart[block];
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: ArchiveIndex
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+ArchiveIndex::ArchiveIndex()
+	:aFromCache( false),
+	aZip( false)
+{
+	memset( &aStat, 0, sizeof( aStat));
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+ArchiveIndex::~ArchiveIndex()
+{
+	Unset();
+}
+
+//---------------------------------------------------
+//	Forget all entries
+//---------------------------------------------------
+void
+ArchiveIndex::Unset()
+{
+	ArchiveIndexEntry *entry;
+	while( ( entry = (ArchiveIndexEntry*)aEntries.RemoveItem( aEntries.CountItems() - 1)) != NULL)
+	{
+		free( entry->name);
+		delete entry;
+	}
+	aFromCache = false;
+	aZip = false;
+}
+
+//---------------------------------------------------
+//	Add entry, name is copied
+//---------------------------------------------------
+void
+ArchiveIndex::AddEntry( const char *name, uint64 offset, uint64 size, uint64 blockOffset, uint64 blockStart, uint32 mode, int64 time, uint8 sparse)
+{
+	ArchiveIndexEntry *entry = new ArchiveIndexEntry;
+	entry->name = strdup( name);
+	entry->offset = offset;
+	entry->size = size;
+	entry->blockOffset = blockOffset;
+	entry->blockStart = blockStart;
+	entry->mode = mode;
+	entry->time = time;
+	entry->sparse = sparse;
+	aEntries.AddItem( entry);
+}
+
+//---------------------------------------------------
+//	List members of archive at path
+//	ZIP - from central directory, TAR - from cache if archive didn't change since it was indexed
+//---------------------------------------------------
+status_t
+ArchiveIndex::SetTo( const char *path, bool useCache)
+{
+	Unset();
+
+	if( stat( path, &aStat) != 0)
+		return errno;
+	aPath.SetTo( path);
+
+	uint8 magic[4] = { 0, 0, 0, 0 };
+	int fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0)
+		return errno;
+	read( fd, magic, sizeof( magic));
+	close( fd);
+
+	// ZIP has it's own index
+	if( !memcmp( magic, "PK\x03\x04", 4) || !memcmp( magic, "PK\x05\x06", 4))
+	{
+		aZip = true;
+		return ReadZip( path);
+	}
+
+	if( useCache && LoadCache() == B_OK)
+	{
+		aFromCache = true;
+		return B_OK;
+	}
+	Unset();
+
+	status_t status = ReadTar( path);
+	if( status == B_OK)
+		SaveCache();
+	return status;
+}
+
+//---------------------------------------------------
+//	Members of ZIP, read from it's central directory
+//---------------------------------------------------
+status_t
+ArchiveIndex::ReadZip( const char *path)
+{
+	ZipArchive zip;
+	status_t status = zip.Open( path, false);
+	if( status != B_OK)
+		return status;
+
+	ZipEntry entry;
+	for( int32 index = 0; zip.GetEntry( index, &entry) == B_OK; index++)
+		AddEntry( entry.aName, entry.aOffset, entry.aSize, 0, 0, entry.Mode(), entry.ModificationTime());
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Walk TAR headers (compressed or not), data is skipped
+//---------------------------------------------------
+status_t
+ArchiveIndex::ReadTar( const char *path)
+{
+	index_reader reader;
+	status_t status = reader_open( &reader, path);
+	if( status != B_OK)
+		return status;
+
+	char header[TAR_BLOCK_SIZE];
+	uint8 *buffer = (uint8*)malloc( ARCHIVE_INDEX_BUFFER_SIZE);
+	char *longName = NULL;
+	int64 paxSize = -1;		// "size" of POSIX extended header - members of 8GB and more have it only there
+	int64 realSize = -1;	// of sparse member - stored size is only it's map and data
+	int32 sparseMajor = -1;
+	bool sparse = false;
+	if( buffer == NULL)
+		status = B_NO_MEMORY;
+	while( status == B_OK)
+	{
+		uint64 offset = reader.position;
+		uint64 blockOffset;
+		uint64 blockStart;
+		reader_block( &reader, &blockOffset, &blockStart);
+
+		status = reader_read( &reader, header, TAR_BLOCK_SIZE);
+		// some tools don't write end-of-archive blocks - stream may end between members, not in the middle of one
+		if( status == B_BAD_DATA && offset > 0 && reader.eof)
+		{
+			status = B_OK;
+			break;
+		}
+		if( status != B_OK || header[0] == 0)
+			break;
+
+		if( tar_get_number( header + 148, 8) != tar_checksum( header))
+		{
+			status = B_BAD_DATA;
+			break;
+		}
+
+		uint64 size = tar_get_number( header + 124, 12);
+		char type = header[156];
+		if( paxSize >= 0 && type != TAR_TYPE_LONG_NAME && type != TAR_TYPE_PAX && type != TAR_TYPE_LONG_LINK && type != TAR_TYPE_PAX_GLOBAL)
+			size = paxSize;
+		uint64 padded = ( size + TAR_BLOCK_SIZE - 1) & ~(uint64)( TAR_BLOCK_SIZE - 1);
+
+		// long name of next member - GNU long name, or "path" of POSIX extended header
+		if( type == TAR_TYPE_LONG_NAME || type == TAR_TYPE_PAX)
+		{
+			char *data = (char*)malloc( padded + 1);
+			if( data == NULL || size > 1024 * 1024)
+			{
+				free( data);
+				status = B_BAD_DATA;
+				break;
+			}
+			status = reader_read( &reader, data, padded);
+			data[size] = 0;
+
+			if( type == TAR_TYPE_LONG_NAME)
+			{
+				free( longName);
+				longName = data;
+				continue;
+			}
+
+			// records are "length key=value\n"
+			for( char *record = data; status == B_OK && record < data + size; )
+			{
+				long length = strtol( record, NULL, 10);
+				if( length <= 0 || record + length > data + size)
+					break;
+				char *key = strchr( record, ' ');
+				// sparse member has real name in "GNU.sparse.name" (PAX 1.0)
+				size_t keySize = 0;
+				if( key != NULL && key < record + length && !strncmp( key + 1, "path=", 5))
+					keySize = 5;
+				else if( key != NULL && key < record + length && !strncmp( key + 1, "GNU.sparse.name=", 16))
+					keySize = 16;
+				if( keySize > 0)
+				{
+					free( longName);
+					longName = strndup( key + 1 + keySize, record + length - key - 2 - keySize);
+				}
+				if( key != NULL && key < record + length && !strncmp( key + 1, "size=", 5))
+					paxSize = strtoll( key + 6, NULL, 10);
+
+				// any other "GNU.sparse." key makes member sparse, "realsize" (1.0) or "size" (0.x) is it's real size
+				if( key != NULL && key < record + length && !strncmp( key + 1, "GNU.sparse.", 11) && keySize == 0)
+				{
+					const char *sparseKey = key + 12;
+					sparse = true;
+					if( !strncmp( sparseKey, "realsize=", 9) || !strncmp( sparseKey, "size=", 5))
+						realSize = strtoll( strchr( sparseKey, '=') + 1, NULL, 10);
+					else if( !strncmp( sparseKey, "major=", 6))
+						sparseMajor = strtol( sparseKey + 6, NULL, 10);
+				}
+				record += length;
+			}
+			free( data);
+			continue;
+		}
+
+		if( type == TAR_TYPE_LONG_LINK || type == TAR_TYPE_PAX_GLOBAL)
+		{
+			status = reader_skip( &reader, padded, buffer);
+			continue;
+		}
+
+		// sparse member is listed with it's real size, only GNU PAX 1.0 one can be read
+		uint8 sparseType = ARCHIVE_INDEX_NOT_SPARSE;
+		uint64 memberSize = size;
+		if( sparse)
+		{
+			sparseType = sparseMajor == 1 ? ARCHIVE_INDEX_SPARSE_PAX : ARCHIVE_INDEX_SPARSE_OTHER;
+			if( realSize >= 0)
+				memberSize = realSize;
+		}
+		if( type == TAR_TYPE_GNU_SPARSE)
+		{
+			sparseType = ARCHIVE_INDEX_SPARSE_OTHER;
+			memberSize = tar_get_number( header + 483, 12);
+
+			// map which doesn't fit in header continues in extension blocks, they aren't counted in size
+			char extension[TAR_BLOCK_SIZE];
+			for( bool extended = header[482] != 0; status == B_OK && extended; extended = extension[504] != 0)
+				status = reader_read( &reader, extension, TAR_BLOCK_SIZE);
+			if( status != B_OK)
+				break;
+		}
+
+		char name[256 + 2];
+		if( longName != NULL)
+			AddEntry( longName, offset, memberSize, blockOffset, blockStart, tar_get_number( header + 100, 8), tar_get_number( header + 136, 12), sparseType);
+		else
+		{
+			// ustar name may be split into prefix and name
+			if( header[345] != 0 && !memcmp( header + 257, "ustar", 5))
+				snprintf( name, sizeof( name), "%.155s/%.100s", header + 345, header);
+			else
+				snprintf( name, sizeof( name), "%.100s", header);
+			AddEntry( name, offset, memberSize, blockOffset, blockStart, tar_get_number( header + 100, 8), tar_get_number( header + 136, 12), sparseType);
+		}
+		free( longName);
+		longName = NULL;
+		paxSize = -1;
+		realSize = -1;
+		sparseMajor = -1;
+		sparse = false;
+
+		// directories, links... have no data, but size of hard link may be set
+		if( type != '1' && type != '2' && type != '5')
+			status = reader_skip( &reader, padded, buffer);
+	}
+
+	free( longName);
+	free( buffer);
+
+	// tool which failed could stop writing anywhere, even between members
+	status_t closed = reader_close( &reader);
+	if( status == B_OK && reader.eof)
+		status = closed;
+
+	if( status != B_OK)
+		Unset();
+	return status;
+}
+
+//---------------------------------------------------
+//	Index of last member with given name, -1 if there is none
+//---------------------------------------------------
+int32
+ArchiveIndex::FindEntry( const char *name) const
+{
+	for( int32 index = CountEntries() - 1; index >= 0; index--)
+	{
+		if( !strcmp( EntryAt( index)->name, name))
+			return index;
+	}
+	return -1;
+}
+
+//---------------------------------------------------
+//	Copy size bytes of stream to out_fd - or write size zeros, if it's hole of sparse member
+//---------------------------------------------------
+static status_t
+copy_member_data( index_reader *reader, int out_fd, uint64 size, bool hole, uint8 *buffer, int32 *cancel)
+{
+	if( hole)
+		memset( buffer, 0, size < ARCHIVE_INDEX_BUFFER_SIZE ? size : ARCHIVE_INDEX_BUFFER_SIZE);
+
+	status_t status = B_OK;
+	while( status == B_OK && size > 0)
+	{
+		if( cancel != NULL && atomic_get( cancel) != 0)
+			return B_CANCELED;
+
+		size_t chunk = size < ARCHIVE_INDEX_BUFFER_SIZE ? size : ARCHIVE_INDEX_BUFFER_SIZE;
+		if( !hole)
+			status = reader_read( reader, buffer, chunk);
+		for( size_t written = 0; status == B_OK && written < chunk; )
+		{
+			ssize_t bytes = write( out_fd, buffer + written, chunk - written);
+			if( bytes < 0 && errno == EINTR)
+				continue;
+			if( bytes < 0)
+				status = errno;
+			else
+				written += bytes;
+		}
+		size -= chunk;
+	}
+	return status;
+}
+
+//---------------------------------------------------
+//	Read map at start of sparse member's data (GNU PAX 1.0) - count of segments, then offset and size of each,
+//	one number on line, padded to full block; segments are returned as pairs (caller frees them)
+//	they must follow each other and lie within real size of file
+//---------------------------------------------------
+static status_t
+read_sparse_map( index_reader *reader, uint64 realSize, uint64 **segments, int64 *count)
+{
+	char block[TAR_BLOCK_SIZE];
+	size_t used = TAR_BLOCK_SIZE;
+	uint64 *map = NULL;
+	int64 numbers = -1;		// of offsets and sizes, known after first number is read
+	int64 found = 0;
+	uint64 value = 0;
+	int32 digits = 0;
+	status_t status = B_OK;
+	while( status == B_OK && ( numbers < 0 || found < numbers))
+	{
+		if( used == TAR_BLOCK_SIZE)
+		{
+			status = reader_read( reader, block, TAR_BLOCK_SIZE);
+			used = 0;
+			continue;
+		}
+
+		char c = block[used++];
+		if( c >= '0' && c <= '9' && digits < 19)
+		{
+			value = value * 10 + c - '0';
+			digits++;
+			continue;
+		}
+		if( c != '\n' || digits == 0)
+		{
+			status = B_BAD_DATA;
+			break;
+		}
+
+		if( numbers >= 0)
+			map[found++] = value;
+		else if( value > ARCHIVE_INDEX_MAX_SEGMENTS)
+			status = B_BAD_DATA;
+		else if( ( map = (uint64*)malloc( sizeof( uint64) * ( value * 2 + 1))) == NULL)
+			status = B_NO_MEMORY;
+		else
+		{
+			*count = value;
+			numbers = value * 2;
+		}
+		value = 0;
+		digits = 0;
+	}
+
+	uint64 end = 0;
+	for( int64 index = 0; status == B_OK && index < numbers; index += 2)
+	{
+		if( map[index] < end || map[index + 1] > realSize || map[index] > realSize - map[index + 1])
+			status = B_BAD_DATA;
+		end = map[index] + map[index + 1];
+	}
+
+	if( status != B_OK)
+	{
+		free( map);
+		return status;
+	}
+	*segments = map;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Write data of TAR member to out_fd - holes of sparse member are written as zeros
+//	gzip is inflated from start of block member's header is in, plain TAR is seeked, other compressors stream from beginning
+//---------------------------------------------------
+status_t
+ArchiveIndex::ReadMember( int32 index, int out_fd, int32 *cancel)
+{
+	ArchiveIndexEntry *entry = EntryAt( index);
+	if( entry == NULL)
+		return B_BAD_INDEX;
+	if( aZip || entry->sparse == ARCHIVE_INDEX_SPARSE_OTHER)
+		return B_NOT_SUPPORTED;
+
+	index_reader reader;
+	status_t status = reader_open( &reader, aPath.Path());
+	if( status != B_OK)
+		return status;
+
+	uint8 *buffer = (uint8*)malloc( ARCHIVE_INDEX_BUFFER_SIZE);
+	if( buffer == NULL)
+		status = B_NO_MEMORY;
+	if( status == B_OK && reader.type == READER_GZIP)
+		status = reader_seek_block( &reader, entry->blockOffset, entry->blockStart);
+	if( status == B_OK && entry->offset + TAR_BLOCK_SIZE < reader.position)
+		status = B_BAD_DATA;
+	if( status == B_OK)
+		status = reader_skip( &reader, entry->offset + TAR_BLOCK_SIZE - reader.position, buffer);
+
+	if( status == B_OK && entry->sparse == ARCHIVE_INDEX_SPARSE_PAX)
+	{
+		uint64 *segments = NULL;
+		int64 count = 0;
+		status = read_sparse_map( &reader, entry->size, &segments, &count);
+
+		uint64 position = 0;
+		for( int64 segment = 0; status == B_OK && segment < count; segment++)
+		{
+			status = copy_member_data( &reader, out_fd, segments[segment * 2] - position, true, buffer, cancel);
+			if( status == B_OK)
+				status = copy_member_data( &reader, out_fd, segments[segment * 2 + 1], false, buffer, cancel);
+			position = segments[segment * 2] + segments[segment * 2 + 1];
+		}
+		if( status == B_OK)
+			status = copy_member_data( &reader, out_fd, entry->size - position, true, buffer, cancel);
+		free( segments);
+	}
+	else if( status == B_OK)
+		status = copy_member_data( &reader, out_fd, entry->size, false, buffer, cancel);
+
+	free( buffer);
+	reader_close( &reader);
+	return status;
+}
+
+//---------------------------------------------------
+//	Path to index of archive in cache - by device and node, so it follows renamed archive
+//	other kinds of cached data about archive use other extensions
+//---------------------------------------------------
+status_t
+ArchiveIndex::GetCachePath( const struct stat *st, BPath *result, const char *extension)
+{
+	status_t status = find_directory( B_USER_CACHE_DIRECTORY, result, true);
+	if( status != B_OK)
+		return status;
+
+	result->Append( ARCHIVE_INDEX_CACHE_DIR);
+	mkdir( result->Path(), 0755);
+
+	char name[64];
+	snprintf( name, sizeof( name), "%" B_PRId64 "-%" B_PRId64 "%s", (int64)st->st_dev, (int64)st->st_ino, extension);
+	return result->Append( name);
+}
+
+//---------------------------------------------------
+//	Load index from cache, if it's made for archive as it's now (size and modification time, with nanoseconds -
+//	archive rewritten in the same second, with the same size, isn't taken for the old one)
+//---------------------------------------------------
+status_t
+ArchiveIndex::LoadCache()
+{
+	BPath path;
+	status_t status = GetCachePath( &aStat, &path);
+	if( status != B_OK)
+		return status;
+
+	FILE *file = fopen( path.Path(), "rb");
+	if( file == NULL)
+		return errno;
+
+	int32 header[2];
+	int64 key[5];
+	int64 count = 0;
+	status = B_BAD_DATA;
+	if( fread( header, sizeof( header), 1, file) == 1 && fread( key, sizeof( key), 1, file) == 1
+		&& fread( &count, sizeof( count), 1, file) == 1
+		&& header[0] == ARCHIVE_INDEX_MAGIC && header[1] == ARCHIVE_INDEX_VERSION
+		&& key[0] == (int64)aStat.st_dev && key[1] == (int64)aStat.st_ino
+		&& key[2] == (int64)aStat.st_size && key[3] == (int64)aStat.st_mtime
+		&& key[4] == (int64)aStat.st_mtim.tv_nsec)
+		status = B_OK;
+
+	for( int64 index = 0; status == B_OK && index < count; index++)
+	{
+		ArchiveIndexEntry entry;
+		uint16 length;
+		char name[B_PATH_NAME_LENGTH * 4];
+		if( fread( &length, sizeof( length), 1, file) != 1 || length >= sizeof( name)
+			|| fread( name, length, 1, file) != 1
+			|| fread( &entry.offset, sizeof( entry.offset), 1, file) != 1
+			|| fread( &entry.size, sizeof( entry.size), 1, file) != 1
+			|| fread( &entry.blockOffset, sizeof( entry.blockOffset), 1, file) != 1
+			|| fread( &entry.blockStart, sizeof( entry.blockStart), 1, file) != 1
+			|| fread( &entry.mode, sizeof( entry.mode), 1, file) != 1
+			|| fread( &entry.time, sizeof( entry.time), 1, file) != 1
+			|| fread( &entry.sparse, sizeof( entry.sparse), 1, file) != 1)
+		{
+			status = B_BAD_DATA;
+			break;
+		}
+		name[length] = 0;
+		AddEntry( name, entry.offset, entry.size, entry.blockOffset, entry.blockStart, entry.mode, entry.time, entry.sparse);
+	}
+	fclose( file);
+
+	return status;
+}
+
+//---------------------------------------------------
+//	Write index to cache, replacing old one
+//---------------------------------------------------
+status_t
+ArchiveIndex::SaveCache()
+{
+	BPath path;
+	status_t status = GetCachePath( &aStat, &path);
+	if( status != B_OK)
+		return status;
+
+	// written to temporary file, so other Archiver doesn't read half of it
+	char temp[B_PATH_NAME_LENGTH + 16];
+	sprintf( temp, "%s.%" B_PRId32, path.Path(), (int32)find_thread( NULL));
+	FILE *file = fopen( temp, "wb");
+	if( file == NULL)
+		return errno;
+
+	int32 header[2] = { ARCHIVE_INDEX_MAGIC, ARCHIVE_INDEX_VERSION };
+	int64 key[5] = { (int64)aStat.st_dev, (int64)aStat.st_ino, (int64)aStat.st_size, (int64)aStat.st_mtime,
+		(int64)aStat.st_mtim.tv_nsec };
+	int64 count = CountEntries();
+	bool written = fwrite( header, sizeof( header), 1, file) == 1
+		&& fwrite( key, sizeof( key), 1, file) == 1
+		&& fwrite( &count, sizeof( count), 1, file) == 1;
+
+	for( int32 index = 0; written && index < CountEntries(); index++)
+	{
+		ArchiveIndexEntry *entry = EntryAt( index);
+		size_t nameLength = strlen( entry->name);
+		uint16 length = nameLength < B_PATH_NAME_LENGTH * 4 ? nameLength : B_PATH_NAME_LENGTH * 4 - 1;
+		written = fwrite( &length, sizeof( length), 1, file) == 1
+			&& fwrite( entry->name, 1, length, file) == length
+			&& fwrite( &entry->offset, sizeof( entry->offset), 1, file) == 1
+			&& fwrite( &entry->size, sizeof( entry->size), 1, file) == 1
+			&& fwrite( &entry->blockOffset, sizeof( entry->blockOffset), 1, file) == 1
+			&& fwrite( &entry->blockStart, sizeof( entry->blockStart), 1, file) == 1
+			&& fwrite( &entry->mode, sizeof( entry->mode), 1, file) == 1
+			&& fwrite( &entry->time, sizeof( entry->time), 1, file) == 1
+			&& fwrite( &entry->sparse, sizeof( entry->sparse), 1, file) == 1;
+	}
+
+	// cache which isn't whole (full disk) mustn't replace old one
+	if( !written)
+	{
+		status = errno != 0 ? errno : B_IO_ERROR;
+		fclose( file);
+		unlink( temp);
+	}
+	else if( fclose( file) != 0 || rename( temp, path.Path()) != 0)
+	{
+		status = errno;
+		unlink( temp);
+	}
+	return status;
+}
+
+//---------------------------------------------------
+//	"Archiver --list [--no-cache] archive..."
+//---------------------------------------------------
+int
+ArchiveIndex::ListMain( int argc, char **argv)
+{
+	bool useCache = true;
+	if( argc > 0 && !strcmp( argv[0], "--no-cache"))
+	{
+		useCache = false;
+		argc--;
+		argv++;
+	}
+
+	if( argc < 1)
+	{
+		fprintf( stderr, "usage: Archiver --list [--no-cache] archive...\n");
+		return 1;
+	}
+
+	int result = 0;
+	for( int32 arg = 0; arg < argc; arg++)
+	{
+		ArchiveIndex index;
+		bigtime_t start = system_time();
+		status_t status = index.SetTo( argv[arg], useCache);
+		bigtime_t time = system_time() - start;
+		if( status != B_OK)
+		{
+			fprintf( stderr, "Archiver: can't list %s (%s)\n", argv[arg], strerror( status));
+			result = 1;
+			continue;
+		}
+
+		for( int32 i = 0; i < index.CountEntries(); i++)
+		{
+			ArchiveIndexEntry *entry = index.EntryAt( i);
+			time_t mtime = entry->time;
+			struct tm tm;
+			localtime_r( &mtime, &tm);
+			char date[32];
+			strftime( date, sizeof( date), "%Y-%m-%d %H:%M", &tm);
+			printf( "%06o %12" B_PRIu64 " %s %s\n", (unsigned int)entry->mode, entry->size, date, entry->name);
+		}
+		fprintf( stderr, "%s: %" B_PRId32 " members, %s in %.3fs\n", argv[arg], index.CountEntries(),
+			index.IsFromCache() ? "from index cache" : "indexed", time / 1000000.0);
+	}
+	return result;
+}
+
+//---------------------------------------------------
+//	"Archiver --cat archive member..."
+//	write data of TAR members to stdout
+//---------------------------------------------------
+int
+ArchiveIndex::CatMain( int argc, char **argv)
+{
+	if( argc < 2)
+	{
+		fprintf( stderr, "usage: Archiver --cat archive member...\n");
+		return 1;
+	}
+
+	ArchiveIndex index;
+	status_t status = index.SetTo( argv[0]);
+	if( status != B_OK)
+	{
+		fprintf( stderr, "Archiver: can't list %s (%s)\n", argv[0], strerror( status));
+		return 1;
+	}
+
+	int result = 0;
+	for( int32 arg = 1; arg < argc; arg++)
+	{
+		int32 member = index.FindEntry( argv[arg]);
+		status = member >= 0 ? index.ReadMember( member, STDOUT_FILENO) : B_ENTRY_NOT_FOUND;
+		if( status != B_OK)
+		{
+			fprintf( stderr, "Archiver: can't read %s (%s)\n", argv[arg], strerror( status));
+			result = 1;
+		}
+	}
+	return result;
+}
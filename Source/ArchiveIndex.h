@@ -0,0 +1,124 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __ARCHIVE_INDEX_H_
+#define __ARCHIVE_INDEX_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <List.h>
+#include <Path.h>
+#include <SupportDefs.h>
+
+#include <sys/stat.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	ARCHIVE_INDEX_MAGIC			'AIDX'	// Archive InDeX
+#define	ARCHIVE_INDEX_VERSION		3
+#define	ARCHIVE_INDEX_CACHE_DIR		"Archiver"
+#define	ARCHIVE_INDEX_CACHE_EXT		".index"
+#define	ARCHIVE_INDEX_BUFFER_SIZE	(256 * 1024)
+#define	ARCHIVE_INDEX_MAX_SEGMENTS	(1024 * 1024)	// in map of sparse member
+
+#define	ARCHIVE_INDEX_NOT_SPARSE	0
+#define	ARCHIVE_INDEX_SPARSE_PAX	1		// GNU PAX 1.0 - map of segments is at start of data, holes are filled when it's read
+#define	ARCHIVE_INDEX_SPARSE_OTHER	2		// older GNU formats - member is listed, but not read
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	One member of archive
+//---------------------------------------------------
+struct ArchiveIndexEntry
+{
+	char		*name;
+	uint64		offset;			// of member's header - in ZIP file, or in uncompressed TAR stream
+	uint64		size;			// uncompressed (real size of sparse member)
+	uint64		blockOffset;	// compressed offset of gzip member (block) header is in
+	uint64		blockStart;		// uncompressed offset at which that block starts
+	uint32		mode;
+	int64		time;
+	uint8		sparse;
+};
+
+//---------------------------------------------------
+//	List of archive's members
+//	ZIP central directory is read directly, TAR (compressed or not) is walked once
+//	and index is kept in cache, until archive changes
+//	member of TAR is read from start of it's gzip block, so seekable gzip doesn't have to be inflated from beginning
+//---------------------------------------------------
+class ArchiveIndex
+{
+	public:
+							ArchiveIndex();
+							~ArchiveIndex();
+
+		status_t			SetTo( const char *path, bool useCache = true);
+		void				Unset();
+
+		int32				CountEntries() const { return aEntries.CountItems(); };
+		ArchiveIndexEntry	*EntryAt( int32 index) const { return (ArchiveIndexEntry*)aEntries.ItemAt( index); };
+		bool				IsFromCache() const { return aFromCache; };
+		int32				FindEntry( const char *name) const;
+		status_t			ReadMember( int32 index, int out_fd, int32 *cancel = NULL);
+
+		static status_t		GetCachePath( const struct stat *st, BPath *result, const char *extension = ARCHIVE_INDEX_CACHE_EXT);
+		static int			ListMain( int argc, char **argv);
+		static int			CatMain( int argc, char **argv);
+
+	private:
+		status_t			ReadZip( const char *path);
+		status_t			ReadTar( const char *path);
+		status_t			LoadCache();
+		status_t			SaveCache();
+		void				AddEntry( const char *name, uint64 offset, uint64 size, uint64 blockOffset, uint64 blockStart, uint32 mode, int64 time, uint8 sparse = ARCHIVE_INDEX_NOT_SPARSE);
+
+		BList				aEntries;
+		BPath				aPath;
+		struct stat			aStat;		// of archive, when index was made
+		bool				aFromCache;
+		bool				aZip;
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+const char	*archive_decompressor( const uint8 *magic, size_t size);
+
+#endif /*__ARCHIVE_INDEX_H_*/
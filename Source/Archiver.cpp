@@ -28,6 +28,19 @@ SOFTWARE
 //----------------------------------------------------------------------------
 
 #include "Archiver.h"
+#include "ArchiveIndex.h"
+#include "Checksum.h"
+#include "DeltaArchive.h"
+#include "EntryTable.h"
+#include "FileSharing.h"
+#include "JobTrace.h"
+#include "ParallelDeflate.h"
+#include "Preflight.h"
+#include "SeekableGzip.h"
+#include "StreamVerifier.h"
+#include "TarArchive.h"
+#include "Throttle.h"
+#include "ZipArchive.h"
 
 
 #include <stdio.h>
@@ -36,13 +49,21 @@ SOFTWARE
 #include <unistd.h>
 #include <image.h>
 #include <stdlib.h>
+#include <ctype.h>
 
 #include <signal.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <sys/stat.h>
 
 extern char	**environ;
 
 static char zipCmd[] = "/bin/zip";
 
+static int32 sRunningJobs = 0;	// number of Compress() threads running tools, they share CPUs
+static BMessage sArchiveNames;	// archives of jobs which don't exist yet (job is queued) - other jobs mustn't take them
+
 //----------------------------------------------------------------------------
 //
 //	Functions :: ArchiverView
@@ -155,139 +176,273 @@ AView::LoadIconForMime( char *mime)
 //----------------------------------------------------------------------------
 
 //---------------------------------------------------
-//	Constructor
+//	Constructor - job takes refs, they are deleted with it
 //---------------------------------------------------
-ACompressView::ACompressView( BMessage *refs, BMessage *settings)
-	:AView( settings),
-	aRefs( new BMessage( *refs)),
+ACompressView::ACompressView( BMessage *refs, AJobSettings *settings)
+	:BHandler( "ACompressView"),
+	aJobSettings( settings->Acquire()),
+	aSettings( &settings->aSettings),
+	aRefs( refs),
 	aRefsCount( 0),
-	aCompressThread( 0),
-	aCompressWatcherThread( 0)
+	aCompressThreadCount( 0),
+	aReadAheadStop( 0),
+	aSuspendCount( 0),
+	aRunning( 0),
+	aRemoved( false),
+	aAppend( false),
+	aExtract( false),
+	aCancel( 0),
+	aReplyFd( -1),
+	aMemoryNeeded( 0),
+	aMemoryReserved( 0),
+	aWaitingForMemory( false),
+	aList( NULL),
+	aTitle( NULL),
+	aStarted( false),
+	aReadAheadStarted( false),
+	aEnded( false),
+	aFinished( false)
 {
+	memset( &aShown, 0, sizeof( aShown));
+	aProgress.SetPhase( JOB_PHASE_QUEUED);
+
 	// count refs
 	type_code typecode;
 	aRefs->GetInfo("refs", &typecode, &aRefsCount);
 
-	// archive name
-	GenerateAName( &aPath);
+	// job submitted through ArchiverService, client waits for result
+	if( aRefs->FindInt32( ARCHIVER_REFS_REPLY_FD, &aReplyFd) != B_OK)
+		aReplyFd = -1;
+
+	// archive name - existing archive if files are added to it, new one otherwise
+	// or first of archives to extract
+	bool append = false;
+	bool extract = false;
+	aSettings->FindBool( ARCHIVER_SETTINGS_APPEND, &append);
+	aSettings->FindBool( ARCHIVER_SETTINGS_EXTRACT, &extract);
+	entry_ref first;
+	if( extract && FindExtractRules() && aRefs->FindRef( "refs", &first) == B_OK)
+	{
+		aExtract = true;
+		aPath.SetTo( &first);
+	}
+	else if( append && FindAppendTarget( &aPath))
+		aAppend = true;
+	else
+		GenerateAName( &aPath);
 	aRefs->AddString( ARCHIVER_REFS_ARCHIVE_NAME, aPath.Leaf());
 
-	// some temporary variables
-	BFont		font = be_plain_font;
-	float		fontsize = font.Size();
-	font_height	fontheight;
-	float		lineheight;
+	aTitle = aExtract ? "Extracting files" : "Compressing files";
 
-	BRect		rect;
+	// memory rule's tools take, if rule says it ("MEMORY=700" for each stage) - peak measured before is known to window
+	// Archiver adds and extracts files itself with few buffers, that doesn't count
+	if( !aAppend && !aExtract)
+	{
+		const char *description;
+		const char *variation;
+		if( aSettings->FindString( ARCHIVER_SETTINGS_FILE_DESC, &description) == B_OK)
+			aRule << description;
+		if( aSettings->FindString( ARCHIVER_SETTINGS_FILE_DESC2, &variation) == B_OK)
+			aRule << " - " << variation;
+
+		const char *option;
+		size_t length = strlen( ARCHIVER_SETTINGS_MEMORY_OPTION);
+		for( int32 index = 0; aSettings->FindString( ARCHIVER_SETTINGS_OPTION, index, &option) == B_OK; index++)
+		{
+			if( !strncmp( option, ARCHIVER_SETTINGS_MEMORY_OPTION, length))
+				aMemoryNeeded += atoll( option + length) * 1024 * 1024;
+		}
+	}
+}
 
-	// set basic width and height
-	aWidth		= aLeftMargin;
-	aHeight		= aTopMargin;
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+ACompressView::~ACompressView()
+{
+	// tasks were told to stop by Cancel(), their groups are used until they are done
+	aReadAheadTask.Wait();
+	aDriver.Wait();
 
-	// icon
-	const char *mime;
-	aSettings->FindString( ARCHIVER_SETTINGS_FILE_MIME, &mime);
-	if( LoadIconForMime( (char*)mime))
+	// if client still waits, job was stopped before it finished
+	ReplyToClient( B_CANCELED);
+
+	const char *name;
+	for( int32 index = 0; sArchiveNames.FindString( "path", index, &name) == B_OK; index++)
 	{
-		aWidth += B_LARGE_ICON / 2;
-		aLeftMargin += B_LARGE_ICON / 2;
-		aHeight += B_LARGE_ICON;
+		if( !strcmp( name, aPath.Path()))
+		{
+			sArchiveNames.RemoveData( "path", index);
+			break;
+		}
 	}
-	
-	// title
-	font.SetSize( fontsize + 2);
-	font.SetFace( B_BOLD_FACE);
-	font.GetHeight( &fontheight);
-	lineheight = ceil( fontheight.ascent + fontheight.descent + fontheight.leading);
-	
-	aTitle = new BStringView( BRect( aLeftMargin, aTopMargin, aLeftMargin, aTopMargin), "", "Compressing files");
-	aTitle->SetFont( &font, B_FONT_ALL);
-	aTitle->ResizeToPreferred();
-	rect = aTitle->Frame();
-	
-	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
-	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
-	
-	// text
-	char *text = new char[B_FILE_NAME_LENGTH+strlen( "Creating archive: ")];
-	sprintf( text, "Creating archive: %s", aPath.Leaf());	
-	
-	aText = new BStringView( BRect( aLeftMargin, aTopMargin + lineheight + fontheight.leading, aLeftMargin, aTopMargin), "", text);
-	delete text;
 
-	font.SetSize( fontsize);
-	font.SetFace( B_REGULAR_FACE);
-	font.GetHeight( &fontheight);
+	delete aRefs;
+	aJobSettings->Release();
+}
 
-	aText->SetFont( &font, B_FONT_ALL);
-	aText->ResizeToPreferred();
-	rect = aText->Frame();
-	
-	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
-	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
 
-	// "Stop" button
-	aButton = new BButton( BRect( aWidth, ceil( rect.bottom + fontheight.leading) + 8, aWidth, aHeight), "", "Stop", new BMessage( ARCHIVER_MSG_STOP), B_FOLLOW_RIGHT | B_FOLLOW_TOP);
-	aButton->SetFont( &font, B_FONT_ALL);
-	aButton->ResizeToPreferred();
-	rect = aButton->Frame();
+//---------------------------------------------------
+//	Tell job one of it's tasks has left it - messenger is made first, job may be deleted as soon as aRunning drops
+//---------------------------------------------------
+static void
+job_left( ACompressView *View)
+{
+	BMessenger messenger( View);
+	atomic_add( &View->aRunning, -1);
+	messenger.SendMessage( ARCHIVER_MSG_JOB_LEFT);
+}
 
-	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
-	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
-	
-	ResizeTo( aWidth+=2, aHeight+=2);
+//---------------------------------------------------
+//	Tasks of WorkerPool running Compress() and ReadAheadFiles() of job (Data is ACompressView)
+//---------------------------------------------------
+static int32
+compress_task( void *Data)
+{
+	int32 result = Compress( Data);
+	job_left( (ACompressView*)Data);
+	return result;
+}
 
-	AddChild( aTitle);
-	AddChild( aText);
-	AddChild( aButton);
+static int32
+read_ahead_task( void *Data)
+{
+	int32 result = ReadAheadFiles( Data);
+	job_left( (ACompressView*)Data);
+	return result;
 }
 
 //---------------------------------------------------
-//	Destructor
+//	Added to window's looper - start compression
 //---------------------------------------------------
-ACompressView::~ACompressView()
+void
+ACompressView::Start()
 {
-	delete aText;
-	delete aRefs;
-}
+	aStarted = true;
+	atomic_set( &aReadAheadStop, 1);
+	aProgress.SetPhase( JOB_PHASE_STARTING);
 
+	// Compress() spends it's time waiting for tools, so it doesn't take CPU worker from other jobs
+	atomic_add( &aRunning, 1);
+	WorkerPool::Default()->SubmitBlocking( &aDriver, compress_task, (void*)this, B_LOW_PRIORITY);
+}
 
 //---------------------------------------------------
-//	Attached to window - start compression
+//	Job is next in queue - read it's files into file cache while other jobs run,
+//	so disk doesn't wait for CPUs to finish last job, and job doesn't wait for disk when it starts
 //---------------------------------------------------
 void
-ACompressView::AttachedToWindow()
+ACompressView::ReadAhead()
 {
-	aCompressWatcherThread = spawn_thread( Compress, "CompressWatcher", B_LOW_PRIORITY, (void*)this);
-	resume_thread( aCompressWatcherThread);
+	if( aStarted || aReadAheadStarted || aRefs->HasBool( ARCHIVER_REFS_NO_READAHEAD))
+		return;
+	aReadAheadStarted = true;
+	atomic_add( &aRunning, 1);
+	WorkerPool::Default()->SubmitBlocking( &aReadAheadTask, read_ahead_task, (void*)this, B_LOW_PRIORITY);
+}
 
-	aButton->SetTarget( this);
+//---------------------------------------------------
+//	Removed from window - kill compression if it's still there
+//	returns true if job can be deleted, false if it's tasks didn't leave it yet (ARCHIVER_MSG_JOB_LEFT comes then)
+//	window's thread doesn't wait for them, Compress() may be sending message to job just now
+//---------------------------------------------------
+bool
+ACompressView::Cancel()
+{
+	atomic_set( &aReadAheadStop, 1);
+	if( atomic_get( &aRunning) == 0)
+		return true;
+
+	// Archiver adds (or extracts) files itself - tell it to stop, it will put archive back as it was
+	// tools are stopped by Compress() too, and it deletes not finished archive
+	aCancel = 1;
+	if( !aAppend && !aExtract && GetCompressThread())
+	{
+		// quit zip gently, so it will delete temp file
+		SignalTools( SIGTERM);
+	}
+	return false;
 }
 
 //---------------------------------------------------
-//	Detached from window - kill compression if it's still there
+//	Text shown under title - what is done with which archive (after aWarning, if there is one), or aStatus
 //---------------------------------------------------
 void
-ACompressView::DetachedFromWindow()
+ACompressView::GetText( BString *text) const
 {
-	thread_id threadID = GetCompressThread();
-	if( threadID)
+	if( aStatus.Length() > 0)
 	{
-		// kill watcher
-		kill_thread( aCompressWatcherThread);
+		text->SetTo( aStatus.String());
+		return;
+	}
 
-		// quit zip gently, so it will delete temp file
-		send_signal( (pid_t)threadID, SIGTERM);
+	if( aShown.phase == JOB_PHASE_QUEUED && aWaitingForMemory)
+	{
+		char memory[64];
+		sprintf( memory, "Waiting for memory (%" B_PRId64 " MB): ", aMemoryReserved / 1048576);
+		text->SetTo( memory);
+		*text << aPath.Leaf();
+		return;
+	}
 
-		// delete not finished file if it was left by compressing application
-		BEntry entry( aPath.Path());
-		if( entry.Exists())
-			entry.Remove();
+	if( aShown.phase == JOB_PHASE_QUEUED)
+	{
+		text->SetTo( "Waiting for other jobs: ");
+		*text << aPath.Leaf();
+		if( aShown.readAhead > 0)
+		{
+			char progress[64];
+			sprintf( progress, " (%.1f MB read ahead)", aShown.readAhead / 1048576.0);
+			*text << progress;
+		}
+		return;
+	}
+
+	if( aShown.phase == JOB_PHASE_CHECKING)
+		text->SetTo( "Checking free space: ");
+	else if( aShown.phase == JOB_PHASE_VERIFYING)
+		text->SetTo( "Verifying archive: ");
+	else if( aShown.phase == JOB_PHASE_COMMITTING)
+		text->SetTo( "Finishing archive: ");
+	else
+		text->SetTo( aExtract ? "Extracting archive: " : aAppend ? "Adding to archive: " : "Creating archive: ");
+	*text << aPath.Leaf();
+
+	// tools don't tell what they read, only Archiver itself does
+	char progress[96];
+	if( aShown.bytesIn > 0)
+	{
+		sprintf( progress, " (%.1f MB read, %.1f MB written, %" B_PRId32 " files)",
+			aShown.bytesIn / 1048576.0, aShown.bytesOut / 1048576.0, aShown.files);
+		*text << progress;
 	}
+	else if( aShown.bytesOut > 0)
+	{
+		sprintf( progress, " (%.1f MB written)", aShown.bytesOut / 1048576.0);
+		*text << progress;
+	}
+
+	// archive may not fit on it's volume - it's said first, so user sees it while job still can be stopped
+	if( aWarning.Length() > 0)
+		text->Prepend( aWarning.String());
+}
+
+//---------------------------------------------------
+//	Take current values of aProgress, true if they changed since last time
+//---------------------------------------------------
+bool
+ACompressView::SampleProgress()
+{
+	job_progress progress;
+	aProgress.Sample( &progress);
+	if( !memcmp( &progress, &aShown, sizeof( progress)))
+		return false;
+	aShown = progress;
+	return true;
 }
 
 //---------------------------------------------------
-//	Generate ArchiveName - if name exist add counter to it
+//	Messages from Compress() and from job list
 //---------------------------------------------------
 void
 ACompressView::MessageReceived( BMessage *msg)
@@ -299,37 +454,100 @@ ACompressView::MessageReceived( BMessage *msg)
 			if( Stop())
 			{
 				BMessage rmsg(ARCHIVER_MSG_REMOVE_AVIEW);
-				rmsg.AddPointer( "view", (const void*)(AView*)this);
-				Window()->PostMessage( &rmsg);
+				rmsg.AddPointer( "job", (const void*)this);
+				Looper()->PostMessage( &rmsg);
 			}
 			break;
 		}
 		case ARCHIVER_MSG_COMPRESS_END:
 		{
+			// peak memory of tools is remembered for next jobs of the same rule
+			int64 memory;
+			if( msg->FindInt64( "memory", &memory) == B_OK && aRule.Length() > 0)
+			{
+				BMessage mmsg( ARCHIVER_MSG_RULE_MEMORY);
+				mmsg.AddString( "rule", aRule.String());
+				mmsg.AddInt64( "memory", memory);
+				Looper()->PostMessage( &mmsg);
+			}
+
+			// next queued job can start
+			aEnded = true;
+			Looper()->PostMessage( ARCHIVER_MSG_START_JOBS);
+
 			bool close;
+			bool damaged = false;
+			bool refused = false;
 			aSettings->FindBool( ARCHIVER_SETTINGS_CLOSE_WIN, &close);
-			if( close)
+			msg->FindBool( "damaged", &damaged);
+			msg->FindBool( "refused", &refused);
+			if( close && !damaged && !refused)
 			{
 				BMessage rmsg(ARCHIVER_MSG_REMOVE_AVIEW);
-				rmsg.AddPointer( "view", (const void*)(AView*)this);
-				Window()->PostMessage( &rmsg);
+				rmsg.AddPointer( "job", (const void*)this);
+				Looper()->PostMessage( &rmsg);
 			}
 			else
 			{
-				aTitle->SetText("Compression finished");
-				aTitle->ResizeToPreferred();
-				aButton->SetLabel("OK");
+				aTitle = damaged ? "Archive is damaged!" : refused ? "Not enough free space!" : aExtract ? "Extraction finished" : "Compression finished";
+				aFinished = true;
+
+				// pipeline tells how long each of it's stages took
+				const char *report;
+				if( msg->FindString( "report", &report) == B_OK)
+					aStatus.SetTo( report);
+				else
+					aStatus.SetTo( NULL);
+				if( aList != NULL)
+					aList->JobChanged( this);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_JOB_LEFT:
+		{
+			// job removed while it's tasks ran can be deleted now
+			if( aRemoved && atomic_get( &aRunning) == 0)
+			{
+				BMessage rmsg(ARCHIVER_MSG_REMOVE_AVIEW);
+				rmsg.AddPointer( "job", (const void*)this);
+				Looper()->PostMessage( &rmsg);
 			}
 			break;
 		}
 		case ARCHIVER_MSG_COMPRESS_THREAD_ID:
 		{
-			msg->FindInt32( "thread_id", &aCompressThread);
+			// one thread for each stage of pipeline
+			aCompressThreadCount = 0;
+			while( aCompressThreadCount < ARCHIVER_MAX_STAGES
+				&& msg->FindInt32( "thread_id", aCompressThreadCount, &aCompressThreads[aCompressThreadCount]) == B_OK)
+				aCompressThreadCount++;
+			break;
+		}
+		case ARCHIVER_MSG_PREFLIGHT:
+		{
+			// archive may not fit on it's volume - job goes on, user may stop it
+			const char *warning;
+			if( msg->FindString( "warning", &warning) == B_OK)
+				aWarning.SetTo( warning) << "! ";
+			if( aList != NULL)
+				aList->JobChanged( this);
+			break;
+		}
+		case ARCHIVER_MSG_THROTTLE:
+		{
+			// job is paused by Throttle until system is idle again, or it's resumed
+			const char *reason;
+			if( msg->FindString( "reason", &reason) == B_OK)
+				aStatus.SetTo( "Paused, ") << reason << ": " << aPath.Leaf();
+			else
+				aStatus.SetTo( NULL);
+			if( aList != NULL)
+				aList->JobChanged( this);
 			break;
 		}
 		default:
 		{
-			_inherited::MessageReceived( msg);
+			BHandler::MessageReceived( msg);
 			break;
 		}
 	}
@@ -373,7 +591,13 @@ ACompressView::GenerateAName( BPath *result)
 	BEntry entry;
 	while( B_OK == entry.SetTo( (const char*)path))
 	{
-		if( entry.Exists())
+		// queued job's archive isn't there yet, but it's taken as well
+		bool taken = false;
+		const char *reserved;
+		for( int32 index = 0; !taken && sArchiveNames.FindString( "path", index, &reserved) == B_OK; index++)
+			taken = !strcmp( reserved, path);
+
+		if( entry.Exists() || taken)
 		{
 			sprintf( path, "%s/%s %ld%s", result->Path(), name, ++i, extension);
 		}
@@ -383,25 +607,217 @@ ACompressView::GenerateAName( BPath *result)
 
 	// here it goes!
 	result->SetTo( path);
+	sArchiveNames.AddString( "path", path);
+
+	// for double extension (".tar.delta") full archive, which delta is made against, is the one without counter and last extension
+	const char *last = strrchr( extension, '.');
+	if( last != NULL && last != extension)
+	{
+		BString base;
+		base << result->Path();
+		base.Truncate( base.Length() - strlen( result->Leaf()));
+		base << name;
+		base.Append( extension, last - extension);
+		aRefs->AddString( ARCHIVER_REFS_BASE, base.String());
+	}
+}
+
+//---------------------------------------------------
+//	Check if all refs are archives known from rules (by extension or mime type)
+//	if so, add extension and tool of matching rule for each of them to aRefs
+//---------------------------------------------------
+bool
+ACompressView::FindExtractRules()
+{
+	BMessage *rules = ASettingsView::LoadRules();
+	BMessage found;
+	entry_ref ref;
+	int32 index;
+	for( index = 0; aRefs->FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		BEntry entry( &ref);
+		if( !entry.IsFile())
+			break;
+
+		char mime[B_MIME_TYPE_LENGTH];
+		BNode node( &ref);
+		BNodeInfo nodeinfo( &node);
+		if( nodeinfo.GetType( mime) != B_OK)
+			mime[0] = 0;
+
+		// longest matching extension wins (".tar.gz" before ".gz"), mime type only if extension doesn't match
+		const char *name;
+		const char *extension = NULL;
+		const char *tool = NULL;
+		size_t namelen = strlen( ref.name);
+		bool byExtension = false;
+		for( int32 rule = 0; rules->FindString( "rules", rule, &name) == B_OK; rule++)
+		{
+			const char *rmime;
+			const char *rext;
+			const char *rtool;
+			if( rules->FindString( name, 2, &rmime) != B_OK || rules->FindString( name, 3, &rext) != B_OK
+				|| rules->FindString( name, 4, &rtool) != B_OK)
+				continue;
+
+			size_t extlen = strlen( rext);
+			if( extlen > 0 && namelen > extlen && !strcasecmp( ref.name + namelen - extlen, rext))
+			{
+				if( !byExtension || extlen > strlen( extension))
+				{
+					extension = rext;
+					tool = rtool;
+					byExtension = true;
+				}
+			}
+			else if( !byExtension && extension == NULL && mime[0] && !strcasecmp( mime, rmime))
+			{
+				extension = rext;
+				tool = rtool;
+			}
+		}
+		if( extension == NULL)
+			break;
+
+		found.AddString( ARCHIVER_REFS_EXTRACT_EXT, extension);
+		found.AddString( ARCHIVER_REFS_EXTRACT_TOOL, tool);
+	}
+	delete rules;
+
+	if( index == 0 || index < aRefsCount)
+		return false;
+
+	const char *value;
+	for( index = 0; found.FindString( ARCHIVER_REFS_EXTRACT_EXT, index, &value) == B_OK; index++)
+	{
+		aRefs->AddString( ARCHIVER_REFS_EXTRACT_EXT, value);
+		found.FindString( ARCHIVER_REFS_EXTRACT_TOOL, index, &value);
+		aRefs->AddString( ARCHIVER_REFS_EXTRACT_TOOL, value);
+	}
+	return true;
+}
+
+//---------------------------------------------------
+//	Find archive of type chosen in settings among refs, so rest of files can be added to it
+//	it's removed from aRefs, set result to it's path
+//---------------------------------------------------
+bool
+ACompressView::FindAppendTarget( BPath *result)
+{
+	// Archiver can add files only to uncompressed TAR and to ZIP
+	const char *extension;
+	if( aSettings->FindString( ARCHIVER_SETTINGS_FILE_EXT, &extension) != B_OK
+		|| ( strcasecmp( extension, ".zip") && strcasecmp( extension, ".tar")))
+		return false;
+
+	// there must be something to add
+	if( aRefsCount < 2)
+		return false;
+
+	entry_ref ref;
+	int32 found = -1;
+	size_t extlen = strlen( extension);
+	for( int32 index = 0; found < 0 && aRefs->FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		size_t namelen = strlen( ref.name);
+		BEntry entry( &ref);
+		if( namelen > extlen && !strcasecmp( ref.name + namelen - extlen, extension) && entry.IsFile())
+			found = index;
+	}
+	if( found < 0)
+		return false;
+
+	// put all refs but archive back
+	BMessage refs;
+	for( int32 index = 0; aRefs->FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		if( index == found)
+		{
+			BEntry entry( &ref);
+			entry.GetPath( result);
+			aRefs->AddRef( ARCHIVER_REFS_APPEND_TO, &ref);
+		}
+		else
+			refs.AddRef( "refs", &ref);
+	}
+	aRefs->RemoveName( "refs");
+	for( int32 index = 0; refs.FindRef( "refs", index, &ref) == B_OK; index++)
+		aRefs->AddRef( "refs", &ref);
+	aRefsCount--;
+
+	return true;
 }
 
 //---------------------------------------------------
-//	Returns aCompressThread if it's valid, NULL if not
+//	Returns first of aCompressThreads which is still valid, NULL if none
 //---------------------------------------------------
 thread_id
 ACompressView::GetCompressThread()
 {
 	thread_info threadinfo;
-	if( get_thread_info( aCompressThread, &threadinfo) == B_OK)
+	for( int32 index = 0; index < aCompressThreadCount; index++)
 	{
-		// aCompressThread is still running - return it's id
-		return aCompressThread;
+		if( get_thread_info( aCompressThreads[index], &threadinfo) == B_OK)
+		{
+			// compression tool is still running - return it's id
+			return aCompressThreads[index];
+		}
 	}
 	
 	// there was no aCompressThread running
 	return 0;
 }
 
+//---------------------------------------------------
+//	Suspend all tools of pipeline, returns false if none was running
+//	calls nest - tools stay suspended until each of them is matched by ResumeTools()
+//---------------------------------------------------
+bool
+ACompressView::SuspendTools()
+{
+	if( atomic_add( &aSuspendCount, 1) > 0)
+		return GetCompressThread() != 0;
+
+	bool suspended = false;
+	for( int32 index = 0; index < aCompressThreadCount; index++)
+	{
+		if( suspend_thread( aCompressThreads[index]) != B_BAD_THREAD_ID)
+			suspended = true;
+	}
+	return suspended;
+}
+
+//---------------------------------------------------
+//	Resume all tools of pipeline, returns false if none was running
+//	force resumes them even if they were suspended more times (i.e. to let them get SIGTERM)
+//---------------------------------------------------
+bool
+ACompressView::ResumeTools( bool force)
+{
+	if( force)
+		atomic_get_and_set( &aSuspendCount, 0);
+	else if( atomic_add( &aSuspendCount, -1) > 1)
+		return GetCompressThread() != 0;
+
+	bool resumed = false;
+	for( int32 index = 0; index < aCompressThreadCount; index++)
+	{
+		if( resume_thread( aCompressThreads[index]) != B_BAD_THREAD_ID)
+			resumed = true;
+	}
+	return resumed;
+}
+
+//---------------------------------------------------
+//	Send signal to all tools of pipeline
+//---------------------------------------------------
+void
+ACompressView::SignalTools( uint32 signal)
+{
+	for( int32 index = 0; index < aCompressThreadCount; index++)
+		send_signal( (pid_t)aCompressThreads[index], signal);
+}
+
 //---------------------------------------------------
 //	If compression is still running ask to really quit it
 //---------------------------------------------------
@@ -409,21 +825,35 @@ ACompressView::GetCompressThread()
 bool
 ACompressView::Stop()
 {
+	// files are added (or extracted) by Compress() and it's tasks in threads of WorkerPool, which are shared by all jobs
+	// so they aren't suspended - they wait between chunks while job is paused, and stop when it's canceled
+	if( ( aAppend || aExtract) && aDriver.Pending() > 0)
+	{
+		aProgress.SetPaused( true);
+		bool stop = ((new BAlert( "", aExtract ? "Are You sure You want to stop extracting this archive?" : "Are You sure You want to stop adding files to this archve?", "Stop", "Keep going", NULL, B_WIDTH_AS_USUAL, B_STOP_ALERT))->Go()) == 0;
+		if( stop)
+			aCancel = 1;
+		aProgress.SetPaused( false);
+
+		// archive is put back as it was before job is deleted (when Compress() leaves it)
+		return stop;
+	}
+
 	// if CompressThread is still there, ask user if Quit it, or keeep going
 	thread_id threadid = GetCompressThread();
 	if( threadid)
 	{
 		// suspend CompressThread while asking question
 		// if it can't be suspended (thread quit probably) give permission to Quit()
-		if( suspend_thread( threadid) == B_BAD_THREAD_ID)
+		if( !SuspendTools())
 			return true;
 
 		// ask question
 		if( ((new BAlert( "", "Are You sure You want to stop creating this archve?", "Stop", "Keep going", NULL, B_WIDTH_AS_USUAL, B_STOP_ALERT))->Go()) == 0)
 		{
 			// quit zip gently, so it will delete temp file
-			send_signal( (pid_t)threadid, SIGTERM);
-			resume_thread( threadid);
+			SignalTools( SIGTERM);
+			ResumeTools( true);
 
 			// delete not finished file if it was left by compressing application
 			BEntry entry( aPath.Path());
@@ -436,7 +866,7 @@ ACompressView::Stop()
 		{
 			// user doesn't want to quit, resume Compress
 			// if it can't be resumed (thread doesn't exist anymore probably) give permission to Quit()
-			if( resume_thread( threadid) == B_BAD_THREAD_ID)
+			if( !ResumeTools())
 				return true;
 			else
 				return false;
@@ -445,48 +875,570 @@ ACompressView::Stop()
 	return true;
 }
 
+//---------------------------------------------------
+//	Let client which submitted job know about result (only once)
+//---------------------------------------------------
+void
+ACompressView::ReplyToClient( status_t result)
+{
+	// only archive created by this job is reported, not one it added files to or extracted
+	int32 fd = atomic_get_and_set( &aReplyFd, -1);
+	if( fd >= 0)
+		ArchiverService::Reply( fd, result, aAppend || aExtract ? NULL : aPath.Path());
+}
+
 
 //----------------------------------------------------------------------------
 //
-//	Functions :: SettingsView
+//	Functions :: JobListView
 //
 //----------------------------------------------------------------------------
 
 //---------------------------------------------------
-//	Constructor
+//	Constructor - scroll bar has no target, it tells list which row is first
 //---------------------------------------------------
-ASettingsView::ASettingsView( BMessage *settings)
-	:AView( settings),
-	aRules( LoadRules())
+AJobScrollBar::AJobScrollBar( AJobListView *list)
+	:BScrollBar( BRect( 0, 0, B_V_SCROLL_BAR_WIDTH, B_H_SCROLL_BAR_HEIGHT), "", NULL, 0, 0, B_VERTICAL),
+	aList( list)
 {
-	// some temporary variables
-	BFont		font = be_plain_font;
-	float		fontsize = font.Size();
-	font_height	fontheight;
-	float		lineheight;
+}
 
-	BRect		rect;
+//---------------------------------------------------
+//	Scroll bar moved - scroll list by whole rows
+//---------------------------------------------------
+void
+AJobScrollBar::ValueChanged( float value)
+{
+	BScrollBar::ValueChanged( value);
+	aList->ScrollToRow( (int32)( value + 0.5));
+}
 
-	// set basic width and height
-	aWidth		= (aLeftMargin += B_LARGE_ICON / 2);
-	aHeight		= aTopMargin;
-	
-	// title
-	font.SetSize( fontsize + 5);
-	font.SetFace( B_BOLD_FACE);
-	font.GetHeight( &fontheight);
-	lineheight = ceil( fontheight.ascent + fontheight.descent + fontheight.leading);
-	
-	aTitle = new BStringView( BRect( aLeftMargin, aTopMargin, aLeftMargin, aTopMargin), "", "Archiver Settings");
-	aTitle->SetFont( &font, B_FONT_ALL);
-	aTitle->ResizeToPreferred();
-	rect = aTitle->Frame();
-	
-	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
-	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+//---------------------------------------------------
+//	Constructor - all rows have the same height, so row of any job is known without layout
+//---------------------------------------------------
+AJobListView::AJobListView()
+	:AView(),
+	aScrollBar( NULL),
+	aProgressRunner( NULL),
+	aScrolling( false),
+	aFirstRow( 0),
+	aRowHeight( 0),
+	aButtonWidth( 0),
+	aButtonHeight( 0),
+	aTextWidth( 0),
+	aPressed( NULL),
+	aPressedInside( false)
+{
+	aLeftMargin += B_LARGE_ICON / 2;
+	SetFlags( Flags() | B_FRAME_EVENTS);
 
-	// rules selection - build BBox, and add BRadioButtons to it (one for each Rule)
-	font.SetSize( fontsize);
+	// title and text lines, next to icon
+	BFont		font = be_plain_font;
+	font_height	titleheight;
+	font_height	textheight;
+	font.GetHeight( &textheight);
+	font.SetSize( font.Size() + 2);
+	font.SetFace( B_BOLD_FACE);
+	font.GetHeight( &titleheight);
+
+	float lines = ceil( titleheight.ascent + titleheight.descent + titleheight.leading)
+		+ ceil( textheight.ascent + textheight.descent + textheight.leading);
+	aRowHeight = aTopMargin * 2 + ( lines > B_LARGE_ICON ? lines : B_LARGE_ICON);
+
+	// "Stop" / "OK" button, on the right of each row
+	aButtonWidth = ceil( be_plain_font->StringWidth( "Stop")) + 24;
+	if( aButtonWidth < 60) aButtonWidth = 60;
+	aButtonHeight = ceil( textheight.ascent + textheight.descent) + 10;
+
+	aScrollBar = new AJobScrollBar( this);
+	aScrollBar->Hide();
+	AddChild( aScrollBar);
+
+	UpdateSize();
+}
+
+//---------------------------------------------------
+//	Destructor - jobs belong to window, icons to list
+//---------------------------------------------------
+AJobListView::~AJobListView()
+{
+	char		*name;
+	type_code	type;
+	for( int32 index = 0; aIcons.GetInfo( B_POINTER_TYPE, index, &name, &type) == B_OK; index++)
+	{
+		BBitmap *icon;
+		if( aIcons.FindPointer( name, (void**)&icon) == B_OK)
+			delete icon;
+	}
+
+	delete aScrollBar;
+}
+
+//---------------------------------------------------
+//	Attached to window - sample progress of jobs while list is shown
+//---------------------------------------------------
+void
+AJobListView::AttachedToWindow()
+{
+	BMessage msg( ARCHIVER_MSG_PROGRESS);
+	aProgressRunner = new BMessageRunner( BMessenger( this), &msg, ARCHIVER_PROGRESS_INTERVAL);
+}
+
+//---------------------------------------------------
+//	Detached from window - there is no job left
+//---------------------------------------------------
+void
+AJobListView::DetachedFromWindow()
+{
+	delete aProgressRunner;
+	aProgressRunner = NULL;
+}
+
+//---------------------------------------------------
+//	Draw only rows which are visible and need it
+//---------------------------------------------------
+void
+AJobListView::Draw( BRect updateRect)
+{
+	// left margin background
+	_inherited::Draw( updateRect);
+
+	int32 count = CountJobs();
+	int32 first = aFirstRow + (int32)( updateRect.top / aRowHeight);
+	int32 last = aFirstRow + (int32)( updateRect.bottom / aRowHeight);
+	if( last >= count)
+		last = count - 1;
+
+	BFont		titlefont = be_plain_font;
+	BFont		textfont = be_plain_font;
+	font_height	titleheight;
+	font_height	textheight;
+	titlefont.SetSize( titlefont.Size() + 2);
+	titlefont.SetFace( B_BOLD_FACE);
+	titlefont.GetHeight( &titleheight);
+	textfont.GetHeight( &textheight);
+	float titleline = ceil( titleheight.ascent + titleheight.descent + titleheight.leading);
+
+	BString line;
+	for( int32 index = first; index <= last; index++)
+	{
+		ACompressView *job = JobAt( index);
+		BRect row = RowFrame( index);
+		BRect button = ButtonFrame( index);
+		float textwidth = button.left - 8 - aLeftMargin;
+
+		// line between jobs
+		if( index > aFirstRow)
+		{
+			SetHighColor( tint_color( ViewColor(), B_DARKEN_2_TINT));
+			StrokeLine( BPoint( B_LARGE_ICON + 1, row.top), BPoint( row.right, row.top));
+		}
+
+		const BBitmap *icon = IconFor( job);
+		if( icon != NULL)
+			DrawBitmap( icon, BPoint( B_LARGE_ICON / 2, row.top + aTopMargin));
+
+		SetHighColor( ui_color( B_PANEL_TEXT_COLOR));
+		line.SetTo( job->Title());
+		titlefont.TruncateString( &line, B_TRUNCATE_END, textwidth);
+		SetFont( &titlefont);
+		DrawString( line.String(), BPoint( aLeftMargin, row.top + aTopMargin + titleheight.ascent));
+
+		job->GetText( &line);
+		textfont.TruncateString( &line, B_TRUNCATE_MIDDLE, textwidth);
+		SetFont( &textfont);
+		DrawString( line.String(), BPoint( aLeftMargin, row.top + aTopMargin + titleline + textheight.ascent));
+
+		rgb_color base = ViewColor();
+		uint32 flags = ( job == aPressed && aPressedInside) ? BControlLook::B_ACTIVATED : 0;
+		be_control_look->DrawButtonFrame( this, button, updateRect, base, base, flags);
+		be_control_look->DrawButtonBackground( this, button, updateRect, base, flags);
+		be_control_look->DrawLabel( this, job->IsFinished() ? "OK" : "Stop", button, updateRect, base, flags,
+			BAlignment( B_ALIGN_CENTER, B_ALIGN_MIDDLE));
+		SetDrawingMode( B_OP_OVER);
+	}
+}
+
+//---------------------------------------------------
+//	Resized by window - keep scroll bar at right edge
+//---------------------------------------------------
+void
+AJobListView::FrameResized( float width, float height)
+{
+	aScrollBar->MoveTo( width - B_V_SCROLL_BAR_WIDTH, 0);
+	aScrollBar->ResizeTo( B_V_SCROLL_BAR_WIDTH, height);
+}
+
+//---------------------------------------------------
+//	Press button of job
+//---------------------------------------------------
+void
+AJobListView::MouseDown( BPoint point)
+{
+	int32 index = RowAt( point);
+	if( index < 0 || !ButtonFrame( index).Contains( point))
+		return;
+
+	aPressed = JobAt( index);
+	aPressedInside = true;
+	SetMouseEventMask( B_POINTER_EVENTS, B_LOCK_WINDOW_FOCUS);
+	Invalidate( ButtonFrame( index));
+}
+
+//---------------------------------------------------
+//	Button is drawn pressed only while mouse is over it
+//---------------------------------------------------
+void
+AJobListView::MouseMoved( BPoint point, uint32 code, const BMessage *dragMessage)
+{
+	int32 index = aJobs.IndexOf( aPressed);
+	if( index < 0)
+		return;
+
+	bool inside = ButtonFrame( index).Contains( point);
+	if( inside != aPressedInside)
+	{
+		aPressedInside = inside;
+		Invalidate( ButtonFrame( index));
+	}
+}
+
+//---------------------------------------------------
+//	Release button - job is asked to stop (or to go away, if it's finished)
+//---------------------------------------------------
+void
+AJobListView::MouseUp( BPoint point)
+{
+	int32 index = aJobs.IndexOf( aPressed);
+	if( index >= 0)
+	{
+		if( ButtonFrame( index).Contains( point))
+			Looper()->PostMessage( ARCHIVER_MSG_STOP, aPressed);
+		Invalidate( ButtonFrame( index));
+	}
+	aPressed = NULL;
+	aPressedInside = false;
+}
+
+//---------------------------------------------------
+//	Mouse wheel scrolls rows
+//---------------------------------------------------
+void
+AJobListView::MessageReceived( BMessage *msg)
+{
+	switch( msg->what)
+	{
+		case ARCHIVER_MSG_PROGRESS:
+		{
+			// only visible rows - the rest is sampled when it's scrolled to
+			int32 last = aFirstRow + ARCHIVER_JOB_LIST_ROWS;
+			if( last > CountJobs())
+				last = CountJobs();
+			for( int32 index = aFirstRow; index < last; index++)
+			{
+				ACompressView *job = JobAt( index);
+				if( !job->IsFinished() && job->SampleProgress())
+				{
+					BRect row = RowFrame( index);
+					Invalidate( BRect( aLeftMargin, row.top, ButtonFrame( index).left - 1, row.bottom));
+				}
+			}
+			break;
+		}
+		case B_MOUSE_WHEEL_CHANGED:
+		{
+			float delta;
+			if( aScrolling && msg->FindFloat( "be:wheel_delta_y", &delta) == B_OK)
+				aScrollBar->SetValue( aFirstRow + ( delta > 0 ? 1 : -1));
+			break;
+		}
+		default:
+		{
+			_inherited::MessageReceived( msg);
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------
+//	Add job to the end of list - layout is done later by window, once for all added jobs
+//---------------------------------------------------
+void
+AJobListView::AddJob( ACompressView *job)
+{
+	aJobs.AddItem( job);
+	job->aList = this;
+
+	float width = TextWidth( job);
+	if( aTextWidth < width)
+		aTextWidth = width;
+
+	int32 index = CountJobs() - 1;
+	if( index >= aFirstRow && index < aFirstRow + ARCHIVER_JOB_LIST_ROWS)
+		Invalidate( RowFrame( index));
+}
+
+//---------------------------------------------------
+//	Remove job from list, false if it wasn't there
+//---------------------------------------------------
+bool
+AJobListView::RemoveJob( ACompressView *job)
+{
+	int32 index = aJobs.IndexOf( job);
+	if( index < 0)
+		return false;
+
+	aJobs.RemoveItem( index);
+	job->aList = NULL;
+	if( aPressed == job)
+		aPressed = NULL;
+
+	// rows below move up
+	if( CountJobs() == 0)
+		aTextWidth = 0;
+	BRect bounds = Bounds();
+	if( index < aFirstRow)
+		index = aFirstRow;
+	Invalidate( BRect( bounds.left, RowFrame( index).top, bounds.right, bounds.bottom));
+	return true;
+}
+
+//---------------------------------------------------
+//	Job's title or text changed - redraw it's row, if it's visible
+//	window is made wider only if text doesn't fit
+//---------------------------------------------------
+void
+AJobListView::JobChanged( ACompressView *job)
+{
+	float width = TextWidth( job);
+	if( aTextWidth < width && aTextWidth < ARCHIVER_JOB_TEXT_MAX_WIDTH)
+	{
+		aTextWidth = width;
+		if( Window() != NULL)
+			((ArchiverWindow*)Window())->ScheduleReorganize();
+	}
+
+	int32 index = aJobs.IndexOf( job);
+	if( index >= aFirstRow && index < aFirstRow + ARCHIVER_JOB_LIST_ROWS)
+		Invalidate( RowFrame( index));
+}
+
+//---------------------------------------------------
+//	Set preferred size and scroll bar for current count of jobs
+//---------------------------------------------------
+void
+AJobListView::UpdateSize()
+{
+	int32 count = CountJobs();
+	int32 rows = count < ARCHIVER_JOB_LIST_ROWS ? count : ARCHIVER_JOB_LIST_ROWS;
+
+	bool scrolling = count > rows;
+	if( scrolling != aScrolling)
+	{
+		if( scrolling)
+			aScrollBar->Show();
+		else
+			aScrollBar->Hide();
+		aScrolling = scrolling;
+	}
+
+	float textwidth = aTextWidth < ARCHIVER_JOB_TEXT_WIDTH ? ARCHIVER_JOB_TEXT_WIDTH
+		: aTextWidth > ARCHIVER_JOB_TEXT_MAX_WIDTH ? ARCHIVER_JOB_TEXT_MAX_WIDTH : ceil( aTextWidth);
+	aWidth = (int32)( aLeftMargin + textwidth + 8 + aButtonWidth + 8 + ( aScrolling ? B_V_SCROLL_BAR_WIDTH : 0));
+	aHeight = (int32)( rows * aRowHeight);
+
+	// first row stays, unless jobs below it are gone
+	if( aFirstRow > count - rows)
+		aFirstRow = count - rows;
+	aScrollBar->SetRange( 0, count - rows);
+	aScrollBar->SetSteps( 1, rows > 1 ? rows - 1 : 1);
+	aScrollBar->SetProportion( count > 0 ? (float)rows / count : 1);
+	aScrollBar->SetValue( aFirstRow);
+
+	Invalidate();
+}
+
+//---------------------------------------------------
+//	Make given row first visible one
+//---------------------------------------------------
+void
+AJobListView::ScrollToRow( int32 row)
+{
+	int32 count = CountJobs();
+	int32 rows = count < ARCHIVER_JOB_LIST_ROWS ? count : ARCHIVER_JOB_LIST_ROWS;
+	if( row > count - rows)
+		row = count - rows;
+	if( row < 0)
+		row = 0;
+	if( row == aFirstRow)
+		return;
+
+	aFirstRow = row;
+	Invalidate();
+}
+
+//---------------------------------------------------
+//	Where row of job with given index is (it may be outside of view)
+//---------------------------------------------------
+BRect
+AJobListView::RowFrame( int32 index) const
+{
+	BRect bounds = Bounds();
+	float top = ( index - aFirstRow) * aRowHeight;
+	return BRect( bounds.left, top, bounds.right - ( aScrolling ? B_V_SCROLL_BAR_WIDTH + 1 : 0), top + aRowHeight - 1);
+}
+
+//---------------------------------------------------
+//	Where button of job with given index is
+//---------------------------------------------------
+BRect
+AJobListView::ButtonFrame( int32 index) const
+{
+	BRect row = RowFrame( index);
+	float top = row.top + floor( ( aRowHeight - aButtonHeight) / 2);
+	return BRect( row.right - 8 - aButtonWidth, top, row.right - 8, top + aButtonHeight);
+}
+
+//---------------------------------------------------
+//	Index of job which row is at point, -1 if there is none
+//---------------------------------------------------
+int32
+AJobListView::RowAt( BPoint point) const
+{
+	if( point.y < 0 || ( aScrolling && point.x > Bounds().right - B_V_SCROLL_BAR_WIDTH))
+		return -1;
+
+	int32 index = aFirstRow + (int32)( point.y / aRowHeight);
+	return index < CountJobs() ? index : -1;
+}
+
+//---------------------------------------------------
+//	Icon of job's archive type - loaded once for each mime type, not for each job
+//---------------------------------------------------
+const BBitmap *
+AJobListView::IconFor( ACompressView *job)
+{
+	const char *mime;
+	if( job->aSettings->FindString( ARCHIVER_SETTINGS_FILE_MIME, &mime) != B_OK)
+		return NULL;
+
+	BBitmap *icon;
+	if( aIcons.FindPointer( mime, (void**)&icon) == B_OK)
+		return icon;
+
+	icon = new BBitmap( BRect( 0, 0, B_LARGE_ICON-1, B_LARGE_ICON-1), B_CMAP8);
+	BMimeType mimeType( mime);
+	if( mimeType.InitCheck() != B_OK || mimeType.GetIcon( icon, B_LARGE_ICON) != B_OK)
+	{
+		delete icon;
+		icon = NULL;
+	}
+	aIcons.AddPointer( mime, icon);
+	return icon;
+}
+
+//---------------------------------------------------
+//	Width job's text needs
+//---------------------------------------------------
+float
+AJobListView::TextWidth( ACompressView *job)
+{
+	BString text;
+	job->GetText( &text);
+	return be_plain_font->StringWidth( text.String());
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: SettingsView
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Menu of limit values (0 is "Off"), each item changes given setting
+//---------------------------------------------------
+static BPopUpMenu *
+limit_menu( BMessage *settings, const char *setting, const int32 *values, int32 count, const char *unit, const char *zero = "Off")
+{
+	int32 current = 0;
+	settings->FindInt32( setting, &current);
+
+	BPopUpMenu *menu = new BPopUpMenu( "");
+	for( int32 i = 0; i < count; i++)
+	{
+		char label[32];
+		if( values[i] == 0)
+			strcpy( label, zero);
+		else
+			sprintf( label, "%" B_PRId32 "%s", values[i], unit);
+		BMessage *lmsg = new BMessage( ARCHIVER_MSG_CHANGE_LIMIT);
+		lmsg->AddString( "setting", setting);
+		lmsg->AddInt32( "value", values[i]);
+		BMenuItem *litem = new BMenuItem( label, lmsg);
+		if( values[i] == current) litem->SetMarked( true);
+		menu->AddItem( litem);
+	}
+	return menu;
+}
+
+//---------------------------------------------------
+//	Popup menu with one item for each of labels, setting is index of chosen one
+//---------------------------------------------------
+static BPopUpMenu *
+choice_menu( BMessage *settings, const char *setting, const char **labels, int32 count)
+{
+	int32 current = 0;
+	settings->FindInt32( setting, &current);
+
+	BPopUpMenu *menu = new BPopUpMenu( "");
+	for( int32 i = 0; i < count; i++)
+	{
+		BMessage *cmsg = new BMessage( ARCHIVER_MSG_CHANGE_LIMIT);
+		cmsg->AddString( "setting", setting);
+		cmsg->AddInt32( "value", i);
+		BMenuItem *citem = new BMenuItem( labels[i], cmsg);
+		if( i == current) citem->SetMarked( true);
+		menu->AddItem( citem);
+	}
+	return menu;
+}
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+ASettingsView::ASettingsView( BMessage *settings)
+	:AView( settings),
+	aRules( LoadRules())
+{
+	// some temporary variables
+	BFont		font = be_plain_font;
+	float		fontsize = font.Size();
+	font_height	fontheight;
+	float		lineheight;
+
+	BRect		rect;
+
+	// set basic width and height
+	aWidth		= (aLeftMargin += B_LARGE_ICON / 2);
+	aHeight		= aTopMargin;
+	
+	// title
+	font.SetSize( fontsize + 5);
+	font.SetFace( B_BOLD_FACE);
+	font.GetHeight( &fontheight);
+	lineheight = ceil( fontheight.ascent + fontheight.descent + fontheight.leading);
+	
+	aTitle = new BStringView( BRect( aLeftMargin, aTopMargin, aLeftMargin, aTopMargin), "", "Archiver Settings");
+	aTitle->SetFont( &font, B_FONT_ALL);
+	aTitle->ResizeToPreferred();
+	rect = aTitle->Frame();
+	
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// rules selection - build BBox, and add BRadioButtons to it (one for each Rule)
+	font.SetSize( fontsize);
 	font.SetFace( B_BOLD_FACE);
 	font.GetHeight( &fontheight);
 	lineheight = ceil( fontheight.ascent + fontheight.descent + fontheight.leading);
@@ -583,25 +1535,244 @@ ASettingsView::ASettingsView( BMessage *settings)
 	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
 	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
 
-	// "OK" button
-	aButton = new BButton( BRect( aWidth, ceil( rect.bottom + fontheight.leading) + 8, aWidth, aHeight), "", "Accept", new BMessage( ARCHIVER_MSG_ACCEPT));
-	aButton->SetFont( &font, B_FONT_ALL);
-	aButton->ResizeToPreferred();
-	aButton->SetEnabled( false);
-	rect = aButton->Frame();
-	
-	aButton->MoveBy( -rect.Width(), 0);
+	// "Merge drops" checkbox
+	int32 coalesce = 0;
+	aSettings->FindInt32( ARCHIVER_SETTINGS_COALESCE, &coalesce);
 
+	aCoalesceCheckBox = new BCheckBox( BRect( aLeftMargin, aHeight, aLeftMargin, aHeight), "", "Put files dropped one after another into one archive", new BMessage( ARCHIVER_MSG_CHANGE_COALESCE));
+	font.SetFace( B_BOLD_FACE);
+	aCoalesceCheckBox->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	if( coalesce > 0) aCoalesceCheckBox->SetValue( 1);
+	aCoalesceCheckBox->ResizeToPreferred();
+	rect = aCoalesceCheckBox->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
 	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
 
+	// "Add to archive" checkbox
+	bool append = false;
+	aSettings->FindBool( ARCHIVER_SETTINGS_APPEND, &append);
 
-	// resize to let all children be visible, add some bottom and right margin
-	ResizeTo( aWidth+=3, aHeight+=2);
+	aAppendCheckBox = new BCheckBox( BRect( aLeftMargin, aHeight, aLeftMargin, aHeight), "", "Add files to archive dropped with them (ZIP and TAR)", new BMessage( ARCHIVER_MSG_CHANGE_APPEND));
+	font.SetFace( B_BOLD_FACE);
+	aAppendCheckBox->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	if( append) aAppendCheckBox->SetValue( 1);
+	aAppendCheckBox->ResizeToPreferred();
+	rect = aAppendCheckBox->Frame();
 
-	// add children
-	AddChild( aTitle);
-	AddChild( aRulesBox);
-	AddChild( aCheckBox);
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// "Store copies as links" checkbox
+	bool dedup = false;
+	aSettings->FindBool( ARCHIVER_SETTINGS_DEDUP, &dedup);
+
+	aDedupCheckBox = new BCheckBox( BRect( aLeftMargin, aHeight, aLeftMargin, aHeight), "", "Store identical files added to archive as links", new BMessage( ARCHIVER_MSG_CHANGE_DEDUP));
+	font.SetFace( B_BOLD_FACE);
+	aDedupCheckBox->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	if( dedup) aDedupCheckBox->SetValue( 1);
+	aDedupCheckBox->ResizeToPreferred();
+	rect = aDedupCheckBox->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// "Extract archives" checkbox
+	bool extract = false;
+	aSettings->FindBool( ARCHIVER_SETTINGS_EXTRACT, &extract);
+
+	aExtractCheckBox = new BCheckBox( BRect( aLeftMargin, aHeight, aLeftMargin, aHeight), "", "Extract dropped archives instead of compressing them", new BMessage( ARCHIVER_MSG_CHANGE_EXTRACT));
+	font.SetFace( B_BOLD_FACE);
+	aExtractCheckBox->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	if( extract) aExtractCheckBox->SetValue( 1);
+	aExtractCheckBox->ResizeToPreferred();
+	rect = aExtractCheckBox->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// "Verify archive" checkbox
+	bool verify = false;
+	aSettings->FindBool( ARCHIVER_SETTINGS_VERIFY, &verify);
+
+	aVerifyCheckBox = new BCheckBox( BRect( aLeftMargin, aHeight, aLeftMargin, aHeight), "", "Verify archive while it's created (pipeline rules)", new BMessage( ARCHIVER_MSG_CHANGE_VERIFY));
+	font.SetFace( B_BOLD_FACE);
+	aVerifyCheckBox->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	if( verify) aVerifyCheckBox->SetValue( 1);
+	aVerifyCheckBox->ResizeToPreferred();
+	rect = aVerifyCheckBox->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// compression level menu - for rules which have "LEVEL" option
+	int32 level = ARCHIVER_SETTINGS_LEVEL_DEF;
+	aSettings->FindInt32( ARCHIVER_SETTINGS_LEVEL, &level);
+
+	BPopUpMenu *levelMenu = new BPopUpMenu( "");
+	for( int32 i = 1; i <= 9; i++)
+	{
+		char label[32];
+		sprintf( label, "%" B_PRId32 "%s", i, i == 1 ? " (fastest)" : i == 9 ? " (best)" : "");
+		BMessage *lmsg = new BMessage( ARCHIVER_MSG_CHANGE_LEVEL);
+		lmsg->AddInt32( "level", i);
+		BMenuItem *litem = new BMenuItem( label, lmsg);
+		if( i == level) litem->SetMarked( true);
+		levelMenu->AddItem( litem);
+	}
+
+	aLevelField = new BMenuField( BRect( aLeftMargin, aHeight + 4, aLeftMargin, aHeight + 4), "", "Compression level:", levelMenu);
+	font.SetFace( B_BOLD_FACE);
+	aLevelField->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	aLevelField->SetDivider( font.StringWidth( "Compression level:") + 16);
+	aLevelField->ResizeToPreferred();
+	rect = aLevelField->Frame();
+
+	// archives menu - one of all dropped files, or one for each of them (made at once)
+	static const char *splitLabels[] = { "One for all files", "One for each file", "One for each subfolder" };
+	aSplitField = new BMenuField( BRect( rect.right + 8, rect.top, rect.right + 8, rect.top), "", "Archives:",
+		choice_menu( aSettings, ARCHIVER_SETTINGS_SPLIT, splitLabels, sizeof( splitLabels) / sizeof( const char*)));
+	font.SetFace( B_BOLD_FACE);
+	aSplitField->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	aSplitField->SetDivider( font.StringWidth( "Archives:") + 16);
+	aSplitField->ResizeToPreferred();
+	rect = aSplitField->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// write limit menus - for one job and for all of them together
+	static const int32 writeLimits[] = { 0, 5, 10, 20, 50, 100 };
+	aWriteLimitField = new BMenuField( BRect( aLeftMargin, aHeight + 4, aLeftMargin, aHeight + 4), "", "Write limit:",
+		limit_menu( aSettings, ARCHIVER_SETTINGS_WRITE_LIMIT, writeLimits, sizeof( writeLimits) / sizeof( int32), " MB/s"));
+	font.SetFace( B_BOLD_FACE);
+	aWriteLimitField->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	aWriteLimitField->SetDivider( font.StringWidth( "Write limit:") + 16);
+	aWriteLimitField->ResizeToPreferred();
+	rect = aWriteLimitField->Frame();
+
+	aGlobalWriteLimitField = new BMenuField( BRect( rect.right + 8, rect.top, rect.right + 8, rect.top), "", "All jobs:",
+		limit_menu( aSettings, ARCHIVER_SETTINGS_GLOBAL_WRITE_LIMIT, writeLimits, sizeof( writeLimits) / sizeof( int32), " MB/s"));
+	font.SetFace( B_BOLD_FACE);
+	aGlobalWriteLimitField->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	aGlobalWriteLimitField->SetDivider( font.StringWidth( "All jobs:") + 16);
+	aGlobalWriteLimitField->ResizeToPreferred();
+	rect = aGlobalWriteLimitField->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// CPU share menu
+	static const int32 cpuShares[] = { 0, 25, 50, 75 };
+	aCpuShareField = new BMenuField( BRect( aLeftMargin, aHeight + 4, aLeftMargin, aHeight + 4), "", "CPU share:",
+		limit_menu( aSettings, ARCHIVER_SETTINGS_CPU_SHARE, cpuShares, sizeof( cpuShares) / sizeof( int32), "%"));
+	font.SetFace( B_BOLD_FACE);
+	aCpuShareField->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	aCpuShareField->SetDivider( font.StringWidth( "CPU share:") + 16);
+	aCpuShareField->ResizeToPreferred();
+	rect = aCpuShareField->Frame();
+
+	// jobs at once menu - the rest waits in queue, while next one's files are read ahead
+	static const int32 maxJobs[] = { 0, 1, 2, 4 };
+	aMaxJobsField = new BMenuField( BRect( rect.right + 8, rect.top, rect.right + 8, rect.top), "", "Jobs at once:",
+		limit_menu( aSettings, ARCHIVER_SETTINGS_MAX_JOBS, maxJobs, sizeof( maxJobs) / sizeof( int32), "", "All"));
+	font.SetFace( B_BOLD_FACE);
+	aMaxJobsField->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	aMaxJobsField->SetDivider( font.StringWidth( "Jobs at once:") + 16);
+	aMaxJobsField->ResizeToPreferred();
+	rect = aMaxJobsField->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// memory for tools menu - jobs which would take more wait in queue
+	static const int32 memoryBudgets[] = { 0, 256, 512, 1024, 2048, 4096 };
+	aMemoryBudgetField = new BMenuField( BRect( aLeftMargin, aHeight + 4, aLeftMargin, aHeight + 4), "", "Memory for tools:",
+		limit_menu( aSettings, ARCHIVER_SETTINGS_MEMORY_BUDGET, memoryBudgets, sizeof( memoryBudgets) / sizeof( int32), " MB", "Free"));
+	font.SetFace( B_BOLD_FACE);
+	aMemoryBudgetField->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	aMemoryBudgetField->SetDivider( font.StringWidth( "Memory for tools:") + 16);
+	aMemoryBudgetField->ResizeToPreferred();
+	rect = aMemoryBudgetField->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// "Pause while system is busy" checkbox
+	bool pauseBusy = false;
+	aSettings->FindBool( ARCHIVER_SETTINGS_PAUSE_BUSY, &pauseBusy);
+
+	aPauseBusyCheckBox = new BCheckBox( BRect( aLeftMargin, aHeight, aLeftMargin, aHeight), "", "Pause while system or disk is busy", new BMessage( ARCHIVER_MSG_CHANGE_PAUSE_BUSY));
+	font.SetFace( B_BOLD_FACE);
+	aPauseBusyCheckBox->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	if( pauseBusy) aPauseBusyCheckBox->SetValue( 1);
+	aPauseBusyCheckBox->ResizeToPreferred();
+	rect = aPauseBusyCheckBox->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// "Record jobs" checkbox
+	bool record = false;
+	aSettings->FindBool( ARCHIVER_SETTINGS_RECORD, &record);
+
+	aRecordCheckBox = new BCheckBox( BRect( aLeftMargin, aHeight, aLeftMargin, aHeight), "", "Record jobs for replay", new BMessage( ARCHIVER_MSG_CHANGE_RECORD));
+	font.SetFace( B_BOLD_FACE);
+	aRecordCheckBox->SetFont( &font, B_FONT_ALL);
+	font.SetFace( B_REGULAR_FACE);
+	if( record) aRecordCheckBox->SetValue( 1);
+	aRecordCheckBox->ResizeToPreferred();
+	rect = aRecordCheckBox->Frame();
+
+	if( aWidth < rect.right) aWidth = (int32)ceil( rect.right);
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+	// "OK" button
+	aButton = new BButton( BRect( aWidth, ceil( rect.bottom + fontheight.leading) + 8, aWidth, aHeight), "", "Accept", new BMessage( ARCHIVER_MSG_ACCEPT));
+	aButton->SetFont( &font, B_FONT_ALL);
+	aButton->ResizeToPreferred();
+	aButton->SetEnabled( false);
+	rect = aButton->Frame();
+	
+	aButton->MoveBy( -rect.Width(), 0);
+
+	if( aHeight < rect.bottom) aHeight = (int32)ceil( rect.bottom);
+
+
+	// resize to let all children be visible, add some bottom and right margin
+	ResizeTo( aWidth+=3, aHeight+=2);
+
+	// add children
+	AddChild( aTitle);
+	AddChild( aRulesBox);
+	AddChild( aCheckBox);
+	AddChild( aCoalesceCheckBox);
+	AddChild( aAppendCheckBox);
+	AddChild( aDedupCheckBox);
+	AddChild( aExtractCheckBox);
+	AddChild( aVerifyCheckBox);
+	AddChild( aLevelField);
+	AddChild( aSplitField);
+	AddChild( aWriteLimitField);
+	AddChild( aGlobalWriteLimitField);
+	AddChild( aCpuShareField);
+	AddChild( aMaxJobsField);
+	AddChild( aMemoryBudgetField);
+	AddChild( aPauseBusyCheckBox);
+	AddChild( aRecordCheckBox);
 	AddChild( aButton);
 
 	// FrameResized() must be called to resize aRulesBox and move aButton
@@ -615,6 +1786,20 @@ ASettingsView::~ASettingsView()
 {
 	delete aRules;
 	delete aCheckBox;
+	delete aCoalesceCheckBox;
+	delete aAppendCheckBox;
+	delete aDedupCheckBox;
+	delete aExtractCheckBox;
+	delete aVerifyCheckBox;
+	delete aLevelField;
+	delete aSplitField;
+	delete aWriteLimitField;
+	delete aGlobalWriteLimitField;
+	delete aCpuShareField;
+	delete aMaxJobsField;
+	delete aMemoryBudgetField;
+	delete aPauseBusyCheckBox;
+	delete aRecordCheckBox;
 	delete aRulesBox;
 }
 
@@ -631,6 +1816,20 @@ ASettingsView::AttachedToWindow()
 		radio->SetTarget( this);
 	}
 	aCheckBox->SetTarget( this);
+	aCoalesceCheckBox->SetTarget( this);
+	aAppendCheckBox->SetTarget( this);
+	aDedupCheckBox->SetTarget( this);
+	aExtractCheckBox->SetTarget( this);
+	aVerifyCheckBox->SetTarget( this);
+	aLevelField->Menu()->SetTargetForItems( this);
+	aSplitField->Menu()->SetTargetForItems( this);
+	aWriteLimitField->Menu()->SetTargetForItems( this);
+	aGlobalWriteLimitField->Menu()->SetTargetForItems( this);
+	aCpuShareField->Menu()->SetTargetForItems( this);
+	aMaxJobsField->Menu()->SetTargetForItems( this);
+	aMemoryBudgetField->Menu()->SetTargetForItems( this);
+	aPauseBusyCheckBox->SetTarget( this);
+	aRecordCheckBox->SetTarget( this);
 	aButton->SetTarget( this);
 }
 
@@ -685,6 +1884,113 @@ ASettingsView::MessageReceived( BMessage *msg)
 			}
 			break;
 		}
+		case ARCHIVER_MSG_CHANGE_COALESCE:
+		{
+			int32 value;
+			if( msg->FindInt32( "be:value", &value) == B_OK)
+			{
+				int32 delay = value ? ARCHIVER_SETTINGS_COALESCE_DEF : 0;
+				if( aSettings->ReplaceInt32( ARCHIVER_SETTINGS_COALESCE, delay) != B_OK)
+					aSettings->AddInt32( ARCHIVER_SETTINGS_COALESCE, delay);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_APPEND:
+		{
+			int32 value;
+			if( msg->FindInt32( "be:value", &value) == B_OK)
+			{
+				bool append = value;
+				if( aSettings->ReplaceBool( ARCHIVER_SETTINGS_APPEND, append) != B_OK)
+					aSettings->AddBool( ARCHIVER_SETTINGS_APPEND, append);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_DEDUP:
+		{
+			int32 value;
+			if( msg->FindInt32( "be:value", &value) == B_OK)
+			{
+				bool dedup = value;
+				if( aSettings->ReplaceBool( ARCHIVER_SETTINGS_DEDUP, dedup) != B_OK)
+					aSettings->AddBool( ARCHIVER_SETTINGS_DEDUP, dedup);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_EXTRACT:
+		{
+			int32 value;
+			if( msg->FindInt32( "be:value", &value) == B_OK)
+			{
+				bool extract = value;
+				if( aSettings->ReplaceBool( ARCHIVER_SETTINGS_EXTRACT, extract) != B_OK)
+					aSettings->AddBool( ARCHIVER_SETTINGS_EXTRACT, extract);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_VERIFY:
+		{
+			int32 value;
+			if( msg->FindInt32( "be:value", &value) == B_OK)
+			{
+				bool verify = value;
+				if( aSettings->ReplaceBool( ARCHIVER_SETTINGS_VERIFY, verify) != B_OK)
+					aSettings->AddBool( ARCHIVER_SETTINGS_VERIFY, verify);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_PAUSE_BUSY:
+		{
+			int32 value;
+			if( msg->FindInt32( "be:value", &value) == B_OK)
+			{
+				bool pauseBusy = value;
+				if( aSettings->ReplaceBool( ARCHIVER_SETTINGS_PAUSE_BUSY, pauseBusy) != B_OK)
+					aSettings->AddBool( ARCHIVER_SETTINGS_PAUSE_BUSY, pauseBusy);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_RECORD:
+		{
+			int32 value;
+			if( msg->FindInt32( "be:value", &value) == B_OK)
+			{
+				bool record = value;
+				if( aSettings->ReplaceBool( ARCHIVER_SETTINGS_RECORD, record) != B_OK)
+					aSettings->AddBool( ARCHIVER_SETTINGS_RECORD, record);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_LIMIT:
+		{
+			const char *setting;
+			int32 value;
+			if( msg->FindString( "setting", &setting) == B_OK && msg->FindInt32( "value", &value) == B_OK)
+			{
+				if( aSettings->ReplaceInt32( setting, value) != B_OK)
+					aSettings->AddInt32( setting, value);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
+		case ARCHIVER_MSG_CHANGE_LEVEL:
+		{
+			int32 level;
+			if( msg->FindInt32( "level", &level) == B_OK)
+			{
+				if( aSettings->ReplaceInt32( ARCHIVER_SETTINGS_LEVEL, level) != B_OK)
+					aSettings->AddInt32( ARCHIVER_SETTINGS_LEVEL, level);
+				aButton->SetEnabled( true);
+			}
+			break;
+		}
 		case ARCHIVER_MSG_ACCEPT:
 		{
 			ChangeSettingsRule();
@@ -777,11 +2083,14 @@ ASettingsView::LoadRules()
 		Rules->AddString( "rule[0]", "-9");
 		Rules->AddString( "rule[0]", "-r");
 		Rules->AddString( "rule[0]", "-y");
+		Rules->AddString( "rule[0]", ARCHIVER_SETTINGS_FILENAME);
+		Rules->AddString( "rule[0]", "-@");
+		Rules->AddString( "rule[0]", ARCHIVER_SETTINGS_FILELIST);
 
 		if( file.SetTo( path.Path(), B_READ_WRITE | B_CREATE_FILE) == B_OK)
 		{
 			char default_rule[] = "ZIP compressed file\tmaximum compression\tapplication/x-zip-compressed\t.zip\t";
-			char zipArgs[] = "\t-9\t-r\t-y\t"ARCHIVER_SETTINGS_FILENAME"\n";
+			char zipArgs[] = "\t-9\t-r\t-y\t"ARCHIVER_SETTINGS_FILENAME"\t-@\t"ARCHIVER_SETTINGS_FILELIST"\n";
 			file.Write( (char*)default_rule, sizeof( default_rule)-1);
 			file.Write( (char*)zipCmd, sizeof( zipCmd)-1);
 			file.Write( (char*)zipArgs, sizeof( zipArgs)-1);
@@ -1059,9 +2368,13 @@ ASettingsSwitch::DrawArrow()
 //---------------------------------------------------
 //	Constructor - build ArchiverWindow
 //---------------------------------------------------
-ArchiverWindow::ArchiverWindow( BMessage *refs)
+ArchiverWindow::ArchiverWindow( BMessage *refs, bool service)
 	:BWindow( BRect( 0, 0, 0, 0), "Archiver", B_TITLED_WINDOW_LOOK, B_NORMAL_WINDOW_FEEL, B_NOT_RESIZABLE | B_NOT_ZOOMABLE | B_ASYNCHRONOUS_CONTROLS),
-	aSettings( NULL)
+	aJobList( new AJobListView()),
+	aReorganizePending( false),
+	aSettings( NULL),
+	aJobSettings( NULL),
+	aService( service)
 {
 	aSettingsSwitch = new ASettingsSwitch();
 	AddChild( aSettingsSwitch);
@@ -1085,19 +2398,17 @@ ArchiverWindow::ArchiverWindow( BMessage *refs)
 	}
 	
 	// if 0 files (no file was selected in Tracker or Archiver was launched as an application)
-	// than show settings
+	// than show settings, unless it's running as service - then it waits hidden for jobs
 	if( !refscount)
 	{
-		aSettingsSwitch->Invoke();
+		if( !aService)
+			aSettingsSwitch->Invoke();
 	}
 	else
 	{
 		// run and show compression
-		ACompressView *AView = new ACompressView( refs, aSettings);
-		BRect rect = AView->Frame();
-		ResizeTo( rect.Width(), rect.Height() + aSettingsSwitch->aHeight);
-		AView->MoveBy( 0, aSettingsSwitch->aHeight);
-		AddChild( AView);
+		StartJob( refs);
+		Reorganize();
 	}
 }
 
@@ -1109,8 +2420,37 @@ ArchiverWindow::~ArchiverWindow()
 	aSettingsSwitch->RemoveSelf();
 	delete aSettingsSwitch;
 
+	// jobs still running are killed, Archiver quits only after their tasks leave them
+	ACompressView *job;
+	while( ( job = aJobList->JobAt( 0)) != NULL)
+	{
+		aJobList->RemoveJob( job);
+		RemoveHandler( job);
+		job->Cancel();
+		delete job;
+	}
+	while( ( job = (ACompressView*)aRemovedJobs.RemoveItem( (int32)0)) != NULL)
+	{
+		RemoveHandler( job);
+		delete job;
+	}
+	aJobList->RemoveSelf();
+	delete aJobList;
+
+	// drops which didn't make it to compression
+	BMessage *batch;
+	while( ( batch = (BMessage*)aDropBatches.RemoveItem( (int32)0)) != NULL)
+	{
+		BMessageRunner *runner;
+		if( batch->FindPointer( "runner", (void**)&runner) == B_OK)
+			delete runner;
+		delete batch;
+	}
+
 	if( aSettings != NULL)
 		delete aSettings;
+	if( aJobSettings != NULL)
+		aJobSettings->Release();
 }
 
 //---------------------------------------------------
@@ -1120,6 +2460,15 @@ void
 ArchiverWindow::MessageReceived( BMessage *msg)
 {
 	if( msg->WasDropped() && msg->HasRef( "refs")) {
+		// wait a moment for more drops onto same directory, so they can go into one archive
+		int32 delay = 0;
+		aSettings->FindInt32( ARCHIVER_SETTINGS_COALESCE, &delay);
+		if( delay > 0)
+		{
+			CoalesceDrop( msg, delay);
+			return;
+		}
+
 		be_app->LockLooper();
 		be_app->RefsReceived( msg);
 		be_app->UnlockLooper();
@@ -1128,24 +2477,85 @@ ArchiverWindow::MessageReceived( BMessage *msg)
 
 	switch( msg->what)
 	{
+		case ARCHIVER_MSG_FLUSH_DROPS:
+		{
+			BMessage *batch;
+			if( msg->FindPointer( "batch", (void**)&batch) == B_OK && aDropBatches.HasItem( batch))
+				FlushDrops( batch);
+			break;
+		}
 		case ARCHIVER_MSG_REMOVE_AVIEW:
 		{
 			AView *view;
+			ACompressView *job = NULL;
 			if( msg->FindPointer( "view", (void**)&view) == B_OK)
 			{
 				view->RemoveSelf();
 				ASettingsView *sview;
-				ACompressView *cview;
 				if( ( sview = dynamic_cast<ASettingsView*>(view)) != NULL)
 				{
 					delete sview;
 				}
-				else if( ( cview = dynamic_cast<ACompressView*>(view)) != NULL)
+				Reorganize();
+			}
+			// job may be asked to go away twice (stopped just when it finished)
+			else if( msg->FindPointer( "job", (void**)&job) == B_OK && aJobList->RemoveJob( job))
+			{
+				// it's tasks are told to stop, if they still run job is deleted when they leave it
+				if( job->Cancel())
+				{
+					RemoveHandler( job);
+					delete job;
+				}
+				else
 				{
-					delete cview;
+					job->aRemoved = true;
+					aRemovedJobs.AddItem( job);
 				}
+				if( aJobList->CountJobs() == 0)
+					aJobList->RemoveSelf();
+				ScheduleReorganize();
+				StartQueuedJobs();
+			}
+			// removed job's tasks left it
+			else if( job != NULL && aRemovedJobs.HasItem( job) && job->Cancel())
+			{
+				aRemovedJobs.RemoveItem( job);
+				RemoveHandler( job);
+				delete job;
 			}
+			break;
+		}
+		case ARCHIVER_MSG_START_JOBS:
+		{
+			StartQueuedJobs();
+			break;
+		}
+		case ARCHIVER_MSG_RULE_MEMORY:
+		{
+			// peak of last job counts most, older ones are slowly forgotten (rule's options or files may change)
+			const char *rule;
+			int64 memory;
+			if( msg->FindString( "rule", &rule) != B_OK || msg->FindInt64( "memory", &memory) != B_OK)
+				break;
+
+			BMessage rules;
+			aSettings->FindMessage( ARCHIVER_SETTINGS_RULE_MEMORY, &rules);
+			int64 old;
+			if( rules.FindInt64( rule, &old) == B_OK && old * 3 / 4 > memory)
+				memory = old * 3 / 4;
+			if( rules.ReplaceInt64( rule, memory) != B_OK)
+				rules.AddInt64( rule, memory);
+			if( aSettings->ReplaceMessage( ARCHIVER_SETTINGS_RULE_MEMORY, &rules) != B_OK)
+				aSettings->AddMessage( ARCHIVER_SETTINGS_RULE_MEMORY, &rules);
+			SaveSettings();
+			break;
+		}
+		case ARCHIVER_MSG_REORGANIZE:
+		{
+			aReorganizePending = false;
 			Reorganize();
+			break;
 		}
 		default:
 			_inherited::MessageReceived( msg);
@@ -1153,22 +2563,109 @@ ArchiverWindow::MessageReceived( BMessage *msg)
 	}
 }
 
+//---------------------------------------------------
+//	Add dropped refs to batch waiting for same directory, or start new batch
+//	batch is compressed when there was no drop onto it's directory for delay ms
+//---------------------------------------------------
+void
+ArchiverWindow::CoalesceDrop( BMessage *msg, int32 delay)
+{
+	// archive goes to directory of first dropped file
+	entry_ref ref;
+	entry_ref dir_ref;
+	msg->FindRef( "refs", &ref);
+	BEntry refEntry( &ref);
+	BEntry dirEntry;
+	refEntry.GetParent( &dirEntry);
+	dirEntry.GetRef( &dir_ref);
+
+	// find batch for that directory
+	BMessage *batch = NULL;
+	entry_ref batch_dir_ref;
+	for( int32 index = 0; ( batch = (BMessage*)aDropBatches.ItemAt( index)) != NULL; index++)
+	{
+		if( batch->FindRef( ARCHIVER_REFS_DIR_REF, &batch_dir_ref) == B_OK && batch_dir_ref == dir_ref)
+			break;
+	}
+
+	if( batch == NULL)
+	{
+		batch = new BMessage( B_REFS_RECEIVED);
+		batch->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+		aDropBatches.AddItem( batch);
+	}
+
+	int32 index = 0;
+	while( msg->FindRef( "refs", index++, &ref) == B_OK)
+		batch->AddRef( "refs", &ref);
+
+	// restart timer for this batch
+	BMessageRunner *runner;
+	if( batch->FindPointer( "runner", (void**)&runner) == B_OK)
+	{
+		delete runner;
+		batch->RemoveName( "runner");
+	}
+
+	BMessage flush( ARCHIVER_MSG_FLUSH_DROPS);
+	flush.AddPointer( "batch", batch);
+	runner = new BMessageRunner( BMessenger( this), &flush, (bigtime_t)delay * 1000, 1);
+	batch->AddPointer( "runner", runner);
+}
+
+//---------------------------------------------------
+//	Time for batch is up - compress it as one job
+//---------------------------------------------------
+void
+ArchiverWindow::FlushDrops( BMessage *batch)
+{
+	aDropBatches.RemoveItem( batch);
+
+	BMessageRunner *runner;
+	if( batch->FindPointer( "runner", (void**)&runner) == B_OK)
+		delete runner;
+	batch->RemoveName( "runner");
+
+	be_app->LockLooper();
+	be_app->RefsReceived( batch);
+	be_app->UnlockLooper();
+
+	delete batch;
+}
+
 //---------------------------------------------------
 //	Quit application - delete objects etc..
 //---------------------------------------------------
 bool
 ArchiverWindow::QuitRequested()
 {
+	// drops still waiting for more become jobs now, as they would without coalescing
+	BMessage *batch;
+	while( ( batch = (BMessage*)aDropBatches.ItemAt( 0)) != NULL)
+		FlushDrops( batch);
+
+	// jobs which didn't start yet would be dropped with window - ask first, they are kept if user doesn't want that
 	int32 index = 0;
-	BView *view;
-	ACompressView *cview;
-	while(( view = ChildAt(index++)) != NULL)
+	int32 queued = 0;
+	ACompressView *job;
+	while(( job = aJobList->JobAt(index++)) != NULL)
 	{
-		if( ( cview = dynamic_cast<ACompressView*>( view)) != NULL)
-		{
-			if( !cview->Stop())
-				return false;
-		}
+		if( !job->IsStarted())
+			queued++;
+	}
+	if( queued > 0)
+	{
+		char text[160];
+		sprintf( text, "%" B_PRId32 " job(s) didn't start yet. Are You sure You want to quit and drop them?", queued);
+		if( ((new BAlert( "", text, "Quit", "Keep them", NULL, B_WIDTH_AS_USUAL, B_WARNING_ALERT))->Go()) != 0)
+			return false;
+	}
+
+	index = 0;
+	while(( job = aJobList->JobAt(index++)) != NULL)
+	{
+		if( !job->Stop())
+			return false;
 	}
 	return true;
 }
@@ -1197,8 +2694,21 @@ ArchiverWindow::Quit()
 void
 ArchiverWindow::ChangeSettings( BMessage *settings)
 {
+	// memory measured while settings were edited mustn't be lost
+	BMessage rules;
+	bool measured = aSettings->FindMessage( ARCHIVER_SETTINGS_RULE_MEMORY, &rules) == B_OK;
 	*aSettings = *settings;
+	if( measured && aSettings->ReplaceMessage( ARCHIVER_SETTINGS_RULE_MEMORY, &rules) != B_OK)
+		aSettings->AddMessage( ARCHIVER_SETTINGS_RULE_MEMORY, &rules);
 	SaveSettings();
+
+	// jobs started from now on get new settings, running ones keep theirs
+	if( aJobSettings != NULL)
+		aJobSettings->Release();
+	aJobSettings = NULL;
+
+	// more jobs may run at once now
+	StartQueuedJobs();
 }
 
 //---------------------------------------------------
@@ -1215,6 +2725,20 @@ ArchiverWindow::LoadDefaultSettings()
 	aSettings->AddInt32( ARCHIVER_SETTINGS_PRIORITY, B_LOW_PRIORITY);
 	aSettings->AddPoint( ARCHIVER_SETTINGS_WIN_POS, BPoint( 200, 200));
 	aSettings->AddBool( ARCHIVER_SETTINGS_CLOSE_WIN, true);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_COALESCE, 0);
+	aSettings->AddBool( ARCHIVER_SETTINGS_APPEND, false);
+	aSettings->AddBool( ARCHIVER_SETTINGS_DEDUP, false);
+	aSettings->AddBool( ARCHIVER_SETTINGS_EXTRACT, false);
+	aSettings->AddBool( ARCHIVER_SETTINGS_VERIFY, false);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_WRITE_LIMIT, 0);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_GLOBAL_WRITE_LIMIT, 0);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_CPU_SHARE, 0);
+	aSettings->AddBool( ARCHIVER_SETTINGS_PAUSE_BUSY, false);
+	aSettings->AddBool( ARCHIVER_SETTINGS_RECORD, false);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_MAX_JOBS, 0);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_MEMORY_BUDGET, 0);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_SPLIT, ARCHIVER_SPLIT_NONE);
+	aSettings->AddInt32( ARCHIVER_SETTINGS_LEVEL, ARCHIVER_SETTINGS_LEVEL_DEF);
 
 	// set default compression tool (ZIP)
 	aSettings->AddString( ARCHIVER_SETTINGS_FILE_DESC, "ZIP compressed file");
@@ -1226,6 +2750,8 @@ ArchiverWindow::LoadDefaultSettings()
 	aSettings->AddString( ARCHIVER_SETTINGS_OPTION, "-r");
 	aSettings->AddString( ARCHIVER_SETTINGS_OPTION, "-y");
 	aSettings->AddString( ARCHIVER_SETTINGS_OPTION, ARCHIVER_SETTINGS_FILENAME);
+	aSettings->AddString( ARCHIVER_SETTINGS_OPTION, "-@");
+	aSettings->AddString( ARCHIVER_SETTINGS_OPTION, ARCHIVER_SETTINGS_FILELIST);
 }
 
 //---------------------------------------------------
@@ -1309,169 +2835,1305 @@ ArchiverWindow::Compress( BMessage *refs)
 	
 	if( refscount)
 	{
-		ACompressView *view = new ACompressView( refs, aSettings);
-		AddChild( view);
-		Reorganize();
+		StartJob( refs);
+		ScheduleReorganize();
+
+		if( IsHidden())
+			Show();
+	}
+}
+
+//---------------------------------------------------
+//	Add job to list and start it (or queue it) - job gets messages through window's looper
+//	if settings say so, each dropped item (or each folder in them) gets job of it's own,
+//	they all run at once, each named after it's item
+//---------------------------------------------------
+void
+ArchiverWindow::StartJob( BMessage *refs)
+{
+	if( aJobSettings == NULL)
+		aJobSettings = new AJobSettings( aSettings);
+
+	// files added to archive go to that one archive, and client waiting for job gets only one reply
+	int32 split = ARCHIVER_SPLIT_NONE;
+	bool append = false;
+	aSettings->FindInt32( ARCHIVER_SETTINGS_SPLIT, &split);
+	aSettings->FindBool( ARCHIVER_SETTINGS_APPEND, &append);
+	BList jobs;
+	if( split != ARCHIVER_SPLIT_NONE && !append && !refs->HasInt32( ARCHIVER_REFS_REPLY_FD))
+		SplitJob( refs, split, &jobs);
+	if( jobs.IsEmpty())
+		jobs.AddItem( new BMessage( *refs));
+
+	if( aJobList->Window() == NULL)
+		AddChild( aJobList);
+
+	// replayed job brings rule it was recorded with, it only makes archive
+	AJobSettings *settings = aJobSettings->Acquire();
+	BMessage rule;
+	if( refs->FindMessage( ARCHIVER_REFS_RULE, &rule) == B_OK)
+	{
+		settings->Release();
+		settings = new AJobSettings( aSettings);
+
+		char *name;
+		type_code type;
+		int32 count;
+		for( int32 index = 0; rule.GetInfo( B_ANY_TYPE, index, &name, &type, &count) == B_OK; index++)
+		{
+			settings->aSettings.RemoveName( name);
+			for( int32 item = 0; item < count; item++)
+			{
+				const void *data;
+				ssize_t size;
+				if( rule.FindData( name, type, item, &data, &size) == B_OK)
+					settings->aSettings.AddData( name, type, data, size, false);
+			}
+		}
+		settings->aSettings.ReplaceBool( ARCHIVER_SETTINGS_APPEND, false);
+		settings->aSettings.ReplaceBool( ARCHIVER_SETTINGS_EXTRACT, false);
+	}
+
+	BMessage *jobRefs;
+	for( int32 index = 0; ( jobRefs = (BMessage*)jobs.ItemAt( index)) != NULL; index++)
+	{
+		ACompressView *job = new ACompressView( jobRefs, settings);
+		AddHandler( job);
+		aJobList->AddJob( job);
+	}
+	settings->Release();
+	StartQueuedJobs();
+}
+
+//---------------------------------------------------
+//	Refs for each job of split drop - one for each dropped item, or for each folder in dropped folders
+//	(files lying in dropped folder go together into one more, files dropped alone get one each)
+//	archive goes next to it's item, so it's directory is the dropped folder
+//---------------------------------------------------
+void
+ArchiverWindow::SplitJob( BMessage *refs, int32 split, BList *jobs)
+{
+	entry_ref ref;
+	for( int32 index = 0; refs->FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		BDirectory directory( &ref);
+		int32 before = jobs->CountItems();
+		if( split == ARCHIVER_SPLIT_SUBFOLDERS && directory.InitCheck() == B_OK)
+		{
+			BMessage *files = NULL;
+			entry_ref child;
+			while( directory.GetNextRef( &child) == B_OK)
+			{
+				BEntry entry( &child);
+				BMessage *job = entry.IsDirectory() ? NULL : files;
+				if( job == NULL)
+				{
+					job = new BMessage( *refs);
+					job->RemoveName( "refs");
+					if( job->ReplaceRef( ARCHIVER_REFS_DIR_REF, &ref) != B_OK)
+						job->AddRef( ARCHIVER_REFS_DIR_REF, &ref);
+					jobs->AddItem( job);
+					if( !entry.IsDirectory())
+						files = job;
+				}
+				job->AddRef( "refs", &child);
+			}
+		}
+
+		// file, or folder which is empty
+		if( jobs->CountItems() == before)
+		{
+			BMessage *job = new BMessage( *refs);
+			job->RemoveName( "refs");
+			job->AddRef( "refs", &ref);
+			jobs->AddItem( job);
+		}
+	}
+}
+
+//---------------------------------------------------
+//	Start queued jobs, in order they were added, while there are less running than settings allow
+//	files of first job which has to wait are read ahead meanwhile
+//---------------------------------------------------
+void
+ArchiverWindow::StartQueuedJobs()
+{
+	int32 maxJobs = 0;
+	aSettings->FindInt32( ARCHIVER_SETTINGS_MAX_JOBS, &maxJobs);
+
+	ACompressView *job;
+	int32 running = 0;
+	int64 reserved = 0;		// memory running jobs took, or may still take
+	int64 used = 0;			// memory running jobs take now
+	for( int32 index = 0; ( job = aJobList->JobAt( index)) != NULL; index++)
+	{
+		if( job->IsRunning())
+		{
+			running++;
+			reserved += job->MemoryReserved();
+			used += job->aProgress.Memory();
+		}
+	}
+
+	// budget of memory for tools - from settings, or what is free (memory running tools take now will be free again)
+	int64 budget = 0;
+	int32 value = 0;
+	if( aSettings->FindInt32( ARCHIVER_SETTINGS_MEMORY_BUDGET, &value) == B_OK && value > 0)
+		budget = (int64)value * 1024 * 1024;
+	else
+	{
+		system_info info;
+		if( get_system_info( &info) == B_OK)
+			budget = (int64)info.free_memory + used - ARCHIVER_MEMORY_RESERVE;
+	}
+
+	for( int32 index = 0; ( job = aJobList->JobAt( index)) != NULL; index++)
+	{
+		if( job->IsStarted())
+			continue;
+
+		// job which needs more memory than is left waits, so jobs after it don't take it's place
+		// alone it always runs - it could wait forever otherwise
+		int64 memory = JobMemory( job);
+		bool memoryFits = running == 0 || memory <= 0 || reserved + memory <= budget;
+		if( ( maxJobs <= 0 || running < maxJobs) && memoryFits)
+		{
+			job->aMemoryReserved = memory;
+			job->aWaitingForMemory = false;
+			job->Start();
+			running++;
+			reserved += memory;
+			continue;
+		}
+
+		if( !memoryFits && !job->aWaitingForMemory)
+		{
+			job->aMemoryReserved = memory;
+			job->aWaitingForMemory = true;
+			job->aList->JobChanged( job);
+		}
+
+		// only one job is read ahead, cache holds as much as budget allows
+		job->ReadAhead();
+		break;
+	}
+}
+
+//---------------------------------------------------
+//	Memory job's tools are expected to take - declared by rule, or peak measured when it ran last time
+//---------------------------------------------------
+int64
+ArchiverWindow::JobMemory( ACompressView *job)
+{
+	if( job->aAppend || job->aExtract)
+		return 0;
+
+	int64 memory = job->MemoryNeeded();
+	int64 measured = 0;
+	BMessage rules;
+	if( aSettings->FindMessage( ARCHIVER_SETTINGS_RULE_MEMORY, &rules) == B_OK
+		&& rules.FindInt64( job->aRule.String(), &measured) == B_OK && measured > memory)
+		memory = measured;
+	return memory;
+}
+
+//---------------------------------------------------
+//	Reorganize once, after all jobs which are added or removed meanwhile
+//---------------------------------------------------
+void
+ArchiverWindow::ScheduleReorganize()
+{
+	if( aReorganizePending)
+		return;
+	aReorganizePending = true;
+	PostMessage( ARCHIVER_MSG_REORGANIZE);
+}
+
+//---------------------------------------------------
+//	resize to widest View, move Views to their proper y
+//---------------------------------------------------
+void
+ArchiverWindow::Reorganize()
+{
+	if( CountChildren() < 2 && !aSettingsSwitch->aState)
+	{
+		// service keeps running (and keeps settings loaded) until it's window is closed by user
+		if( aService)
+		{
+			if( !IsHidden())
+				Hide();
+			return;
+		}
+
+		LockLooper();
+		Quit();
+		return;
+	}
+
+	aJobList->UpdateSize();
+
+	int32 index = 0;
+	AView *view;
+	float width = 0;
+	float vwidth = 0;
+	float height = 0;
+	float vheight = 0;
+
+	while( ( view = (AView*)ChildAt(index++)) != NULL)
+	{
+		view->MoveTo( 0, height);
+		view->GetPreferredSize( &vwidth, &vheight);
+		if( width < vwidth) width = vwidth;
+		height += vheight;
+	}
+	ResizeTo( width, height);
+	index = 0;
+	while( ( view = (AView*)ChildAt(index++)) != NULL)
+	{
+		view->GetPreferredSize( &vwidth, &vheight);
+		view->ResizeTo( width, vheight);
+	}
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: ArchiverApp
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor - build and show ArchiverWindow
+//---------------------------------------------------
+ArchiverApp::ArchiverApp( int argc, char **argv)
+	:BApplication( ARCHIVER_MIME_TYPE),
+	aService( NULL)
+{
+	// "Archiver --service" - stay in background and accept jobs from ArchiverService clients
+	if( argc > 1 && !strcmp( argv[1], "--service"))
+	{
+		aService = new ArchiverService();
+		status_t status = aService->Start();
+		if( status != B_OK)
+		{
+			// without socket nobody can give jobs to it - quit as soon as app runs
+			fprintf( stderr, "Archiver: can't start service (%s)\n", strerror( status));
+			PostMessage( B_QUIT_REQUESTED);
+			return;
+		}
+
+		// window's looper must run, but there is nothing to show until first job comes
+		ArchiverWindow *Window = new ArchiverWindow( NULL, true);
+		Window->Hide();
+		Window->Show();
+		return;
+	}
+
+	// files passed in command line - compress them just like refs from Tracker
+	if( argc > 1)
+	{
+		BMessage *refs = RefsFromArgs( argc-1, argv+1);
+		if( refs != NULL)
+		{
+			ArchiverWindow *Window = new ArchiverWindow( refs);
+			Window->Show();
+			delete refs;
+			return;
+		}
+	}
+
+	// check if there is B_REFS_RECEIVED message waiting
+	// there should be one if Archiver was run as Tracker's Add-On
+	// or from "Open with..." and similar
+	BMessageQueue *msgqueue = MessageQueue();
+	if( msgqueue != NULL)
+	{
+		BMessage *msg = msgqueue->FindMessage( (uint32)B_REFS_RECEIVED);
+		// are there any refs to comress?
+		if( msg != NULL)
+		{
+			// check if there is ARCHIVER_REFS_DIR_REF (it will if Archiver was run as Add-On)
+			type_code typecode;
+			if (msg->GetInfo( ARCHIVER_REFS_DIR_REF, &typecode) != B_OK)
+			{
+				// it wasn't sent by Tracker Add-On, so Archiver must check dir_ref itself (by taking it from first entry_ref in refs)
+				entry_ref ref;
+				entry_ref dir_ref;
+				msg->FindRef( "refs", &ref);
+				BEntry refEntry( &ref);
+				BEntry dirEntry;
+				refEntry.GetParent( &dirEntry);
+				dirEntry.GetRef( &dir_ref);
+				msg->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+			}
+			// uff... now run compression window :)
+			ArchiverWindow *Window = new ArchiverWindow( msg);
+			Window->Show();
+
+			// remove message from queue since Archiver will parse it itself, not waiting for RefsReceived()
+			msgqueue->RemoveMessage( msg);
+		}
+		// nope - it was run by double click probably
+		else
+		{
+			// run settings window
+			ArchiverWindow *Window = new ArchiverWindow();
+			Window->Show();
+		}
+	}
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+ArchiverApp::~ArchiverApp()
+{
+	if( aService != NULL)
+		delete aService;
+}
+
+//---------------------------------------------------
+//	New refs - add compression view
+//---------------------------------------------------
+void
+ArchiverApp::RefsReceived( BMessage *msg)
+{
+	type_code typecode;
+	if (msg->GetInfo( ARCHIVER_REFS_DIR_REF, &typecode) != B_OK)
+	{
+		// it wasn't sent by Tracker Add-On, so Archiver must check dir_ref itself (by taking it from first entry_ref in refs)
+		entry_ref ref;
+		entry_ref dir_ref;
+		msg->FindRef( "refs", &ref);
+		BEntry refEntry( &ref);
+		BEntry dirEntry;
+		refEntry.GetParent( &dirEntry);
+		dirEntry.GetRef( &dir_ref);
+		msg->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+	}
+	// run compression
+	ArchiverWindow *Window = (ArchiverWindow*)WindowAt( 0);
+	Window->LockLooper();
+	Window->Compress( msg);
+	Window->UnlockLooper();
+	Window->Activate( true);
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: Main
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Main Archiver function
+//---------------------------------------------------
+int
+main( int argc, char **argv)
+{
+	// tool which quits before reading whole list of files must not kill Archiver
+	signal( SIGPIPE, SIG_IGN);
+
+	// command line clients - they only talk to running service, there is no need for BApplication
+	if( argc > 1 && !strcmp( argv[1], "--submit"))
+		return ArchiverService::SubmitMain( argc-2, argv+2);
+	if( argc > 1 && !strcmp( argv[1], "--bench"))
+		return ArchiverService::BenchMain( argc-2, argv+2);
+	if( argc > 1 && !strcmp( argv[1], "--bench-queue"))
+		return ArchiverService::QueueBenchMain( argc-2, argv+2);
+
+	// listing archives - TAR indexes are cached
+	if( argc > 1 && !strcmp( argv[1], "--list"))
+		return ArchiveIndex::ListMain( argc-2, argv+2);
+	if( argc > 1 && !strcmp( argv[1], "--cat"))
+		return ArchiveIndex::CatMain( argc-2, argv+2);
+
+	// delta archives - only chunks which aren't in base archive are stored
+	if( argc > 1 && ( !strcmp( argv[1], "--delta-create") || !strcmp( argv[1], "--delta-apply")))
+		return delta_main( argc-1, argv+1);
+
+	// speed of CRC32 and content hash kernels chosen for this CPU
+	if( argc > 1 && !strcmp( argv[1], "--bench-checksum"))
+		return checksum_bench_main( argc-2, argv+2);
+
+	// how compression of blocks scales with CPU workers of WorkerPool
+	if( argc > 1 && !strcmp( argv[1], "--bench-pool"))
+		return worker_pool_bench_main( argc-2, argv+2);
+
+	// recorded jobs are run again with synthetic files, by running service
+	if( argc > 1 && !strcmp( argv[1], "--replay"))
+		return job_trace_replay_main( argc-2, argv+2);
+
+	// how files would compress, by extension, without writing archive
+	if( argc > 1 && !strcmp( argv[1], "--preflight"))
+		return preflight_main( argc-2, argv+2);
+
+	// memory ZIP's table of members takes, with million of them
+	if( argc > 1 && !strcmp( argv[1], "--bench-entries"))
+		return entry_table_bench_main( argc-2, argv+2);
+
+	// compression stage of rules - gzip which can be read from the middle
+	if( argc > 1 && !strcmp( argv[1], "--gzip-seekable"))
+		return seekable_gzip_main( argc-2, argv+2);
+
+	// compression stage of rules - gzip made on all CPUs
+	if( argc > 1 && !strcmp( argv[1], "--gzip"))
+		return parallel_gzip_main( argc-2, argv+2);
+
+	// how deflate of one stream scales with CPU workers
+	if( argc > 1 && !strcmp( argv[1], "--bench-deflate"))
+		return parallel_deflate_bench_main( argc-2, argv+2);
+
+	// editing ZIP archives - members are copied without recompressing them
+	if( argc > 1 && ( !strcmp( argv[1], "--merge") || !strcmp( argv[1], "--delete") || !strcmp( argv[1], "--replace")))
+		return ZipArchive::EditMain( argc-1, argv+1);
+
+	ArchiverApp *app = new ArchiverApp( argc, argv);
+	app->Run();
+	
+	return( 0);
+}
+
+//---------------------------------------------------
+//	Called by Tracker
+//---------------------------------------------------
+void process_refs( entry_ref dir_ref, BMessage *msg, void *)
+{
+	// add dir_ref as ref - easier way to pass it to Archiver
+	msg->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+
+	// if Archiver runs as service, give it the job - it's much faster than launching new Archiver
+	if( ArchiverService::Submit( msg, false) == B_OK)
+		return;
+
+	// run Archiver
+	be_roster->Launch( ARCHIVER_MIME_TYPE, msg);
+}
+
+//---------------------------------------------------
+//	Build B_REFS_RECEIVED message from paths given in command line
+//	returns NULL if there is no valid path
+//---------------------------------------------------
+BMessage *
+RefsFromArgs( int argc, char **argv)
+{
+	BMessage *refs = new BMessage( B_REFS_RECEIVED);
+	entry_ref ref;
+	for( int i = 0; i < argc; i++)
+	{
+		if( get_ref_for_path( argv[i], &ref) == B_OK)
+			refs->AddRef( "refs", &ref);
+		else
+			fprintf( stderr, "Archiver: can't find \"%s\"\n", argv[i]);
+	}
+
+	if( refs->FindRef( "refs", &ref) != B_OK)
+	{
+		delete refs;
+		return NULL;
+	}
+
+	// archive goes to directory of first file
+	entry_ref dir_ref;
+	BEntry refEntry( &ref);
+	BEntry dirEntry;
+	refEntry.GetParent( &dirEntry);
+	dirEntry.GetRef( &dir_ref);
+	refs->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+
+	return refs;
+}
+
+//---------------------------------------------------
+//	Tools are loaded, and pipes made, one at a time - see launch_tool() and make_pipe()
+//---------------------------------------------------
+static BLocker sLaunchLock( "launch_tool");
+
+//---------------------------------------------------
+//	Load compression tool with stdin_fd and stdout_fd as it's standard input and output (if they're not -1)
+//	and directory (if it's not NULL) as it's current directory
+//	returns thread_id of tool's main thread (not running yet)
+//---------------------------------------------------
+thread_id
+launch_tool( int32 arg_c, const char **arg_v, int stdin_fd, int stdout_fd, const char *directory)
+{
+	// child inherits Archiver's descriptors and current directory, so they're replaced for a moment
+	// other compression threads must not load their tools (nor make pipes) in the meantime
+	BAutolock locker( &sLaunchLock);
+	if( stdin_fd < 0 && stdout_fd < 0 && directory == NULL)
+		return load_image( arg_c, arg_v, (const char**) environ);
+
+	// many jobs run at once, each from it's own directory - Archiver's stays as it was
+	char saved_directory[B_PATH_NAME_LENGTH];
+	if( directory != NULL && ( getcwd( saved_directory, sizeof( saved_directory)) == NULL || chdir( directory) != 0))
+		return errno;
+
+	int saved_stdin = -1;
+	int saved_stdout = -1;
+	if( stdin_fd >= 0)
+	{
+		saved_stdin = dup( STDIN_FILENO);
+		dup2( stdin_fd, STDIN_FILENO);
+	}
+	if( stdout_fd >= 0)
+	{
+		fflush( stdout);
+		saved_stdout = dup( STDOUT_FILENO);
+		dup2( stdout_fd, STDOUT_FILENO);
+	}
+
+	thread_id thread = load_image( arg_c, arg_v, (const char**) environ);
+
+	if( directory != NULL)
+		chdir( saved_directory);
+	if( stdin_fd >= 0)
+	{
+		if( saved_stdin >= 0)
+		{
+			dup2( saved_stdin, STDIN_FILENO);
+			close( saved_stdin);
+		}
+		else
+			close( STDIN_FILENO);
+	}
+	if( stdout_fd >= 0)
+	{
+		if( saved_stdout >= 0)
+		{
+			dup2( saved_stdout, STDOUT_FILENO);
+			close( saved_stdout);
+		}
+		else
+			close( STDOUT_FILENO);
+	}
+
+	return thread;
+}
+
+//---------------------------------------------------
+//	Make pipe which is not inherited by tools (until it's dup2()ed to their stdin/stdout)
+//	it's made under launch_tool()'s lock - tool loaded between pipe() and FD_CLOEXEC would keep it's write end,
+//	and reader would never see end of it
+//---------------------------------------------------
+status_t
+make_pipe( int fds[2])
+{
+	BAutolock locker( &sLaunchLock);
+	if( pipe( fds) != 0)
+	{
+		fds[0] = fds[1] = -1;
+		return errno;
+	}
+
+	fcntl( fds[0], F_SETFD, FD_CLOEXEC);
+	fcntl( fds[1], F_SETFD, FD_CLOEXEC);
+
+#ifdef F_SETPIPE_SZ
+	// bigger pipe means less context switches between stages
+	fcntl( fds[1], F_SETPIPE_SZ, ARCHIVER_PIPE_SIZE);
+#endif
+
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Returns copy of option with "THREADS" and "LEVEL" replaced by numbers (i.e. "-TTHREADS" -> "-T4")
+//---------------------------------------------------
+static char *
+expand_option( const char *option, int32 threads, int32 level)
+{
+	if( strstr( option, ARCHIVER_SETTINGS_THREADS) == NULL && strstr( option, ARCHIVER_SETTINGS_LEVEL_OPTION) == NULL)
+		return strdup( option);
+
+	char number[16];
+	BString result( option);
+	sprintf( number, "%" B_PRId32, threads);
+	result.ReplaceAll( ARCHIVER_SETTINGS_THREADS, number);
+	sprintf( number, "%" B_PRId32, level);
+	result.ReplaceAll( ARCHIVER_SETTINGS_LEVEL_OPTION, number);
+
+	return strdup( result.String());
+}
+
+//---------------------------------------------------
+//	Split rule options into stages of pipeline and build arguments for each of them
+//	returns number of stages
+//---------------------------------------------------
+static int32
+build_stages( BMessage *Settings, BMessage *Refs, const char *filename, int32 threads, char **arg_v[], int32 arg_c[], bool *fileList, bool *filenameFound)
+{
+	int32 level = ARCHIVER_SETTINGS_LEVEL_DEF;
+	Settings->FindInt32( ARCHIVER_SETTINGS_LEVEL, &level);
+
+	int32 ref_c = 0;
+	type_code typecode;
+	Refs->GetInfo( "refs", &typecode, &ref_c);
+
+	// count arguments of each stage
+	// if rule has "FILELIST" option, tool reads names of files from stdin (i.e. "zip -@", "tar -T -")
+	// so they are streamed through pipe instead of being put in arguments
+	char *temp;
+	int32 index = 0;
+	int32 stage_c = 1;
+	arg_c[0] = 0;
+	*fileList = false;
+	while( Settings->FindString( ARCHIVER_SETTINGS_OPTION, index++, (const char**)&temp) == B_OK)
+	{
+		if( !strcmp( temp, ARCHIVER_SETTINGS_PIPE) && stage_c < ARCHIVER_MAX_STAGES)
+			arg_c[stage_c++] = 0;
+		else if( !strcmp( temp, ARCHIVER_SETTINGS_FILELIST))
+			*fileList = true;
+		else if( strncmp( temp, ARCHIVER_SETTINGS_MEMORY_OPTION, strlen( ARCHIVER_SETTINGS_MEMORY_OPTION)))
+			arg_c[stage_c-1]++;
+	}
+
+	// names of files go to first stage
+	if( !*fileList)
+		arg_c[0] += ref_c;
+
+	// allocate arrays of arguments - they will be passed to compression tools
+	// plus one - last must be NULL
+	int32 arg_index[ARCHIVER_MAX_STAGES];
+	int32 stage;
+	for( stage = 0; stage < stage_c; stage++)
+	{
+		arg_v[stage] = (char **)malloc( sizeof(char *) * (arg_c[stage] + 1));
+		arg_index[stage] = 0;
+	}
+
+	// parse arguments
+	index = 0;
+	stage = 0;
+	*filenameFound = false; // remember if there was ARCHIVER_SETTINGS_FILENAME replaced already, so it will not compare strings in each loop
+	while( Settings->FindString( ARCHIVER_SETTINGS_OPTION, index++, (const char**)&temp) == B_OK)
+	{
+		// "|" - next stage
+		if( !strcmp( temp, ARCHIVER_SETTINGS_PIPE) && stage + 1 < stage_c)
+			stage++;
+		// if it's special arg ("FILENAME") then put filename of created archive instead of it
+		else if( !*filenameFound && !strcmp( temp, ARCHIVER_SETTINGS_FILENAME))
+		{
+			arg_v[stage][arg_index[stage]++] = strdup( filename);
+			*filenameFound = true;
+		}
+		// "FILELIST" only marks that names go to stdin, "MEMORY=" is for Archiver
+		else if( !strcmp( temp, ARCHIVER_SETTINGS_FILELIST)
+			|| !strncmp( temp, ARCHIVER_SETTINGS_MEMORY_OPTION, strlen( ARCHIVER_SETTINGS_MEMORY_OPTION)))
+			continue;
+		// "BASE" - archive delta is made against
+		else if( !strcmp( temp, ARCHIVER_SETTINGS_BASE))
+		{
+			const char *base;
+			arg_v[stage][arg_index[stage]++] = strdup( Refs->FindString( ARCHIVER_REFS_BASE, &base) == B_OK ? base : temp);
+		}
+		// "ARCHIVER" - Archiver itself is the tool
+		else if( !strcmp( temp, ARCHIVER_SETTINGS_SELF))
+		{
+			app_info info;
+			BPath path;
+			if( be_app->GetAppInfo( &info) == B_OK && path.SetTo( &info.ref) == B_OK)
+				arg_v[stage][arg_index[stage]++] = strdup( path.Path());
+			else
+				arg_v[stage][arg_index[stage]++] = strdup( temp);
+		}
+		else
+			arg_v[stage][arg_index[stage]++] = expand_option( temp, threads, level);
+	}
+
+	// parse filenames
+	entry_ref ref;
+	int32 ref_index = 0;
+	while( !*fileList && Refs->FindRef( "refs", ref_index++, &ref) == B_OK)
+	{
+		// if user wants to store file paths there should be such option for compression tool :)
+		arg_v[0][arg_index[0]++] = strdup( ref.name);
+	}
+
+	// last argument must be NULL
+	for( stage = 0; stage < stage_c; stage++)
+		arg_v[stage][arg_index[stage]] = NULL;
+
+	return stage_c;
+}
+
+//---------------------------------------------------
+//	Feed first tool of pipeline with names of files, one per line
+//	tool reads them while it works, so only pipe buffer is used no matter how many files there are
+//---------------------------------------------------
+static int32
+feed_file_list( void *Data)
+{
+	// Data is copy of refs, so it's still valid if ACompressView is gone
+	BMessage *Refs = (BMessage*)Data;
+
+	int32 fd;
+	Refs->FindInt32( "list_fd", &fd);
+
+	FILE *list = fdopen( fd, "w");
+	if( list == NULL)
+	{
+		close( fd);
+		delete Refs;
+		return -1;
+	}
+
+	entry_ref ref;
+	int32 ref_index = 0;
+	while( Refs->FindRef( "refs", ref_index++, &ref) == B_OK)
+	{
+		if( fprintf( list, "%s\n", ref.name) < 0)
+			break;
+	}
+	fclose( list);
+	delete Refs;
+
+	return 0;
+}
+
+//---------------------------------------------------
+//	Read file (or everything in directory) into file cache, until budget is used up
+//	files are read in the same order tools read them - directory order
+//---------------------------------------------------
+static void
+read_ahead_path( ACompressView *View, const char *path, uint8 *buffer, int64 *budget)
+{
+	struct stat st;
+	if( lstat( path, &st) != 0)
+		return;
+
+	if( S_ISDIR( st.st_mode))
+	{
+		DIR *dir = opendir( path);
+		if( dir == NULL)
+			return;
+		struct dirent *entry;
+		while( *budget > 0 && !atomic_get( &View->aReadAheadStop) && ( entry = readdir( dir)) != NULL)
+		{
+			if( !strcmp( entry->d_name, ".") || !strcmp( entry->d_name, ".."))
+				continue;
+			BString child( path);
+			child << "/" << entry->d_name;
+			read_ahead_path( View, child.String(), buffer, budget);
+		}
+		closedir( dir);
+		return;
+	}
+
+	if( !S_ISREG( st.st_mode))
+		return;
+	int fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0)
+		return;
+	ssize_t size;
+	while( *budget > 0 && !atomic_get( &View->aReadAheadStop)
+		&& ( size = read( fd, buffer, *budget < ARCHIVER_READAHEAD_BLOCK ? *budget : ARCHIVER_READAHEAD_BLOCK)) > 0)
+	{
+		*budget -= size;
+		View->aProgress.AddReadAhead( size);
+	}
+	close( fd);
+}
+
+//---------------------------------------------------
+//	Read files of queued job ahead (task of WorkerPool, Data is ACompressView)
+//	it stops when job starts - from then on job reads it's files itself, and finds them in cache
+//---------------------------------------------------
+int32
+ReadAheadFiles( void *Data)
+{
+	ACompressView *View = (ACompressView*)Data;
+
+	// cache is only as big as free memory, what doesn't fit would push out what was read before
+	int64 budget = ARCHIVER_READAHEAD_BUDGET;
+	system_info info;
+	if( get_system_info( &info) == B_OK && (int64)( info.free_memory / 4) < budget)
+		budget = info.free_memory / 4;
+
+	uint8 *buffer = (uint8*)malloc( ARCHIVER_READAHEAD_BLOCK);
+	if( buffer == NULL)
+		return B_NO_MEMORY;
+
+	entry_ref ref;
+	for( int32 index = 0; budget > 0 && !atomic_get( &View->aReadAheadStop) && View->aRefs->FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		BPath path( &ref);
+		if( path.InitCheck() == B_OK)
+			read_ahead_path( View, path.Path(), buffer, &budget);
+	}
+	free( buffer);
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Full archive delta is made against - "Project.tar" for "Project.tar.delta" or "Project 1.tar.delta"
+//	name is delta's name without extension, counter is dropped only if there is no full archive with it
+//---------------------------------------------------
+static status_t
+find_delta_base( const char *directory, const char *name, BString *base)
+{
+	struct stat st;
+	base->SetTo( directory);
+	*base << "/" << name << ".tar";
+	if( stat( base->String(), &st) == 0)
+		return B_OK;
+
+	const char *space = strrchr( name, ' ');
+	if( space == NULL || space[1] == 0 || strspn( space + 1, "0123456789") != strlen( space + 1))
+		return B_ENTRY_NOT_FOUND;
+
+	base->SetTo( directory);
+	*base << "/";
+	base->Append( name, space - name);
+	*base << ".tar";
+	return stat( base->String(), &st) == 0 ? B_OK : B_ENTRY_NOT_FOUND;
+}
+
+//---------------------------------------------------
+//	Wait for tools extracting archive, but pause or stop them if user wants so (each is team of it's own, it can be suspended)
+//---------------------------------------------------
+static status_t
+wait_for_extract_tools( ACompressView *View, thread_id *threads, int32 count)
+{
+	status_t status = B_OK;
+	bool suspended = false;
+	for( int32 stage = 0; stage < count; stage++)
+	{
+		status_t result = B_OK;
+		while( wait_for_thread_etc( threads[stage], B_RELATIVE_TIMEOUT, ARCHIVER_STAGE_POLL, &result) == B_TIMED_OUT)
+		{
+			if( View->aProgress.IsPaused() != suspended)
+			{
+				suspended = !suspended;
+				for( int32 other = stage; other < count; other++)
+				{
+					if( suspended)
+						suspend_thread( threads[other]);
+					else
+						resume_thread( threads[other]);
+				}
+			}
+			if( View->aCancel)
+			{
+				for( int32 other = stage; other < count; other++)
+				{
+					if( suspended)
+						resume_thread( threads[other]);
+					send_signal( (pid_t)threads[other], SIGTERM);
+				}
+				suspended = false;
+			}
+		}
+		if( result != 0 && status == B_OK)
+			status = B_ERROR;
+	}
+	if( View->aCancel)
+		status = B_CANCELED;
+	return status;
+}
+
+//---------------------------------------------------
+//	Extract each of refs to new directory next to it, named after archive
+//	ZIP is extracted by Archiver itself, with tasks of WorkerPool - one for each CPU
+//	everything made by tar (compressed or not) is extracted by tar, it knows all compressors
+//	TAR delta is rebuilt by "Archiver --delta-apply" and piped to tar
+//---------------------------------------------------
+static status_t
+extract_archives( ACompressView *View, BString *report)
+{
+	BMessage	*Refs = View->aRefs;
+	system_info	sysinfo;
+	int32		threads = 1;
+	if( get_system_info( &sysinfo) == B_OK)
+		threads = sysinfo.cpu_count;
+
+	bigtime_t	start = system_time();
+	int32		total = 0;
+	off_t		totalBytes = 0;
+	status_t	status = B_OK;
+	entry_ref	ref;
+	View->aProgress.SetPhase( JOB_PHASE_WORKING);
+	for( int32 index = 0; status == B_OK && Refs->FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		const char *extension = "";
+		const char *tool = "";
+		Refs->FindString( ARCHIVER_REFS_EXTRACT_EXT, index, &extension);
+		Refs->FindString( ARCHIVER_REFS_EXTRACT_TOOL, index, &tool);
+
+		BPath archive( &ref);
+		BPath parent;
+		archive.GetParent( &parent);
+
+		// directory named after archive, without extension - with counter, if it exists
+		char name[B_FILE_NAME_LENGTH];
+		char path[B_PATH_NAME_LENGTH];
+		strcpy( name, ref.name);
+		size_t namelen = strlen( name);
+		size_t extlen = strlen( extension);
+		if( extlen > 0 && namelen > extlen && !strcasecmp( name + namelen - extlen, extension))
+			name[namelen - extlen] = 0;
+
+		int32 i = 0;
+		sprintf( path, "%s/%s", parent.Path(), name);
+		BEntry entry;
+		while( entry.SetTo( path) == B_OK && entry.Exists())
+			sprintf( path, "%s/%s %" B_PRId32, parent.Path(), name, ++i);
+
+		BPath toolPath( tool);
+		if( !strcasecmp( extension, ".zip"))
+		{
+			ZipArchive zip;
+			int32 extracted = 0;
+			off_t bytes = 0;
+			zip.SetProgress( &View->aProgress);
+			if( ( status = zip.Open( archive.Path(), false)) == B_OK)
+				status = zip.Extract( path, threads, &View->aCancel, &extracted, &bytes);
+			total += extracted;
+			totalBytes += bytes;
+		}
+		else if( toolPath.Leaf() != NULL && !strcmp( toolPath.Leaf(), "tar"))
+		{
+			// delta is rebuilt to TAR by Archiver itself against full archive next to it, tar reads it from pipe
+			BString base;
+			app_info info;
+			BPath self;
+			bool delta = !strcasecmp( extension, ".tar.delta");
+			if( delta && ( status = find_delta_base( parent.Path(), name, &base)) != B_OK)
+				break;
+			if( delta && ( ( status = be_app->GetAppInfo( &info)) != B_OK || ( status = self.SetTo( &info.ref)) != B_OK))
+				break;
+
+			if( mkdir( path, 0755) != 0)
+			{
+				status = errno;
+				break;
+			}
+
+			thread_id threads[2];
+			int32 count = 0;
+			if( delta)
+			{
+				int fds[2];
+				if( ( status = make_pipe( fds)) != B_OK)
+					break;
+
+				const char *apply_v[] = { self.Path(), "--delta-apply", base.String(), archive.Path(), NULL };
+				const char *tar_v[] = { tool, "-x", "-f", "-", "-C", path, NULL };
+				threads[count] = launch_tool( 4, apply_v, -1, fds[1]);
+				if( threads[count] >= B_OK)
+					count++;
+				threads[count] = launch_tool( 6, tar_v, fds[0], -1);
+				if( threads[count] >= B_OK)
+					count++;
+				close( fds[0]);
+				close( fds[1]);
+				if( count < 2)
+				{
+					for( int32 stage = 0; stage < count; stage++)
+						kill_thread( threads[stage]);
+					status = B_ERROR;
+					break;
+				}
+			}
+			else
+			{
+				const char *arg_v[] = { tool, "-x", "-f", archive.Path(), "-C", path, NULL };
+				threads[count] = launch_tool( 6, arg_v, -1, -1);
+				if( threads[count] < B_OK)
+				{
+					status = threads[count];
+					break;
+				}
+				count++;
+			}
+
+			for( int32 stage = 0; stage < count; stage++)
+				resume_thread( threads[stage]);
+			status = wait_for_extract_tools( View, threads, count);
+			total++;
+		}
+		else
+			status = B_NOT_SUPPORTED;
 	}
+
+	bigtime_t time = system_time() - start;
+	char text[128];
+	if( totalBytes > 0)
+		sprintf( text, "Extracted %" B_PRId32 " files, %.1f MB in %.1fs", total, totalBytes / 1048576.0, time / 1000000.0);
+	else
+		sprintf( text, "Extracted %" B_PRId32 " archives in %.1fs", total, time / 1000000.0);
+	*report = text;
+	return status;
 }
 
 //---------------------------------------------------
-//	resize to widest View, move Views to their proper y
+//	Add refs to existing archive - only new members and central directory (ZIP)
+//	or end of archive (TAR) are written, archive is not recreated
+//	if it fails, or is cancelled, archive is put back as it was
 //---------------------------------------------------
-void
-ArchiverWindow::Reorganize()
+static status_t
+append_to_archive( ACompressView *View, BString *report)
 {
-	if( CountChildren() < 2 && !aSettingsSwitch->aState)
+	BMessage	*Refs = View->aRefs;
+	BMessage	*Settings = View->aSettings;
+	const char	*extension;
+	Settings->FindString( ARCHIVER_SETTINGS_FILE_EXT, &extension);
+	bool		zip = !strcasecmp( extension, ".zip");
+
+	// level from settings, but rules with "-0" store files, so keep doing it
+	int32		level = ARCHIVER_SETTINGS_LEVEL_DEF;
+	const char	*option;
+	Settings->FindInt32( ARCHIVER_SETTINGS_LEVEL, &level);
+	for( int32 index = 1; Settings->FindString( ARCHIVER_SETTINGS_OPTION, index, &option) == B_OK; index++)
 	{
-		LockLooper();
-		Quit();
-		return;
+		if( !strcmp( option, "-0"))
+			level = 0;
 	}
 
-	int32 index = 0;
-	AView *view;
-	float width = 0;
-	float vwidth = 0;
-	float height = 0;
-	float vheight = 0;
-
-	while( ( view = (AView*)ChildAt(index++)) != NULL)
+	ZipArchive	zipArchive;
+	TarArchive	tarArchive;
+	status_t	status = zip ? zipArchive.Open( View->aPath.Path(), true) : tarArchive.Open( View->aPath.Path());
+	if( status != B_OK)
+		return status;
+	zipArchive.SetProgress( &View->aProgress);
+	tarArchive.SetProgress( &View->aProgress);
+	View->aProgress.SetPhase( JOB_PHASE_WORKING);
+
+	// TAR stores other hard links of file as links anyway, identical files only if settings say so
+	// (extracted, they are hard links to one file - or symlinks in case of ZIP, which has no hard links)
+	bool		dedup = false;
+	Settings->FindBool( ARCHIVER_SETTINGS_DEDUP, &dedup);
+	FileSharing	sharing( !zip, dedup);
+	zipArchive.SetSharing( &sharing);
+	tarArchive.SetSharing( &sharing);
+	bigtime_t	start = system_time();
+
+	int32		before = zip ? zipArchive.CountEntries() : tarArchive.CountEntries();
+	entry_ref	ref;
+	BPath		path;
+	for( int32 index = 0; status == B_OK && Refs->FindRef( "refs", index, &ref) == B_OK; index++)
 	{
-		view->MoveTo( 0, height);
-		view->GetPreferredSize( &vwidth, &vheight);
-		if( width < vwidth) width = vwidth;
-		height += vheight;
+		if( ( status = path.SetTo( &ref)) != B_OK)
+			break;
+
+		if( zip)
+			status = zipArchive.AddPath( path.Path(), ref.name, level, &View->aCancel);
+		else
+			status = tarArchive.AddPath( path.Path(), ref.name, &View->aCancel);
 	}
-	ResizeTo( width, height);
-	index = 0;
-	while( ( view = (AView*)ChildAt(index++)) != NULL)
+
+	View->aProgress.SetPhase( JOB_PHASE_COMMITTING);
+	if( status == B_OK)
+		status = zip ? zipArchive.Commit() : tarArchive.Commit();
+	if( status != B_OK)
 	{
-		view->GetPreferredSize( &vwidth, &vheight);
-		view->ResizeTo( width, vheight);
+		if( zip)
+			zipArchive.Rollback();
+		else
+			tarArchive.Rollback();
+		return status;
 	}
-}
 
+	char text[B_FILE_NAME_LENGTH + 64];
+	sprintf( text, "Added %" B_PRId32 " entries to %s", ( zip ? zipArchive.CountEntries() : tarArchive.CountEntries()) - before, View->aPath.Leaf());
+	*report = text;
 
-//----------------------------------------------------------------------------
-//
-//	Functions :: ArchiverApp
-//
-//----------------------------------------------------------------------------
+	job_progress progress;
+	View->aProgress.Sample( &progress);
+	sharing.GetReport( report, progress.bytesIn, system_time() - start);
+	return B_OK;
+}
 
 //---------------------------------------------------
-//	Constructor - build and show ArchiverWindow
+//	True if job is one big file and rule is plain zip (only level and options which don't change archive)
+//	Archiver makes such archive itself, deflating file on all CPUs - zip would use one
+//	it doesn't write attributes (zip's BeOS extra field), so file mustn't have any, unless rule has "-X"
 //---------------------------------------------------
-ArchiverApp::ArchiverApp()
-	:BApplication( ARCHIVER_MIME_TYPE)
+static bool
+parallel_zip_job( ACompressView *View, int32 ref_c)
 {
-	// check if there is B_REFS_RECEIVED message waiting
-	// there should be one if Archiver was run as Tracker's Add-On
-	// or from "Open with..." and similar
-	BMessageQueue *msgqueue = MessageQueue();
-	if( msgqueue != NULL)
-	{
-		BMessage *msg = msgqueue->FindMessage( (uint32)B_REFS_RECEIVED);
-		// are there any refs to comress?
-		if( msg != NULL)
-		{
-			// check if there is ARCHIVER_REFS_DIR_REF (it will if Archiver was run as Add-On)
-			type_code typecode;
-			if (msg->GetInfo( ARCHIVER_REFS_DIR_REF, &typecode) != B_OK)
-			{
-				// it wasn't sent by Tracker Add-On, so Archiver must check dir_ref itself (by taking it from first entry_ref in refs)
-				entry_ref ref;
-				entry_ref dir_ref;
-				msg->FindRef( "refs", &ref);
-				BEntry refEntry( &ref);
-				BEntry dirEntry;
-				refEntry.GetParent( &dirEntry);
-				dirEntry.GetRef( &dir_ref);
-				msg->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
-			}
-			// uff... now run compression window :)
-			ArchiverWindow *Window = new ArchiverWindow( msg);
-			Window->Show();
+	BMessage *Settings = View->aSettings;
+	const char *extension;
+	if( ref_c != 1 || WorkerPool::Default()->CountWorkers() < 2
+		|| Settings->FindString( ARCHIVER_SETTINGS_FILE_EXT, &extension) != B_OK || strcasecmp( extension, ".zip"))
+		return false;
 
-			// remove message from queue since Archiver will parse it itself, not waiting for RefsReceived()
-			msgqueue->RemoveMessage( msg);
-		}
-		// nope - it was run by double click probably
-		else
+	const char *option;
+	bool attributes = true;
+	for( int32 index = 0; Settings->FindString( ARCHIVER_SETTINGS_OPTION, index, &option) == B_OK; index++)
+	{
+		if( index == 0)
 		{
-			// run settings window
-			ArchiverWindow *Window = new ArchiverWindow();
-			Window->Show();
+			BPath tool( option);
+			if( tool.Leaf() == NULL || strcmp( tool.Leaf(), "zip"))
+				return false;
 		}
+		else if( !strcmp( option, "-X"))
+			attributes = false;
+		else if( strcmp( option, "-r") && strcmp( option, "-y") && strcmp( option, "-q") && strcmp( option, "-@")
+			&& strcmp( option, ARCHIVER_SETTINGS_FILENAME) && strcmp( option, ARCHIVER_SETTINGS_FILELIST)
+			&& strcmp( option, "-" ARCHIVER_SETTINGS_LEVEL_OPTION)
+			&& strncmp( option, ARCHIVER_SETTINGS_MEMORY_OPTION, strlen( ARCHIVER_SETTINGS_MEMORY_OPTION))
+			&& !( option[0] == '-' && isdigit( option[1]) && option[2] == 0))
+			return false;
 	}
+
+	entry_ref ref;
+	BPath path;
+	struct stat st;
+	if( View->aRefs->FindRef( "refs", &ref) != B_OK || path.SetTo( &ref) != B_OK || lstat( path.Path(), &st) != 0
+		|| !S_ISREG( st.st_mode) || st.st_size < ARCHIVER_PARALLEL_ZIP_MINIMUM)
+		return false;
+
+	// attributes (MIME type too) are stored by zip, file which has them is left to it
+	BNode node( path.Path());
+	char name[B_ATTR_NAME_LENGTH];
+	return !attributes || ( node.InitCheck() == B_OK && node.GetNextAttrName( name) == B_ENTRY_NOT_FOUND);
 }
 
 //---------------------------------------------------
-//	Destructor
+//	Make ZIP archive of one file, deflated on all CPUs (see parallel_zip_job())
+//	archive which isn't finished is removed
 //---------------------------------------------------
-ArchiverApp::~ArchiverApp()
+static status_t
+make_parallel_zip( ACompressView *View, const char *archivePath, int32 level, BString *report)
 {
+	entry_ref	ref;
+	BPath		path;
+	status_t	status = View->aRefs->FindRef( "refs", &ref);
+	if( status == B_OK)
+		status = path.SetTo( &ref);
+	if( status != B_OK)
+		return status;
+
+	ZipArchive	archive;
+	if( ( status = archive.Create( archivePath)) != B_OK)
+		return status;
+
+	// disk images are often sparse, their holes aren't read
+	FileSharing	sharing( false, false);
+	archive.SetProgress( &View->aProgress);
+	archive.SetSharing( &sharing);
+	View->aProgress.SetPhase( JOB_PHASE_WORKING);
+
+	bigtime_t	start = system_time();
+	status = archive.AddPath( path.Path(), ref.name, level, &View->aCancel);
+	View->aProgress.SetPhase( JOB_PHASE_COMMITTING);
+	if( status == B_OK)
+		status = archive.Commit();
+	archive.Close();
+	if( status != B_OK)
+	{
+		unlink( archivePath);
+		return status;
+	}
+
+	struct stat st;
+	bigtime_t time = system_time() - start;
+	off_t size = stat( path.Path(), &st) == 0 ? st.st_size : 0;
+	char text[128];
+	sprintf( text, "Deflated %.1f MB on %" B_PRId32 " CPUs in %.1fs (%.1f MB/s)", size / 1048576.0,
+		WorkerPool::Default()->CountWorkers(), time / 1000000.0, time > 0 ? size / 1.048576 / time : 0.0);
+	*report = text;
+
+	job_progress progress;
+	View->aProgress.Sample( &progress);
+	sharing.GetReport( report, progress.bytesIn, time);
+	return B_OK;
 }
 
 //---------------------------------------------------
-//	New refs - add compression view
+//	Level of deflate which stands in for rule's tools when archive's size is estimated - 0 if rule doesn't compress
 //---------------------------------------------------
-void
-ArchiverApp::RefsReceived( BMessage *msg)
+static int32
+preflight_level( BMessage *Settings)
 {
-	type_code typecode;
-	if (msg->GetInfo( ARCHIVER_REFS_DIR_REF, &typecode) != B_OK)
+	const char *extension;
+	if( Settings->FindString( ARCHIVER_SETTINGS_FILE_EXT, &extension) == B_OK && !strcmp( extension, ".tar"))
+		return 0;
+
+	// rule may have it's level ("zip -9"), instead of "-LEVEL" from settings
+	const char *option;
+	for( int32 index = 0; Settings->FindString( ARCHIVER_SETTINGS_OPTION, index, &option) == B_OK; index++)
 	{
-		// it wasn't sent by Tracker Add-On, so Archiver must check dir_ref itself (by taking it from first entry_ref in refs)
-		entry_ref ref;
-		entry_ref dir_ref;
-		msg->FindRef( "refs", &ref);
-		BEntry refEntry( &ref);
-		BEntry dirEntry;
-		refEntry.GetParent( &dirEntry);
-		dirEntry.GetRef( &dir_ref);
-		msg->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+		if( option[0] == '-' && isdigit( option[1]) && option[2] == 0)
+			return option[1] - '0';
 	}
-	// run compression
-	ArchiverWindow *Window = (ArchiverWindow*)WindowAt( 0);
-	Window->LockLooper();
-	Window->Compress( msg);
-	Window->UnlockLooper();
-	Window->Activate( true);
-}
 
-
-//----------------------------------------------------------------------------
-//
-//	Functions :: Main
-//
-//----------------------------------------------------------------------------
+	int32 level = ARCHIVER_SETTINGS_LEVEL_DEF;
+	Settings->FindInt32( ARCHIVER_SETTINGS_LEVEL, &level);
+	return level;
+}
 
 //---------------------------------------------------
-//	Main Archiver function
+//	Check if archive fits on volume of directory, before tools start - job mustn't fill disk hours later
+//	files are only walked if they fit stored as they are, sampled otherwise
+//	returns B_DEVICE_FULL if archive surely doesn't fit, report tells why
 //---------------------------------------------------
-int
-main() 
+static status_t
+check_free_space( ACompressView *View, const char *directory, BString *report)
 {
-	ArchiverApp *app = new ArchiverApp();
-	app->Run();
-	
-	return( 0);
+	off_t free = Preflight::FreeSpace( directory);
+	if( free < 0)
+		return B_OK;
+
+	View->aProgress.SetPhase( JOB_PHASE_CHECKING);
+	Preflight preflight( preflight_level( View->aSettings));
+	entry_ref ref;
+	for( int32 index = 0; View->aRefs->FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		BPath path( &ref);
+		if( path.InitCheck() == B_OK)
+			preflight.AddPath( path.Path(), &View->aCancel);
+	}
+	// sizes are only partial when job was cancelled while walking
+	if( atomic_get( &View->aCancel))
+		return B_OK;
+
+	// most jobs end here
+	if( preflight.MaxSize() <= free)
+		return B_OK;
+	if( preflight.Sample( &View->aCancel) != B_OK)
+		return B_OK;
+
+	char text[192];
+	if( preflight.EstimateLow() > free)
+	{
+		sprintf( text, "Not started: archive would take about %.1f MB (%.1f - %.1f MB), only %.1f MB is free",
+			preflight.Estimate() / 1048576.0, preflight.EstimateLow() / 1048576.0, preflight.EstimateHigh() / 1048576.0, free / 1048576.0);
+		report->SetTo( text);
+		return B_DEVICE_FULL;
+	}
+	if( preflight.EstimateHigh() > free)
+	{
+		sprintf( text, "May not fit (%.1f - %.1f MB, %.1f MB free)",
+			preflight.EstimateLow() / 1048576.0, preflight.EstimateHigh() / 1048576.0, free / 1048576.0);
+		report->SetTo( text);
+
+		BMessage warning( ARCHIVER_MSG_PREFLIGHT);
+		warning.AddString( "warning", text);
+		BMessenger( View).SendMessage( &warning);
+	}
+	return B_OK;
 }
 
 //---------------------------------------------------
-//	Called by Tracker
+//	Memory team takes - all it's areas which are in RAM
 //---------------------------------------------------
-void process_refs( entry_ref dir_ref, BMessage *msg, void *)
+static int64
+team_memory( team_id team)
 {
-	// add dir_ref as ref - easier way to pass it to Archiver
-	msg->AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
-
-	// run Archiver
-	be_roster->Launch( ARCHIVER_MIME_TYPE, msg);
+	int64 memory = 0;
+	ssize_t cookie = 0;
+	area_info info;
+	while( get_next_area_info( team, &cookie, &info) == B_OK)
+		memory += info.ram_size;
+	return memory;
 }
 
 //---------------------------------------------------
 //	Launch Zip in new thread and return it's thread_id
+//	if rule is pipeline ("tar -c | zstd"), launch all of it's tools connected with pipes
 //---------------------------------------------------
 int32
 Compress( void *Data)
@@ -1483,12 +4145,10 @@ Compress( void *Data)
 
 	//
 	int32	ref_c = 0;	// refs count
-	int32	arg_c = 0;	// args (options for compression tool) count
 
-	// count Refs and arguments for compression tool
+	// count Refs
 	type_code typecode;
 	Refs->GetInfo( "refs", &typecode, &ref_c);
-	Settings->GetInfo( ARCHIVER_SETTINGS_OPTION, &typecode, &arg_c);
 
 	// if there is no refs return
 	if ( !ref_c)
@@ -1498,93 +4158,419 @@ Compress( void *Data)
 	BEntry	entry;
 	BPath	path;
 	
-	// set current directory, so compression tool will work from it
+	// directory compression tools will work from (jobs run at once, so it's set for each tool, not for Archiver)
 	entry_ref dir_ref;
 	Refs->FindRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
 	entry.SetTo( &dir_ref);
 	entry.GetPath( &path);
-	chdir( path.Path());
+	BString directory( path.Path());
 
 	// get file name for archive to be created
 	char	*filename;
 	Refs->FindString( ARCHIVER_REFS_ARCHIVE_NAME, (const char**)&filename);
 
+	// files are added to existing archive (or extracted) by Archiver itself
+	if( View->aAppend || View->aExtract)
+	{
+		BString report;
+		status_t result = View->aExtract ? extract_archives( View, &report) : append_to_archive( View, &report);
+
+		BMessage end( ARCHIVER_MSG_COMPRESS_END);
+		if( result != B_OK && View->aExtract)
+			report.SetTo( "Extraction failed: ") << strerror( result);
+		else if( result != B_OK)
+			report.SetTo( "Archive wasn't changed: ") << strerror( result);
+		end.AddString( "report", report.String());
+
+		if( View->aAppend)
+			update_mime_info( View->aPath.Path(), 0, 0, 0);
+
+		View->ReplyToClient( result);
+		BMessenger( View).SendMessage( &end);
+		return( 0);
+	}
+
+	// archive has to fit on it's volume
+	BString preflight;
+	if( filename[0] && check_free_space( View, path.Path(), &preflight) == B_DEVICE_FULL)
+	{
+		BMessage end( ARCHIVER_MSG_COMPRESS_END);
+		end.AddString( "report", preflight.String());
+		end.AddBool( "refused", true);
+		View->ReplyToClient( B_DEVICE_FULL);
+		BMessenger( View).SendMessage( &end);
+		return( 0);
+	}
+
+	// one big file with plain zip rule - Archiver deflates it itself, on all CPUs
+	if( filename[0] && parallel_zip_job( View, ref_c))
+	{
+		path.Append( filename);
+		BString report;
+		status_t result = make_parallel_zip( View, path.Path(), preflight_level( Settings), &report);
+
+		BMessage end( ARCHIVER_MSG_COMPRESS_END);
+		if( result != B_OK && result != B_CANCELED)
+			report.SetTo( "Archive wasn't made: ") << strerror( result);
+		if( preflight.Length() > 0)
+			report << "; " << preflight;
+		if( report.Length() > 0)
+			end.AddString( "report", report.String());
+
+		update_mime_info( path.Path(), 0, 0, 0);
+		View->ReplyToClient( result);
+		BMessenger( View).SendMessage( &end);
+		return( 0);
+	}
+
 	// if there there is name for created file, go with compression
 	if( filename[0])
 	{
-		int			arg_index = 0;
-		int			ref_index = 0;
-		entry_ref	ref;
-		
-		// = options + filenames
-		arg_c += ref_c;
+		char		**arg_v[ARCHIVER_MAX_STAGES];
+		int32		arg_c[ARCHIVER_MAX_STAGES];
+		bool		fileList;
+		bool		filenameFound;
+		// share CPUs between jobs running now, this one included
+		int32		jobs = atomic_add( &sRunningJobs, 1) + 1;
+		system_info	sysinfo;
+		int32		threads = 1;
+		if( get_system_info( &sysinfo) == B_OK && (int32)sysinfo.cpu_count > jobs)
+			threads = sysinfo.cpu_count / jobs;
+
+		int32		built_c = build_stages( Settings, Refs, filename, threads, arg_v, arg_c, &fileList, &filenameFound);
+		int32		stage_c = built_c;
+		int32		stage;
 
-		// allocate array of arguments - they will be passed to compression tool
-		// plus one - last must be NULL
-		char **arg_v = (char **)malloc( sizeof(char *) * (arg_c + 1));
-		
-		// parse arguments
-		char *temp;
-		int32 index = 0;
-		bool found = false; // remember if there was ARCHIVER_SETTINGS_FILENAME replaced already, so it will not compare strings in each loop
-		while( Settings->FindString( ARCHIVER_SETTINGS_OPTION, index++, (const char**)&temp) == B_OK)
+		path.Append( filename);
+
+		// pipe for list of files, write end stays only in Archiver
+		int list_pipe[2] = { -1, -1 };
+		if( fileList)
+			make_pipe( list_pipe);
+
+		// if none of tools was given "FILENAME", output of last one is written to archive
+		int output_fd = -1;
+		status_t	exec_thread_return_value = B_OK;
+		if( !filenameFound)
 		{
-			// if it's special arg ("FILENAME") then put filename of created archive instead of it
-			if( !found && !strcmp( temp, ARCHIVER_SETTINGS_FILENAME))
+			output_fd = open( path.Path(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+			if( output_fd < 0)
 			{
-				arg_v[arg_index++] = strdup( filename);
-				found = true;
+				// no tool is launched, list of files has no reader
+				exec_thread_return_value = errno;
+				stage_c = 0;
+				if( list_pipe[0] >= 0)
+					close( list_pipe[0]);
+				if( list_pipe[1] >= 0)
+					close( list_pipe[1]);
+				list_pipe[0] = list_pipe[1] = -1;
 			}
-			else
-				arg_v[arg_index++] = strdup( temp);
 		}
-				
-		// parse filenames
-		while( Refs->FindRef( "refs", ref_index++, &ref) == B_OK)
+
+		// output goes through Archiver, which writes it to archive and verifies it at the same time
+		bool		verify = false;
+		StreamVerifier	*verifier = NULL;
+		int			verify_pipe[2] = { -1, -1 };
+		Settings->FindBool( ARCHIVER_SETTINGS_VERIFY, &verify);
+		if( verify && output_fd >= 0 && make_pipe( verify_pipe) == B_OK)
 		{
-			// if user wants to store file paths there should be such option for compression tool :)
-			arg_v[arg_index++] = strdup( ref.name);
+			verifier = new StreamVerifier();
+			if( verifier->Start( verify_pipe[0], output_fd) == B_OK)
+				output_fd = verify_pipe[1];
+			else
+			{
+				delete verifier;
+				verifier = NULL;
+				close( verify_pipe[0]);
+				close( verify_pipe[1]);
+			}
 		}
-		
-		// last argument must be NULL
-		arg_v[arg_index] = NULL;
 
-		// launch compression tool in new thread
-		thread_id	exec_thread;
-		status_t	exec_thread_return_value;
+		// launch compression tools in new threads, each one reads output of previous one
+		thread_id	exec_threads[ARCHIVER_MAX_STAGES];
 		int32		exec_thread_priotity = B_NORMAL_PRIORITY;
+		int			stage_in = list_pipe[0];
 		
-		exec_thread = load_image( arg_c, (const char**) arg_v, (const char**) environ); 
+		for( stage = 0; stage < stage_c; stage++)
+		{
+			int stage_pipe[2] = { -1, -1 };
+			int stage_out = output_fd;
+			if( stage < stage_c - 1)
+			{
+				make_pipe( stage_pipe);
+				stage_out = stage_pipe[1];
+			}
 
-		rename_thread( exec_thread, "Archiver_compression_thread");
-		
-		if( Settings->FindInt32( ARCHIVER_SETTINGS_PRIORITY, &exec_thread_priotity) == B_OK)
-			set_thread_priority( exec_thread, exec_thread_priotity);
+			if( arg_c[stage] > 0)
+				exec_threads[stage] = launch_tool( arg_c[stage], (const char**) arg_v[stage], stage_in, stage_out, directory.String());
+			else
+				exec_threads[stage] = B_BAD_VALUE;
+
+			// tools have their copies now
+			if( stage_in >= 0)
+				close( stage_in);
+			if( stage_pipe[1] >= 0)
+				close( stage_pipe[1]);
+			stage_in = stage_pipe[0];
+
+			if( exec_threads[stage] < B_OK)
+			{
+				exec_thread_return_value = exec_threads[stage];
+				break;
+			}
+		}
+		if( stage_in >= 0)
+			close( stage_in);
+		if( output_fd >= 0)
+			close( output_fd);
+
+		// one of tools couldn't be loaded, kill those which were
+		if( stage < stage_c)
+		{
+			while( --stage >= 0)
+				kill_thread( exec_threads[stage]);
+			stage_c = 0;
+
+			if( list_pipe[1] >= 0)
+				close( list_pipe[1]);
+		}
+
+		// time and CPU usage of each stage, so it's visible which one is the bottleneck
+		bigtime_t	start_time = system_time();
+		bigtime_t	stage_time[ARCHIVER_MAX_STAGES];
+		bigtime_t	stage_cpu[ARCHIVER_MAX_STAGES];
+		bool		stage_done[ARCHIVER_MAX_STAGES];
+		int32		running = stage_c;
+
+		if( stage_c > 0)
+		{
+			BMessage msg( ARCHIVER_MSG_COMPRESS_THREAD_ID);
+			for( stage = 0; stage < stage_c; stage++)
+			{
+				rename_thread( exec_threads[stage], "Archiver_compression_thread");
+				
+				if( Settings->FindInt32( ARCHIVER_SETTINGS_PRIORITY, &exec_thread_priotity) == B_OK)
+					set_thread_priority( exec_threads[stage], exec_thread_priotity);
+
+				msg.AddInt32( "thread_id", exec_threads[stage]);
+
+				stage_time[stage] = 0;
+				stage_cpu[stage] = 0;
+				stage_done[stage] = false;
+			}
+
+			// send compression tools' thread_ids to ACompressView, so it can have some control
+			BMessenger( View).SendMessage( &msg);
+
+			for( stage = 0; stage < stage_c; stage++)
+				resume_thread( exec_threads[stage]);
+			View->aProgress.SetPhase( JOB_PHASE_WORKING);
+
+			if( list_pipe[1] >= 0)
+			{
+				BMessage *feed = new BMessage( *Refs);
+				feed->AddInt32( "list_fd", list_pipe[1]);
+				WorkerPool::Default()->SubmitBlocking( NULL, feed_file_list, (void*)feed);
+			}
+		}
+
+		// wait until all tools are finished, sample their CPU time meanwhile
+		// and keep them under limits from settings
+		Throttle throttle( Settings, View, path.Path());
+		bool canceled = false;
+		int64 peak_memory = 0;
+		int32 poll = 0;
+		while( running > 0)
+		{
+			// job was removed - tools are stopped here, Cancel() only tells to
+			if( View->aCancel && !canceled)
+			{
+				canceled = true;
+				throttle.Finish();
+				for( stage = 0; stage < stage_c; stage++)
+				{
+					if( !stage_done[stage])
+						send_signal( (pid_t)exec_threads[stage], SIGTERM);
+				}
+			}
 
-		// send compression tool's thread_id to ACompressView, so it can have some control
-		BMessage msg( ARCHIVER_MSG_COMPRESS_THREAD_ID);
-		msg.AddInt32( "thread_id", exec_thread);
-		BMessenger( View).SendMessage( &msg);
+			bigtime_t tools_cpu = 0;
+			for( stage = 0; stage < stage_c; stage++)
+			{
+				team_usage_info usage;
+				if( !stage_done[stage] && get_team_usage_info( exec_threads[stage], B_TEAM_USAGE_SELF, &usage) == B_OK)
+					stage_cpu[stage] = usage.user_time + usage.kernel_time;
+				tools_cpu += stage_cpu[stage];
+			}
+			throttle.Check( tools_cpu);
+
+			// memory of all tools together - window keeps it in budget, and next jobs of rule are known to take as much
+			if( poll++ % ARCHIVER_MEMORY_POLL == 0)
+			{
+				int64 memory = 0;
+				for( stage = 0; stage < stage_c; stage++)
+				{
+					if( !stage_done[stage])
+						memory += team_memory( exec_threads[stage]);
+				}
+				View->aProgress.SetMemory( memory);
+				if( memory > peak_memory)
+					peak_memory = memory;
+			}
+
+			// tools don't report progress, archive's size is all there is to show
+			struct stat st;
+			if( stat( path.Path(), &st) == 0)
+				View->aProgress.SetOut( st.st_size);
 
-		// resume exec_thread, and wait until it's finished
-		wait_for_thread( exec_thread, &exec_thread_return_value);
+			// wait a moment for first running stage, just check the others
+			bool waited = false;
+			for( stage = 0; stage < stage_c; stage++)
+			{
+				if( stage_done[stage])
+					continue;
+
+				status_t return_value;
+				status_t status = wait_for_thread_etc( exec_threads[stage], B_RELATIVE_TIMEOUT, waited ? 0 : ARCHIVER_STAGE_POLL, &return_value);
+				waited = true;
+				if( status == B_OK || status == B_BAD_THREAD_ID)
+				{
+					stage_done[stage] = true;
+					stage_time[stage] = system_time() - start_time;
+					running--;
+
+					// whole job failed if any of stages failed
+					if( status == B_OK && return_value != 0 && exec_thread_return_value == B_OK)
+						exec_thread_return_value = return_value;
+				}
+			}
+		}
 
 		// compression finished (or killed... whatever)
-		// free allocated memory
-		while ( --arg_c >= 0)
-			free( arg_v[arg_c]);
+		throttle.Finish();
 
-		free( arg_v);
+		// delete not finished file if it was left by compressing application
+		if( canceled)
+		{
+			BEntry archive( path.Path());
+			if( archive.Exists())
+				archive.Remove();
+		}
+
+		// make report about stages of pipeline
+		BMessage end( ARCHIVER_MSG_COMPRESS_END);
+		View->aProgress.SetMemory( 0);
+		if( !canceled && peak_memory > 0)
+			end.AddInt64( "memory", peak_memory);
+		BString report;
+		if( stage_c == 0 && exec_thread_return_value != B_OK)
+			report << "Archive wasn't made: " << strerror( exec_thread_return_value);
+		if( stage_c > 1)
+		{
+			report << "CPU time:";
+			int32 slowest = 0;
+			for( stage = 0; stage < stage_c; stage++)
+			{
+				BPath tool( arg_v[stage][0]);
+				char text[B_FILE_NAME_LENGTH + 64];
+				sprintf( text, "%s %s %.1fs (done at %.1fs)", stage ? "," : "", tool.Leaf() ? tool.Leaf() : arg_v[stage][0],
+					stage_cpu[stage] / 1000000.0, stage_time[stage] / 1000000.0);
+				report << text;
+
+				if( stage_cpu[slowest] < stage_cpu[stage])
+					slowest = stage;
+			}
+			BPath tool( arg_v[slowest][0]);
+			report << ", slowest: " << ( tool.Leaf() ? tool.Leaf() : arg_v[slowest][0]);
+		}
+
+		// verifier finishes with last stage, unless it's slower than whole pipeline
+		if( verifier != NULL)
+		{
+			bigtime_t	wait_time = system_time();
+			View->aProgress.SetPhase( JOB_PHASE_VERIFYING);
+			status_t	verified = verifier->Wait();
+			bigtime_t	job_time = system_time() - start_time;
+			wait_time = system_time() - wait_time;
+
+			char text[128];
+			if( report.Length() > 0)
+				report << "; ";
+			if( verifier->Format() == NULL)
+				report << "not verified (unknown format)";
+			else if( verified == B_BAD_DATA)
+			{
+				report << "VERIFICATION FAILED, " << verifier->Format() << " data is damaged";
+				end.AddBool( "damaged", true);
+			}
+			else if( verified != B_OK)
+				report << "verification failed: " << strerror( verified);
+			else
+			{
+				sprintf( text, "%s verified, %.1fs CPU (%.0f%% of job time, %.1fs waited)", verifier->Format(),
+					verifier->CheckTime() / 1000000.0, job_time > 0 ? verifier->CheckTime() * 100.0 / job_time : 0.0, wait_time / 1000000.0);
+				report << text;
+			}
+
+			if( verified != B_OK && exec_thread_return_value == B_OK)
+				exec_thread_return_value = verified;
+			delete verifier;
+		}
+		if( preflight.Length() > 0)
+		{
+			struct stat st;
+			char text[64];
+			if( stat( path.Path(), &st) == 0)
+				sprintf( text, ", made %.1f MB", st.st_size / 1048576.0);
+			else
+				text[0] = 0;
+			if( report.Length() > 0)
+				report << "; ";
+			report << preflight << text;
+		}
+		if( throttle.PausedTime() > 0)
+		{
+			char text[64];
+			sprintf( text, "%sthrottled %.1fs", report.Length() > 0 ? "; " : "", throttle.PausedTime() / 1000000.0);
+			report << text;
+		}
+		if( report.Length() > 0)
+			end.AddString( "report", report.String());
+
+		// shape and time of job go to trace, it can be replayed later
+		bool record = false;
+		Settings->FindBool( ARCHIVER_SETTINGS_RECORD, &record);
+		if( record && !canceled && stage_c > 0)
+		{
+			bigtime_t tools_cpu = 0;
+			for( stage = 0; stage < stage_c; stage++)
+				tools_cpu += stage_cpu[stage];
+			job_trace_submit( Settings, Refs, path.Path(), preflight_level( Settings), system_time() - start_time,
+				tools_cpu, exec_thread_return_value);
+		}
+
+		// free allocated memory
+		for( stage = 0; stage < built_c; stage++)
+		{
+			for( int32 index = 0; index < arg_c[stage]; index++)
+				free( arg_v[stage][index]);
+			free( arg_v[stage]);
+		}
 		
 		// update file's mime type
 		// it doesn't matter if compression finished successfully (file is there)
 		// even if not - nothing happens :)
-		path.Append( filename);
 		update_mime_info( path.Path(), 0, 0, 0);
 
+		atomic_add( &sRunningJobs, -1);
+
+		// let client waiting for this job know about result
+		View->ReplyToClient( canceled ? B_CANCELED : exec_thread_return_value);
+
 		// let ACompressView know compression has been finished/killed/etc...
-		BMessenger( View).SendMessage( ARCHIVER_MSG_COMPRESS_END);
+		BMessenger( View).SendMessage( &end);
 		
 		return( 0);
 	}
+	return( -1);
 }
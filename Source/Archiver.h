@@ -32,27 +32,39 @@ SOFTWARE
 
 #include <Alert.h>
 #include <Application.h>
+#include <Autolock.h>
 #include <Bitmap.h>
 #include <Box.h>
 #include <Button.h>
 #include <CheckBox.h>
+#include <ControlLook.h>
 #include <Entry.h>
 #include <GraphicsDefs.h>
+#include <List.h>
+#include <Locker.h>
 #include <Menu.h>
 #include <MenuBar.h>
 #include <MenuItem.h>
 #include <MenuField.h>
 #include <MessageQueue.h>
+#include <MessageRunner.h>
 #include <Path.h>
+#include <PopUpMenu.h>
 #include <RadioButton.h>
 #include <Roster.h>
+#include <ScrollBar.h>
 #include <StorageKit.h>
+#include <String.h>
 #include <StringView.h>
 #include <View.h>
 #include <Window.h>
 
 #include <os/add-ons/tracker/TrackerAddOn.h>
 
+#include "ArchiverService.h"
+#include "Progress.h"
+#include "WorkerPool.h"
+
 //----------------------------------------------------------------------------
 //
 //	Define
@@ -65,6 +77,9 @@ SOFTWARE
 #define	ARCHIVER_SETTINGS_FILE			"archiver.settings"
 #define	ARCHIVER_RULES_FILE_PATH		"/boot/home/config/etc/"
 #define	ARCHIVER_RULES_FILE				"archiver.rules"
+#define	ARCHIVER_SERVICE_SOCKET_PATH	"/tmp/"
+#define	ARCHIVER_SERVICE_DIRECTORY		"archiver-%d"
+#define	ARCHIVER_SERVICE_SOCKET			"archiver.socket"
 
 #define	ARCHIVER_SETTINGS_FILE_DESC		"file description"				// "ZIP compressed file"
 #define	ARCHIVER_SETTINGS_FILE_DESC2	"file variation"				// "maximum compression"
@@ -72,20 +87,88 @@ SOFTWARE
 #define	ARCHIVER_SETTINGS_FILE_EXT		"file extension"				// ".zip"
 #define	ARCHIVER_SETTINGS_OPTION		"arg_v"							// "-9", "-r", "-y"...
 #define	ARCHIVER_SETTINGS_FILENAME		"FILENAME"						// this will be replaced by generated name for archive file (i.e. "Archive.zip")
+#define	ARCHIVER_SETTINGS_FILELIST		"FILELIST"						// tool reads names of files from stdin, they are not put in arguments
+#define	ARCHIVER_SETTINGS_PIPE			"|"								// starts next stage of pipeline (i.e. "tar -c | zstd")
+#define	ARCHIVER_SETTINGS_THREADS		"THREADS"						// replaced by number of threads tool can use without oversubscribing CPUs
+#define	ARCHIVER_SETTINGS_LEVEL_OPTION	"LEVEL"							// replaced by compression level chosen in settings
+#define	ARCHIVER_SETTINGS_BASE			"BASE"							// replaced by path of full archive, delta is made against (i.e. "name.tar" for "name.tar.delta")
+#define	ARCHIVER_SETTINGS_SELF			"ARCHIVER"						// replaced by path of Archiver, for its own tools (i.e. "ARCHIVER --gzip-seekable")
+#define	ARCHIVER_SETTINGS_MEMORY_OPTION	"MEMORY="						// "MEMORY=700" - tool takes up to 700MB, it's not passed to tool
+#define	ARCHIVER_SETTINGS_LEVEL			"compression level"				// 1 (fastest) - 9 (best)
+#define	ARCHIVER_SETTINGS_LEVEL_DEF		6
 #define	ARCHIVER_SETTINGS_PRIORITY		"compression thread priority"	// speaks for itself ;]
 #define	ARCHIVER_SETTINGS_WIN_POS		"windowPosition"				// keeps Archiver's window's position on screen
 #define	ARCHIVER_SETTINGS_CLOSE_WIN		"closeWindow"					// close window after comression?
+#define	ARCHIVER_SETTINGS_COALESCE		"coalesceDelay"					// drops onto same directory within this many ms make one archive (0 = off)
+#define	ARCHIVER_SETTINGS_COALESCE_DEF	500								// delay used when coalescing is switched on in settings
+#define	ARCHIVER_SETTINGS_APPEND		"appendToArchive"				// if one of dropped files is archive of chosen type, add the rest to it
+#define	ARCHIVER_SETTINGS_DEDUP			"storeCopiesAsLinks"			// files added to archive which are the same as one added before are links to it
+#define	ARCHIVER_SETTINGS_EXTRACT		"extractArchives"				// if all dropped files are archives known from rules, extract them
+#define	ARCHIVER_SETTINGS_VERIFY		"verifyArchive"					// decompress output of pipeline while it's written, to check it
+#define	ARCHIVER_SETTINGS_WRITE_LIMIT	"writeLimit"					// MB/s one job may write (0 = no limit)
+#define	ARCHIVER_SETTINGS_GLOBAL_WRITE_LIMIT	"globalWriteLimit"		// MB/s all jobs together may write (0 = no limit)
+#define	ARCHIVER_SETTINGS_CPU_SHARE		"cpuShare"						// % of all CPUs tools of one job may use (0 = no limit)
+#define	ARCHIVER_SETTINGS_PAUSE_BUSY	"pauseWhenBusy"					// pause jobs while other programs keep CPUs or disk busy
+#define	ARCHIVER_SETTINGS_MAX_JOBS		"maxJobs"						// jobs running at once, the rest waits in queue (0 = no limit)
+#define	ARCHIVER_SETTINGS_MEMORY_BUDGET	"memoryBudget"					// MB tools of all running jobs may take (0 = what is free)
+#define	ARCHIVER_SETTINGS_RULE_MEMORY	"ruleMemory"					// peak memory measured for each rule (int64 by rule's description)
+#define	ARCHIVER_SETTINGS_SPLIT			"splitJobs"						// one archive of all dropped files, or ARCHIVER_SPLIT_* for each of them
+#define	ARCHIVER_SETTINGS_RECORD		"recordJobs"					// shape and time of each job is added to trace, for "--replay"
+
+#define	ARCHIVER_SPLIT_NONE				0				// one archive of all dropped files
+#define	ARCHIVER_SPLIT_ITEMS			1				// archive for each dropped file or folder
+#define	ARCHIVER_SPLIT_SUBFOLDERS		2				// archive for each folder in dropped folders (their files make one more)
+
+#define	ARCHIVER_MAX_STAGES				8				// max number of tools in pipeline
+#define	ARCHIVER_PIPE_SIZE				(1024 * 1024)	// requested size of pipe between stages, if system allows it
+#define	ARCHIVER_STAGE_POLL				100000			// how often CPU time of pipeline stages is sampled
+#define	ARCHIVER_PARALLEL_ZIP_MINIMUM	(64 * 1024 * 1024)	// single file this big is zipped by Archiver, on all CPUs
+
+#define	ARCHIVER_JOB_LIST_ROWS			8				// jobs visible in window at once, the rest is scrolled to
+#define	ARCHIVER_JOB_TEXT_WIDTH			280				// width of job's text, if all of them are shorter
+#define	ARCHIVER_JOB_TEXT_MAX_WIDTH		640				// ... and if some are longer (report of finished job), they are truncated
+#define	ARCHIVER_PROGRESS_INTERVAL		16667			// how often visible jobs' progress is sampled (display refresh, 60 Hz)
+
+#define	ARCHIVER_READAHEAD_BUDGET		(256 * 1024 * 1024)	// most of next queued job's files read into cache (and 1/4 of free memory at most)
+#define	ARCHIVER_READAHEAD_BLOCK		(1024 * 1024)
+#define	ARCHIVER_MEMORY_RESERVE			(128 * 1024 * 1024)	// memory left to the rest of system, when budget is what is free
+#define	ARCHIVER_MEMORY_POLL			5				// tools' memory is measured each 5th time pipeline is sampled
 
 #define	ARCHIVER_REFS_DIR_REF			"dir_ref"
 #define	ARCHIVER_REFS_ARCHIVE_NAME		"ArchiveName"
+#define	ARCHIVER_REFS_WAIT				"wait"			// client submitting job wants to know when it's done
+#define	ARCHIVER_REFS_REPLY_FD			"reply_fd"		// connection to client waiting for job result
+#define	ARCHIVER_REFS_APPEND_TO			"append_to"		// existing archive to which refs are added
+#define	ARCHIVER_REFS_EXTRACT_EXT		"extract_ext"	// extension of each archive to extract, from rules
+#define	ARCHIVER_REFS_EXTRACT_TOOL		"extract_tool"	// tool of rule each archive was made by
+#define	ARCHIVER_REFS_BASE				"base"			// full archive, for rules which make delta against it
+#define	ARCHIVER_REFS_NO_READAHEAD		"no_readahead"	// files of job aren't read ahead while it's queued ("--bench-queue")
+#define	ARCHIVER_REFS_RULE				"rule"			// settings of rule job is made with, instead of those chosen ("--replay")
 
 #define	ARCHIVER_MSG_CHANGE_RULE		'ARCG'	// Archiver - Rule ChanGe
 #define ARCHIVER_MSG_CHANGE_CLOSE_WIN	'ACCW'	// Archiver - Change Close Window after compression
+#define ARCHIVER_MSG_CHANGE_COALESCE	'ACCD'	// Archiver - Change Coalescing of Drops
+#define ARCHIVER_MSG_CHANGE_LEVEL		'ACCL'	// Archiver - Change Compression Level
+#define ARCHIVER_MSG_CHANGE_APPEND		'ACAA'	// Archiver - Change Append to Archive
+#define ARCHIVER_MSG_CHANGE_DEDUP		'ACDF'	// Archiver - Change Duplicate Files stored as links
+#define ARCHIVER_MSG_CHANGE_EXTRACT		'ACEA'	// Archiver - Change Extracting of Archives
+#define ARCHIVER_MSG_CHANGE_VERIFY		'ACVA'	// Archiver - Change Verifying of Archive
+#define ARCHIVER_MSG_CHANGE_LIMIT		'ACLM'	// Archiver - Change LiMit ("setting" to change, "value")
+#define ARCHIVER_MSG_CHANGE_PAUSE_BUSY	'ACPB'	// Archiver - Change Pausing while system is Busy
+#define ARCHIVER_MSG_CHANGE_RECORD		'ACRJ'	// Archiver - Change Recording of Jobs
 #define	ARCHIVER_MSG_ACCEPT				'AACC'	// Archiver - ACCept
 #define	ARCHIVER_MSG_COMPRESS_THREAD_ID	'ACTI'	// Archiver - CompressThreadId
 #define	ARCHIVER_MSG_COMPRESS_END		'ACHF'	// Archiver - Compression Has been Finished
+#define	ARCHIVER_MSG_JOB_LEFT			'AJLF'	// Archiver - Job's task Left it (Compress() or read ahead returned)
+#define	ARCHIVER_MSG_THROTTLE			'ATHR'	// Archiver - THRottled job paused ("reason") or resumed
 #define ARCHIVER_MSG_STOP				'ASTC'	// Archiver - STop Compression
-#define ARCHIVER_MSG_REMOVE_AVIEW		'ARAV'	// Archiver - Remove AView
+#define ARCHIVER_MSG_REMOVE_AVIEW		'ARAV'	// Archiver - Remove AView ("view"), or job ("job")
+#define ARCHIVER_MSG_REORGANIZE			'AREO'	// Archiver - REOrganize window, after all jobs added or removed meanwhile
+#define ARCHIVER_MSG_PROGRESS			'APRG'	// Archiver - sample PRoGress of visible jobs
+#define ARCHIVER_MSG_FLUSH_DROPS		'AFDR'	// Archiver - Flush coalesced DRops
+#define ARCHIVER_MSG_START_JOBS			'ASTJ'	// Archiver - STart queued Jobs, one of running ones has ended
+#define ARCHIVER_MSG_RULE_MEMORY		'ARUM'	// Archiver - Rule Used Memory ("rule", "memory" - peak of it's tools)
+#define ARCHIVER_MSG_PREFLIGHT			'ARPF'	// Archiver - PreFlight ("warning" - archive may not fit on volume)
 
 
 //----------------------------------------------------------------------------
@@ -127,27 +210,152 @@ class AView : public BView
 };
 
 //---------------------------------------------------
-//	Archiver Comression view
+//	Settings jobs were started with - one copy shared by all jobs started before settings changed
 //---------------------------------------------------
-class ACompressView : public AView
+class AJobSettings
 {
 	public:
-							ACompressView( BMessage *refs, BMessage *settings);
+							AJobSettings( BMessage *settings) : aSettings( *settings), aReferences( 1) {};
+
+		AJobSettings		*Acquire() { atomic_add( &aReferences, 1); return this; };
+		void				Release() { if( atomic_add( &aReferences, -1) == 1) delete this; };
+
+		BMessage			aSettings;
+
+	private:
+		int32				aReferences;
+};
+
+class AJobListView;
+
+//---------------------------------------------------
+//	Archiver Comression job - one row of AJobListView, it has no views nor bitmaps of it's own
+//---------------------------------------------------
+class ACompressView : public BHandler
+{
+	public:
+							ACompressView( BMessage *refs, AJobSettings *settings);
 							~ACompressView();
-		void				AttachedToWindow();
-		void				DetachedFromWindow();
+		void				Start();
+		void				ReadAhead();
+		bool				Cancel();
 		void				MessageReceived( BMessage *msg);
+		const char			*Title() const { return aTitle; };
+		void				GetText( BString *text) const;
+		bool				IsStarted() const { return aStarted; };
+		int64				MemoryNeeded() const { return aMemoryNeeded; };
+		int64				MemoryReserved() { return aMemoryReserved > aProgress.Memory() ? aMemoryReserved : aProgress.Memory(); };
+		bool				IsRunning() const { return aStarted && !aEnded; };
+		bool				IsFinished() const { return aFinished; };
+		bool				SampleProgress();
 		void				GenerateAName( BPath *result);
+		bool				FindAppendTarget( BPath *result);
+		bool				FindExtractRules();
 		thread_id			GetCompressThread();
 		bool				Stop();
+		bool				SuspendTools();
+		bool				ResumeTools( bool force = false);
+		void				SignalTools( uint32 signal);
+		void				ReplyToClient( status_t result);
 
-		BStringView			*aText;
+		AJobSettings		*aJobSettings;
+		BMessage			*aSettings;		// settings of aJobSettings
 		BMessage			*aRefs;
 		int32				aRefsCount;
 		BPath				aPath;
 
-		thread_id			aCompressThread;
-		thread_id			aCompressWatcherThread;
+		thread_id			aCompressThreads[ARCHIVER_MAX_STAGES];
+		int32				aCompressThreadCount;
+		TaskGroup			aDriver;		// Compress() of this job, job can't be deleted until it's done
+		TaskGroup			aReadAheadTask;
+		int32				aReadAheadStop;	// set when job starts, or is removed while queued
+		int32				aSuspendCount;	// Stop() and Throttle may suspend tools at the same time
+		int32				aRunning;		// Compress() and read ahead which didn't leave job yet
+		bool				aRemoved;		// removed from list while aRunning, deleted when it drops to 0
+
+		bool				aAppend;		// files are added to existing archive aPath by Archiver itself
+		bool				aExtract;		// refs are archives, Archiver extracts them itself (or with tar)
+		int32				aCancel;		// set to stop adding
+
+		int32				aReplyFd;
+
+		BString				aRule;			// description of rule, measured memory is kept by it
+		int64				aMemoryNeeded;	// declared by rule ("MEMORY=")
+		int64				aMemoryReserved;	// taken from budget of memory when job started
+		bool				aWaitingForMemory;
+
+		JobProgress			aProgress;		// updated by threads doing the job
+		job_progress		aShown;			// aProgress when it was sampled last time
+
+		AJobListView		*aList;			// list job is shown in
+		const char			*aTitle;
+		BString				aStatus;		// shown instead of archive's name - report of finished job, reason of pause
+		BString				aWarning;		// shown before job's text - archive may not fit
+		bool				aStarted;		// false while job waits in queue
+		bool				aReadAheadStarted;
+		bool				aEnded;			// Compress() is done, job doesn't count as running
+		bool				aFinished;
+};
+
+//---------------------------------------------------
+//	Scroll bar of job list - it scrolls by rows, list view itself doesn't move
+//---------------------------------------------------
+class AJobScrollBar : public BScrollBar
+{
+	public:
+							AJobScrollBar( AJobListView *list);
+		void				ValueChanged( float value);
+
+	private:
+		AJobListView		*aList;
+};
+
+//---------------------------------------------------
+//	Archiver Job List - all jobs in one view, only visible rows are drawn
+//---------------------------------------------------
+class AJobListView : public AView
+{
+	public:
+							AJobListView();
+							~AJobListView();
+		void				AttachedToWindow();
+		void				DetachedFromWindow();
+		void				Draw( BRect updateRect);
+		void				FrameResized( float width, float height);
+		void				MouseDown( BPoint point);
+		void				MouseMoved( BPoint point, uint32 code, const BMessage *dragMessage);
+		void				MouseUp( BPoint point);
+		void				MessageReceived( BMessage *msg);
+
+		void				AddJob( ACompressView *job);
+		bool				RemoveJob( ACompressView *job);
+		ACompressView		*JobAt( int32 index) const { return (ACompressView*)aJobs.ItemAt( index); };
+		int32				CountJobs() const { return aJobs.CountItems(); };
+		void				JobChanged( ACompressView *job);
+		void				UpdateSize();
+		void				ScrollToRow( int32 row);
+
+	private:
+		BRect				RowFrame( int32 index) const;
+		BRect				ButtonFrame( int32 index) const;
+		int32				RowAt( BPoint point) const;
+		const BBitmap		*IconFor( ACompressView *job);
+		float				TextWidth( ACompressView *job);
+
+		BList				aJobs;
+		BMessage			aIcons;			// icon (BBitmap pointer, or NULL if there is none) for each mime type
+		AJobScrollBar		*aScrollBar;
+		BMessageRunner		*aProgressRunner;
+		bool				aScrolling;		// aScrollBar is shown
+		int32				aFirstRow;		// first visible row
+		float				aRowHeight;
+		float				aButtonWidth;
+		float				aButtonHeight;
+		float				aTextWidth;		// widest text of jobs so far
+		ACompressView		*aPressed;		// job which button is pressed
+		bool				aPressedInside;
+
+		typedef AView _inherited;
 };
 
 //---------------------------------------------------
@@ -163,7 +371,7 @@ class ASettingsView : public AView
 		void				FrameResized( float width, float height);
 		void				MessageReceived( BMessage *msg);
 
-		BMessage			*LoadRules();
+		static BMessage		*LoadRules();
 		void				ChangeSettingsRule();
 		void				RedrawIcon();
 
@@ -172,6 +380,20 @@ class ASettingsView : public AView
 
 		BBox				*aRulesBox;
 		BCheckBox			*aCheckBox;
+		BCheckBox			*aCoalesceCheckBox;
+		BCheckBox			*aAppendCheckBox;
+		BCheckBox			*aDedupCheckBox;
+		BCheckBox			*aExtractCheckBox;
+		BCheckBox			*aVerifyCheckBox;
+		BCheckBox			*aPauseBusyCheckBox;
+		BCheckBox			*aRecordCheckBox;
+		BMenuField			*aLevelField;
+		BMenuField			*aWriteLimitField;
+		BMenuField			*aGlobalWriteLimitField;
+		BMenuField			*aCpuShareField;
+		BMenuField			*aMaxJobsField;
+		BMenuField			*aSplitField;
+		BMenuField			*aMemoryBudgetField;
 };
 
 //---------------------------------------------------
@@ -205,7 +427,7 @@ class ASettingsSwitch : public AView
 class ArchiverWindow : public BWindow
 {
 	public:
-						ArchiverWindow( BMessage *refs = NULL);
+						ArchiverWindow( BMessage *refs = NULL, bool service = false);
 						~ArchiverWindow();
 		void			MessageReceived( BMessage *msg);
 		bool			QuitRequested();
@@ -215,15 +437,30 @@ class ArchiverWindow : public BWindow
 		void			Reorganize();
 		
 		BMessage		*GetSettings() { return aSettings; };
+		void			ScheduleReorganize();
 		
 	private:
+		void			StartJob( BMessage *refs);
+		void			SplitJob( BMessage *refs, int32 split, BList *jobs);
+		void			StartQueuedJobs();
+		int64			JobMemory( ACompressView *job);
+		void			CoalesceDrop( BMessage *msg, int32 delay);
+		void			FlushDrops( BMessage *batch);
+
 		void			LoadSettings();
 		void			LoadDefaultSettings();
 		void			SaveSettings();
 
 		ASettingsSwitch	*aSettingsSwitch;
+		AJobListView	*aJobList;		// child of window only while there are jobs
+		bool			aReorganizePending;
 
 		BMessage		*aSettings;
+		AJobSettings	*aJobSettings;	// copy of aSettings for new jobs, until they change
+		bool			aService;
+
+		BList			aDropBatches;	// BMessages with refs waiting for more drops
+		BList			aRemovedJobs;	// jobs removed from list, their tasks didn't leave them yet
 
 		typedef BWindow _inherited;
 };
@@ -234,9 +471,12 @@ class ArchiverWindow : public BWindow
 class ArchiverApp : public BApplication
 {
 	public:
-						ArchiverApp();
+						ArchiverApp( int argc, char **argv);
 						~ArchiverApp();
 		void			RefsReceived( BMessage *msg);
+
+	private:
+		ArchiverService	*aService;
 };
 
 //----------------------------------------------------------------------------
@@ -245,6 +485,10 @@ class ArchiverApp : public BApplication
 //
 //----------------------------------------------------------------------------
 
-int32	Compress( void *Data);
+int32		Compress( void *Data);
+int32		ReadAheadFiles( void *Data);
+thread_id	launch_tool( int32 arg_c, const char **arg_v, int stdin_fd, int stdout_fd, const char *directory = NULL);
+status_t	make_pipe( int fds[2]);
+BMessage	*RefsFromArgs( int argc, char **argv);
 
 #endif /*__ARCHIVER_H_*/
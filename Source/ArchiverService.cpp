@@ -0,0 +1,699 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "ArchiverService.h"
+#include "Archiver.h"
+
+
+#include <ctype.h>
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+
+#ifndef MSG_NOSIGNAL
+#define MSG_NOSIGNAL 0
+#endif
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: helpers
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Read exactly size bytes, return false on EOF or error
+//---------------------------------------------------
+static bool
+read_fully( int fd, void *buffer, size_t size)
+{
+	char *data = (char*)buffer;
+	while( size > 0)
+	{
+		ssize_t bytes = read( fd, data, size);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes <= 0)
+			return false;
+		data += bytes;
+		size -= bytes;
+	}
+	return true;
+}
+
+//---------------------------------------------------
+//	Write exactly size bytes, return false on error
+//---------------------------------------------------
+static bool
+write_fully( int fd, const void *buffer, size_t size)
+{
+	const char *data = (const char*)buffer;
+	while( size > 0)
+	{
+		// Tracker submits jobs too, it must not get SIGPIPE if service goes away
+		ssize_t bytes = send( fd, data, size, MSG_NOSIGNAL);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes <= 0)
+			return false;
+		data += bytes;
+		size -= bytes;
+	}
+	return true;
+}
+
+//---------------------------------------------------
+//	Connect to running service, return socket or -1
+//---------------------------------------------------
+static int
+connect_service()
+{
+	BPath path;
+	if( ArchiverService::GetSocketPath( &path) != B_OK)
+		return -1;
+
+	// socket must be made by service of the same user
+	struct stat st;
+	if( lstat( path.Path(), &st) < 0 || !S_ISSOCK( st.st_mode) || st.st_uid != getuid())
+		return -1;
+
+	struct sockaddr_un address;
+	memset( &address, 0, sizeof( address));
+	address.sun_family = AF_UNIX;
+	strlcpy( address.sun_path, path.Path(), sizeof( address.sun_path));
+
+	int fd = socket( AF_UNIX, SOCK_STREAM, 0);
+	if( fd < 0)
+		return -1;
+
+	if( connect( fd, (struct sockaddr*)&address, sizeof( address)) < 0)
+	{
+		close( fd);
+		return -1;
+	}
+	return fd;
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: ArchiverService
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+ArchiverService::ArchiverService()
+	:aSocket( -1),
+	aListenThread( -1)
+{
+}
+
+//---------------------------------------------------
+//	Destructor - close socket and remove it from disk
+//---------------------------------------------------
+ArchiverService::~ArchiverService()
+{
+	Stop();
+}
+
+//---------------------------------------------------
+//	Make path to socket file, it lives in directory
+//	which only current user can access, so nobody else
+//	can submit jobs or take socket name first
+//---------------------------------------------------
+status_t
+ArchiverService::GetSocketPath( BPath *result, bool create)
+{
+	if( find_directory( B_SYSTEM_TEMP_DIRECTORY, result) != B_OK)
+		result->SetTo( ARCHIVER_SERVICE_SOCKET_PATH);
+
+	char name[B_FILE_NAME_LENGTH];
+	snprintf( name, sizeof( name), ARCHIVER_SERVICE_DIRECTORY, (int)getuid());
+	result->Append( name);
+
+	if( create && mkdir( result->Path(), 0700) < 0 && errno != EEXIST)
+		return errno;
+
+	// directory made by someone else (or symlink to it) can't be trusted
+	struct stat st;
+	if( lstat( result->Path(), &st) < 0)
+		return errno;
+	if( !S_ISDIR( st.st_mode) || st.st_uid != getuid() || (st.st_mode & 077) != 0)
+		return B_NOT_ALLOWED;
+
+	result->Append( ARCHIVER_SERVICE_SOCKET);
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Bind socket and start listening thread
+//---------------------------------------------------
+status_t
+ArchiverService::Start()
+{
+	if( aSocket >= 0)
+		return B_OK;
+
+	status_t error = GetSocketPath( &aSocketPath, true);
+	if( error != B_OK)
+		return error;
+
+	struct sockaddr_un address;
+	memset( &address, 0, sizeof( address));
+	address.sun_family = AF_UNIX;
+	strlcpy( address.sun_path, aSocketPath.Path(), sizeof( address.sun_path));
+
+	// if there is another service running, don't steal it's socket
+	int other = connect_service();
+	if( other >= 0)
+	{
+		close( other);
+		return B_BUSY;
+	}
+
+	// socket file left by crashed service would make bind() fail
+	unlink( aSocketPath.Path());
+
+	aSocket = socket( AF_UNIX, SOCK_STREAM, 0);
+	if( aSocket < 0)
+		return errno;
+
+	if( bind( aSocket, (struct sockaddr*)&address, sizeof( address)) < 0
+		|| listen( aSocket, 32) < 0)
+	{
+		error = errno;
+		close( aSocket);
+		aSocket = -1;
+		return error;
+	}
+
+	aListenThread = spawn_thread( Listen, "ArchiverService", B_NORMAL_PRIORITY, (void*)this);
+	resume_thread( aListenThread);
+
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Stop listening, close socket
+//---------------------------------------------------
+void
+ArchiverService::Stop()
+{
+	if( aSocket < 0)
+		return;
+
+	// closing socket makes accept() in Listen() fail, so thread quits
+	shutdown( aSocket, SHUT_RDWR);
+	close( aSocket);
+	aSocket = -1;
+
+	status_t result;
+	wait_for_thread( aListenThread, &result);
+	aListenThread = -1;
+
+	unlink( aSocketPath.Path());
+	aSocketPath.Unset();
+}
+
+//---------------------------------------------------
+//	Listening thread - accept connections, one job per connection
+//---------------------------------------------------
+int32
+ArchiverService::Listen( void *data)
+{
+	ArchiverService *service = (ArchiverService*)data;
+
+	int fd;
+	while( ( fd = accept( service->aSocket, NULL, NULL)) >= 0)
+		service->ReceiveJob( fd);
+
+	return 0;
+}
+
+//---------------------------------------------------
+//	Read job from client and pass it to be_app as B_REFS_RECEIVED
+//---------------------------------------------------
+void
+ArchiverService::ReceiveJob( int fd)
+{
+	uint32 magic;
+	int32 size;
+	if( !read_fully( fd, &magic, sizeof( magic)) || magic != ARCHIVER_SERVICE_MAGIC
+		|| !read_fully( fd, &size, sizeof( size)) || size <= 0 || size > ARCHIVER_SERVICE_MAX_JOB_SIZE)
+	{
+		close( fd);
+		return;
+	}
+
+	char *buffer = (char*)malloc( size);
+	if( buffer == NULL)
+	{
+		Reply( fd, B_NO_MEMORY);
+		return;
+	}
+
+	BMessage job;
+	bool ok = read_fully( fd, buffer, size) && job.Unflatten( buffer) == B_OK;
+	free( buffer);
+
+	if( !ok || !job.HasRef( "refs"))
+	{
+		Reply( fd, B_BAD_DATA);
+		return;
+	}
+
+	// client waits for result - keep connection open, ACompressView will reply when job ends
+	// reply fd sent by client is dropped, job must reply only to it's own connection
+	bool wait = false;
+	job.FindBool( ARCHIVER_REFS_WAIT, &wait);
+	job.RemoveName( ARCHIVER_REFS_WAIT);
+	job.RemoveName( ARCHIVER_REFS_REPLY_FD);
+	if( wait)
+		job.AddInt32( ARCHIVER_REFS_REPLY_FD, fd);
+	else
+		close( fd);
+
+	job.what = B_REFS_RECEIVED;
+	if( be_app->PostMessage( &job) != B_OK && wait)
+		Reply( fd, B_ERROR);
+}
+
+//---------------------------------------------------
+//	Send job result and path of archive it created (empty if none) to waiting client and close connection
+//---------------------------------------------------
+void
+ArchiverService::Reply( int32 fd, status_t result, const char *archive)
+{
+	if( fd < 0)
+		return;
+
+	int32 length = archive != NULL ? strlen( archive) : 0;
+	if( write_fully( fd, &result, sizeof( result)) && write_fully( fd, &length, sizeof( length)))
+		write_fully( fd, archive, length);
+	close( fd);
+}
+
+//---------------------------------------------------
+//	Send job to running service
+//	if wait is true, block until job is finished and set result (and archive, to path of archive job created)
+//---------------------------------------------------
+status_t
+ArchiverService::Submit( BMessage *refs, bool wait, status_t *result, BString *archive)
+{
+	int fd = connect_service();
+	if( fd < 0)
+		return B_NAME_NOT_FOUND;
+
+	BMessage job( *refs);
+	job.AddBool( ARCHIVER_REFS_WAIT, wait);
+
+	uint32 magic = ARCHIVER_SERVICE_MAGIC;
+	int32 size = job.FlattenedSize();
+	char *buffer = (char*)malloc( size);
+	if( buffer == NULL)
+	{
+		close( fd);
+		return B_NO_MEMORY;
+	}
+	job.Flatten( buffer, size);
+
+	status_t status = B_OK;
+	if( !write_fully( fd, &magic, sizeof( magic))
+		|| !write_fully( fd, &size, sizeof( size))
+		|| !write_fully( fd, buffer, size))
+		status = B_IO_ERROR;
+
+	free( buffer);
+
+	if( status == B_OK && wait)
+	{
+		status_t jobResult;
+		int32 length;
+		if( !read_fully( fd, &jobResult, sizeof( jobResult))
+			|| !read_fully( fd, &length, sizeof( length)) || length < 0 || length >= B_PATH_NAME_LENGTH)
+			status = B_IO_ERROR;
+		else
+		{
+			char path[B_PATH_NAME_LENGTH];
+			if( !read_fully( fd, path, length))
+				status = B_IO_ERROR;
+			else
+			{
+				path[length] = 0;
+				if( result != NULL)
+					*result = jobResult;
+				if( archive != NULL)
+					archive->SetTo( path);
+			}
+		}
+	}
+
+	close( fd);
+	return status;
+}
+
+//---------------------------------------------------
+//	"Archiver --submit [--wait] files..." - thin client
+//---------------------------------------------------
+int
+ArchiverService::SubmitMain( int argc, char **argv)
+{
+	bool wait = false;
+	if( argc > 0 && !strcmp( argv[0], "--wait"))
+	{
+		wait = true;
+		argc--;
+		argv++;
+	}
+
+	BMessage *refs = RefsFromArgs( argc, argv);
+	if( refs == NULL)
+	{
+		fprintf( stderr, "usage: Archiver --submit [--wait] file...\n");
+		return 1;
+	}
+
+	status_t result = B_OK;
+	status_t status = Submit( refs, wait, &result);
+	delete refs;
+
+	if( status != B_OK)
+	{
+		fprintf( stderr, "Archiver: can't submit job (%s), is \"Archiver --service\" running?\n", strerror( status));
+		return 1;
+	}
+	if( result != B_OK)
+	{
+		fprintf( stderr, "Archiver: job failed (%s)\n", strerror( result));
+		return 1;
+	}
+	return 0;
+}
+
+//---------------------------------------------------
+//	Names of everything in directory of refs
+//---------------------------------------------------
+static void
+list_directory( BMessage *refs, BMessage *names)
+{
+	entry_ref dir_ref;
+	refs->FindRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+	BDirectory dir( &dir_ref);
+	entry_ref ref;
+	while( dir.GetNextRef( &ref) == B_OK)
+		names->AddString( "name", ref.name);
+}
+
+//---------------------------------------------------
+//	Remove archives reported by service for benchmark jobs
+//---------------------------------------------------
+static void
+remove_archives( BMessage *archives)
+{
+	const char *path;
+	for( int32 i = 0; archives->FindString( "path", i, &path) == B_OK; i++)
+	{
+		BEntry entry( path);
+		entry.Remove();
+	}
+}
+
+//---------------------------------------------------
+//	Is leaf the name launched Archiver gives to archive - "name.ext" or "name N.ext" (see GenerateAName)
+//---------------------------------------------------
+static bool
+is_archive_name( const char *leaf, const char *name, const char *extension)
+{
+	int32 nameLength = strlen( name);
+	if( strncmp( leaf, name, nameLength) != 0)
+		return false;
+	leaf += nameLength;
+
+	if( leaf[0] == ' ' && isdigit( leaf[1]))
+	{
+		leaf++;
+		while( isdigit( *leaf))
+			leaf++;
+	}
+	return !strcmp( leaf, extension);
+}
+
+//---------------------------------------------------
+//	Remove archives created by Archiver launched for each job - it can't report them,
+//	so only entries which weren't in names before and are named like it names archives are removed
+//---------------------------------------------------
+static void
+remove_launched_archives( BMessage *refs, BMessage *names)
+{
+	// the same extension as launched Archiver takes from settings
+	BPath path;
+	if( find_directory( B_USER_SETTINGS_DIRECTORY, &path) != B_OK)
+		path.SetTo( ARCHIVER_SETTINGS_FILE_PATH);
+	path.Append( ARCHIVER_SETTINGS_FILE);
+	BFile file( path.Path(), B_READ_ONLY);
+	BMessage settings;
+	const char *extension;
+	if( settings.Unflatten( &file) != B_OK
+		|| settings.FindString( ARCHIVER_SETTINGS_FILE_EXT, &extension) != B_OK)
+		return;
+
+	// archive is named after the only file, or "Archive"
+	entry_ref ref;
+	type_code type;
+	int32 count = 0;
+	refs->GetInfo( "refs", &type, &count);
+	BString name( "Archive");
+	if( count == 1 && refs->FindRef( "refs", &ref) == B_OK)
+		name = ref.name;
+
+	entry_ref dir_ref;
+	refs->FindRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+	BDirectory dir( &dir_ref);
+	while( dir.GetNextRef( &ref) == B_OK)
+	{
+		if( !is_archive_name( ref.name, name.String(), extension))
+			continue;
+
+		const char *known;
+		bool found = false;
+		for( int32 i = 0; !found && names->FindString( "name", i, &known) == B_OK; i++)
+			found = !strcmp( known, ref.name);
+		if( !found)
+		{
+			BEntry entry( &ref);
+			entry.Remove();
+		}
+	}
+}
+
+//---------------------------------------------------
+//	"Archiver --bench count files..."
+//	compare jobs per second of running service against launching Archiver for each job
+//---------------------------------------------------
+int
+ArchiverService::BenchMain( int argc, char **argv)
+{
+	int32 count = argc > 0 ? atoi( argv[0]) : 0;
+	BMessage *refs = count > 0 ? RefsFromArgs( argc-1, argv+1) : NULL;
+	if( refs == NULL)
+	{
+		fprintf( stderr, "usage: Archiver --bench count file...\n");
+		return 1;
+	}
+
+	// service: submit jobs one after another, each one waits until archive is created
+	bigtime_t serviceTime = -1;
+	bigtime_t start = system_time();
+	int32 index;
+	BMessage archives;
+	for( index = 0; index < count; index++)
+	{
+		status_t result;
+		BString archive;
+		if( Submit( refs, true, &result, &archive) != B_OK)
+			break;
+		if( archive.Length() > 0)
+			archives.AddString( "path", archive);
+	}
+	if( index == count)
+		serviceTime = system_time() - start;
+
+	// Archiver is B_SINGLE_LAUNCH - while service runs, launched Archiver would only pass it's files to it
+	// so service is asked to quit for the second half, and started again afterwards
+	app_info service;
+	bool serviceRunning = be_roster->GetAppInfo( ARCHIVER_MIME_TYPE, &service) == B_OK;
+	if( serviceRunning)
+	{
+		status_t result;
+		BMessenger( ARCHIVER_MIME_TYPE, service.team).SendMessage( B_QUIT_REQUESTED);
+		wait_for_thread( service.thread, &result);
+	}
+
+	// remember what was in directory before, so archives created by launched Archiver can be told apart
+	BMessage before;
+	list_directory( refs, &before);
+
+	// launch per job: what Tracker add-on does without service
+	bigtime_t launchTime = -1;
+	start = system_time();
+	for( index = 0; index < count; index++)
+	{
+		team_id team;
+		if( be_roster->Launch( ARCHIVER_MIME_TYPE, argc-1, argv+1, &team) != B_OK)
+			break;
+
+		// team's main thread has the same id as team
+		status_t result;
+		wait_for_thread( team, &result);
+	}
+	if( index == count)
+		launchTime = system_time() - start;
+
+	if( serviceRunning)
+	{
+		const char *arg_v[] = { "--service" };
+		be_roster->Launch( ARCHIVER_MIME_TYPE, 1, arg_v);
+	}
+
+	// clean up archives created by benchmark
+	remove_archives( &archives);
+	remove_launched_archives( refs, &before);
+	delete refs;
+
+	printf( "jobs: %" B_PRId32 "\n", count);
+	if( serviceTime > 0)
+		printf( "service:         %8.2f jobs/s\n", count * 1000000.0 / serviceTime);
+	else
+		printf( "service:         not running (start \"Archiver --service\")\n");
+	if( launchTime > 0)
+		printf( "launch per job:  %8.2f jobs/s\n", count * 1000000.0 / launchTime);
+	else
+		printf( "launch per job:  failed (is other Archiver running?)\n");
+
+	return 0;
+}
+
+//---------------------------------------------------
+//	Job submitted by "--bench-queue", each one waits for it's result in task of WorkerPool
+//---------------------------------------------------
+struct queue_bench_job
+{
+	BMessage	*refs;
+	status_t	status;
+	status_t	result;
+	BString		archive;	// created by job
+	bigtime_t	start;
+	bigtime_t	done;		// when job was finished, from start of benchmark
+};
+
+static int32
+queue_bench_submit( void *data)
+{
+	queue_bench_job *job = (queue_bench_job*)data;
+	job->result = B_OK;
+	job->status = ArchiverService::Submit( job->refs, true, &job->result, &job->archive);
+	job->done = system_time() - job->start;
+	return 0;
+}
+
+//---------------------------------------------------
+//	"Archiver --bench-queue [--no-readahead] count files..."
+//	submit count jobs at once and measure how long it takes until queue is drained
+//	with "Jobs at once" set in settings, files of next queued job are read ahead, unless --no-readahead is given
+//---------------------------------------------------
+int
+ArchiverService::QueueBenchMain( int argc, char **argv)
+{
+	bool readAhead = true;
+	if( argc > 0 && !strcmp( argv[0], "--no-readahead"))
+	{
+		readAhead = false;
+		argc--;
+		argv++;
+	}
+
+	int32 count = argc > 0 ? atoi( argv[0]) : 0;
+	BMessage *refs = count > 0 ? RefsFromArgs( argc-1, argv+1) : NULL;
+	if( refs == NULL)
+	{
+		fprintf( stderr, "usage: Archiver --bench-queue [--no-readahead] count file...\n");
+		return 1;
+	}
+	if( !readAhead)
+		refs->AddBool( ARCHIVER_REFS_NO_READAHEAD, true);
+
+	// jobs are submitted one after another, so they are queued in this order
+	queue_bench_job *jobs = new queue_bench_job[count];
+	TaskGroup group;
+	bigtime_t start = system_time();
+	for( int32 index = 0; index < count; index++)
+	{
+		jobs[index].refs = refs;
+		jobs[index].start = start;
+		jobs[index].done = 0;
+		WorkerPool::Default()->SubmitBlocking( &group, queue_bench_submit, (void*)&jobs[index]);
+		snooze( 10000);
+	}
+	group.Wait();
+	bigtime_t drain = system_time() - start;
+
+	int failed = 0;
+	for( int32 index = 0; index < count; index++)
+	{
+		if( jobs[index].status != B_OK || jobs[index].result != B_OK)
+			failed++;
+		if( jobs[index].archive.Length() > 0)
+		{
+			BEntry entry( jobs[index].archive.String());
+			entry.Remove();
+		}
+	}
+
+	delete refs;
+
+	printf( "jobs: %" B_PRId32 ", read ahead: %s\n", count, readAhead ? "yes" : "no");
+	if( failed > 0)
+	{
+		printf( "failed: %d (is \"Archiver --service\" running?)\n", failed);
+		delete[] jobs;
+		return 1;
+	}
+	for( int32 index = 0; index < count; index++)
+		printf( "job %3" B_PRId32 " done after %8.2f s\n", index + 1, jobs[index].done / 1000000.0);
+	printf( "queue drained in %.2f s (%.2f jobs/s)\n", drain / 1000000.0, count * 1000000.0 / drain);
+	delete[] jobs;
+	return 0;
+}
@@ -0,0 +1,82 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __ARCHIVER_SERVICE_H_
+#define __ARCHIVER_SERVICE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <Message.h>
+#include <OS.h>
+#include <Path.h>
+#include <String.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	ARCHIVER_SERVICE_MAGIC			'AJOB'	// Archiver - JOB submission
+#define	ARCHIVER_SERVICE_MAX_JOB_SIZE	(64 * 1024 * 1024)
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Archiver Service - accepts jobs over local socket
+//	and hands them to running ArchiverApp
+//---------------------------------------------------
+class ArchiverService
+{
+	public:
+							ArchiverService();
+							~ArchiverService();
+		status_t			Start();
+		void				Stop();
+
+		static status_t		GetSocketPath( BPath *result, bool create = false);
+		static status_t		Submit( BMessage *refs, bool wait, status_t *result = NULL, BString *archive = NULL);
+		static void			Reply( int32 fd, status_t result, const char *archive = NULL);
+
+		static int			SubmitMain( int argc, char **argv);
+		static int			BenchMain( int argc, char **argv);
+		static int			QueueBenchMain( int argc, char **argv);
+
+	private:
+		static int32		Listen( void *data);
+		void				ReceiveJob( int fd);
+
+		int					aSocket;
+		thread_id			aListenThread;
+		BPath				aSocketPath;
+};
+
+#endif /*__ARCHIVER_SERVICE_H_*/
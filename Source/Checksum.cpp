@@ -0,0 +1,416 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "Checksum.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <stdlib.h>
+
+#include <ByteOrder.h>
+#include <OS.h>
+
+#include <zlib.h>
+
+// carry-less multiply is used only when compiler can build it and CPU has it (checked at runtime)
+#if ( defined( __x86_64__) || defined( __i386__)) && defined( __GNUC__) && __GNUC__ >= 5
+#define	CHECKSUM_HAVE_CLMUL
+#include <cpuid.h>
+#include <immintrin.h>
+#endif
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: CRC32
+//
+//----------------------------------------------------------------------------
+
+static uint32		sCrc32Table[256];
+static bool			sCrc32TableReady = false;
+static int32		sCrc32Clmul = -1;		// -1 not checked yet, 0 no, 1 yes
+
+//---------------------------------------------------
+//	Table driven CRC32, one byte at a time - slow, but it's the reference for others
+//---------------------------------------------------
+uint32
+checksum_crc32_table( uint32 crc, const void *data, size_t size)
+{
+	if( !sCrc32TableReady)
+	{
+		for( uint32 index = 0; index < 256; index++)
+		{
+			uint32 value = index;
+			for( int32 bit = 0; bit < 8; bit++)
+				value = ( value & 1) ? ( value >> 1) ^ 0xedb88320 : value >> 1;
+			sCrc32Table[index] = value;
+		}
+		sCrc32TableReady = true;
+	}
+
+	const uint8 *bytes = (const uint8*)data;
+	crc = ~crc;
+	while( size-- > 0)
+		crc = sCrc32Table[( crc ^ *bytes++) & 0xff] ^ ( crc >> 8);
+	return ~crc;
+}
+
+#ifdef CHECKSUM_HAVE_CLMUL
+//---------------------------------------------------
+//	CRC32 by folding 4x128 bits at a time with PCLMULQDQ, then Barrett reduction
+//	("Fast CRC Computation for Generic Polynomials Using PCLMULQDQ Instruction", Intel)
+//	size must be multiple of 16, at least 64 - crc is not inverted here
+//---------------------------------------------------
+__attribute__(( target( "pclmul,sse4.1")))
+static uint32
+crc32_clmul( uint32 crc, const uint8 *data, size_t size)
+{
+	// constants for reflected polynomial 0xedb88320
+	static const uint64 k1k2[2] __attribute__(( aligned( 16))) = { 0x0154442bd4ULL, 0x01c6e41596ULL };
+	static const uint64 k3k4[2] __attribute__(( aligned( 16))) = { 0x01751997d0ULL, 0x00ccaa009eULL };
+	static const uint64 k5k0[2] __attribute__(( aligned( 16))) = { 0x0163cd6124ULL, 0x0000000000ULL };
+	static const uint64 poly[2] __attribute__(( aligned( 16))) = { 0x01db710641ULL, 0x01f7011641ULL };
+
+	__m128i x0, x1, x2, x3, x4, x5, x6, x7, x8;
+
+	x1 = _mm_loadu_si128( (const __m128i*)( data + 0x00));
+	x2 = _mm_loadu_si128( (const __m128i*)( data + 0x10));
+	x3 = _mm_loadu_si128( (const __m128i*)( data + 0x20));
+	x4 = _mm_loadu_si128( (const __m128i*)( data + 0x30));
+	x1 = _mm_xor_si128( x1, _mm_cvtsi32_si128( crc));
+	x0 = _mm_load_si128( (const __m128i*)k1k2);
+	data += 64;
+	size -= 64;
+
+	// four independent folds, so multiplies run in parallel
+	while( size >= 64)
+	{
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00);
+		x6 = _mm_clmulepi64_si128( x2, x0, 0x00);
+		x7 = _mm_clmulepi64_si128( x3, x0, 0x00);
+		x8 = _mm_clmulepi64_si128( x4, x0, 0x00);
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11);
+		x2 = _mm_clmulepi64_si128( x2, x0, 0x11);
+		x3 = _mm_clmulepi64_si128( x3, x0, 0x11);
+		x4 = _mm_clmulepi64_si128( x4, x0, 0x11);
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x5), _mm_loadu_si128( (const __m128i*)( data + 0x00)));
+		x2 = _mm_xor_si128( _mm_xor_si128( x2, x6), _mm_loadu_si128( (const __m128i*)( data + 0x10)));
+		x3 = _mm_xor_si128( _mm_xor_si128( x3, x7), _mm_loadu_si128( (const __m128i*)( data + 0x20)));
+		x4 = _mm_xor_si128( _mm_xor_si128( x4, x8), _mm_loadu_si128( (const __m128i*)( data + 0x30)));
+		data += 64;
+		size -= 64;
+	}
+
+	// fold 4x128 bits into 128
+	x0 = _mm_load_si128( (const __m128i*)k3k4);
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11);
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x2), x5);
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11);
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x3), x5);
+	x5 = _mm_clmulepi64_si128( x1, x0, 0x00);
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x11);
+	x1 = _mm_xor_si128( _mm_xor_si128( x1, x4), x5);
+
+	// rest, 16 bytes at a time
+	while( size >= 16)
+	{
+		x2 = _mm_loadu_si128( (const __m128i*)data);
+		x5 = _mm_clmulepi64_si128( x1, x0, 0x00);
+		x1 = _mm_clmulepi64_si128( x1, x0, 0x11);
+		x1 = _mm_xor_si128( _mm_xor_si128( x1, x2), x5);
+		data += 16;
+		size -= 16;
+	}
+
+	// 128 bits to 64
+	x2 = _mm_clmulepi64_si128( x1, x0, 0x10);
+	x3 = _mm_setr_epi32( ~0, 0, ~0, 0);
+	x1 = _mm_srli_si128( x1, 8);
+	x1 = _mm_xor_si128( x1, x2);
+	x0 = _mm_loadl_epi64( (const __m128i*)k5k0);
+	x2 = _mm_srli_si128( x1, 4);
+	x1 = _mm_and_si128( x1, x3);
+	x1 = _mm_clmulepi64_si128( x1, x0, 0x00);
+	x1 = _mm_xor_si128( x1, x2);
+
+	// Barrett reduction to 32 bits
+	x0 = _mm_load_si128( (const __m128i*)poly);
+	x2 = _mm_and_si128( x1, x3);
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x10);
+	x2 = _mm_and_si128( x2, x3);
+	x2 = _mm_clmulepi64_si128( x2, x0, 0x00);
+	x1 = _mm_xor_si128( x1, x2);
+
+	return _mm_extract_epi32( x1, 1);
+}
+#endif
+
+//---------------------------------------------------
+//	Check once, if CPU can run folding kernel
+//---------------------------------------------------
+static bool
+crc32_has_clmul()
+{
+	if( sCrc32Clmul < 0)
+	{
+		int32 clmul = 0;
+#ifdef CHECKSUM_HAVE_CLMUL
+		unsigned int eax, ebx, ecx, edx;
+		if( __get_cpuid( 1, &eax, &ebx, &ecx, &edx) && ( ecx & bit_PCLMUL) && ( ecx & bit_SSE4_1))
+			clmul = 1;
+#endif
+		// every thread finds the same, so it doesn't matter which one writes it
+		sCrc32Clmul = clmul;
+	}
+	return sCrc32Clmul > 0;
+}
+
+//---------------------------------------------------
+//	CRC32, continues crc of data before (start with 0)
+//	big blocks are folded with PCLMULQDQ if CPU has it, the rest goes to zlib
+//---------------------------------------------------
+uint32
+checksum_crc32( uint32 crc, const void *data, size_t size)
+{
+	const uint8 *bytes = (const uint8*)data;
+#ifdef CHECKSUM_HAVE_CLMUL
+	if( size >= CHECKSUM_CLMUL_MINIMUM && crc32_has_clmul())
+	{
+		size_t chunk = size & ~(size_t)15;
+		crc = ~crc32_clmul( ~crc, bytes, chunk);
+		bytes += chunk;
+		size -= chunk;
+	}
+#endif
+
+	// zlib takes only 32 bit size
+	while( size > 0)
+	{
+		uInt chunk = size < 0x40000000 ? size : 0x40000000;
+		crc = crc32( crc, bytes, chunk);
+		bytes += chunk;
+		size -= chunk;
+	}
+	return crc;
+}
+
+//---------------------------------------------------
+//	Name of kernel checksum_crc32() uses on this CPU
+//---------------------------------------------------
+const char *
+checksum_crc32_kernel()
+{
+	return crc32_has_clmul() ? "pclmulqdq" : "zlib";
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: content hash
+//
+//----------------------------------------------------------------------------
+
+#define	XXH_PRIME64_1	0x9e3779b185ebca87ULL
+#define	XXH_PRIME64_2	0xc2b2ae3d27d4eb4fULL
+#define	XXH_PRIME64_3	0x165667b19e3779f9ULL
+#define	XXH_PRIME64_4	0x85ebca77c2b2ae63ULL
+#define	XXH_PRIME64_5	0x27d4eb2f165667c5ULL
+
+static inline uint64
+xxh_rotl( uint64 value, int bits)
+{
+	return ( value << bits) | ( value >> ( 64 - bits));
+}
+
+static inline uint64
+xxh_read64( const uint8 *data)
+{
+	uint64 value;
+	memcpy( &value, data, sizeof( value));
+	return B_LENDIAN_TO_HOST_INT64( value);
+}
+
+static inline uint32
+xxh_read32( const uint8 *data)
+{
+	uint32 value;
+	memcpy( &value, data, sizeof( value));
+	return B_LENDIAN_TO_HOST_INT32( value);
+}
+
+static inline uint64
+xxh_round( uint64 accumulator, uint64 input)
+{
+	accumulator += input * XXH_PRIME64_2;
+	return xxh_rotl( accumulator, 31) * XXH_PRIME64_1;
+}
+
+static inline uint64
+xxh_merge( uint64 hash, uint64 accumulator)
+{
+	hash ^= xxh_round( 0, accumulator);
+	return hash * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+//---------------------------------------------------
+//	XXH64 - four independent lanes of 8 bytes, which keep all multipliers of CPU busy
+//	(64 bit multiply has no SIMD form before AVX-512, so lanes are in scalar registers)
+//---------------------------------------------------
+uint64
+checksum_hash64( const void *data, size_t size, uint64 seed)
+{
+	const uint8 *bytes = (const uint8*)data;
+	const uint8 *end = bytes + size;
+	uint64 hash;
+
+	if( size >= 32)
+	{
+		uint64 v1 = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+		uint64 v2 = seed + XXH_PRIME64_2;
+		uint64 v3 = seed;
+		uint64 v4 = seed - XXH_PRIME64_1;
+		const uint8 *limit = end - 32;
+		do
+		{
+			v1 = xxh_round( v1, xxh_read64( bytes));
+			v2 = xxh_round( v2, xxh_read64( bytes + 8));
+			v3 = xxh_round( v3, xxh_read64( bytes + 16));
+			v4 = xxh_round( v4, xxh_read64( bytes + 24));
+			bytes += 32;
+		} while( bytes <= limit);
+
+		hash = xxh_rotl( v1, 1) + xxh_rotl( v2, 7) + xxh_rotl( v3, 12) + xxh_rotl( v4, 18);
+		hash = xxh_merge( hash, v1);
+		hash = xxh_merge( hash, v2);
+		hash = xxh_merge( hash, v3);
+		hash = xxh_merge( hash, v4);
+	}
+	else
+		hash = seed + XXH_PRIME64_5;
+
+	hash += size;
+
+	for( ; bytes + 8 <= end; bytes += 8)
+	{
+		hash ^= xxh_round( 0, xxh_read64( bytes));
+		hash = xxh_rotl( hash, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if( bytes + 4 <= end)
+	{
+		hash ^= (uint64)xxh_read32( bytes) * XXH_PRIME64_1;
+		hash = xxh_rotl( hash, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		bytes += 4;
+	}
+	for( ; bytes < end; bytes++)
+	{
+		hash ^= *bytes * XXH_PRIME64_5;
+		hash = xxh_rotl( hash, 11) * XXH_PRIME64_1;
+	}
+
+	hash ^= hash >> 33;
+	hash *= XXH_PRIME64_2;
+	hash ^= hash >> 29;
+	hash *= XXH_PRIME64_3;
+	hash ^= hash >> 32;
+	return hash;
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: benchmark
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	GB/s of one kernel over buffer, repeated for at least half a second
+//---------------------------------------------------
+static double
+bench_kernel( int kernel, const uint8 *buffer, size_t size, uint64 *result)
+{
+	bigtime_t start = system_time();
+	bigtime_t time;
+	uint64 rounds = 0;
+	do
+	{
+		switch( kernel)
+		{
+			case 0: *result = checksum_crc32_table( 0, buffer, size); break;
+			case 1: *result = crc32( 0, buffer, size); break;
+			case 2: *result = checksum_crc32( 0, buffer, size); break;
+			default: *result = checksum_hash64( buffer, size); break;
+		}
+		rounds++;
+		time = system_time() - start;
+	} while( time < 500000);
+
+	return rounds * (double)size / time / 1000.0;
+}
+
+//---------------------------------------------------
+//	"Archiver --bench-checksum [MB]"
+//	speed of each CRC32 kernel and content hash on one core
+//---------------------------------------------------
+int
+checksum_bench_main( int argc, char **argv)
+{
+	size_t size = ( argc > 0 ? atoi( argv[0]) : CHECKSUM_BENCH_SIZE) * 1024 * 1024;
+	uint8 *buffer = size > 0 ? (uint8*)malloc( size) : NULL;
+	if( buffer == NULL)
+	{
+		fprintf( stderr, "usage: Archiver --bench-checksum [MB]\n");
+		return 1;
+	}
+
+	// data doesn't matter for speed, but odd size checks handling of tail
+	uint32 seed = 1;
+	for( size_t index = 0; index < size; index++)
+	{
+		seed = seed * 1103515245 + 12345;
+		buffer[index] = seed >> 16;
+	}
+	size -= 7;
+
+	const char *names[] = { "crc32 table (1 byte)", "crc32 zlib", "crc32 dispatched", "xxh64 hash" };
+	uint64 results[4];
+	for( int kernel = 0; kernel < 4; kernel++)
+	{
+		double speed = bench_kernel( kernel, buffer, size, &results[kernel]);
+		printf( "%-22s %7.2f GB/s  %016" B_PRIx64 "%s%s%s\n", names[kernel], speed, results[kernel],
+			kernel == 2 ? "  (" : "", kernel == 2 ? checksum_crc32_kernel() : "", kernel == 2 ? ")" : "");
+	}
+	free( buffer);
+
+	if( results[0] != results[1] || results[0] != results[2])
+	{
+		fprintf( stderr, "Archiver: CRC32 kernels don't agree!\n");
+		return 1;
+	}
+	return 0;
+}
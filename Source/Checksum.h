@@ -0,0 +1,60 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __CHECKSUM_H_
+#define __CHECKSUM_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <SupportDefs.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	CHECKSUM_CLMUL_MINIMUM		64		// shorter data isn't worth folding, it goes to table
+#define	CHECKSUM_BENCH_SIZE			64		// MB hashed by each kernel in "--bench-checksum"
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+// CRC32 of ZIP and gzip - the same as zlib's crc32(), but folded with carry-less multiply when CPU has it
+uint32		checksum_crc32( uint32 crc, const void *data, size_t size);
+uint32		checksum_crc32_table( uint32 crc, const void *data, size_t size);
+const char	*checksum_crc32_kernel();
+
+// 64 bit content hash (XXH64), for finding files with the same data - not cryptographic
+uint64		checksum_hash64( const void *data, size_t size, uint64 seed = 0);
+
+int			checksum_bench_main( int argc, char **argv);
+
+#endif /*__CHECKSUM_H_*/
@@ -0,0 +1,830 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "DeltaArchive.h"
+#include "ArchiveIndex.h"
+#include "Checksum.h"
+#include "ZipArchive.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <Path.h>
+
+#include <zlib.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: chunking
+//
+//----------------------------------------------------------------------------
+
+static uint64		sGear[256];
+static bool			sGearReady = false;
+
+//---------------------------------------------------
+//	Length of first chunk of data - where rolling (gear) hash of last 64 bytes has top bits zero
+//	if data is shorter than DELTA_CHUNK_MAX, it's end of stream
+//---------------------------------------------------
+size_t
+delta_chunk_length( const uint8 *data, size_t size)
+{
+	// random values for each byte, always the same (splitmix64), so chunks of base and new data match
+	if( !sGearReady)
+	{
+		uint64 seed = 0x41726368697665ULL;
+		for( int32 index = 0; index < 256; index++)
+		{
+			uint64 value = ( seed += 0x9e3779b97f4a7c15ULL);
+			value = ( value ^ ( value >> 30)) * 0xbf58476d1ce4e5b9ULL;
+			value = ( value ^ ( value >> 27)) * 0x94d049bb133111ebULL;
+			sGear[index] = value ^ ( value >> 31);
+		}
+		sGearReady = true;
+	}
+
+	if( size <= DELTA_CHUNK_MIN)
+		return size;
+
+	size_t limit = size < DELTA_CHUNK_MAX ? size : DELTA_CHUNK_MAX;
+	uint64 hash = 0;
+	// hash depends only on last 64 bytes, so it can start just before minimal length
+	for( size_t index = DELTA_CHUNK_MIN - 64; index < limit; index++)
+	{
+		hash = ( hash << 1) + sGear[data[index]];
+		if( index >= DELTA_CHUNK_MIN && ( hash & DELTA_CHUNK_MASK) == 0)
+			return index + 1;
+	}
+	return limit;
+}
+
+//---------------------------------------------------
+//	Read as much as possible, less only at the end of file
+//---------------------------------------------------
+static status_t
+read_all( int fd, void *buffer, size_t size, size_t *read_size)
+{
+	uint8 *data = (uint8*)buffer;
+	*read_size = 0;
+	while( *read_size < size)
+	{
+		ssize_t bytes = read( fd, data + *read_size, size - *read_size);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes < 0)
+			return errno;
+		if( bytes == 0)
+			break;
+		*read_size += bytes;
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Read exactly size bytes, B_BAD_DATA if file ends before
+//---------------------------------------------------
+static status_t
+read_exactly( int fd, void *buffer, size_t size)
+{
+	size_t read_size;
+	status_t status = read_all( fd, buffer, size, &read_size);
+	if( status == B_OK && read_size != size)
+		status = B_BAD_DATA;
+	return status;
+}
+
+//---------------------------------------------------
+//	Write whole buffer (to pipe, or file)
+//---------------------------------------------------
+static status_t
+write_all( int fd, const void *buffer, size_t size)
+{
+	const uint8 *data = (const uint8*)buffer;
+	while( size > 0)
+	{
+		ssize_t bytes = write( fd, data, size);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes <= 0)
+			return bytes < 0 ? errno : B_IO_ERROR;
+		data += bytes;
+		size -= bytes;
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Stream split into chunks, buffer always holds whole next chunk
+//---------------------------------------------------
+struct chunk_reader
+{
+	int			fd;
+	uint8		*buffer;
+	size_t		start;
+	size_t		end;
+	bool		eof;
+};
+
+static status_t
+chunk_next( chunk_reader *reader, const uint8 **chunk, size_t *length)
+{
+	if( !reader->eof && reader->end - reader->start < DELTA_CHUNK_MAX)
+	{
+		memmove( reader->buffer, reader->buffer + reader->start, reader->end - reader->start);
+		reader->end -= reader->start;
+		reader->start = 0;
+
+		size_t read_size;
+		status_t status = read_all( reader->fd, reader->buffer + reader->end, DELTA_BUFFER_SIZE - reader->end, &read_size);
+		if( status != B_OK)
+			return status;
+		reader->end += read_size;
+		reader->eof = reader->end < DELTA_BUFFER_SIZE;
+	}
+
+	*chunk = reader->buffer + reader->start;
+	*length = delta_chunk_length( *chunk, reader->end - reader->start);
+	reader->start += *length;
+	return B_OK;
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: DeltaIndex
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+DeltaIndex::DeltaIndex()
+	:aHashes( NULL),
+	aOffsets( NULL),
+	aLengths( NULL),
+	aCount( 0),
+	aAllocated( 0),
+	aTable( NULL),
+	aTableSize( 0),
+	aBaseSize( 0),
+	aBaseCrc( 0)
+{
+	memset( &aStat, 0, sizeof( aStat));
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+DeltaIndex::~DeltaIndex()
+{
+	Unset();
+}
+
+//---------------------------------------------------
+//	Forget all chunks
+//---------------------------------------------------
+void
+DeltaIndex::Unset()
+{
+	free( aHashes);
+	free( aOffsets);
+	free( aLengths);
+	free( aTable);
+	aHashes = aOffsets = NULL;
+	aLengths = NULL;
+	aTable = NULL;
+	aCount = aAllocated = aTableSize = 0;
+	aBaseSize = 0;
+	aBaseCrc = 0;
+}
+
+//---------------------------------------------------
+//	Index chunks of base archive - from cache, if base didn't change since it was indexed
+//---------------------------------------------------
+status_t
+DeltaIndex::SetTo( const char *path)
+{
+	Unset();
+
+	int fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0)
+		return errno;
+	if( fstat( fd, &aStat) != 0)
+	{
+		close( fd);
+		return errno;
+	}
+
+	status_t status = LoadCache();
+	if( status != B_OK)
+	{
+		Unset();
+		status = Read( fd);
+		if( status == B_OK)
+			SaveCache();
+	}
+	close( fd);
+
+	if( status == B_OK)
+		MakeTable();
+	else
+		Unset();
+	return status;
+}
+
+//---------------------------------------------------
+//	Remember chunk
+//---------------------------------------------------
+status_t
+DeltaIndex::AddChunk( uint64 hash, uint64 offset, uint32 length)
+{
+	if( aCount == aAllocated)
+	{
+		int32 allocated = aAllocated > 0 ? aAllocated * 2 : 4096;
+		uint64 *hashes = (uint64*)realloc( aHashes, sizeof( uint64) * allocated);
+		if( hashes != NULL)
+			aHashes = hashes;
+		uint64 *offsets = (uint64*)realloc( aOffsets, sizeof( uint64) * allocated);
+		if( offsets != NULL)
+			aOffsets = offsets;
+		uint32 *lengths = (uint32*)realloc( aLengths, sizeof( uint32) * allocated);
+		if( lengths != NULL)
+			aLengths = lengths;
+		if( hashes == NULL || offsets == NULL || lengths == NULL)
+			return B_NO_MEMORY;
+		aAllocated = allocated;
+	}
+
+	aHashes[aCount] = hash;
+	aOffsets[aCount] = offset;
+	aLengths[aCount] = length;
+	aCount++;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Read whole base, chunk it and hash each chunk
+//---------------------------------------------------
+status_t
+DeltaIndex::Read( int fd)
+{
+	chunk_reader reader = { fd, (uint8*)malloc( DELTA_BUFFER_SIZE), 0, 0, false };
+	if( reader.buffer == NULL)
+		return B_NO_MEMORY;
+
+	status_t status = B_OK;
+	while( status == B_OK)
+	{
+		const uint8 *chunk;
+		size_t length;
+		status = chunk_next( &reader, &chunk, &length);
+		if( status != B_OK || length == 0)
+			break;
+
+		status = AddChunk( checksum_hash64( chunk, length), aBaseSize, length);
+		aBaseCrc = checksum_crc32( aBaseCrc, chunk, length);
+		aBaseSize += length;
+	}
+	free( reader.buffer);
+	return status;
+}
+
+//---------------------------------------------------
+//	Hash table of chunks
+//---------------------------------------------------
+void
+DeltaIndex::MakeTable()
+{
+	aTableSize = 1024;
+	while( aTableSize < aCount * 2)
+		aTableSize *= 2;
+	aTable = (int32*)calloc( aTableSize, sizeof( int32));
+	if( aTable == NULL)
+	{
+		aTableSize = 0;
+		return;
+	}
+
+	// first chunk with the same data wins
+	for( int32 index = 0; index < aCount; index++)
+	{
+		if( Find( aHashes[index], aLengths[index]) >= 0)
+			continue;
+		uint32 slot = aHashes[index] & ( aTableSize - 1);
+		while( aTable[slot] != 0)
+			slot = ( slot + 1) & ( aTableSize - 1);
+		aTable[slot] = index + 1;
+	}
+}
+
+//---------------------------------------------------
+//	Index of chunk with given hash and length, -1 if base doesn't have it
+//---------------------------------------------------
+int32
+DeltaIndex::Find( uint64 hash, uint32 length) const
+{
+	if( aTableSize == 0)
+		return -1;
+
+	for( uint32 slot = hash & ( aTableSize - 1); aTable[slot] != 0; slot = ( slot + 1) & ( aTableSize - 1))
+	{
+		int32 index = aTable[slot] - 1;
+		if( aHashes[index] == hash && aLengths[index] == length)
+			return index;
+	}
+	return -1;
+}
+
+//---------------------------------------------------
+//	Load chunks from cache, if they're made for base as it's now (size and modification time, with nanoseconds)
+//---------------------------------------------------
+status_t
+DeltaIndex::LoadCache()
+{
+	BPath path;
+	status_t status = ArchiveIndex::GetCachePath( &aStat, &path, DELTA_INDEX_CACHE_EXT);
+	if( status != B_OK)
+		return status;
+
+	FILE *file = fopen( path.Path(), "rb");
+	if( file == NULL)
+		return errno;
+
+	int32 header[2];
+	int64 key[5];
+	int32 count = 0;
+	status = B_BAD_DATA;
+	if( fread( header, sizeof( header), 1, file) == 1 && fread( key, sizeof( key), 1, file) == 1
+		&& fread( &aBaseSize, sizeof( aBaseSize), 1, file) == 1 && fread( &aBaseCrc, sizeof( aBaseCrc), 1, file) == 1
+		&& fread( &count, sizeof( count), 1, file) == 1
+		&& header[0] == DELTA_INDEX_MAGIC && header[1] == DELTA_INDEX_VERSION
+		&& key[0] == (int64)aStat.st_dev && key[1] == (int64)aStat.st_ino
+		&& key[2] == (int64)aStat.st_size && key[3] == (int64)aStat.st_mtime
+		&& key[4] == (int64)aStat.st_mtim.tv_nsec
+		&& count >= 0 && aBaseSize == (uint64)aStat.st_size)
+		status = B_OK;
+
+	if( status == B_OK && count > 0)
+	{
+		aHashes = (uint64*)malloc( sizeof( uint64) * count);
+		aOffsets = (uint64*)malloc( sizeof( uint64) * count);
+		aLengths = (uint32*)malloc( sizeof( uint32) * count);
+		if( aHashes == NULL || aOffsets == NULL || aLengths == NULL)
+			status = B_NO_MEMORY;
+		else if( fread( aHashes, sizeof( uint64), count, file) != (size_t)count
+			|| fread( aOffsets, sizeof( uint64), count, file) != (size_t)count
+			|| fread( aLengths, sizeof( uint32), count, file) != (size_t)count)
+			status = B_BAD_DATA;
+		aCount = aAllocated = count;
+	}
+	fclose( file);
+
+	return status;
+}
+
+//---------------------------------------------------
+//	Write chunks to cache, replacing old ones
+//---------------------------------------------------
+status_t
+DeltaIndex::SaveCache()
+{
+	BPath path;
+	status_t status = ArchiveIndex::GetCachePath( &aStat, &path, DELTA_INDEX_CACHE_EXT);
+	if( status != B_OK)
+		return status;
+
+	// written to temporary file, so other Archiver doesn't read half of it
+	char temp[B_PATH_NAME_LENGTH + 16];
+	sprintf( temp, "%s.%" B_PRId32, path.Path(), (int32)find_thread( NULL));
+	FILE *file = fopen( temp, "wb");
+	if( file == NULL)
+		return errno;
+
+	int32 header[2] = { DELTA_INDEX_MAGIC, DELTA_INDEX_VERSION };
+	int64 key[5] = { (int64)aStat.st_dev, (int64)aStat.st_ino, (int64)aStat.st_size, (int64)aStat.st_mtime,
+		(int64)aStat.st_mtim.tv_nsec };
+	bool written = fwrite( header, sizeof( header), 1, file) == 1
+		&& fwrite( key, sizeof( key), 1, file) == 1
+		&& fwrite( &aBaseSize, sizeof( aBaseSize), 1, file) == 1
+		&& fwrite( &aBaseCrc, sizeof( aBaseCrc), 1, file) == 1
+		&& fwrite( &aCount, sizeof( aCount), 1, file) == 1
+		&& fwrite( aHashes, sizeof( uint64), aCount, file) == (size_t)aCount
+		&& fwrite( aOffsets, sizeof( uint64), aCount, file) == (size_t)aCount
+		&& fwrite( aLengths, sizeof( uint32), aCount, file) == (size_t)aCount;
+
+	// chunks which aren't all there (full disk) mustn't replace old ones
+	if( !written)
+	{
+		status = errno != 0 ? errno : B_IO_ERROR;
+		fclose( file);
+		unlink( temp);
+	}
+	else if( fclose( file) != 0 || rename( temp, path.Path()) != 0)
+	{
+		status = errno;
+		unlink( temp);
+	}
+	return status;
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: delta
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	State of delta being written - copy and data waiting to be written as records
+//---------------------------------------------------
+struct delta_writer
+{
+	int			fd;
+	z_stream	stream;
+	uint8		*data;
+	size_t		dataSize;
+	uint8		*deflated;
+	uint64		copyOffset;
+	uint32		copyLength;
+	uint64		newSize;
+};
+
+static status_t
+flush_copy( delta_writer *writer)
+{
+	if( writer->copyLength == 0)
+		return B_OK;
+
+	uint8 record[13];
+	record[0] = 'C';
+	zip_put64( record + 1, writer->copyOffset);
+	zip_put32( record + 9, writer->copyLength);
+	writer->copyLength = 0;
+	return write_all( writer->fd, record, sizeof( record));
+}
+
+static status_t
+flush_data( delta_writer *writer)
+{
+	if( writer->dataSize == 0)
+		return B_OK;
+
+	deflateReset( &writer->stream);
+	writer->stream.next_in = writer->data;
+	writer->stream.avail_in = writer->dataSize;
+	writer->stream.next_out = writer->deflated;
+	writer->stream.avail_out = deflateBound( &writer->stream, writer->dataSize);
+	int result = deflate( &writer->stream, Z_FINISH);
+	size_t deflatedSize = writer->stream.total_out;
+
+	uint8 record[9];
+	status_t status;
+	// data which doesn't compress is stored
+	if( result != Z_STREAM_END || deflatedSize >= writer->dataSize)
+	{
+		record[0] = 'S';
+		zip_put32( record + 1, writer->dataSize);
+		status = write_all( writer->fd, record, 5);
+		if( status == B_OK)
+			status = write_all( writer->fd, writer->data, writer->dataSize);
+	}
+	else
+	{
+		record[0] = 'D';
+		zip_put32( record + 1, writer->dataSize);
+		zip_put32( record + 5, deflatedSize);
+		status = write_all( writer->fd, record, 9);
+		if( status == B_OK)
+			status = write_all( writer->fd, writer->deflated, deflatedSize);
+	}
+
+	writer->newSize += writer->dataSize;
+	writer->dataSize = 0;
+	return status;
+}
+
+//---------------------------------------------------
+//	Whether base has the same bytes as chunk at offset - hashes can match by chance (or on purpose)
+//---------------------------------------------------
+static bool
+same_as_base( int base_fd, uint64 offset, const uint8 *chunk, size_t length, uint8 *buffer)
+{
+	size_t done = 0;
+	while( done < length)
+	{
+		ssize_t bytes = pread( base_fd, buffer + done, length - done, offset + done);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes <= 0)
+			return false;
+		done += bytes;
+	}
+	return memcmp( buffer, chunk, length) == 0;
+}
+
+//---------------------------------------------------
+//	Write delta of in_fd (new archive) against base to out_fd
+//	chunks which are in base (byte for byte, not only by hash) become copy records, the rest is deflated
+//---------------------------------------------------
+status_t
+delta_create( const char *base, int in_fd, int out_fd, int32 level, uint64 *size, uint64 *newSize)
+{
+	DeltaIndex index;
+	status_t status = index.SetTo( base);
+	if( status != B_OK)
+		return status;
+
+	delta_writer writer;
+	memset( &writer, 0, sizeof( writer));
+	writer.fd = out_fd;
+	writer.data = (uint8*)malloc( DELTA_BUFFER_SIZE + DELTA_CHUNK_MAX);
+	writer.deflated = (uint8*)malloc( compressBound( DELTA_BUFFER_SIZE + DELTA_CHUNK_MAX));
+	chunk_reader reader = { in_fd, (uint8*)malloc( DELTA_BUFFER_SIZE), 0, 0, false };
+	uint8 *compare = (uint8*)malloc( DELTA_CHUNK_MAX);
+	if( writer.data == NULL || writer.deflated == NULL || reader.buffer == NULL || compare == NULL
+		|| deflateInit2( &writer.stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		free( writer.data);
+		free( writer.deflated);
+		free( reader.buffer);
+		free( compare);
+		return B_NO_MEMORY;
+	}
+
+	// chunks found by hash are compared with base before they're copied from it
+	int base_fd = open( base, O_RDONLY | O_CLOEXEC);
+	if( base_fd < 0)
+	{
+		status = errno;
+		deflateEnd( &writer.stream);
+		free( writer.data);
+		free( writer.deflated);
+		free( reader.buffer);
+		free( compare);
+		return status;
+	}
+
+	uint8 header[DELTA_HEADER_SIZE];
+	memset( header, 0, sizeof( header));
+	zip_put32( header, DELTA_MAGIC);
+	zip_put32( header + 4, DELTA_VERSION);
+	zip_put64( header + 8, index.BaseSize());
+	zip_put32( header + 16, index.BaseCrc());
+	status = write_all( out_fd, header, sizeof( header));
+
+	uint64 total = 0;
+	uint32 crc = 0;
+	while( status == B_OK)
+	{
+		const uint8 *chunk;
+		size_t length;
+		status = chunk_next( &reader, &chunk, &length);
+		if( status != B_OK || length == 0)
+			break;
+		total += length;
+		crc = checksum_crc32( crc, chunk, length);
+
+		int32 found = index.Find( checksum_hash64( chunk, length), length);
+		if( found >= 0 && !same_as_base( base_fd, index.ChunkOffset( found), chunk, length, compare))
+			found = -1;
+		if( found >= 0)
+		{
+			status = flush_data( &writer);
+			// chunks following each other in base make one copy
+			uint64 offset = index.ChunkOffset( found);
+			if( status == B_OK && ( writer.copyOffset + writer.copyLength != offset || writer.copyLength > 0x7fffffff))
+				status = flush_copy( &writer);
+			if( writer.copyLength == 0)
+				writer.copyOffset = offset;
+			writer.copyLength += length;
+		}
+		else
+		{
+			status = flush_copy( &writer);
+			memcpy( writer.data + writer.dataSize, chunk, length);
+			writer.dataSize += length;
+			if( status == B_OK && writer.dataSize >= DELTA_BUFFER_SIZE)
+				status = flush_data( &writer);
+		}
+	}
+
+	if( status == B_OK)
+		status = flush_copy( &writer);
+	if( status == B_OK)
+		status = flush_data( &writer);
+	if( status == B_OK)
+	{
+		uint8 record[13];
+		record[0] = 'E';
+		zip_put64( record + 1, total);
+		zip_put32( record + 9, crc);
+		status = write_all( out_fd, record, sizeof( record));
+	}
+
+	close( base_fd);
+	deflateEnd( &writer.stream);
+	free( writer.data);
+	free( writer.deflated);
+	free( reader.buffer);
+	free( compare);
+
+	if( size != NULL)
+		*size = total;
+	if( newSize != NULL)
+		*newSize = writer.newSize;
+	return status;
+}
+
+//---------------------------------------------------
+//	Rebuild archive from base and delta, it's checked with CRC32 of original
+//---------------------------------------------------
+status_t
+delta_apply( const char *base, int delta_fd, int out_fd)
+{
+	uint8 header[DELTA_HEADER_SIZE];
+	status_t status = read_exactly( delta_fd, header, sizeof( header));
+	if( status != B_OK)
+		return status;
+	if( zip_get32( header) != DELTA_MAGIC || zip_get32( header + 4) != DELTA_VERSION)
+		return B_BAD_DATA;
+
+	// delta must be applied to the same base it was made from
+	DeltaIndex index;
+	status = index.SetTo( base);
+	if( status != B_OK)
+		return status;
+	if( index.BaseSize() != zip_get64( header + 8) || index.BaseCrc() != zip_get32( header + 16))
+		return B_MISMATCHED_VALUES;
+
+	int base_fd = open( base, O_RDONLY | O_CLOEXEC);
+	if( base_fd < 0)
+		return errno;
+
+	size_t bufferSize = DELTA_BUFFER_SIZE + DELTA_CHUNK_MAX;
+	uint8 *buffer = (uint8*)malloc( bufferSize);
+	uint8 *deflated = (uint8*)malloc( compressBound( bufferSize));
+	z_stream stream;
+	memset( &stream, 0, sizeof( stream));
+	if( buffer == NULL || deflated == NULL || inflateInit2( &stream, -MAX_WBITS) != Z_OK)
+		status = B_NO_MEMORY;
+
+	uint64 total = 0;
+	uint32 crc = 0;
+	bool ended = false;
+	while( status == B_OK && !ended)
+	{
+		uint8 record[13];
+		status = read_exactly( delta_fd, record, 1);
+		if( status != B_OK)
+			break;
+
+		switch( record[0])
+		{
+			case 'C':
+			{
+				status = read_exactly( delta_fd, record + 1, 12);
+				uint64 offset = zip_get64( record + 1);
+				uint32 length = zip_get32( record + 9);
+				if( status == B_OK && offset + length > index.BaseSize())
+					status = B_BAD_DATA;
+				while( status == B_OK && length > 0)
+				{
+					uint32 chunk = length < bufferSize ? length : bufferSize;
+					status = zip_read_at( base_fd, offset, buffer, chunk);
+					if( status == B_OK)
+						status = write_all( out_fd, buffer, chunk);
+					crc = checksum_crc32( crc, buffer, chunk);
+					total += chunk;
+					offset += chunk;
+					length -= chunk;
+				}
+				break;
+			}
+			case 'D':
+			case 'S':
+			{
+				status = read_exactly( delta_fd, record + 1, record[0] == 'D' ? 8 : 4);
+				uint32 length = zip_get32( record + 1);
+				uint32 deflatedSize = record[0] == 'D' ? zip_get32( record + 5) : length;
+				if( status == B_OK && ( length > bufferSize || deflatedSize > compressBound( bufferSize)))
+					status = B_BAD_DATA;
+				if( status != B_OK)
+					break;
+
+				if( record[0] == 'S')
+					status = read_exactly( delta_fd, buffer, length);
+				else
+				{
+					status = read_exactly( delta_fd, deflated, deflatedSize);
+					inflateReset( &stream);
+					stream.next_in = deflated;
+					stream.avail_in = deflatedSize;
+					stream.next_out = buffer;
+					stream.avail_out = length;
+					if( status == B_OK && ( inflate( &stream, Z_FINISH) != Z_STREAM_END || stream.total_out != length))
+						status = B_BAD_DATA;
+				}
+				if( status == B_OK)
+					status = write_all( out_fd, buffer, length);
+				crc = checksum_crc32( crc, buffer, length);
+				total += length;
+				break;
+			}
+			case 'E':
+			{
+				status = read_exactly( delta_fd, record + 1, 12);
+				if( status == B_OK && ( zip_get64( record + 1) != total || zip_get32( record + 9) != crc))
+					status = B_BAD_DATA;
+				ended = true;
+				break;
+			}
+			default:
+				status = B_BAD_DATA;
+				break;
+		}
+	}
+
+	inflateEnd( &stream);
+	free( buffer);
+	free( deflated);
+	close( base_fd);
+	return status;
+}
+
+//---------------------------------------------------
+//	"Archiver --delta-create [-1..-9] base < archive > delta"
+//	"Archiver --delta-apply base delta > archive"
+//---------------------------------------------------
+int
+delta_main( int argc, char **argv)
+{
+	if( argc >= 2 && !strcmp( argv[0], "--delta-create"))
+	{
+		int32 level = Z_DEFAULT_COMPRESSION;
+		int32 arg = 1;
+		if( argv[arg][0] == '-' && argv[arg][1] >= '1' && argv[arg][1] <= '9' && argv[arg][2] == 0)
+			level = argv[arg++][1] - '0';
+
+		if( arg + 1 == argc)
+		{
+			uint64 size = 0;
+			uint64 newSize = 0;
+			bigtime_t start = system_time();
+			status_t status = delta_create( argv[arg], STDIN_FILENO, STDOUT_FILENO, level, &size, &newSize);
+			if( status != B_OK)
+			{
+				fprintf( stderr, "Archiver: can't make delta against %s (%s)\n", argv[arg], strerror( status));
+				return 1;
+			}
+			fprintf( stderr, "Archiver: %.1f MB, %.1f MB new (%.1f%% from base) in %.1fs\n", size / 1048576.0, newSize / 1048576.0,
+				size > 0 ? ( size - newSize) * 100.0 / size : 0.0, ( system_time() - start) / 1000000.0);
+			return 0;
+		}
+	}
+	else if( argc == 3 && !strcmp( argv[0], "--delta-apply"))
+	{
+		int fd = open( argv[2], O_RDONLY | O_CLOEXEC);
+		status_t status = fd >= 0 ? delta_apply( argv[1], fd, STDOUT_FILENO) : errno;
+		if( fd >= 0)
+			close( fd);
+		if( status != B_OK)
+		{
+			fprintf( stderr, "Archiver: can't rebuild %s (%s)\n", argv[2], strerror( status));
+			return 1;
+		}
+		return 0;
+	}
+
+	fprintf( stderr, "usage: Archiver --delta-create [-1..-9] base < archive > delta\n"
+		"       Archiver --delta-apply base delta > archive\n");
+	return 1;
+}
@@ -0,0 +1,116 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __DELTA_ARCHIVE_H_
+#define __DELTA_ARCHIVE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <SupportDefs.h>
+
+#include <sys/stat.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+// delta is "ADLT" header (version, base size and CRC32), then records:
+// 'C' - copy (uint64 offset in base, uint32 length)
+// 'D' - data (uint32 length, uint32 deflated length, raw deflate data), 'S' - stored data (uint32 length, data)
+// 'E' - end (uint64 size, uint32 CRC32 of rebuilt archive)
+#define	DELTA_MAGIC					'ADLT'		// Archiver DeLTa
+#define	DELTA_VERSION				1
+#define	DELTA_HEADER_SIZE			24
+#define	DELTA_INDEX_MAGIC			'ADCI'		// Archiver Delta Chunk Index
+#define	DELTA_INDEX_VERSION			2			// not DELTA_VERSION - cache of chunks changes apart from delta files
+#define	DELTA_INDEX_CACHE_EXT		".chunks"
+
+// content defined chunks - boundaries follow data, so inserting bytes moves only chunks around them
+#define	DELTA_CHUNK_MIN				2048
+#define	DELTA_CHUNK_MASK			0xfff8000000000000ULL	// 13 bits - 8 KB average, top bits depend on last 64 bytes
+#define	DELTA_CHUNK_MAX				(64 * 1024)
+
+#define	DELTA_BUFFER_SIZE			(1024 * 1024)	// new data is deflated in records of this size
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Chunks of base archive, found by hash of their data
+//	it's kept in cache until base changes, so base isn't read again each night
+//---------------------------------------------------
+class DeltaIndex
+{
+	public:
+							DeltaIndex();
+							~DeltaIndex();
+
+		status_t			SetTo( const char *path);
+		int32				Find( uint64 hash, uint32 length) const;
+
+		int32				CountChunks() const { return aCount; };
+		uint64				ChunkOffset( int32 index) const { return aOffsets[index]; };
+		uint64				BaseSize() const { return aBaseSize; };
+		uint32				BaseCrc() const { return aBaseCrc; };
+
+	private:
+		status_t			Read( int fd);
+		status_t			LoadCache();
+		status_t			SaveCache();
+		status_t			AddChunk( uint64 hash, uint64 offset, uint32 length);
+		void				MakeTable();
+		void				Unset();
+
+		struct stat			aStat;
+		uint64				*aHashes;
+		uint64				*aOffsets;
+		uint32				*aLengths;
+		int32				aCount;
+		int32				aAllocated;
+		int32				*aTable;		// index+1 of chunks, by hash
+		int32				aTableSize;
+		uint64				aBaseSize;
+		uint32				aBaseCrc;
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+size_t		delta_chunk_length( const uint8 *data, size_t size);
+status_t	delta_create( const char *base, int in_fd, int out_fd, int32 level, uint64 *size = NULL, uint64 *newSize = NULL);
+status_t	delta_apply( const char *base, int delta_fd, int out_fd);
+int			delta_main( int argc, char **argv);
+
+#endif /*__DELTA_ARCHIVE_H_*/
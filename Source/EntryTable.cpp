@@ -0,0 +1,662 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "EntryTable.h"
+#include "ZipArchive.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <OS.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: StringPool
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+StringPool::StringPool()
+	:aChunks( NULL),
+	aChunkCount( 0),
+	aChunkUsed( 0),
+	aHash( NULL),
+	aHashSize( 0),
+	aCount( 0)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+StringPool::~StringPool()
+{
+	MakeEmpty();
+}
+
+//---------------------------------------------------
+//	Forget all strings, ids given so far aren't valid anymore
+//---------------------------------------------------
+void
+StringPool::MakeEmpty()
+{
+	for( int32 index = 0; index < aChunkCount; index++)
+		free( aChunks[index]);
+	free( aChunks);
+	aChunks = NULL;
+	aChunkCount = 0;
+	aChunkUsed = 0;
+
+	free( aHash);
+	aHash = NULL;
+	aHashSize = 0;
+	aCount = 0;
+}
+
+//---------------------------------------------------
+//	FNV-1a hash of data
+//---------------------------------------------------
+static uint32
+pool_hash( const void *data, size_t size)
+{
+	const uint8 *bytes = (const uint8*)data;
+	uint32 hash = 2166136261U;
+	while( size-- > 0)
+	{
+		hash ^= *bytes++;
+		hash *= 16777619U;
+	}
+	return hash;
+}
+
+//---------------------------------------------------
+//	Id of data, 0 if it isn't in pool - slot is where it would go in hash table
+//	each record in arena is hash, size, data and 0 (so strings can be used as they are), aligned to 4 bytes
+//---------------------------------------------------
+uint32
+StringPool::Lookup( const void *data, size_t size, uint32 hash, uint32 *slot) const
+{
+	*slot = hash & ( aHashSize - 1);
+	while( aHash[*slot] != 0)
+	{
+		uint8 *record = Record( aHash[*slot]);
+		if( *(uint32*)record == hash && *(uint32*)( record + 4) == size && !memcmp( record + 8, data, size))
+			return aHash[*slot];
+		*slot = ( *slot + 1) & ( aHashSize - 1);
+	}
+	return 0;
+}
+
+//---------------------------------------------------
+//	Id of data already in pool, 0 if it isn't there
+//---------------------------------------------------
+uint32
+StringPool::Find( const void *data, size_t size) const
+{
+	if( aHashSize == 0)
+		return 0;
+
+	uint32 slot;
+	return Lookup( data, size, pool_hash( data, size), &slot);
+}
+
+//---------------------------------------------------
+//	Keep hash table at most half full - records know their hash, so strings aren't hashed again
+//---------------------------------------------------
+bool
+StringPool::GrowHash()
+{
+	uint32 size = aHashSize > 0 ? aHashSize * 2 : 1024;
+	uint32 *hash = (uint32*)calloc( size, sizeof( uint32));
+	if( hash == NULL)
+		return false;
+
+	for( uint32 index = 0; index < aHashSize; index++)
+	{
+		if( aHash[index] == 0)
+			continue;
+		uint32 slot = *(uint32*)Record( aHash[index]) & ( size - 1);
+		while( hash[slot] != 0)
+			slot = ( slot + 1) & ( size - 1);
+		hash[slot] = aHash[index];
+	}
+
+	free( aHash);
+	aHash = hash;
+	aHashSize = size;
+	return true;
+}
+
+//---------------------------------------------------
+//	Id of data - it's copied to arena, unless it's there already
+//	0 when there is no memory left or data doesn't fit in chunk
+//---------------------------------------------------
+uint32
+StringPool::Add( const void *data, size_t size)
+{
+	size_t recordSize = ( 8 + size + 1 + 3) & ~3;
+	if( recordSize > STRING_POOL_CHUNK_SIZE - 8)
+		return 0;
+	if( ( aCount + 1) * 2 > (int64)aHashSize && !GrowHash())
+		return 0;
+
+	uint32 hash = pool_hash( data, size);
+	uint32 slot;
+	uint32 id = Lookup( data, size, hash, &slot);
+	if( id != 0)
+		return id;
+
+	// new chunk - first one starts after 8 bytes, so no record has id 0
+	if( aChunkCount == 0 || aChunkUsed + recordSize > STRING_POOL_CHUNK_SIZE)
+	{
+		if( aChunkCount == STRING_POOL_MAX_CHUNKS)
+			return 0;
+		if( aChunks == NULL && ( aChunks = (uint8**)malloc( sizeof( uint8*) * STRING_POOL_MAX_CHUNKS)) == NULL)
+			return 0;
+		if( ( aChunks[aChunkCount] = (uint8*)malloc( STRING_POOL_CHUNK_SIZE)) == NULL)
+			return 0;
+		aChunkUsed = aChunkCount == 0 ? 8 : 0;
+		aChunkCount++;
+	}
+
+	id = ( ( aChunkCount - 1) << STRING_POOL_CHUNK_SHIFT) | aChunkUsed;
+	uint8 *record = aChunks[aChunkCount - 1] + aChunkUsed;
+	*(uint32*)record = hash;
+	*(uint32*)( record + 4) = size;
+	memcpy( record + 8, data, size);
+	record[8 + size] = 0;
+	aChunkUsed += recordSize;
+
+	aHash[slot] = id;
+	aCount++;
+	return id;
+}
+
+//---------------------------------------------------
+//	Bytes taken by arena and hash table
+//---------------------------------------------------
+size_t
+StringPool::Memory() const
+{
+	return (size_t)aChunkCount * STRING_POOL_CHUNK_SIZE + aHashSize * sizeof( uint32)
+		+ ( aChunks != NULL ? sizeof( uint8*) * STRING_POOL_MAX_CHUNKS : 0);
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: EntryTable
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+EntryTable::EntryTable()
+	:aDeleted( NULL),
+	aCount( 0),
+	aSize( 0),
+	aLarge( NULL),
+	aLargeCount( 0),
+	aLargeSize( 0),
+	aNameHash( NULL),
+	aNameHashSize( 0)
+{
+	for( int32 column = 0; column < COLUMN_COUNT; column++)
+		aColumns[column] = NULL;
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+EntryTable::~EntryTable()
+{
+	MakeEmpty();
+}
+
+//---------------------------------------------------
+//	Forget all entries
+//---------------------------------------------------
+void
+EntryTable::MakeEmpty()
+{
+	aStrings.MakeEmpty();
+	for( int32 column = 0; column < COLUMN_COUNT; column++)
+	{
+		free( aColumns[column]);
+		aColumns[column] = NULL;
+	}
+	free( aDeleted);
+	aDeleted = NULL;
+	aCount = 0;
+	aSize = 0;
+
+	free( aLarge);
+	aLarge = NULL;
+	aLargeCount = 0;
+	aLargeSize = 0;
+
+	free( aNameHash);
+	aNameHash = NULL;
+	aNameHashSize = 0;
+}
+
+//---------------------------------------------------
+//	Double room in all columns
+//---------------------------------------------------
+bool
+EntryTable::Grow()
+{
+	int32 size = aSize > 0 ? aSize * 2 : ENTRY_TABLE_FIRST_SIZE;
+	for( int32 column = 0; column < COLUMN_COUNT; column++)
+	{
+		uint32 *data = (uint32*)realloc( aColumns[column], sizeof( uint32) * size);
+		if( data == NULL)
+			return false;
+		aColumns[column] = data;
+	}
+
+	uint32 *deleted = (uint32*)realloc( aDeleted, sizeof( uint32) * ( size / 32));
+	if( deleted == NULL)
+		return false;
+	memset( deleted + aSize / 32, 0, sizeof( uint32) * ( size - aSize) / 32);
+	aDeleted = deleted;
+
+	aSize = size;
+	return true;
+}
+
+//---------------------------------------------------
+//	Directory part of name (with "/" at the end) - last "/" of directory member's name doesn't count
+//---------------------------------------------------
+static size_t
+directory_length( const char *name, size_t length)
+{
+	for( size_t index = length > 1 ? length - 1 : 0; index > 0; index--)
+	{
+		if( name[index - 1] == '/')
+			return index;
+	}
+	return 0;
+}
+
+//---------------------------------------------------
+//	Hash of name by ids of it's parts
+//---------------------------------------------------
+static uint32
+name_hash( uint32 directory, uint32 leaf)
+{
+	uint32 hash = directory * 2654435761U + leaf;
+	hash ^= hash >> 15;
+	hash *= 2246822519U;
+	return hash ^ ( hash >> 13);
+}
+
+uint32
+EntryTable::NameHash( int32 index) const
+{
+	return name_hash( aColumns[COLUMN_DIRECTORY][index], aColumns[COLUMN_LEAF][index]);
+}
+
+//---------------------------------------------------
+//	Keep hash table of names at most half full
+//---------------------------------------------------
+bool
+EntryTable::GrowNameHash()
+{
+	int32 size = aNameHashSize > 0 ? aNameHashSize * 2 : 1024;
+	int32 *hash = (int32*)calloc( size, sizeof( int32));
+	if( hash == NULL)
+		return false;
+
+	for( int32 index = 0; index < aCount; index++)
+	{
+		uint32 slot = NameHash( index) & ( size - 1);
+		while( hash[slot] != 0)
+			slot = ( slot + 1) & ( size - 1);
+		hash[slot] = index + 1;
+	}
+
+	free( aNameHash);
+	aNameHash = hash;
+	aNameHashSize = size;
+	return true;
+}
+
+//---------------------------------------------------
+//	Add copy of entry at the end of table
+//---------------------------------------------------
+status_t
+EntryTable::Add( const ZipEntry *entry)
+{
+	if( aCount == aSize && !Grow())
+		return B_NO_MEMORY;
+	if( ( aCount + 1) * 2 > aNameHashSize && !GrowNameHash())
+		return B_NO_MEMORY;
+
+	// version, flags, method, attributes and size of extra field, 16 bytes
+	uint8 kind[16];
+	zip_put16( kind, entry->aVersionMadeBy);
+	zip_put16( kind + 2, entry->aVersionNeeded);
+	zip_put16( kind + 4, entry->aFlags);
+	zip_put16( kind + 6, entry->aMethod);
+	zip_put16( kind + 8, entry->aInternalAttributes);
+	zip_put32( kind + 10, entry->aExternalAttributes);
+	zip_put16( kind + 14, entry->aExtraSize);
+
+	size_t length = strlen( entry->aName);
+	size_t directoryLength = directory_length( entry->aName, length);
+	uint32 directory = aStrings.Add( entry->aName, directoryLength);
+	uint32 leaf = aStrings.Add( entry->aName + directoryLength, length - directoryLength);
+	uint32 kindId = aStrings.Add( kind, sizeof( kind));
+
+	// extra field and comment are one record, comment is rare
+	uint32 blob = 0;
+	if( entry->aCommentSize == 0)
+		blob = entry->aExtraSize > 0 ? aStrings.Add( entry->aExtra, entry->aExtraSize) : 0;
+	else
+	{
+		uint8 *data = (uint8*)malloc( entry->aExtraSize + entry->aCommentSize);
+		if( data == NULL)
+			return B_NO_MEMORY;
+		if( entry->aExtraSize > 0)
+			memcpy( data, entry->aExtra, entry->aExtraSize);
+		memcpy( data + entry->aExtraSize, entry->aComment, entry->aCommentSize);
+		blob = aStrings.Add( data, entry->aExtraSize + entry->aCommentSize);
+		free( data);
+		if( blob == 0)
+			return B_NO_MEMORY;
+	}
+	if( directory == 0 || leaf == 0 || kindId == 0 || ( blob == 0 && entry->aExtraSize > 0))
+		return B_NO_MEMORY;
+
+	// values which don't fit in 32 bits go to table of their own
+	bool large = entry->aCompressedSize >= ENTRY_TABLE_LARGE || entry->aSize >= ENTRY_TABLE_LARGE
+		|| entry->aOffset >= ENTRY_TABLE_LARGE;
+	if( large)
+	{
+		if( aLargeCount == aLargeSize)
+		{
+			int32 size = aLargeSize > 0 ? aLargeSize * 2 : 64;
+			large_values *values = (large_values*)realloc( aLarge, sizeof( large_values) * size);
+			if( values == NULL)
+				return B_NO_MEMORY;
+			aLarge = values;
+			aLargeSize = size;
+		}
+		aLarge[aLargeCount].index = aCount;
+		aLarge[aLargeCount].value[0] = entry->aCompressedSize;
+		aLarge[aLargeCount].value[1] = entry->aSize;
+		aLarge[aLargeCount].value[2] = entry->aOffset;
+		aLargeCount++;
+	}
+
+	int32 index = aCount++;
+	aColumns[COLUMN_DIRECTORY][index] = directory;
+	aColumns[COLUMN_LEAF][index] = leaf;
+	aColumns[COLUMN_KIND][index] = kindId;
+	aColumns[COLUMN_BLOB][index] = blob;
+	aColumns[COLUMN_TIME][index] = ( (uint32)entry->aDate << 16) | entry->aTime;
+	aColumns[COLUMN_CRC][index] = entry->aCrc;
+	aColumns[COLUMN_COMPRESSED][index] = large ? ENTRY_TABLE_LARGE : entry->aCompressedSize;
+	aColumns[COLUMN_SIZE][index] = large ? ENTRY_TABLE_LARGE : entry->aSize;
+	aColumns[COLUMN_OFFSET][index] = large ? ENTRY_TABLE_LARGE : entry->aOffset;
+	aDeleted[index >> 5] &= ~( 1 << ( index & 31));
+
+	uint32 slot = NameHash( index) & ( aNameHashSize - 1);
+	while( aNameHash[slot] != 0)
+		slot = ( slot + 1) & ( aNameHashSize - 1);
+	aNameHash[slot] = index + 1;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Size or offset - from column, or from table of ZIP64 values (entries are added in order, so it's sorted)
+//---------------------------------------------------
+uint64
+EntryTable::Value( int32 column, int32 index) const
+{
+	uint32 value = aColumns[column][index];
+	if( value != ENTRY_TABLE_LARGE)
+		return value;
+
+	int32 low = 0, high = aLargeCount - 1;
+	while( low <= high)
+	{
+		int32 middle = ( low + high) / 2;
+		if( aLarge[middle].index == index)
+			return aLarge[middle].value[column - COLUMN_COMPRESSED];
+		if( aLarge[middle].index < index)
+			low = middle + 1;
+		else
+			high = middle - 1;
+	}
+	return value;
+}
+
+//---------------------------------------------------
+//	Fill entry with copy of one in table - entry's buffers are reused, so it's best kept for more calls
+//---------------------------------------------------
+status_t
+EntryTable::Get( int32 index, ZipEntry *entry) const
+{
+	if( index < 0 || index >= aCount)
+		return B_BAD_INDEX;
+
+	uint32 directory = aColumns[COLUMN_DIRECTORY][index];
+	uint32 leaf = aColumns[COLUMN_LEAF][index];
+	entry->SetName( aStrings.String( directory), aStrings.Length( directory),
+		aStrings.String( leaf), aStrings.Length( leaf));
+
+	const uint8 *kind = (const uint8*)aStrings.String( aColumns[COLUMN_KIND][index]);
+	entry->aVersionMadeBy = zip_get16( kind);
+	entry->aVersionNeeded = zip_get16( kind + 2);
+	entry->aFlags = zip_get16( kind + 4);
+	entry->aMethod = zip_get16( kind + 6);
+	entry->aInternalAttributes = zip_get16( kind + 8);
+	entry->aExternalAttributes = zip_get32( kind + 10);
+	uint16 extraSize = zip_get16( kind + 14);
+
+	uint32 blob = aColumns[COLUMN_BLOB][index];
+	const uint8 *data = blob != 0 ? (const uint8*)aStrings.String( blob) : NULL;
+	size_t size = blob != 0 ? aStrings.Length( blob) : 0;
+	entry->SetExtra( data, extraSize);
+	entry->SetComment( (const char*)data + extraSize, size - extraSize);
+
+	uint32 time = aColumns[COLUMN_TIME][index];
+	entry->aDate = time >> 16;
+	entry->aTime = time & 0xffff;
+	entry->aCrc = aColumns[COLUMN_CRC][index];
+	entry->aCompressedSize = CompressedSize( index);
+	entry->aSize = Size( index);
+	entry->aOffset = Offset( index);
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Index of entry with given name (last one, if there are more), -1 if there is none
+//	name which has part not in string pool can't be in table, so most misses don't even touch it
+//---------------------------------------------------
+int32
+EntryTable::Find( const char *name) const
+{
+	if( aNameHashSize == 0)
+		return -1;
+
+	size_t length = strlen( name);
+	size_t directoryLength = directory_length( name, length);
+	uint32 directory = aStrings.Find( name, directoryLength);
+	uint32 leaf = directory != 0 ? aStrings.Find( name + directoryLength, length - directoryLength) : 0;
+	if( leaf == 0)
+		return -1;
+
+	int32 found = -1;
+	uint32 slot = name_hash( directory, leaf) & ( aNameHashSize - 1);
+	while( aNameHash[slot] != 0)
+	{
+		int32 index = aNameHash[slot] - 1;
+		if( aColumns[COLUMN_DIRECTORY][index] == directory && aColumns[COLUMN_LEAF][index] == leaf
+			&& !IsDeleted( index) && index > found)
+			found = index;
+		slot = ( slot + 1) & ( aNameHashSize - 1);
+	}
+	return found;
+}
+
+//---------------------------------------------------
+//	Mark entry as replaced or removed, it stays in table
+//---------------------------------------------------
+void
+EntryTable::SetDeleted( int32 index)
+{
+	if( index >= 0 && index < aCount)
+		aDeleted[index >> 5] |= 1 << ( index & 31);
+}
+
+//---------------------------------------------------
+//	Bytes taken by table - columns, strings and hash tables
+//---------------------------------------------------
+size_t
+EntryTable::Memory() const
+{
+	return aStrings.Memory() + (size_t)aSize * ( sizeof( uint32) * COLUMN_COUNT) + aSize / 8
+		+ aLargeSize * sizeof( large_values) + aNameHashSize * sizeof( int32);
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: bench
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Name of n-th member of made up source tree - 20 files in each directory, file names repeat in other directories
+//---------------------------------------------------
+static void
+bench_name( int32 index, char *name, size_t size)
+{
+	static const char *stems[] = { "main", "Makefile", "util", "index", "README", "test", "config", "data" };
+	static const char *types[] = { "cpp", "h", "txt", "html", "png", "c", "rdef", "sh" };
+	uint32 seed = index * 2654435761U;
+	snprintf( name, size, "Archiver-sources/src/module%03" B_PRId32 "/part%02" B_PRId32 "/%s%" B_PRId32 ".%s",
+		index / 2000, ( index / 20) % 100, stems[( seed >> 8) % 8], ( seed >> 12) % 50, types[( seed >> 20) % 8]);
+}
+
+//---------------------------------------------------
+//	Heap block malloc() gives for size bytes
+//---------------------------------------------------
+static size_t
+heap_block( size_t size)
+{
+	return ( size + 8 + 15) & ~15;
+}
+
+//---------------------------------------------------
+//	"Archiver --bench-entries [count]"
+//	memory taken by entry table compared to object (and strings) for each entry, time to add, find and read entries
+//---------------------------------------------------
+int
+entry_table_bench_main( int argc, char **argv)
+{
+	int32 count = argc > 0 ? atoi( argv[0]) : ENTRY_BENCH_COUNT;
+	if( count <= 0)
+	{
+		fprintf( stderr, "usage: Archiver --bench-entries [count]\n");
+		return 1;
+	}
+
+	EntryTable table;
+	ZipEntry entry;
+	char name[B_PATH_NAME_LENGTH];
+	uint8 extra[9];
+	size_t objects = 0;
+
+	bigtime_t start = system_time();
+	for( int32 index = 0; index < count; index++)
+	{
+		// extended timestamp, files in one directory were saved at once
+		bench_name( index, name, sizeof( name));
+		zip_put16( extra, 0x5455);
+		zip_put16( extra + 2, 5);
+		extra[4] = 1;
+		zip_put32( extra + 5, 1000000000 + index / 20);
+
+		entry.SetName( name);
+		entry.SetExtra( extra, sizeof( extra));
+		entry.aFlags = ZIP_FLAG_UTF8;
+		entry.aMethod = index % 3 ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED;
+		entry.aExternalAttributes = (uint32)( S_IFREG | 0644) << 16;
+		entry.aCrc = index * 2654435761U;
+		entry.aSize = index % 100000;
+		entry.aCompressedSize = entry.aSize / 2;
+		entry.aOffset = (uint64)index * 4096;
+		if( table.Add( &entry) != B_OK)
+		{
+			fprintf( stderr, "Archiver: no memory for %" B_PRId32 " entries\n", count);
+			return 1;
+		}
+
+		// what list of ZipEntry objects took - pointer in list, 2 slots in hash table, object (96 bytes), name and extra field
+		objects += sizeof( void*) + 2 * sizeof( int32) + heap_block( 96) + heap_block( strlen( name) + 1) + heap_block( sizeof( extra));
+	}
+	bigtime_t addTime = system_time() - start;
+
+	start = system_time();
+	int32 found = 0;
+	for( int32 index = 0; index < count; index++)
+	{
+		bench_name( index, name, sizeof( name));
+		found += table.Find( name) == index;
+	}
+	bigtime_t findTime = system_time() - start;
+
+	start = system_time();
+	int32 same = 0;
+	for( int32 index = 0; index < count; index++)
+	{
+		bench_name( index, name, sizeof( name));
+		same += table.Get( index, &entry) == B_OK && !strcmp( entry.aName, name) && entry.aOffset == (uint64)index * 4096
+			&& entry.aExtraSize == sizeof( extra) && zip_get32( entry.aExtra + 5) == (uint32)( 1000000000 + index / 20);
+	}
+	bigtime_t getTime = system_time() - start;
+
+	printf( "%" B_PRId32 " entries, %" B_PRId32 " distinct strings\n", count, table.CountStrings());
+	printf( "entry table: %.1f MB (%.1f bytes/entry)\n", table.Memory() / 1048576.0, table.Memory() / (double)count);
+	printf( "object for each entry: %.1f MB (%.1f bytes/entry)\n", objects / 1048576.0, objects / (double)count);
+	printf( "add %.0f ns, find %.0f ns, get %.0f ns per entry\n", addTime * 1000.0 / count,
+		findTime * 1000.0 / count, getTime * 1000.0 / count);
+
+	if( found != count || same != count)
+	{
+		fprintf( stderr, "Archiver: %" B_PRId32 " entries found, %" B_PRId32 " read back right, of %" B_PRId32 "\n", found, same, count);
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,162 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+#ifndef __ENTRY_TABLE_H_
+#define __ENTRY_TABLE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <SupportDefs.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	STRING_POOL_CHUNK_SHIFT		20		// arena is made of 1MB chunks, id of string is it's place in them
+#define	STRING_POOL_CHUNK_SIZE		(1 << STRING_POOL_CHUNK_SHIFT)
+#define	STRING_POOL_MAX_CHUNKS		4096	// ids are uint32
+#define	ENTRY_TABLE_FIRST_SIZE		1024	// entries the columns have room for at first, they double when full
+#define	ENTRY_TABLE_LARGE			0xffffffff	// value in column is in table of ZIP64 values
+#define	ENTRY_BENCH_COUNT			1000000	// entries made by "--bench-entries"
+
+class ZipEntry;
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Interned strings (or any data) kept in arena - each is stored once, whatever number of times it's added
+//	id is never 0, it stays valid until MakeEmpty()
+//---------------------------------------------------
+class StringPool
+{
+	public:
+							StringPool();
+							~StringPool();
+
+		void				MakeEmpty();
+		uint32				Add( const void *data, size_t size);
+		uint32				Find( const void *data, size_t size) const;
+		const char			*String( uint32 id) const { return (const char*)Record( id) + 8; };
+		size_t				Length( uint32 id) const { return *(uint32*)( Record( id) + 4); };
+
+		int32				CountStrings() const { return aCount; };
+		size_t				Memory() const;
+
+	private:
+		uint8				*Record( uint32 id) const { return aChunks[id >> STRING_POOL_CHUNK_SHIFT] + ( id & ( STRING_POOL_CHUNK_SIZE - 1)); };
+		uint32				Lookup( const void *data, size_t size, uint32 hash, uint32 *slot) const;
+		bool				GrowHash();
+
+		uint8				**aChunks;
+		int32				aChunkCount;
+		size_t				aChunkUsed;		// of last chunk
+		uint32				*aHash;			// ids, by hash of data
+		uint32				aHashSize;
+		int32				aCount;
+};
+
+//---------------------------------------------------
+//	Members of ZIP archive, column by column - there is no object for each of them
+//	name is split to directory and last part, both are interned, so members in one directory share it
+//	attributes which are mostly the same (version, flags, method, mode) are interned together too,
+//	extra field and comment are interned as one, sizes and offset take 32 bits unless they need ZIP64
+//---------------------------------------------------
+class EntryTable
+{
+	public:
+							EntryTable();
+							~EntryTable();
+
+		void				MakeEmpty();
+		int32				CountEntries() const { return aCount; };
+		status_t			Add( const ZipEntry *entry);
+		status_t			Get( int32 index, ZipEntry *entry) const;
+		int32				Find( const char *name) const;
+
+		void				SetDeleted( int32 index);
+		bool				IsDeleted( int32 index) const { return ( aDeleted[index >> 5] >> ( index & 31)) & 1; };
+		uint64				CompressedSize( int32 index) const { return Value( COLUMN_COMPRESSED, index); };
+		uint64				Size( int32 index) const { return Value( COLUMN_SIZE, index); };
+		uint64				Offset( int32 index) const { return Value( COLUMN_OFFSET, index); };
+
+		size_t				Memory() const;
+		int32				CountStrings() const { return aStrings.CountStrings(); };
+
+	private:
+		enum
+		{
+			COLUMN_DIRECTORY = 0,
+			COLUMN_LEAF,
+			COLUMN_KIND,
+			COLUMN_BLOB,
+			COLUMN_TIME,
+			COLUMN_CRC,
+			COLUMN_COMPRESSED,
+			COLUMN_SIZE,
+			COLUMN_OFFSET,
+			COLUMN_COUNT
+		};
+
+		struct large_values
+		{
+			int32			index;
+			uint64			value[3];	// compressed size, size, offset
+		};
+
+		uint64				Value( int32 column, int32 index) const;
+		bool				Grow();
+		bool				GrowNameHash();
+		uint32				NameHash( int32 index) const;
+
+		StringPool			aStrings;
+		uint32				*aColumns[COLUMN_COUNT];
+		uint32				*aDeleted;		// bit for each entry
+		int32				aCount;
+		int32				aSize;			// entries columns have room for
+
+		large_values		*aLarge;		// by index of entry, for those which need ZIP64
+		int32				aLargeCount;
+		int32				aLargeSize;
+
+		int32				*aNameHash;		// index+1 of entries, by directory and last part of name
+		int32				aNameHashSize;
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+int			entry_table_bench_main( int argc, char **argv);
+
+#endif /*__ENTRY_TABLE_H_*/
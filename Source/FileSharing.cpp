@@ -0,0 +1,523 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "FileSharing.h"
+#include "Checksum.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: FileSharing
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor - links: other hard links of stored file are stored as links to it,
+//	content: files with the same content as stored file too
+//---------------------------------------------------
+FileSharing::FileSharing( bool links, bool content)
+	:aStoreLinks( links || content),
+	aStoreContent( content),
+	aFiles( NULL),
+	aCount( 0),
+	aSize( 0),
+	aNodes( NULL),
+	aSizes( NULL),
+	aSlots( 0),
+	aLastDevice( -1),
+	aLastNode( 0),
+	aLastHash( 0),
+	aLastHashed( false),
+	aBuffer( NULL),
+	aLinks( 0),
+	aDuplicates( 0),
+	aLinkBytes( 0),
+	aDuplicateBytes( 0),
+	aHoleBytes( 0),
+	aHashedBytes( 0)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+FileSharing::~FileSharing()
+{
+	free( aFiles);
+	free( aNodes);
+	free( aSizes);
+	free( aBuffer);
+}
+
+//---------------------------------------------------
+//	Slot of hash tables for node and size
+//---------------------------------------------------
+static inline uint32
+node_slot( dev_t device, ino_t node, int32 slots)
+{
+	return (uint32)( node * 2654435761U + device) % slots;
+}
+
+static inline uint32
+size_slot( off_t size, int32 slots)
+{
+	return (uint32)( ( size ^ ( size >> 32)) * 2654435761U) % slots;
+}
+
+//---------------------------------------------------
+//	Make room for more files - hash tables are twice as big as files in them
+//---------------------------------------------------
+bool
+FileSharing::Grow()
+{
+	int32 size = aSize > 0 ? aSize * 2 : FILE_SHARING_FIRST_SIZE;
+	shared_file *files = (shared_file*)realloc( aFiles, size * sizeof( shared_file));
+	if( files == NULL)
+		return false;
+	aFiles = files;
+
+	int32 *nodes = (int32*)calloc( size * 2, sizeof( int32));
+	int32 *sizes = (int32*)calloc( size * 2, sizeof( int32));
+	if( nodes == NULL || sizes == NULL)
+	{
+		free( nodes);
+		free( sizes);
+		return false;
+	}
+	free( aNodes);
+	free( aSizes);
+	aNodes = nodes;
+	aSizes = sizes;
+	aSize = size;
+	aSlots = size * 2;
+
+	// files are put back in order they were added, so last of each size ends in table
+	for( int32 index = 0; index < aCount; index++)
+	{
+		shared_file *file = &aFiles[index];
+		uint32 slot = node_slot( file->device, file->node, aSlots);
+		while( aNodes[slot] != 0)
+			slot = ( slot + 1) % aSlots;
+		aNodes[slot] = index + 1;
+
+		if( file->size < 0)
+			continue;
+		slot = size_slot( file->size, aSlots);
+		while( aSizes[slot] != 0 && aFiles[aSizes[slot] - 1].size != file->size)
+			slot = ( slot + 1) % aSlots;
+		aSizes[slot] = index + 1;
+	}
+	return true;
+}
+
+//---------------------------------------------------
+//	Index of stored file which st is hard link of, -1 if there is none
+//---------------------------------------------------
+int32
+FileSharing::FindNode( const struct stat *st) const
+{
+	if( aSlots == 0)
+		return -1;
+
+	uint32 slot = node_slot( st->st_dev, st->st_ino, aSlots);
+	for( ; aNodes[slot] != 0; slot = ( slot + 1) % aSlots)
+	{
+		const shared_file *file = &aFiles[aNodes[slot] - 1];
+		if( file->node == st->st_ino && file->device == st->st_dev)
+			return aNodes[slot] - 1;
+	}
+	return -1;
+}
+
+//---------------------------------------------------
+//	Index of last stored file of size, -1 if there is none - the others are chained by next
+//---------------------------------------------------
+int32
+FileSharing::FindSize( off_t size) const
+{
+	if( aSlots == 0)
+		return -1;
+
+	uint32 slot = size_slot( size, aSlots);
+	for( ; aSizes[slot] != 0; slot = ( slot + 1) % aSlots)
+	{
+		if( aFiles[aSizes[slot] - 1].size == size)
+			return aSizes[slot] - 1;
+	}
+	return -1;
+}
+
+//---------------------------------------------------
+//	Hash of file's content - XXH64 of each chunk, seeded by hash of chunk before
+//	false if file can't be read, or it's size isn't what it was
+//---------------------------------------------------
+bool
+FileSharing::Hash( const char *path, off_t size, uint64 *hash, int32 *cancel)
+{
+	if( aBuffer == NULL && ( aBuffer = (uint8*)malloc( FILE_SHARING_BUFFER_SIZE * 2)) == NULL)
+		return false;
+
+	int fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0)
+		return false;
+
+	uint64 value = (uint64)size;
+	off_t read = 0;
+	bool done = false;
+	while( !done && ( cancel == NULL || !*cancel))
+	{
+		ssize_t bytes = ::read( fd, aBuffer, FILE_SHARING_BUFFER_SIZE);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes < 0)
+			break;
+		done = bytes == 0;
+		if( bytes > 0)
+			value = checksum_hash64( aBuffer, bytes, value);
+		read += bytes;
+		aHashedBytes += bytes;
+	}
+	close( fd);
+
+	*hash = value;
+	return done && read == size;
+}
+
+//---------------------------------------------------
+//	Whether files have the same content, byte for byte - hashes can match by chance (or on purpose)
+//---------------------------------------------------
+bool
+FileSharing::Same( const char *path, const char *other, off_t size, int32 *cancel)
+{
+	if( aBuffer == NULL && ( aBuffer = (uint8*)malloc( FILE_SHARING_BUFFER_SIZE * 2)) == NULL)
+		return false;
+
+	int fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0)
+		return false;
+	int otherFd = open( other, O_RDONLY | O_CLOEXEC);
+	if( otherFd < 0)
+	{
+		close( fd);
+		return false;
+	}
+
+	uint8 *otherBuffer = aBuffer + FILE_SHARING_BUFFER_SIZE;
+	off_t offset = 0;
+	bool same = true;
+	while( same && offset < size)
+	{
+		if( cancel != NULL && *cancel)
+		{
+			same = false;
+			break;
+		}
+
+		size_t chunk = size - offset < FILE_SHARING_BUFFER_SIZE ? size - offset : FILE_SHARING_BUFFER_SIZE;
+		ssize_t bytes = pread( fd, aBuffer, chunk, offset);
+		ssize_t otherBytes = pread( otherFd, otherBuffer, chunk, offset);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		same = bytes > 0 && bytes == otherBytes && memcmp( aBuffer, otherBuffer, bytes) == 0;
+		if( bytes > 0)
+		{
+			offset += bytes;
+			aHashedBytes += bytes * 2;
+		}
+	}
+
+	// file which grew since it was hashed isn't the same either
+	if( same && pread( fd, aBuffer, 1, size) + pread( otherFd, otherBuffer, 1, size) != 0)
+		same = false;
+
+	close( fd);
+	close( otherFd);
+	return same;
+}
+
+//---------------------------------------------------
+//	Name of stored member file at path is copy of - other hard link of it, or file with the same content
+//	NULL if file has to be stored (it isn't read unless stored file of the same size was there before,
+//	and it's compared to stored file byte for byte only if their hashes match)
+//---------------------------------------------------
+const char *
+FileSharing::FindCopy( const char *path, const struct stat *st, int32 *cancel)
+{
+	aLastHashed = false;
+	aLastDevice = st->st_dev;
+	aLastNode = st->st_ino;
+
+	int32 index = aStoreLinks && st->st_nlink > 1 ? FindNode( st) : -1;
+	if( index >= 0)
+	{
+		aLinks++;
+		aLinkBytes += st->st_size;
+		return aStrings.String( aFiles[index].name);
+	}
+
+	if( !aStoreContent || st->st_size < FILE_SHARING_MIN_SIZE)
+		return NULL;
+
+	// files of other sizes can't be the same, they aren't read
+	index = FindSize( st->st_size);
+	if( index < 0)
+		return NULL;
+
+	if( !Hash( path, st->st_size, &aLastHash, cancel))
+		return NULL;
+	aLastHashed = true;
+
+	for( ; index >= 0; index = aFiles[index].next - 1)
+	{
+		shared_file *file = &aFiles[index];
+		if( !file->hashed)
+		{
+			// file which can't be hashed anymore gets hash of nothing, it doesn't match
+			if( !Hash( aStrings.String( file->path), file->size, &file->hash, cancel))
+				file->hash = 0;
+			file->hashed = true;
+		}
+		// file is linked only if it's content is really the same, otherwise it's stored
+		if( file->hash == aLastHash && file->hash != 0 && Same( path, aStrings.String( file->path), st->st_size, cancel))
+		{
+			aDuplicates++;
+			aDuplicateBytes += st->st_size;
+			return aStrings.String( file->name);
+		}
+	}
+	return NULL;
+}
+
+//---------------------------------------------------
+//	File at path was stored as member name - later files may be copies of it
+//---------------------------------------------------
+void
+FileSharing::Added( const char *path, const char *name, const struct stat *st)
+{
+	bool linked = aStoreLinks && st->st_nlink > 1;
+	bool content = aStoreContent && st->st_size >= FILE_SHARING_MIN_SIZE;
+	if( !linked && !content)
+		return;
+
+	if( aCount * 2 >= aSlots && !Grow())
+		return;
+
+	shared_file *file = &aFiles[aCount];
+	file->device = st->st_dev;
+	file->node = st->st_ino;
+	file->size = content ? st->st_size : -1;
+	file->hashed = aLastHashed && aLastDevice == st->st_dev && aLastNode == st->st_ino;
+	file->hash = file->hashed ? aLastHash : 0;
+	file->name = aStrings.Add( name, strlen( name) + 1);
+	file->path = content ? aStrings.Add( path, strlen( path) + 1) : 0;
+	file->next = 0;
+	aLastHashed = false;
+
+	uint32 slot = node_slot( file->device, file->node, aSlots);
+	while( aNodes[slot] != 0)
+		slot = ( slot + 1) % aSlots;
+	aNodes[slot] = aCount + 1;
+
+	aCount++;
+
+	// hard link which is too small to be hashed isn't found by size
+	if( !content)
+		return;
+	slot = size_slot( file->size, aSlots);
+	while( aSizes[slot] != 0 && aFiles[aSizes[slot] - 1].size != file->size)
+		slot = ( slot + 1) % aSlots;
+	file->next = aSizes[slot];
+	aSizes[slot] = aCount;
+}
+
+//---------------------------------------------------
+//	What wasn't read, for report of job - time is estimated from speed job went through data of files at
+//	(holes included, ZIP still compresses them as zeros)
+//---------------------------------------------------
+void
+FileSharing::GetReport( BString *report, off_t bytesRead, bigtime_t time) const
+{
+	if( aLinks == 0 && aDuplicates == 0 && aHoleBytes == 0)
+		return;
+
+	char text[192];
+	if( aLinks > 0 || aDuplicates > 0)
+	{
+		sprintf( text, ", %" B_PRId32 " hard links and %" B_PRId32 " identical files stored as links", aLinks, aDuplicates);
+		*report << text;
+	}
+	if( aHoleBytes > 0)
+	{
+		sprintf( text, ", %.1f MB of holes skipped", aHoleBytes / 1048576.0);
+		*report << text;
+	}
+
+	off_t saved = SavedBytes();
+	off_t read = bytesRead + aHashedBytes + aHoleBytes;
+	if( saved > 0 && read > 0 && time > 0)
+		sprintf( text, " - %.1f MB less read (about %.1fs)", saved / 1048576.0, (double)saved * time / read / 1000000.0);
+	else
+		sprintf( text, " - %.1f MB read to find copies", aHashedBytes / 1048576.0);
+	*report << text;
+}
+
+//---------------------------------------------------
+//	Data segments of sparse file (offset and length of each, in one array), *segments is freed by caller
+//	0 if file has no holes worth storing it sparse, or system can't tell where they are
+//---------------------------------------------------
+int32
+FileSharing::DataSegments( int fd, off_t size, off_t **segments, off_t *holes)
+{
+	*segments = NULL;
+	*holes = 0;
+
+#if defined( SEEK_DATA) && defined( SEEK_HOLE)
+	// file which takes all of it's blocks has no holes - most don't, so they aren't seeked
+	struct stat st;
+	if( fstat( fd, &st) != 0 || (off_t)st.st_blocks * 512 >= size)
+		return 0;
+
+	off_t *map = NULL;
+	int32 count = 0;
+	int32 room = 0;
+	off_t data = 0;
+	off_t stored = 0;
+	bool failed = false;
+	while( !failed && data < size)
+	{
+		data = lseek( fd, data, SEEK_DATA);
+		// rest of file is hole
+		if( data < 0 && errno == ENXIO)
+			break;
+		off_t hole = data >= 0 ? lseek( fd, data, SEEK_HOLE) : -1;
+		if( hole > size)
+			hole = size;
+
+		// last segment is empty one at end of file, if file ends with hole
+		if( data < 0 || hole < 0 || count + 1 >= FILE_SHARING_MAX_SEGMENTS)
+			failed = true;
+		else if( count + 1 >= room)
+		{
+			room = room > 0 ? room * 2 : 16;
+			off_t *grown = (off_t*)realloc( map, room * 2 * sizeof( off_t));
+			if( grown != NULL)
+				map = grown;
+			failed = grown == NULL;
+		}
+		if( failed)
+			break;
+
+		map[count * 2] = data;
+		map[count * 2 + 1] = hole - data;
+		stored += hole - data;
+		count++;
+		data = hole;
+	}
+	lseek( fd, 0, SEEK_SET);
+
+	if( failed || size - stored < FILE_SHARING_MIN_HOLES)
+	{
+		free( map);
+		return 0;
+	}
+
+	if( count == 0 || map[count * 2 - 2] + map[count * 2 - 1] < size)
+	{
+		if( map == NULL && ( map = (off_t*)malloc( 2 * sizeof( off_t))) == NULL)
+			return 0;
+		map[count * 2] = size;
+		map[count * 2 + 1] = 0;
+		count++;
+	}
+	*segments = map;
+	*holes = size - stored;
+	return count;
+#else
+	return 0;
+#endif
+}
+
+//---------------------------------------------------
+//	Bytes of hole at offset of sparse file (0 if offset is in data segment, it's end is in *dataEnd)
+//	segment is index of segment offset is in or before, it only moves on as file is read from start to end
+//---------------------------------------------------
+off_t
+FileSharing::HoleAt( const off_t *segments, int32 count, int32 *segment, off_t offset, off_t size, off_t *dataEnd)
+{
+	while( *segment < count && segments[*segment * 2] + segments[*segment * 2 + 1] <= offset && segments[*segment * 2 + 1] > 0)
+		(*segment)++;
+
+	if( *segment >= count)
+	{
+		*dataEnd = size;
+		return offset < size ? size - offset : 0;
+	}
+
+	off_t start = segments[*segment * 2];
+	if( offset < start)
+	{
+		*dataEnd = offset;
+		return start - offset;
+	}
+	*dataEnd = start + segments[*segment * 2 + 1];
+	return 0;
+}
+
+//---------------------------------------------------
+//	Path of "to" relative to directory of "from" (both are names in archive) - to be freed by caller
+//---------------------------------------------------
+char *
+FileSharing::RelativePath( const char *from, const char *to)
+{
+	size_t common = 0;
+	for( size_t index = 0; from[index] != 0 && from[index] == to[index]; index++)
+	{
+		if( from[index] == '/')
+			common = index + 1;
+	}
+
+	int32 up = 0;
+	for( const char *slash = strchr( from + common, '/'); slash != NULL; slash = strchr( slash + 1, '/'))
+		up++;
+
+	char *path = (char*)malloc( up * 3 + strlen( to + common) + 1);
+	if( path == NULL)
+		return NULL;
+	path[0] = 0;
+	for( int32 index = 0; index < up; index++)
+		strcat( path, "../");
+	strcat( path, to + common);
+	return path;
+}
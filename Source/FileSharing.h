@@ -0,0 +1,131 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __FILE_SHARING_H_
+#define __FILE_SHARING_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <OS.h>
+#include <String.h>
+
+#include <sys/stat.h>
+#include <sys/types.h>
+
+#include "EntryTable.h"
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	FILE_SHARING_MIN_SIZE		1024	// smaller files aren't hashed, link to them takes about as much as they do
+#define	FILE_SHARING_FIRST_SIZE		256		// files tables have room for at first, they double when half full
+#define	FILE_SHARING_BUFFER_SIZE	(256 * 1024)	// files are hashed (and compared) in chunks this big, hash of each is seed of next
+#define	FILE_SHARING_MIN_HOLES		(64 * 1024)	// file with less bytes in holes is stored as it is
+#define	FILE_SHARING_MAX_SEGMENTS	65536	// file with more data segments is stored as it is (map would be too big)
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	File stored by archive, which later files may be copies of
+//---------------------------------------------------
+struct shared_file
+{
+	dev_t				device;
+	ino_t				node;
+	off_t				size;
+	uint64				hash;
+	uint32				name;			// of member, in aStrings
+	uint32				path;			// to hash file when file of same size comes
+	int32				next;			// index+1 of file of same size stored before
+	bool				hashed;
+};
+
+//---------------------------------------------------
+//	What archive doesn't have to read (and store) again - other hard links of file it stored,
+//	files with the same content as file it stored (found by size, then by hash, then compared) and holes of sparse files
+//	archive asks FindCopy() before it stores file, and tells Added() when it did
+//---------------------------------------------------
+class FileSharing
+{
+	public:
+							FileSharing( bool links, bool content);
+							~FileSharing();
+
+		const char			*FindCopy( const char *path, const struct stat *st, int32 *cancel);
+		void				Added( const char *path, const char *name, const struct stat *st);
+		void				AddHoles( off_t bytes) { aHoleBytes += bytes; };
+
+		int32				CountLinks() const { return aLinks; };
+		int32				CountDuplicates() const { return aDuplicates; };
+		off_t				SavedBytes() const { return aLinkBytes + aDuplicateBytes + aHoleBytes - aHashedBytes; };
+		void				GetReport( BString *report, off_t bytesRead, bigtime_t time) const;
+
+		static int32		DataSegments( int fd, off_t size, off_t **segments, off_t *holes);
+		static off_t		HoleAt( const off_t *segments, int32 count, int32 *segment, off_t offset, off_t size, off_t *dataEnd);
+		static char			*RelativePath( const char *from, const char *to);
+
+	private:
+		int32				FindNode( const struct stat *st) const;
+		int32				FindSize( off_t size) const;
+		bool				Hash( const char *path, off_t size, uint64 *hash, int32 *cancel);
+		bool				Same( const char *path, const char *other, off_t size, int32 *cancel);
+		bool				Grow();
+
+		bool				aStoreLinks;	// other hard links of stored file are stored as links
+		bool				aStoreContent;	// files with the same content too
+
+		StringPool			aStrings;
+		shared_file			*aFiles;
+		int32				aCount;
+		int32				aSize;
+		int32				*aNodes;		// index+1 of files with more hard links, by device and node
+		int32				*aSizes;		// index+1 of last file of each size
+		int32				aSlots;			// of both hash tables
+
+		// hash of file FindCopy() didn't find copy of, Added() keeps it
+		dev_t				aLastDevice;
+		ino_t				aLastNode;
+		uint64				aLastHash;
+		bool				aLastHashed;
+		uint8				*aBuffer;		// two chunks, to compare files
+
+		int32				aLinks;
+		int32				aDuplicates;
+		off_t				aLinkBytes;
+		off_t				aDuplicateBytes;
+		off_t				aHoleBytes;
+		off_t				aHashedBytes;	// read to find (and compare) duplicates, they count against savings
+};
+
+#endif /*__FILE_SHARING_H_*/
@@ -0,0 +1,561 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "JobTrace.h"
+#include "Archiver.h"
+#include "ArchiverService.h"
+#include "Preflight.h"
+#include "WorkerPool.h"
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Entry.h>
+#include <FindDirectory.h>
+#include <Path.h>
+#include <String.h>
+
+// text synthetic files are filled with, besides random bytes - deflate makes almost nothing of it
+static const char kFiller[] = "Archiver replays recorded job with files of the same sizes and compressibility. ";
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: recording
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Path of trace file - in settings directory
+//---------------------------------------------------
+static void
+trace_path( BPath *result)
+{
+	if( find_directory( B_USER_SETTINGS_DIRECTORY, result) != B_OK)
+		result->SetTo( ARCHIVER_SETTINGS_FILE_PATH);
+	result->Append( JOB_TRACE_FILE);
+}
+
+//---------------------------------------------------
+//	Add shape of file (or everything in directory) to record - what it is, how deep, extension and size
+//---------------------------------------------------
+static void
+trace_walk( const char *path, int32 depth, BString *record, int32 *entries, off_t *bytes)
+{
+	struct stat st;
+	if( lstat( path, &st) != 0)
+		return;
+
+	char line[64 + PREFLIGHT_EXTENSION_LENGTH];
+	(*entries)++;
+	if( S_ISDIR( st.st_mode))
+	{
+		sprintf( line, "d\t%" B_PRId32 "\n", depth);
+		*record << line;
+
+		DIR *dir = opendir( path);
+		if( dir == NULL)
+			return;
+		struct dirent *entry;
+		while( ( entry = readdir( dir)) != NULL)
+		{
+			if( !strcmp( entry->d_name, ".") || !strcmp( entry->d_name, ".."))
+				continue;
+			BString child( path);
+			child << "/" << entry->d_name;
+			trace_walk( child.String(), depth + 1, record, entries, bytes);
+		}
+		closedir( dir);
+	}
+	else if( S_ISREG( st.st_mode))
+	{
+		const char *leaf = strrchr( path, '/');
+		char extension[PREFLIGHT_EXTENSION_LENGTH];
+		Preflight::ExtensionOf( leaf != NULL ? leaf + 1 : path, extension);
+		sprintf( line, "f\t%" B_PRId32 "\t%s\t%" B_PRIdOFF "\n", depth, extension, st.st_size);
+		*record << line;
+		*bytes += st.st_size;
+	}
+	else
+	{
+		sprintf( line, "l\t%" B_PRId32 "\n", depth);
+		*record << line;
+	}
+}
+
+//---------------------------------------------------
+//	Write record of job to trace (task of WorkerPool, Data is BMessage made by job_trace_submit())
+//	record is written at once, so records of jobs ending together don't mix
+//---------------------------------------------------
+static int32
+record_job( void *Data)
+{
+	BMessage *job = (BMessage*)Data;
+	BMessage settings;
+	BMessage refs;
+	const char *archive = NULL;
+	bigtime_t time = 0;
+	bigtime_t cpu = 0;
+	int32 result = B_OK;
+	int32 level = ARCHIVER_SETTINGS_LEVEL_DEF;
+	job->FindMessage( "settings", &settings);
+	job->FindMessage( "refs", &refs);
+	job->FindString( "archive", &archive);
+	job->FindInt64( "time", &time);
+	job->FindInt64( "cpu", &cpu);
+	job->FindInt32( "result", &result);
+	settings.FindInt32( ARCHIVER_SETTINGS_LEVEL, &level);
+
+	// shape of files, and how each extension compresses
+	BString tree;
+	int32 entries = 0;
+	off_t bytes = 0;
+	int32 sampleLevel = ARCHIVER_SETTINGS_LEVEL_DEF;
+	job->FindInt32( "sample_level", &sampleLevel);
+	Preflight preflight( sampleLevel > 0 ? sampleLevel : ARCHIVER_SETTINGS_LEVEL_DEF);
+	entry_ref ref;
+	for( int32 index = 0; refs.FindRef( "refs", index, &ref) == B_OK; index++)
+	{
+		BPath path( &ref);
+		if( path.InitCheck() != B_OK)
+			continue;
+		trace_walk( path.Path(), 0, &tree, &entries, &bytes);
+		preflight.AddPath( path.Path());
+	}
+	preflight.Sample();
+
+	BString record;
+	char line[256];
+	struct stat st;
+	sprintf( line, "job\t%" B_PRId32 "\t%" B_PRId32 "\t%" B_PRIdOFF "\t%" B_PRIdOFF "\t%" B_PRId64 "\t%" B_PRId64 "\t%" B_PRId32 "\n",
+		(int32)real_time_clock(), entries, bytes, archive != NULL && stat( archive, &st) == 0 ? st.st_size : (off_t)0, time, cpu, result);
+	record << line;
+
+	const char *value;
+	bool verify = false;
+	settings.FindBool( ARCHIVER_SETTINGS_VERIFY, &verify);
+	record << "rule";
+	record << "\t" << ( settings.FindString( ARCHIVER_SETTINGS_FILE_DESC, &value) == B_OK ? value : "");
+	record << "\t" << ( settings.FindString( ARCHIVER_SETTINGS_FILE_DESC2, &value) == B_OK ? value : "");
+	record << "\t" << ( settings.FindString( ARCHIVER_SETTINGS_FILE_MIME, &value) == B_OK ? value : "");
+	record << "\t" << ( settings.FindString( ARCHIVER_SETTINGS_FILE_EXT, &value) == B_OK ? value : "");
+	record << "\t" << level << "\t" << (int32)verify;
+	for( int32 index = 0; settings.FindString( ARCHIVER_SETTINGS_OPTION, index, &value) == B_OK; index++)
+		record << "\t" << value;
+	record << "\n";
+
+	for( int32 index = 0; index < preflight.CountExtensions(); index++)
+	{
+		const preflight_extension *extension = preflight.ExtensionAt( index);
+		if( extension->taken == 0)
+			continue;
+		sprintf( line, "ratio\t%s\t%.4f\n", extension->name[0] ? extension->name : "(none)", preflight.Ratio( extension));
+		record << line;
+	}
+	sprintf( line, "ratio\t*\t%.4f\n", preflight.Ratio( NULL));
+	record << line << tree << "end\n";
+
+	BPath path;
+	trace_path( &path);
+	int fd = open( path.Path(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+	if( fd >= 0)
+	{
+		write( fd, record.String(), record.Length());
+		close( fd);
+	}
+
+	delete job;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Record job which has just ended - it's walked and sampled by task of WorkerPool, so job doesn't wait for it
+//	level is deflate's, which stands in for rule's tools (0 if rule doesn't compress)
+//---------------------------------------------------
+void
+job_trace_submit( BMessage *settings, BMessage *refs, const char *archive, int32 level, bigtime_t time, bigtime_t cpu, status_t result)
+{
+	BMessage *job = new BMessage();
+	job->AddMessage( "settings", settings);
+	job->AddMessage( "refs", refs);
+	job->AddString( "archive", archive);
+	job->AddInt32( "sample_level", level);
+	job->AddInt64( "time", time);
+	job->AddInt64( "cpu", cpu);
+	job->AddInt32( "result", result);
+	WorkerPool::Default()->SubmitBlocking( NULL, record_job, (void*)job);
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: replaying
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Recorded job, while it's tree is made
+//---------------------------------------------------
+struct replay_job
+{
+	int32				number;
+	int32				entries;
+	off_t				bytes;
+	off_t				archiveSize;
+	bigtime_t			time;
+	BMessage			rule;
+	BMessage			ratios;			// by extension
+	BMessage			refs;
+	BMessage			names;			// of entries at depth 0
+	BString				root;
+	BString				directories[JOB_TRACE_MAX_DEPTH];	// last directory made at each depth
+	int32				made;			// entries made so far - their names are numbered
+	uint32				seed;
+	uint8				*buffer;
+};
+
+//---------------------------------------------------
+//	Remove file, or directory with everything in it
+//---------------------------------------------------
+static void
+remove_tree( const char *path)
+{
+	struct stat st;
+	if( lstat( path, &st) != 0)
+		return;
+	if( S_ISDIR( st.st_mode))
+	{
+		DIR *dir = opendir( path);
+		if( dir != NULL)
+		{
+			struct dirent *entry;
+			while( ( entry = readdir( dir)) != NULL)
+			{
+				if( !strcmp( entry->d_name, ".") || !strcmp( entry->d_name, ".."))
+					continue;
+				BString child( path);
+				child << "/" << entry->d_name;
+				remove_tree( child.String());
+			}
+			closedir( dir);
+		}
+		rmdir( path);
+	}
+	else
+		unlink( path);
+}
+
+//---------------------------------------------------
+//	Make synthetic file which compresses about as well as ratio says - each chunk has that much random bytes
+//---------------------------------------------------
+static status_t
+make_file( replay_job *job, const char *path, off_t size, double ratio)
+{
+	int fd = open( path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if( fd < 0)
+		return errno;
+
+	int32 random = ratio <= 0 ? 0 : ratio >= 1 ? JOB_TRACE_CHUNK : (int32)( ratio * JOB_TRACE_CHUNK);
+	status_t status = B_OK;
+	while( size > 0 && status == B_OK)
+	{
+		for( int32 chunk = 0; chunk < JOB_TRACE_BLOCK; chunk += JOB_TRACE_CHUNK)
+		{
+			uint8 *data = job->buffer + chunk;
+			for( int32 index = 0; index < random; index++)
+			{
+				job->seed = job->seed * 1103515245 + 12345;
+				data[index] = job->seed >> 16;
+			}
+			for( int32 index = random; index < JOB_TRACE_CHUNK; index++)
+				data[index] = kFiller[index % ( sizeof( kFiller) - 1)];
+		}
+
+		size_t length = size < JOB_TRACE_BLOCK ? (size_t)size : JOB_TRACE_BLOCK;
+		if( write( fd, job->buffer, length) != (ssize_t)length)
+			status = errno;
+		size -= length;
+	}
+	close( fd);
+	return status;
+}
+
+//---------------------------------------------------
+//	Make entry of tree from line of record ("d", "f" or "l")
+//---------------------------------------------------
+static status_t
+make_entry( replay_job *job, char type, int32 depth, const char *extension, off_t size)
+{
+	if( depth < 0)
+		return B_BAD_DATA;
+	if( depth >= JOB_TRACE_MAX_DEPTH)
+		depth = JOB_TRACE_MAX_DEPTH - 1;
+
+	// entry goes to last directory made one level up, if there is none it stays at depth 0
+	BString name;
+	name << ( type == 'd' ? "dir" : type == 'f' ? "file" : "link") << job->made++;
+	if( type == 'f')
+		name << extension;
+	if( depth > 0 && job->directories[depth - 1].Length() == 0)
+		depth = 0;
+	BString path( depth > 0 ? job->directories[depth - 1] : job->root);
+	path << "/" << name;
+
+	status_t status = B_OK;
+	if( type == 'd')
+	{
+		if( mkdir( path.String(), 0755) != 0)
+			status = errno;
+		job->directories[depth] = path;
+		for( int32 deeper = depth + 1; deeper < JOB_TRACE_MAX_DEPTH && job->directories[deeper].Length() > 0; deeper++)
+			job->directories[deeper].Truncate( 0);
+	}
+	else if( type == 'f')
+	{
+		double ratio;
+		if( job->ratios.FindDouble( extension[0] ? extension : "(none)", &ratio) != B_OK
+			&& job->ratios.FindDouble( "*", &ratio) != B_OK)
+			ratio = 1.0;
+		status = make_file( job, path.String(), size, ratio);
+	}
+	else if( symlink( "missing", path.String()) != 0)
+		status = errno;
+
+	if( status == B_OK && depth == 0)
+	{
+		entry_ref ref;
+		if( get_ref_for_path( path.String(), &ref) == B_OK)
+			job->refs.AddRef( "refs", &ref);
+		job->names.AddString( "name", name.String());
+	}
+	return status;
+}
+
+//---------------------------------------------------
+//	Size of archive job made in root - the entry which isn't one of job's files
+//---------------------------------------------------
+static off_t
+archive_size( replay_job *job)
+{
+	DIR *dir = opendir( job->root.String());
+	if( dir == NULL)
+		return 0;
+	off_t size = 0;
+	struct dirent *entry;
+	while( ( entry = readdir( dir)) != NULL)
+	{
+		const char *name;
+		bool found = !strcmp( entry->d_name, ".") || !strcmp( entry->d_name, "..");
+		for( int32 index = 0; !found && job->names.FindString( "name", index, &name) == B_OK; index++)
+			found = !strcmp( name, entry->d_name);
+		struct stat st;
+		BString path( job->root);
+		path << "/" << entry->d_name;
+		if( !found && stat( path.String(), &st) == 0)
+			size += st.st_size;
+	}
+	closedir( dir);
+	return size;
+}
+
+//---------------------------------------------------
+//	Run job, whose tree is made - running service does it, with rule it was recorded with
+//	prints it's time against recorded one, adds both to totals
+//---------------------------------------------------
+static status_t
+run_job( replay_job *job, bigtime_t *recorded, bigtime_t *replayed)
+{
+	entry_ref dir_ref;
+	if( get_ref_for_path( job->root.String(), &dir_ref) != B_OK)
+		return B_ENTRY_NOT_FOUND;
+	job->refs.what = B_REFS_RECEIVED;
+	job->refs.AddRef( ARCHIVER_REFS_DIR_REF, &dir_ref);
+	job->refs.AddMessage( ARCHIVER_REFS_RULE, &job->rule);
+
+	// files were just written, they are in cache as they were when job was dropped (mostly)
+	sync();
+	status_t result = B_OK;
+	bigtime_t start = system_time();
+	status_t status = ArchiverService::Submit( &job->refs, true, &result);
+	bigtime_t time = system_time() - start;
+	if( status != B_OK)
+		return status;
+
+	const char *description = "";
+	const char *variation = "";
+	job->rule.FindString( ARCHIVER_SETTINGS_FILE_DESC, &description);
+	job->rule.FindString( ARCHIVER_SETTINGS_FILE_DESC2, &variation);
+	double megabytes = job->bytes / 1048576.0;
+	double before = job->time > 0 ? megabytes * 1000000.0 / job->time : 0.0;
+	double now = time > 0 ? megabytes * 1000000.0 / time : 0.0;
+	printf( "job %3" B_PRId32 ": %s%s%s, %" B_PRId32 " entries, %.1f MB\n", job->number, description,
+		variation[0] ? " - " : "", variation, job->entries, megabytes);
+	printf( "         recorded %8.2fs %8.1f MB/s, archive %.1f MB\n", job->time / 1000000.0, before, job->archiveSize / 1048576.0);
+	printf( "         replayed %8.2fs %8.1f MB/s, archive %.1f MB, %+.1f%%%s\n", time / 1000000.0, now, archive_size( job) / 1048576.0,
+		before > 0 ? ( now - before) * 100.0 / before : 0.0, result != B_OK ? " (job failed)" : "");
+
+	*recorded += job->time;
+	*replayed += time;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	"Archiver --replay [--keep] trace [directory]"
+//	make synthetic tree of each recorded job in directory, run job with it's rule by running service, compare throughput
+//	trees are removed after their job, unless --keep is given
+//---------------------------------------------------
+int
+job_trace_replay_main( int argc, char **argv)
+{
+	bool keep = false;
+	if( argc > 0 && !strcmp( argv[0], "--keep"))
+	{
+		keep = true;
+		argc--;
+		argv++;
+	}
+	if( argc < 1)
+	{
+		BPath path;
+		trace_path( &path);
+		fprintf( stderr, "usage: Archiver --replay [--keep] trace [directory]\n(jobs are recorded to %s)\n", path.Path());
+		return 1;
+	}
+
+	FILE *file = fopen( argv[0], "r");
+	if( file == NULL)
+	{
+		fprintf( stderr, "Archiver: can't open \"%s\": %s\n", argv[0], strerror( errno));
+		return 1;
+	}
+	const char *directory = argc > 1 ? argv[1] : JOB_TRACE_REPLAY_PATH;
+
+	replay_job *job = NULL;
+	uint8 *buffer = (uint8*)malloc( JOB_TRACE_BLOCK);
+	char *line = NULL;
+	size_t lineSize = 0;
+	ssize_t length;
+	int32 jobs = 0;
+	int32 failed = 0;
+	bigtime_t recorded = 0;
+	bigtime_t replayed = 0;
+	while( buffer != NULL && ( length = getline( &line, &lineSize, file)) > 0)
+	{
+		if( line[length - 1] == '\n')
+			line[length - 1] = 0;
+		char *rest = line;
+		char *type = strsep( &rest, "\t");
+
+		if( !strcmp( type, "job"))
+		{
+			delete job;
+			job = new replay_job;
+			job->number = ++jobs;
+			job->made = 0;
+			job->seed = jobs;
+			job->buffer = buffer;
+			strsep( &rest, "\t");
+			const char *field;
+			job->entries = ( field = strsep( &rest, "\t")) != NULL ? atol( field) : 0;
+			job->bytes = ( field = strsep( &rest, "\t")) != NULL ? atoll( field) : 0;
+			job->archiveSize = ( field = strsep( &rest, "\t")) != NULL ? atoll( field) : 0;
+			job->time = ( field = strsep( &rest, "\t")) != NULL ? atoll( field) : 0;
+
+			job->root << directory << "/archiver-replay-" << (int32)getpid() << "-" << jobs;
+			if( mkdir( job->root.String(), 0755) != 0)
+			{
+				fprintf( stderr, "Archiver: can't make \"%s\": %s\n", job->root.String(), strerror( errno));
+				break;
+			}
+		}
+		else if( job == NULL)
+			continue;
+		else if( !strcmp( type, "rule"))
+		{
+			const char *names[] = { ARCHIVER_SETTINGS_FILE_DESC, ARCHIVER_SETTINGS_FILE_DESC2, ARCHIVER_SETTINGS_FILE_MIME, ARCHIVER_SETTINGS_FILE_EXT };
+			const char *field;
+			for( uint32 index = 0; index < sizeof( names) / sizeof( names[0]); index++)
+				job->rule.AddString( names[index], ( field = strsep( &rest, "\t")) != NULL ? field : "");
+			job->rule.AddInt32( ARCHIVER_SETTINGS_LEVEL, ( field = strsep( &rest, "\t")) != NULL ? atol( field) : ARCHIVER_SETTINGS_LEVEL_DEF);
+			job->rule.AddBool( ARCHIVER_SETTINGS_VERIFY, ( field = strsep( &rest, "\t")) != NULL && atol( field) != 0);
+			while( ( field = strsep( &rest, "\t")) != NULL)
+				job->rule.AddString( ARCHIVER_SETTINGS_OPTION, field);
+		}
+		else if( !strcmp( type, "ratio"))
+		{
+			const char *extension = strsep( &rest, "\t");
+			if( extension != NULL && rest != NULL)
+				job->ratios.AddDouble( extension, atof( rest));
+		}
+		else if( !strcmp( type, "d") || !strcmp( type, "f") || !strcmp( type, "l"))
+		{
+			const char *depth = strsep( &rest, "\t");
+			const char *extension = type[0] == 'f' ? strsep( &rest, "\t") : "";
+			off_t size = type[0] == 'f' && rest != NULL ? atoll( rest) : 0;
+			status_t status = depth != NULL && extension != NULL ? make_entry( job, type[0], atol( depth), extension, size) : B_BAD_DATA;
+			if( status != B_OK)
+			{
+				fprintf( stderr, "Archiver: can't make tree of job %" B_PRId32 ": %s\n", job->number, strerror( status));
+				break;
+			}
+		}
+		else if( !strcmp( type, "end"))
+		{
+			status_t status = job->refs.HasRef( "refs") ? run_job( job, &recorded, &replayed) : B_BAD_DATA;
+			if( status != B_OK)
+			{
+				fprintf( stderr, "Archiver: job %" B_PRId32 " wasn't replayed (%s), is \"Archiver --service\" running?\n", job->number, strerror( status));
+				failed++;
+			}
+			if( !keep)
+				remove_tree( job->root.String());
+			delete job;
+			job = NULL;
+		}
+	}
+
+	// record which wasn't finished
+	if( job != NULL && !keep)
+		remove_tree( job->root.String());
+	delete job;
+	free( line);
+	free( buffer);
+	fclose( file);
+
+	if( replayed > 0 && recorded > 0)
+	{
+		printf( "%" B_PRId32 " jobs: recorded %.2fs, replayed %.2fs, %+.1f%% throughput\n", jobs - failed,
+			recorded / 1000000.0, replayed / 1000000.0, ( (double)recorded / replayed - 1.0) * 100.0);
+	}
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,66 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __JOB_TRACE_H_
+#define __JOB_TRACE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <Message.h>
+#include <OS.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	JOB_TRACE_FILE				"archiver.trace"	// in settings directory
+#define	JOB_TRACE_REPLAY_PATH		"/tmp"				// synthetic trees are made there, unless other directory is given
+#define	JOB_TRACE_MAX_DEPTH			64					// deeper entries are made at this depth
+#define	JOB_TRACE_CHUNK				1024				// synthetic data is made in chunks - random part, then repeated text
+#define	JOB_TRACE_BLOCK				65536				// bytes of synthetic file written at once
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+//	Trace is text file, one record for each job, fields are separated with tabs:
+//		job		<when> <entries> <bytes> <archive bytes> <time> <CPU time of tools> <result>	(times in µs)
+//		rule	<description> <variation> <mime> <extension> <level> <verify> <option>...
+//		ratio	<extension> <ratio of deflate>	- for each extension, so synthetic files compress alike
+//		d		<depth>							- directory
+//		f		<depth> <extension> <size>		- file
+//		l		<depth>							- link, or other entry without data
+//		end
+//	entries are in order they were walked, each one in last directory of lower depth - names aren't recorded
+void		job_trace_submit( BMessage *settings, BMessage *refs, const char *archive, int32 level, bigtime_t time, bigtime_t cpu, status_t result);
+int			job_trace_replay_main( int argc, char **argv);
+
+#endif /*__JOB_TRACE_H_*/
@@ -0,0 +1,461 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "ParallelDeflate.h"
+#include "Checksum.h"
+#include "ZipArchive.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: ParallelDeflate
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor - level is deflate's (1-9), pool runs chunks (NULL - default one)
+//---------------------------------------------------
+ParallelDeflate::ParallelDeflate( int32 level, WorkerPool *pool)
+	:aLevel( level),
+	aPool( pool != NULL ? pool : WorkerPool::Default()),
+	aSlots( NULL),
+	aSlotCount( 0),
+	aCrc( 0),
+	aInputSize( 0),
+	aOutputSize( 0),
+	aChunks( 0)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+ParallelDeflate::~ParallelDeflate()
+{
+	Free();
+}
+
+//---------------------------------------------------
+//	Free slots - each may be only partly made, if Allocate() failed
+//---------------------------------------------------
+void
+ParallelDeflate::Free()
+{
+	for( int32 index = 0; index < aSlotCount; index++)
+	{
+		parallel_deflate_chunk *chunk = &aSlots[index];
+		chunk->group.Wait();
+		if( chunk->stream != NULL)
+			deflateEnd( (z_stream*)chunk->stream);
+		free( chunk->stream);
+		free( chunk->input);
+		free( chunk->output);
+	}
+	delete[] aSlots;
+	aSlots = NULL;
+	aSlotCount = 0;
+}
+
+//---------------------------------------------------
+//	Slots for chunks in flight, with buffers and deflate of each - they stay for next Run()
+//	slots start zeroed and stream is set only once it's initialized, so what failed half way can be freed
+//---------------------------------------------------
+bool
+ParallelDeflate::Allocate()
+{
+	// previous chunk has to stay while next one is read, for it's dictionary
+	int32 count = aPool->CountWorkers() * PARALLEL_DEFLATE_WINDOW;
+	if( count < 2)
+		count = 2;
+
+	aSlots = new parallel_deflate_chunk[count]();
+	aSlotCount = count;
+	for( int32 index = 0; index < count; index++)
+	{
+		parallel_deflate_chunk *chunk = &aSlots[index];
+		chunk->input = (uint8*)malloc( PARALLEL_DEFLATE_DICTIONARY + PARALLEL_DEFLATE_CHUNK);
+		z_stream *stream = (z_stream*)calloc( 1, sizeof( z_stream));
+		if( stream != NULL && deflateInit2( stream, aLevel, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		{
+			free( stream);
+			stream = NULL;
+		}
+		chunk->stream = stream;
+
+		// sync flush adds empty stored block, and bits left of last one
+		if( stream != NULL)
+		{
+			chunk->outputCapacity = deflateBound( stream, PARALLEL_DEFLATE_CHUNK) + 64;
+			chunk->output = (uint8*)malloc( chunk->outputCapacity);
+		}
+		if( chunk->input == NULL || chunk->stream == NULL || chunk->output == NULL)
+		{
+			Free();
+			return false;
+		}
+	}
+	return true;
+}
+
+//---------------------------------------------------
+//	Compress one chunk - runs in worker of pool
+//---------------------------------------------------
+int32
+ParallelDeflate::CompressTask( void *data)
+{
+	parallel_deflate_chunk *chunk = (parallel_deflate_chunk*)data;
+	z_stream *stream = (z_stream*)chunk->stream;
+	uint8 *input = chunk->input + PARALLEL_DEFLATE_DICTIONARY;
+
+	deflateReset( stream);
+	if( chunk->dictionarySize > 0)
+		deflateSetDictionary( stream, input - chunk->dictionarySize, chunk->dictionarySize);
+
+	stream->next_in = input;
+	stream->avail_in = chunk->size;
+	stream->next_out = chunk->output;
+	stream->avail_out = chunk->outputCapacity;
+	int result = deflate( stream, chunk->last ? Z_FINISH : Z_SYNC_FLUSH);
+	chunk->outputSize = chunk->outputCapacity - stream->avail_out;
+
+	if( chunk->last)
+		chunk->status = result == Z_STREAM_END ? B_OK : B_ERROR;
+	else
+		chunk->status = result == Z_OK && stream->avail_in == 0 && stream->avail_out > 0 ? B_OK : B_ERROR;
+
+	chunk->crc = checksum_crc32( 0, input, chunk->size);
+	return 0;
+}
+
+//---------------------------------------------------
+//	Compress all reader gives and pass it to writer, as one raw deflate stream
+//	chunks are read and written in order, pool compresses up to all of it's slots at once meanwhile
+//---------------------------------------------------
+status_t
+ParallelDeflate::Run( parallel_deflate_reader reader, void *readerCookie,
+	parallel_deflate_writer writer, void *writerCookie, int32 *cancel)
+{
+	aCrc = 0;
+	aInputSize = 0;
+	aOutputSize = 0;
+	aChunks = 0;
+	if( aSlots == NULL && !Allocate())
+		return B_NO_MEMORY;
+
+	status_t status = B_OK;
+	int64 read = 0;			// chunks read and given to pool
+	int64 written = 0;
+	bool end = false;
+	for( ;;)
+	{
+		// keep all slots busy, as long as there is input
+		while( status == B_OK && !end && read - written < aSlotCount)
+		{
+			if( cancel != NULL && *cancel)
+			{
+				status = B_CANCELED;
+				break;
+			}
+
+			parallel_deflate_chunk *chunk = &aSlots[read % aSlotCount];
+			uint8 *input = chunk->input + PARALLEL_DEFLATE_DICTIONARY;
+			chunk->dictionarySize = 0;
+			if( read > 0)
+			{
+				const parallel_deflate_chunk *previous = &aSlots[( read - 1) % aSlotCount];
+				size_t size = previous->dictionarySize + previous->size;
+				chunk->dictionarySize = size < PARALLEL_DEFLATE_DICTIONARY ? size : PARALLEL_DEFLATE_DICTIONARY;
+				memcpy( input - chunk->dictionarySize, previous->input + PARALLEL_DEFLATE_DICTIONARY + previous->size - chunk->dictionarySize,
+					chunk->dictionarySize);
+			}
+
+			size_t bytes = 0;
+			status = reader( readerCookie, input, PARALLEL_DEFLATE_CHUNK, &bytes);
+			if( status != B_OK)
+				break;
+			chunk->size = bytes;
+			chunk->last = end = bytes < PARALLEL_DEFLATE_CHUNK;
+			aPool->Submit( &chunk->group, CompressTask, chunk);
+			read++;
+		}
+		if( written == read)
+			break;
+
+		// oldest chunk is written as soon as it's done - the rest go on meanwhile
+		parallel_deflate_chunk *chunk = &aSlots[written % aSlotCount];
+		chunk->group.Wait();
+		written++;
+		if( status == B_OK)
+			status = chunk->status;
+		if( status == B_OK)
+			status = writer( writerCookie, chunk->output, chunk->outputSize);
+		if( status == B_OK)
+		{
+			aCrc = crc32_combine( aCrc, chunk->crc, chunk->size);
+			aInputSize += chunk->size;
+			aOutputSize += chunk->outputSize;
+			aChunks++;
+		}
+	}
+	return status;
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: tool
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Fill buffer from file descriptor (pipe gives less at once)
+//---------------------------------------------------
+static status_t
+read_fd( void *cookie, void *buffer, size_t size, size_t *bytes)
+{
+	int fd = *(int*)cookie;
+	*bytes = 0;
+	while( *bytes < size)
+	{
+		ssize_t got = read( fd, (uint8*)buffer + *bytes, size - *bytes);
+		if( got < 0 && errno == EINTR)
+			continue;
+		if( got < 0)
+			return errno;
+		if( got == 0)
+			break;
+		*bytes += got;
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	write() whole buffer - output may be pipe, so no pwrite()
+//---------------------------------------------------
+static status_t
+write_fd( void *cookie, const void *buffer, size_t size)
+{
+	int fd = *(int*)cookie;
+	const uint8 *data = (const uint8*)buffer;
+	while( size > 0)
+	{
+		ssize_t bytes = write( fd, data, size);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes <= 0)
+			return bytes < 0 ? errno : B_IO_ERROR;
+		data += bytes;
+		size -= bytes;
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	"Archiver --gzip [-1..-9]" - gzip of stdin on all CPUs, to stdout (one member, as gzip makes it)
+//---------------------------------------------------
+int
+parallel_gzip_main( int argc, char **argv)
+{
+	int32 level = Z_DEFAULT_COMPRESSION;
+	for( int32 arg = 0; arg < argc; arg++)
+	{
+		if( argv[arg][0] == '-' && argv[arg][1] >= '1' && argv[arg][1] <= '9' && argv[arg][2] == 0)
+			level = argv[arg][1] - '0';
+		else
+		{
+			fprintf( stderr, "usage: Archiver --gzip [-1..-9] < input > output\n");
+			return 1;
+		}
+	}
+
+	static const uint8 header[10] = { 0x1f, 0x8b, 8, 0, 0, 0, 0, 0, 0, 255 };
+	int in = STDIN_FILENO;
+	int out = STDOUT_FILENO;
+	ParallelDeflate deflater( level);
+	status_t status = write_fd( &out, header, sizeof( header));
+	if( status == B_OK)
+		status = deflater.Run( read_fd, &in, write_fd, &out);
+
+	uint8 trailer[8];
+	zip_put32( trailer, deflater.Crc());
+	zip_put32( trailer + 4, (uint32)deflater.InputSize());
+	if( status == B_OK)
+		status = write_fd( &out, trailer, sizeof( trailer));
+	if( status != B_OK)
+	{
+		fprintf( stderr, "Archiver: can't compress (%s)\n", strerror( status));
+		return 1;
+	}
+	return 0;
+}
+
+//---------------------------------------------------
+//	Benchmark's data, read from memory and written to memory
+//---------------------------------------------------
+struct bench_buffer
+{
+	uint8				*data;
+	size_t				size;
+	size_t				offset;
+};
+
+static status_t
+bench_read( void *cookie, void *buffer, size_t size, size_t *bytes)
+{
+	bench_buffer *input = (bench_buffer*)cookie;
+	*bytes = input->size - input->offset < size ? input->size - input->offset : size;
+	memcpy( buffer, input->data + input->offset, *bytes);
+	input->offset += *bytes;
+	return B_OK;
+}
+
+static status_t
+bench_write( void *cookie, const void *buffer, size_t size)
+{
+	bench_buffer *output = (bench_buffer*)cookie;
+	if( output->offset + size > output->size)
+		return B_NO_MEMORY;
+	memcpy( output->data + output->offset, buffer, size);
+	output->offset += size;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Inflate raw stream and compare it with data
+//---------------------------------------------------
+static bool
+bench_check( const bench_buffer *output, const uint8 *data, size_t size)
+{
+	uint8 *inflated = (uint8*)malloc( size + 1);
+	z_stream stream;
+	memset( &stream, 0, sizeof( stream));
+	if( inflated == NULL || inflateInit2( &stream, -MAX_WBITS) != Z_OK)
+	{
+		free( inflated);
+		return false;
+	}
+
+	stream.next_in = output->data;
+	stream.avail_in = output->offset;
+	stream.next_out = inflated;
+	stream.avail_out = size + 1;
+	int result = inflate( &stream, Z_FINISH);
+	bool valid = result == Z_STREAM_END && stream.total_out == size && stream.avail_in == 0 && !memcmp( inflated, data, size);
+	inflateEnd( &stream);
+	free( inflated);
+	return valid;
+}
+
+//---------------------------------------------------
+//	"Archiver --bench-deflate [MB]" - one stream deflated with 1, 2... up to all CPUs
+//	output is inflated again, to check that chunks make one valid stream
+//---------------------------------------------------
+int
+parallel_deflate_bench_main( int argc, char **argv)
+{
+	size_t size = ( argc > 0 ? atoi( argv[0]) : PARALLEL_DEFLATE_BENCH_SIZE) * 1024 * 1024;
+	uint8 *data = size > 0 ? (uint8*)malloc( size) : NULL;
+	if( data == NULL)
+	{
+		fprintf( stderr, "usage: Archiver --bench-deflate [MB]\n");
+		return 1;
+	}
+
+	// words of text, so deflate has as much work as with real files
+	static const char *words[] = { "archive", "file", "the", "of", "compressed", "data", "Haiku", "tar", "zip", "block", "a", "is", "to", "and", "directory", "size" };
+	uint32 seed = 1;
+	for( size_t index = 0; index < size; )
+	{
+		seed = seed * 1103515245 + 12345;
+		const char *word = words[( seed >> 16) % 16];
+		size_t length = strlen( word);
+		if( length > size - index - 1)
+			length = size - index - 1;
+		memcpy( data + index, word, length);
+		index += length;
+		data[index++] = ( seed >> 8) % 13 == 0 ? '\n' : ' ';
+	}
+
+	system_info info;
+	int32 cpus = get_system_info( &info) == B_OK ? info.cpu_count : 1;
+	if( cpus > WORKER_POOL_MAX_WORKERS)
+		cpus = WORKER_POOL_MAX_WORKERS;
+
+	// what deflate makes in one go, to compare speed and size with
+	uLongf single = compressBound( size);
+	uint8 *whole = (uint8*)malloc( single);
+	uint32 crc = checksum_crc32( 0, data, size);
+	bigtime_t start = system_time();
+	if( whole == NULL || compress2( whole, &single, data, size, Z_DEFAULT_COMPRESSION) != Z_OK)
+		single = 0;
+	double base = size / (double)( system_time() - start);
+	free( whole);
+
+	printf( "%" B_PRId32 " MB, deflate -6 in one go: %.1f MB/s, %.2f MB\n", (int32)( size / 1024 / 1024), base, single / 1048576.0);
+	printf( "workers      MB/s  speedup   size MB  chunks  valid\n");
+
+	// sync flush of each chunk adds few bytes
+	size_t outSize = compressBound( size) + ( size / PARALLEL_DEFLATE_CHUNK + 1) * 64;
+	uint8 *out = (uint8*)malloc( outSize);
+	if( out == NULL)
+	{
+		free( data);
+		return 1;
+	}
+
+	int result = 0;
+	for( int32 workers = 1; workers <= cpus; workers++)
+	{
+		WorkerPool pool( workers);
+		ParallelDeflate deflater( Z_DEFAULT_COMPRESSION, &pool);
+		bench_buffer input = { data, size, 0 };
+		bench_buffer output = { out, outSize, 0 };
+
+		start = system_time();
+		status_t status = deflater.Run( bench_read, &input, bench_write, &output);
+		double speed = size / (double)( system_time() - start);
+
+		bool valid = status == B_OK && deflater.Crc() == crc && bench_check( &output, data, size);
+		printf( "%7" B_PRId32 "  %8.1f  %7.2f  %8.2f  %6" B_PRId32 "  %s\n", workers, speed, speed / base, output.offset / 1048576.0,
+			deflater.CountChunks(), valid ? "yes" : "NO");
+		if( !valid)
+			result = 1;
+	}
+
+	free( out);
+	free( data);
+	return result;
+}
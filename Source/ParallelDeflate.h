@@ -0,0 +1,124 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __PARALLEL_DEFLATE_H_
+#define __PARALLEL_DEFLATE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include "WorkerPool.h"
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	PARALLEL_DEFLATE_CHUNK		(512 * 1024)	// input one task compresses
+#define	PARALLEL_DEFLATE_DICTIONARY	32768			// end of chunk before primes deflate of next one (it's window)
+#define	PARALLEL_DEFLATE_WINDOW		2				// chunks in flight for each worker
+#define	PARALLEL_DEFLATE_MINIMUM	(8 * 1024 * 1024)	// smaller data isn't worth splitting
+#define	PARALLEL_DEFLATE_BENCH_SIZE	256				// MB compressed by "--bench-deflate"
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+// reader fills whole buffer, less only at end of data; writer writes all it's given
+typedef status_t	(*parallel_deflate_reader)( void *cookie, void *buffer, size_t size, size_t *bytes);
+typedef status_t	(*parallel_deflate_writer)( void *cookie, const void *buffer, size_t size);
+
+//---------------------------------------------------
+//	One chunk - input has dictionary (end of chunk before) in front of data
+//	slot is reused when it's output is written
+//---------------------------------------------------
+struct parallel_deflate_chunk
+{
+	uint8				*input;
+	size_t				dictionarySize;
+	size_t				size;			// of data after dictionary
+	uint8				*output;
+	size_t				outputSize;
+	size_t				outputCapacity;
+	uint32				crc;			// of data
+	bool				last;
+	status_t			status;
+	void				*stream;		// z_stream of slot, reset for each chunk
+	TaskGroup			group;
+};
+
+//---------------------------------------------------
+//	Deflate of one stream on all CPUs - it's cut into chunks, which are compressed by pool's workers
+//	each chunk is primed with 32KB before it and ends with sync flush (last one with final block),
+//	so they make one raw deflate stream together, as if it was compressed in one go (as pigz does)
+//	CRC of chunks is combined, reading and writing stay in caller's thread, in order
+//---------------------------------------------------
+class ParallelDeflate
+{
+	public:
+							ParallelDeflate( int32 level, WorkerPool *pool = NULL);
+							~ParallelDeflate();
+
+		status_t			Run( parallel_deflate_reader reader, void *readerCookie,
+								parallel_deflate_writer writer, void *writerCookie, int32 *cancel = NULL);
+
+		uint32				Crc() const { return aCrc; };
+		uint64				InputSize() const { return aInputSize; };
+		uint64				OutputSize() const { return aOutputSize; };
+		int32				CountChunks() const { return aChunks; };
+
+	private:
+		static int32		CompressTask( void *data);
+		bool				Allocate();
+		void				Free();
+
+		int32				aLevel;
+		WorkerPool			*aPool;
+		parallel_deflate_chunk	*aSlots;
+		int32				aSlotCount;
+
+		uint32				aCrc;
+		uint64				aInputSize;
+		uint64				aOutputSize;
+		int32				aChunks;
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+int			parallel_gzip_main( int argc, char **argv);
+int			parallel_deflate_bench_main( int argc, char **argv);
+
+#endif /*__PARALLEL_DEFLATE_H_*/
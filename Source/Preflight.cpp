@@ -0,0 +1,648 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "Preflight.h"
+#include "Archiver.h"
+
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <fs_info.h>
+#include <zlib.h>
+
+#define	PREFLIGHT_HASH_SIZE		( PREFLIGHT_MAX_EXTENSIONS * 2)
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: Preflight
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor - level is deflate's (1-9), 0 if archive isn't compressed
+//---------------------------------------------------
+Preflight::Preflight( int32 level)
+	:aLevel( level),
+	aSize( 0),
+	aLinkedSize( 0),
+	aFiles( 0),
+	aSampled( false),
+	aExtensions( NULL),
+	aExtensionCount( 0),
+	aHash( NULL),
+	aLinks( NULL),
+	aLinkCount( 0),
+	aLinkSlots( 0),
+	aStream( NULL),
+	aIn( NULL),
+	aOut( NULL),
+	aOutSize( 0),
+	aSeed( (uint32)system_time())
+{
+	if( aLevel > 9)
+		aLevel = 9;
+	if( aLevel < 0)
+		aLevel = 0;
+
+	// one more for extensions which didn't fit
+	aExtensions = (preflight_extension*)calloc( PREFLIGHT_MAX_EXTENSIONS + 1, sizeof( preflight_extension));
+	aHash = (int32*)calloc( PREFLIGHT_HASH_SIZE, sizeof( int32));
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+Preflight::~Preflight()
+{
+	for( int32 index = 0; index < aPaths.CountItems(); index++)
+		free( aPaths.ItemAt( index));
+	if( aExtensions != NULL)
+	{
+		for( int32 index = 0; index < aExtensionCount; index++)
+			free( aExtensions[index].offsets);
+	}
+	free( aExtensions);
+	free( aHash);
+	free( aLinks);
+
+	if( aStream != NULL)
+	{
+		deflateEnd( (z_stream*)aStream);
+		delete (z_stream*)aStream;
+	}
+	free( aIn);
+	free( aOut);
+}
+
+//---------------------------------------------------
+//	Extension of file name, lower case ("" if there is none, or it's too long)
+//	extension must have room for PREFLIGHT_EXTENSION_LENGTH characters
+//---------------------------------------------------
+void
+Preflight::ExtensionOf( const char *name, char *extension)
+{
+	extension[0] = 0;
+	const char *dot = strrchr( name, '.');
+	if( dot != NULL && dot != name && strlen( dot) < PREFLIGHT_EXTENSION_LENGTH)
+	{
+		int32 index = 0;
+		for( ; dot[index]; index++)
+			extension[index] = tolower( dot[index]);
+		extension[index] = 0;
+	}
+}
+
+//---------------------------------------------------
+//	Extension files are counted by
+//---------------------------------------------------
+preflight_extension *
+Preflight::Extension( const char *name)
+{
+	char extension[PREFLIGHT_EXTENSION_LENGTH];
+	ExtensionOf( name, extension);
+
+	uint32 hash = 2166136261U;
+	for( const char *c = extension; *c; c++)
+		hash = ( hash ^ (uint8)*c) * 16777619U;
+
+	uint32 slot = hash % PREFLIGHT_HASH_SIZE;
+	while( aHash[slot] != 0)
+	{
+		preflight_extension *known = &aExtensions[aHash[slot] - 1];
+		if( !strcmp( known->name, extension))
+			return known;
+		slot = ( slot + 1) % PREFLIGHT_HASH_SIZE;
+	}
+
+	// too many extensions, the rest are counted together
+	if( aExtensionCount == PREFLIGHT_MAX_EXTENSIONS)
+	{
+		preflight_extension *other = &aExtensions[PREFLIGHT_MAX_EXTENSIONS];
+		strcpy( other->name, "(other)");
+		return other;
+	}
+
+	preflight_extension *added = &aExtensions[aExtensionCount++];
+	strcpy( added->name, extension);
+	aHash[slot] = aExtensionCount;
+	return added;
+}
+
+//---------------------------------------------------
+//	True if file has more links, and one of them was walked before - otherwise it's remembered now
+//---------------------------------------------------
+bool
+Preflight::IsLinkSeen( const struct stat *st)
+{
+	if( st->st_nlink < 2)
+		return false;
+
+	// table is twice as big as links in it, empty slot has node 0
+	if( ( aLinkCount + 1) * 2 > aLinkSlots)
+	{
+		int32 slots = aLinkSlots > 0 ? aLinkSlots * 2 : PREFLIGHT_LINKS_FIRST_SIZE;
+		preflight_link *links = (preflight_link*)calloc( slots, sizeof( preflight_link));
+		if( links == NULL)
+			return false;
+		for( int32 index = 0; index < aLinkSlots; index++)
+		{
+			if( aLinks[index].node == 0)
+				continue;
+			uint32 slot = (uint32)( aLinks[index].node * 2654435761U + aLinks[index].device) % slots;
+			while( links[slot].node != 0)
+				slot = ( slot + 1) % slots;
+			links[slot] = aLinks[index];
+		}
+		free( aLinks);
+		aLinks = links;
+		aLinkSlots = slots;
+	}
+
+	uint32 slot = (uint32)( st->st_ino * 2654435761U + st->st_dev) % aLinkSlots;
+	while( aLinks[slot].node != 0)
+	{
+		if( aLinks[slot].node == st->st_ino && aLinks[slot].device == st->st_dev)
+			return true;
+		slot = ( slot + 1) % aLinkSlots;
+	}
+	aLinks[slot].device = st->st_dev;
+	aLinks[slot].node = st->st_ino;
+	aLinkCount++;
+	return false;
+}
+
+//---------------------------------------------------
+//	Walk file (or everything in directory) - for sizes, or for samples
+//	order is the same both times, so offsets of samples are found in files they were chosen in
+//---------------------------------------------------
+void
+Preflight::Walk( const char *path, bool sample, int32 *cancel)
+{
+	if( cancel != NULL && atomic_get( cancel))
+		return;
+
+	struct stat st;
+	if( lstat( path, &st) != 0)
+		return;
+
+	if( S_ISDIR( st.st_mode))
+	{
+		if( !sample)
+			aFiles++;
+		DIR *dir = opendir( path);
+		if( dir == NULL)
+			return;
+		struct dirent *entry;
+		while( ( entry = readdir( dir)) != NULL && ( cancel == NULL || !atomic_get( cancel)))
+		{
+			if( !strcmp( entry->d_name, ".") || !strcmp( entry->d_name, ".."))
+				continue;
+			BString child( path);
+			child << "/" << entry->d_name;
+			Walk( child.String(), sample, cancel);
+		}
+		closedir( dir);
+		return;
+	}
+
+	// links and special files take only their header
+	if( !S_ISREG( st.st_mode))
+	{
+		if( !sample)
+			aFiles++;
+		return;
+	}
+
+	// second link to the same file has no data of it's own in TAR
+	if( IsLinkSeen( &st))
+	{
+		if( !sample)
+		{
+			aLinkedSize += st.st_size;
+			aFiles++;
+		}
+		return;
+	}
+
+	const char *leaf = strrchr( path, '/');
+	preflight_extension *extension = Extension( leaf != NULL ? leaf + 1 : path);
+	if( !sample)
+	{
+		extension->size += st.st_size;
+		extension->files++;
+		aSize += st.st_size;
+		aFiles++;
+		return;
+	}
+
+	SampleFile( extension, path, st.st_size);
+	extension->seen += st.st_size;
+}
+
+//---------------------------------------------------
+//	Compress samples which fall in file, if any
+//---------------------------------------------------
+void
+Preflight::SampleFile( preflight_extension *extension, const char *path, off_t size)
+{
+	int fd = -1;
+	while( extension->next < extension->samples && extension->offsets[extension->next] < extension->seen + size)
+	{
+		off_t offset = extension->offsets[extension->next++] - extension->seen;
+		size_t length = size < PREFLIGHT_BLOCK ? (size_t)size : PREFLIGHT_BLOCK;
+		if( offset + (off_t)length > size)
+			offset = size - length;
+
+		if( fd < 0 && ( fd = open( path, O_RDONLY | O_CLOEXEC)) < 0)
+			break;
+		ssize_t read = pread( fd, aIn, length, offset);
+		if( read <= 0)
+			break;
+
+		z_stream *stream = (z_stream*)aStream;
+		deflateReset( stream);
+		stream->next_in = aIn;
+		stream->avail_in = read;
+		stream->next_out = aOut;
+		stream->avail_out = aOutSize;
+		bigtime_t start = system_time();
+		if( deflate( stream, Z_FINISH) != Z_STREAM_END)
+			break;
+		extension->cpu += system_time() - start;
+
+		double ratio = (double)stream->total_out / read;
+		extension->sampledIn += read;
+		extension->sampledOut += stream->total_out;
+		extension->sumRatio += ratio;
+		extension->sumRatio2 += ratio * ratio;
+		extension->taken++;
+
+		// small file is sampled whole, once
+		if( (off_t)length == size)
+		{
+			while( extension->next < extension->samples && extension->offsets[extension->next] < extension->seen + size)
+				extension->next++;
+		}
+	}
+	if( fd >= 0)
+		close( fd);
+}
+
+//---------------------------------------------------
+//	Add file or directory archive is made of - it's walked for sizes of files, until it's done or cancel is set
+//---------------------------------------------------
+void
+Preflight::AddPath( const char *path, int32 *cancel)
+{
+	aPaths.AddItem( strdup( path));
+	Walk( path, false, cancel);
+}
+
+//---------------------------------------------------
+//	Compress samples spread over all files added, until it's done or cancel is set
+//	each extension gets share of samples by it's size, each sample lies in random place of it's part of extension
+//---------------------------------------------------
+status_t
+Preflight::Sample( int32 *cancel)
+{
+	aSampled = true;
+	if( aLevel == 0 || aSize == 0)
+		return B_OK;
+	if( aExtensions == NULL || aHash == NULL)
+		return B_NO_MEMORY;
+
+	z_stream *stream = new z_stream;
+	memset( stream, 0, sizeof( z_stream));
+	if( deflateInit( stream, aLevel) != Z_OK)
+	{
+		delete stream;
+		return B_NO_MEMORY;
+	}
+	aStream = stream;
+	aOutSize = deflateBound( stream, PREFLIGHT_BLOCK);
+	aIn = (uint8*)malloc( PREFLIGHT_BLOCK);
+	aOut = (uint8*)malloc( aOutSize);
+	if( aIn == NULL || aOut == NULL)
+		return B_NO_MEMORY;
+
+	int32 count = aExtensionCount + ( aExtensions[PREFLIGHT_MAX_EXTENSIONS].files > 0 ? 1 : 0);
+	for( int32 index = 0; index < count; index++)
+	{
+		preflight_extension *extension = &aExtensions[index < aExtensionCount ? index : PREFLIGHT_MAX_EXTENSIONS];
+		if( extension->size == 0)
+			continue;
+
+		// there is no need for more samples than blocks
+		off_t samples = PREFLIGHT_SAMPLES * extension->size / aSize;
+		off_t blocks = ( extension->size + PREFLIGHT_BLOCK - 1) / PREFLIGHT_BLOCK;
+		if( samples < PREFLIGHT_MIN_SAMPLES)
+			samples = PREFLIGHT_MIN_SAMPLES;
+		if( samples > blocks)
+			samples = blocks;
+
+		extension->offsets = (off_t*)malloc( samples * sizeof( off_t));
+		if( extension->offsets == NULL)
+			continue;
+		extension->samples = samples;
+		for( int32 sample = 0; sample < samples; sample++)
+		{
+			aSeed = aSeed * 1103515245 + 12345;
+			double place = ( sample + ( aSeed >> 8) / 16777216.0) / samples;
+			extension->offsets[sample] = (off_t)( place * extension->size);
+		}
+	}
+
+	// links are found again in the same order
+	if( aLinks != NULL)
+		memset( aLinks, 0, aLinkSlots * sizeof( preflight_link));
+	aLinkCount = 0;
+	for( int32 index = 0; index < aPaths.CountItems(); index++)
+		Walk( (const char*)aPaths.ItemAt( index), true, cancel);
+
+	if( cancel != NULL && atomic_get( cancel))
+		return B_CANCELED;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Ratio of extension's samples - or of all samples, if it has none (or extension is NULL)
+//---------------------------------------------------
+double
+Preflight::Ratio( const preflight_extension *extension) const
+{
+	if( aLevel == 0)
+		return 1.0;
+	if( extension != NULL && extension->sampledIn > 0)
+		return (double)extension->sampledOut / extension->sampledIn;
+
+	off_t in = 0;
+	off_t out = 0;
+	for( int32 index = 0; index <= PREFLIGHT_MAX_EXTENSIONS; index++)
+	{
+		if( index >= aExtensionCount && index < PREFLIGHT_MAX_EXTENSIONS)
+			continue;
+		in += aExtensions[index].sampledIn;
+		out += aExtensions[index].sampledOut;
+	}
+	return in > 0 ? (double)out / in : 1.0;
+}
+
+//---------------------------------------------------
+//	Standard error of extension's ratio
+//	samples which cover whole extension leave no error, extension without samples can be anything
+//---------------------------------------------------
+double
+Preflight::Error( const preflight_extension *extension) const
+{
+	if( aLevel == 0 || extension->size == 0)
+		return 0.0;
+	if( extension->taken == 0)
+		return 0.5;
+
+	double unsampled = 1.0 - (double)extension->sampledIn / extension->size;
+	if( unsampled <= 0.0)
+		return 0.0;
+	if( extension->taken == 1)
+		return 0.5 * sqrt( unsampled);
+
+	double n = extension->taken;
+	double variance = ( extension->sumRatio2 - extension->sumRatio * extension->sumRatio / n) / ( n - 1);
+	if( variance < 0.0)
+		variance = 0.0;
+	return sqrt( variance / n * unsampled);
+}
+
+//---------------------------------------------------
+//	Half of error bar of estimate, in bytes
+//---------------------------------------------------
+off_t
+Preflight::Spread() const
+{
+	double variance = 0.0;
+	for( int32 index = 0; index <= PREFLIGHT_MAX_EXTENSIONS; index++)
+	{
+		if( index >= aExtensionCount && index < PREFLIGHT_MAX_EXTENSIONS)
+			continue;
+		double error = aExtensions[index].size * Error( &aExtensions[index]);
+		variance += error * error;
+	}
+	return (off_t)( PREFLIGHT_SPREAD * sqrt( variance));
+}
+
+//---------------------------------------------------
+//	Most archive can take - files stored as they are, links too (deflate adds few bytes to each 16KB it can't compress)
+//---------------------------------------------------
+off_t
+Preflight::MaxSize() const
+{
+	off_t size = aSize + aLinkedSize;
+	return size + size / 1000 + (off_t)aFiles * PREFLIGHT_FILE_OVERHEAD;
+}
+
+//---------------------------------------------------
+//	Size of archive, as samples say - with each file stored once (TAR)
+//---------------------------------------------------
+off_t
+Preflight::Estimate() const
+{
+	if( !aSampled)
+		return MaxSize();
+
+	double size = (double)aFiles * PREFLIGHT_FILE_OVERHEAD;
+	for( int32 index = 0; index <= PREFLIGHT_MAX_EXTENSIONS; index++)
+	{
+		if( index >= aExtensionCount && index < PREFLIGHT_MAX_EXTENSIONS)
+			continue;
+		size += aExtensions[index].size * Ratio( &aExtensions[index]);
+	}
+	return size < MaxSize() ? (off_t)size : MaxSize();
+}
+
+//---------------------------------------------------
+//	Smallest size archive is likely to have
+//---------------------------------------------------
+off_t
+Preflight::EstimateLow() const
+{
+	if( !aSampled)
+		return MaxSize();
+	off_t low = Estimate() - Spread();
+	return low > 0 ? low : 0;
+}
+
+//---------------------------------------------------
+//	Biggest size archive is likely to have - with files stored for each of their links (ZIP)
+//---------------------------------------------------
+off_t
+Preflight::EstimateHigh() const
+{
+	if( !aSampled)
+		return MaxSize();
+	off_t high = Estimate() + Spread() + (off_t)( aLinkedSize * Ratio( NULL));
+	return high < MaxSize() ? high : MaxSize();
+}
+
+//---------------------------------------------------
+//	CPU time deflate would take for all files, at speed it had on samples
+//---------------------------------------------------
+bigtime_t
+Preflight::CpuTime() const
+{
+	bigtime_t cpu = 0;
+	off_t in = 0;
+	for( int32 index = 0; index <= PREFLIGHT_MAX_EXTENSIONS; index++)
+	{
+		cpu += aExtensions[index].cpu;
+		in += aExtensions[index].sampledIn;
+	}
+	return in > 0 ? (bigtime_t)( (double)cpu * aSize / in) : 0;
+}
+
+//---------------------------------------------------
+//	Sort extensions - the biggest first
+//---------------------------------------------------
+static int
+compare_extensions( const void *first, const void *second)
+{
+	off_t a = (*(const preflight_extension**)first)->size;
+	off_t b = (*(const preflight_extension**)second)->size;
+	return a < b ? 1 : a > b ? -1 : 0;
+}
+
+//---------------------------------------------------
+//	Table of extensions - size, ratio (with error bar), size in archive and CPU time, then whole estimate
+//---------------------------------------------------
+void
+Preflight::PrintReport( FILE *out) const
+{
+	const preflight_extension *sorted[PREFLIGHT_MAX_EXTENSIONS + 1];
+	int32 count = 0;
+	for( int32 index = 0; index <= PREFLIGHT_MAX_EXTENSIONS; index++)
+	{
+		if( ( index < aExtensionCount || index == PREFLIGHT_MAX_EXTENSIONS) && aExtensions[index].files > 0)
+			sorted[count++] = &aExtensions[index];
+	}
+	qsort( sorted, count, sizeof( sorted[0]), compare_extensions);
+
+	fprintf( out, "%-16s %8s %10s %7s %7s %8s %10s %8s\n", "extension", "files", "MB", "samples", "ratio", "+-", "est. MB", "CPU s");
+	for( int32 index = 0; index < count; index++)
+	{
+		const preflight_extension *extension = sorted[index];
+		double ratio = Ratio( extension);
+		double cpu = extension->sampledIn > 0 ? (double)extension->cpu * extension->size / extension->sampledIn / 1000000.0 : 0.0;
+		fprintf( out, "%-16s %8" B_PRId32 " %10.1f %7" B_PRId32 " %6.1f%% %7.1f%% %10.1f %8.1f\n",
+			extension->name[0] ? extension->name : "(none)", extension->files, extension->size / 1048576.0,
+			extension->taken, ratio * 100, PREFLIGHT_SPREAD * Error( extension) * 100,
+			extension->size * ratio / 1048576.0, cpu);
+	}
+
+	fprintf( out, "%" B_PRId32 " files, %.1f MB", aFiles, aSize / 1048576.0);
+	if( aLinkedSize > 0)
+		fprintf( out, " (and %.1f MB of hard links)", aLinkedSize / 1048576.0);
+	fprintf( out, "; archive about %.1f MB (%.1f - %.1f MB)",
+		Estimate() / 1048576.0, EstimateLow() / 1048576.0, EstimateHigh() / 1048576.0);
+	if( aLevel > 0)
+		fprintf( out, ", %.1fs CPU for deflate -%" B_PRId32, CpuTime() / 1000000.0, aLevel);
+	fprintf( out, "\n");
+}
+
+//---------------------------------------------------
+//	Free bytes on volume of directory, -1 if it isn't known
+//---------------------------------------------------
+off_t
+Preflight::FreeSpace( const char *directory)
+{
+	fs_info info;
+	dev_t device = dev_for_path( directory);
+	if( device < 0 || fs_stat_dev( device, &info) != 0)
+		return -1;
+	return info.free_blocks * info.block_size;
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	"Archiver --preflight [-level] path..."
+//	report how files would compress, by extension, and whether archive fits next to first of them - nothing is written
+//	level 0 is for rules which don't compress (plain TAR)
+//---------------------------------------------------
+int
+preflight_main( int argc, char **argv)
+{
+	int32 level = ARCHIVER_SETTINGS_LEVEL_DEF;
+	int32 first = 0;
+	if( argc > 0 && argv[0][0] == '-' && isdigit( argv[0][1]) && argv[0][2] == 0)
+	{
+		level = argv[0][1] - '0';
+		first++;
+	}
+	if( first >= argc)
+	{
+		fprintf( stderr, "usage: Archiver --preflight [-0..-9] path...\n");
+		return 1;
+	}
+
+	Preflight preflight( level);
+	bigtime_t start = system_time();
+	for( int32 index = first; index < argc; index++)
+		preflight.AddPath( argv[index]);
+	bigtime_t walked = system_time();
+	status_t result = preflight.Sample();
+	if( result != B_OK)
+	{
+		fprintf( stderr, "Archiver: can't sample files: %s\n", strerror( result));
+		return 1;
+	}
+	bigtime_t sampled = system_time();
+
+	preflight.PrintReport( stdout);
+	printf( "walked in %.2fs, sampled in %.2fs\n", ( walked - start) / 1000000.0, ( sampled - walked) / 1000000.0);
+
+	// archive is made next to first file
+	BString directory( argv[first]);
+	int32 slash = directory.FindLast( '/');
+	directory.Truncate( slash > 0 ? slash : 0);
+	off_t free = Preflight::FreeSpace( directory.Length() > 0 ? directory.String() : ".");
+	if( free >= 0)
+	{
+		printf( "%.1f MB free: %s\n", free / 1048576.0, preflight.EstimateHigh() <= free ? "archive fits"
+			: preflight.EstimateLow() > free ? "archive doesn't fit" : "archive may not fit");
+	}
+	return 0;
+}
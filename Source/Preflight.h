@@ -0,0 +1,162 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __PREFLIGHT_H_
+#define __PREFLIGHT_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <List.h>
+#include <OS.h>
+
+#include <stdio.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	PREFLIGHT_BLOCK				65536	// bytes compressed for each sample
+#define	PREFLIGHT_SAMPLES			256		// samples of whole selection, split between extensions by their size
+#define	PREFLIGHT_MIN_SAMPLES		2		// ... but each extension gets at least as many
+#define	PREFLIGHT_FILE_OVERHEAD		128		// bytes archive takes for each file besides it's data (headers, name)
+#define	PREFLIGHT_MAX_EXTENSIONS	512		// more extensions than that are counted as one
+#define	PREFLIGHT_EXTENSION_LENGTH	16
+#define	PREFLIGHT_SPREAD			2.0		// error bars are +- 2 standard errors (about 95%)
+#define	PREFLIGHT_LINKS_FIRST_SIZE	256		// slots of table of hard linked files at first, it doubles when half full
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Files of one extension, and samples taken of them
+//---------------------------------------------------
+struct preflight_extension
+{
+	char				name[PREFLIGHT_EXTENSION_LENGTH];
+	off_t				size;
+	int32				files;
+
+	int32				samples;		// samples wanted
+	off_t				*offsets;		// where they are, in all files of extension one after another
+	int32				next;			// first offset Sample() didn't get to yet
+	int32				taken;			// samples compressed
+	off_t				seen;			// bytes of files walked by Sample() so far
+	off_t				sampledIn;
+	off_t				sampledOut;
+	double				sumRatio;		// of samples, for their variance
+	double				sumRatio2;
+	bigtime_t			cpu;
+};
+
+//---------------------------------------------------
+//	File with more than one hard link
+//---------------------------------------------------
+struct preflight_link
+{
+	dev_t				device;
+	ino_t				node;
+};
+
+//---------------------------------------------------
+//	Estimate of archive made of files, before it's made - files are walked for their sizes,
+//	and blocks spread over them are compressed, by extension (which is what ratio depends on most)
+//	rule's tools aren't run for that, deflate at rule's level stands in for them
+//	(bzip2, xz and zstd make smaller archives, so estimate is rather too big than too small)
+//	hard links to file walked before are counted apart - tar stores them once, zip as many times as there are links
+//---------------------------------------------------
+class Preflight
+{
+	public:
+							Preflight( int32 level);
+							~Preflight();
+
+		void				AddPath( const char *path, int32 *cancel = NULL);
+		status_t			Sample( int32 *cancel = NULL);
+
+		off_t				InputSize() const { return aSize; };
+		off_t				LinkedSize() const { return aLinkedSize; };
+		int32				CountFiles() const { return aFiles; };
+		off_t				MaxSize() const;
+		off_t				Estimate() const;
+		off_t				EstimateLow() const;
+		off_t				EstimateHigh() const;
+		bigtime_t			CpuTime() const;
+		bool				IsSampled() const { return aSampled; };
+		void				PrintReport( FILE *out) const;
+
+		int32				CountExtensions() const { return aExtensionCount; };
+		const preflight_extension	*ExtensionAt( int32 index) const { return &aExtensions[index]; };
+		double				Ratio( const preflight_extension *extension) const;
+
+		static off_t		FreeSpace( const char *directory);
+		static void			ExtensionOf( const char *name, char *extension);
+
+	private:
+		preflight_extension	*Extension( const char *name);
+		double				Error( const preflight_extension *extension) const;
+		off_t				Spread() const;
+		void				Walk( const char *path, bool sample, int32 *cancel);
+		void				SampleFile( preflight_extension *extension, const char *path, off_t size);
+		bool				IsLinkSeen( const struct stat *st);
+
+		int32				aLevel;			// of deflate, 0 - rule doesn't compress
+		BList				aPaths;			// paths added (copies)
+		off_t				aSize;
+		off_t				aLinkedSize;	// of files which are hard links to files walked before
+		int32				aFiles;
+		bool				aSampled;
+
+		preflight_extension	*aExtensions;
+		int32				aExtensionCount;
+		int32				*aHash;			// index+1 of extensions, by hash of name
+		preflight_link		*aLinks;		// files with hard links seen by walk
+		int32				aLinkCount;
+		int32				aLinkSlots;
+
+		void				*aStream;		// z_stream, reset for each sample
+		uint8				*aIn;
+		uint8				*aOut;
+		size_t				aOutSize;
+		uint32				aSeed;
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+int			preflight_main( int argc, char **argv);
+
+#endif /*__PREFLIGHT_H_*/
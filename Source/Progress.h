@@ -0,0 +1,117 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __PROGRESS_H_
+#define __PROGRESS_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <OS.h>
+#include <SupportDefs.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	JOB_PHASE_STARTING			0
+#define	JOB_PHASE_WORKING			1		// tools run, or Archiver adds (extracts) files itself
+#define	JOB_PHASE_VERIFYING			2		// tools are done, verification isn't
+#define	JOB_PHASE_COMMITTING		3		// central directory (end of TAR) is written
+#define	JOB_PHASE_QUEUED			4		// waits for other jobs, it's files are read ahead meanwhile
+#define	JOB_PHASE_CHECKING			5		// files are sampled, to see if archive fits on it's volume
+
+#define	JOB_PAUSE_POLL				50000	// how often paused work checks if it can go on
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Values of JobProgress at one moment
+//---------------------------------------------------
+struct job_progress
+{
+	int64				bytesIn;
+	int64				bytesOut;
+	int64				readAhead;
+	int64				memory;
+	int32				files;
+	int32				phase;
+};
+
+//---------------------------------------------------
+//	Progress of job - counters are updated by threads doing the work, with atomic operations only,
+//	and window reads them when it redraws, so no message is sent and no lock is taken for progress
+//---------------------------------------------------
+class JobProgress
+{
+	public:
+							JobProgress() : aBytesIn( 0), aBytesOut( 0), aReadAhead( 0), aMemory( 0), aFiles( 0), aPhase( JOB_PHASE_STARTING), aPaused( 0) {};
+
+		inline void			AddIn( int64 bytes) { atomic_add64( &aBytesIn, bytes); };
+		inline void			AddOut( int64 bytes) { atomic_add64( &aBytesOut, bytes); };
+		inline void			SetOut( int64 bytes) { atomic_set64( &aBytesOut, bytes); };
+		inline void			AddReadAhead( int64 bytes) { atomic_add64( &aReadAhead, bytes); };
+		inline void			SetMemory( int64 bytes) { atomic_set64( &aMemory, bytes); };
+		inline int64		Memory() { return atomic_get64( &aMemory); };
+		inline void			FileDone() { atomic_add( &aFiles, 1); };
+		inline void			SetPhase( int32 phase) { atomic_set( &aPhase, phase); };
+
+		// threads doing the work wait here, between chunks, while job is paused (they're never suspended)
+		inline void			SetPaused( bool paused) { atomic_set( &aPaused, paused ? 1 : 0); };
+		inline bool			IsPaused() { return atomic_get( &aPaused) != 0; };
+		void				WaitWhilePaused()
+							{
+								while( atomic_get( &aPaused) != 0)
+									snooze( JOB_PAUSE_POLL);
+							};
+
+		void				Sample( job_progress *progress)
+							{
+								progress->bytesIn = atomic_get64( &aBytesIn);
+								progress->bytesOut = atomic_get64( &aBytesOut);
+								progress->readAhead = atomic_get64( &aReadAhead);
+								progress->memory = atomic_get64( &aMemory);
+								progress->files = atomic_get( &aFiles);
+								progress->phase = atomic_get( &aPhase);
+							};
+
+	private:
+		int64				aBytesIn;		// bytes of files read
+		int64				aBytesOut;		// bytes of archive (or extracted files) written
+		int64				aReadAhead;		// bytes of files read into cache while job was queued
+		int64				aMemory;		// bytes of memory job's tools take now
+		int32				aFiles;
+		int32				aPhase;
+		int32				aPaused;
+};
+
+#endif /*__PROGRESS_H_*/
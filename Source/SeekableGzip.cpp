@@ -0,0 +1,349 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "SeekableGzip.h"
+#include "ZipArchive.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: writing
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	write() whole buffer - output may be pipe, so no pwrite()
+//---------------------------------------------------
+static status_t
+write_fully( int fd, const void *buffer, size_t size)
+{
+	const uint8 *data = (const uint8*)buffer;
+	while( size > 0)
+	{
+		ssize_t bytes = write( fd, data, size);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes <= 0)
+			return bytes < 0 ? errno : B_IO_ERROR;
+		data += bytes;
+		size -= bytes;
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Empty gzip member with one subfield in extra field
+//---------------------------------------------------
+static status_t
+write_extra_member( int fd, const char *id, const uint8 *data, uint16 size)
+{
+	uint8 header[16];
+	header[0] = 0x1f;
+	header[1] = 0x8b;
+	header[2] = 8;			// deflate
+	header[3] = 4;			// FEXTRA
+	zip_put32( header + 4, 0);
+	header[8] = 0;
+	header[9] = 255;		// unknown OS
+	zip_put16( header + 10, size + 4);
+	header[12] = id[0];
+	header[13] = id[1];
+	zip_put16( header + 14, size);
+
+	// empty deflate stream, CRC and size of nothing
+	static const uint8 trailer[10] = { 3, 0, 0, 0, 0, 0, 0, 0, 0, 0 };
+
+	status_t status = write_fully( fd, header, sizeof( header));
+	if( status == B_OK)
+		status = write_fully( fd, data, size);
+	if( status == B_OK)
+		status = write_fully( fd, trailer, sizeof( trailer));
+	return status;
+}
+
+//---------------------------------------------------
+//	Compress in_fd to out_fd, each blockSize of input to separate gzip member
+//	and add seek table at the end
+//---------------------------------------------------
+status_t
+seekable_gzip_write( int in_fd, int out_fd, int32 level, size_t blockSize, int32 *blocks)
+{
+	z_stream stream;
+	memset( &stream, 0, sizeof( stream));
+	if( deflateInit2( &stream, level, Z_DEFLATED, 15 + 16, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return B_NO_MEMORY;
+
+	size_t outputSize = deflateBound( &stream, blockSize);
+	uint8 *input = (uint8*)malloc( blockSize);
+	uint8 *output = (uint8*)malloc( outputSize);
+	uint8 *sizes = NULL;	// 4 bytes compressed, 4 bytes uncompressed, for each block
+	int32 count = 0;
+	uint64 offset = 0;
+	status_t status = ( input != NULL && output != NULL) ? B_OK : B_NO_MEMORY;
+
+	bool end = false;
+	while( status == B_OK && !end)
+	{
+		// whole block, unless input ends
+		size_t size = 0;
+		while( size < blockSize)
+		{
+			ssize_t bytes = read( in_fd, input + size, blockSize - size);
+			if( bytes < 0 && errno == EINTR)
+				continue;
+			if( bytes < 0)
+				status = errno;
+			if( bytes <= 0)
+			{
+				end = true;
+				break;
+			}
+			size += bytes;
+		}
+		// empty input still makes one (empty) block, so output is valid gzip
+		if( status != B_OK || ( size == 0 && count > 0))
+			break;
+
+		deflateReset( &stream);
+		stream.next_in = input;
+		stream.avail_in = size;
+		stream.next_out = output;
+		stream.avail_out = outputSize;
+		if( deflate( &stream, Z_FINISH) != Z_STREAM_END)
+		{
+			status = B_ERROR;
+			break;
+		}
+
+		size_t compressed = outputSize - stream.avail_out;
+		status = write_fully( out_fd, output, compressed);
+
+		if( count % 1024 == 0)
+		{
+			uint8 *more = (uint8*)realloc( sizes, (count + 1024) * 8);
+			if( more == NULL)
+			{
+				status = B_NO_MEMORY;
+				break;
+			}
+			sizes = more;
+		}
+		zip_put32( sizes + count * 8, compressed);
+		zip_put32( sizes + count * 8 + 4, size);
+		count++;
+		offset += compressed;
+	}
+	deflateEnd( &stream);
+	free( input);
+	free( output);
+
+	// seek table, split to fit into extra fields
+	for( int32 first = 0; status == B_OK && first < count; first += SEEKABLE_GZIP_TABLE_ENTRIES)
+	{
+		int32 entries = count - first < SEEKABLE_GZIP_TABLE_ENTRIES ? count - first : SEEKABLE_GZIP_TABLE_ENTRIES;
+		status = write_extra_member( out_fd, SEEKABLE_GZIP_TABLE_ID, sizes + first * 8, entries * 8);
+	}
+	free( sizes);
+
+	if( status == B_OK)
+	{
+		uint8 footer[16];
+		zip_put64( footer, offset);
+		zip_put64( footer + 8, count);
+		status = write_extra_member( out_fd, SEEKABLE_GZIP_FOOTER_ID, footer, sizeof( footer));
+	}
+
+	if( blocks != NULL)
+		*blocks = count;
+	return status;
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: reading
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Read seek table of seekable gzip file, B_BAD_DATA if it's ordinary gzip
+//---------------------------------------------------
+status_t
+seekable_gzip_read_table( int fd, seekable_gzip_table *table)
+{
+	table->count = 0;
+	table->compressed = NULL;
+	table->uncompressed = NULL;
+
+	struct stat st;
+	if( fstat( fd, &st) != 0)
+		return errno;
+	if( st.st_size < SEEKABLE_GZIP_FOOTER_SIZE)
+		return B_BAD_DATA;
+
+	uint8 footer[SEEKABLE_GZIP_FOOTER_SIZE];
+	status_t status = zip_read_at( fd, st.st_size - SEEKABLE_GZIP_FOOTER_SIZE, footer, sizeof( footer));
+	if( status != B_OK)
+		return status;
+	if( footer[0] != 0x1f || footer[1] != 0x8b || footer[3] != 4 || zip_get16( footer + 10) != 20
+		|| memcmp( footer + 12, SEEKABLE_GZIP_FOOTER_ID, 2) || zip_get16( footer + 14) != 16)
+		return B_BAD_DATA;
+
+	uint64 tableOffset = zip_get64( footer + 16);
+	uint64 count = zip_get64( footer + 24);
+	if( tableOffset >= (uint64)st.st_size || count > (uint64)st.st_size / 8)
+		return B_BAD_DATA;
+
+	table->compressed = (uint64*)malloc( sizeof( uint64) * (count + 1));
+	table->uncompressed = (uint64*)malloc( sizeof( uint64) * (count + 1));
+	uint8 *data = (uint8*)malloc( SEEKABLE_GZIP_TABLE_ENTRIES * 8);
+	if( table->compressed == NULL || table->uncompressed == NULL || data == NULL)
+	{
+		free( data);
+		seekable_gzip_free_table( table);
+		return B_NO_MEMORY;
+	}
+
+	table->compressed[0] = 0;
+	table->uncompressed[0] = 0;
+	uint64 offset = tableOffset;
+	uint64 index = 0;
+	while( status == B_OK && index < count)
+	{
+		uint8 header[16];
+		status = zip_read_at( fd, offset, header, sizeof( header));
+		if( status != B_OK)
+			break;
+
+		uint16 size = zip_get16( header + 14);
+		if( header[0] != 0x1f || header[1] != 0x8b || memcmp( header + 12, SEEKABLE_GZIP_TABLE_ID, 2)
+			|| size % 8 != 0 || size > SEEKABLE_GZIP_TABLE_ENTRIES * 8 || index + size / 8 > count)
+		{
+			status = B_BAD_DATA;
+			break;
+		}
+
+		status = zip_read_at( fd, offset + sizeof( header), data, size);
+		for( int32 entry = 0; status == B_OK && entry < size / 8; entry++, index++)
+		{
+			table->compressed[index+1] = table->compressed[index] + zip_get32( data + entry * 8);
+			table->uncompressed[index+1] = table->uncompressed[index] + zip_get32( data + entry * 8 + 4);
+		}
+		offset += sizeof( header) + size + 10;
+	}
+	free( data);
+
+	// blocks must end where table starts
+	if( status == B_OK && table->compressed[count] != tableOffset)
+		status = B_BAD_DATA;
+
+	if( status != B_OK)
+	{
+		seekable_gzip_free_table( table);
+		return status;
+	}
+
+	table->count = count;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Free arrays of table
+//---------------------------------------------------
+void
+seekable_gzip_free_table( seekable_gzip_table *table)
+{
+	free( table->compressed);
+	free( table->uncompressed);
+	table->compressed = NULL;
+	table->uncompressed = NULL;
+	table->count = 0;
+}
+
+//---------------------------------------------------
+//	Index of block which contains uncompressed position
+//---------------------------------------------------
+int32
+seekable_gzip_find_block( const seekable_gzip_table *table, uint64 position)
+{
+	int32 low = 0;
+	int32 high = table->count - 1;
+	while( low < high)
+	{
+		int32 middle = (low + high + 1) / 2;
+		if( table->uncompressed[middle] <= position)
+			low = middle;
+		else
+			high = middle - 1;
+	}
+	return low;
+}
+
+//---------------------------------------------------
+//	"Archiver --gzip-seekable [-level] [--block-size bytes]"
+//	compress stdin to stdout, for use in pipelines of rules
+//---------------------------------------------------
+int
+seekable_gzip_main( int argc, char **argv)
+{
+	int32 level = Z_DEFAULT_COMPRESSION;
+	size_t blockSize = SEEKABLE_GZIP_BLOCK_SIZE;
+	for( int32 arg = 0; arg < argc; arg++)
+	{
+		if( argv[arg][0] == '-' && argv[arg][1] >= '1' && argv[arg][1] <= '9' && argv[arg][2] == 0)
+			level = argv[arg][1] - '0';
+		else if( !strcmp( argv[arg], "--block-size") && arg + 1 < argc)
+			blockSize = strtoul( argv[++arg], NULL, 10);
+		else
+		{
+			fprintf( stderr, "usage: Archiver --gzip-seekable [-1..-9] [--block-size bytes] < input > output\n");
+			return 1;
+		}
+	}
+	if( blockSize < 4096 || blockSize > 0x7fffffff)
+		blockSize = SEEKABLE_GZIP_BLOCK_SIZE;
+
+	status_t status = seekable_gzip_write( STDIN_FILENO, STDOUT_FILENO, level, blockSize);
+	if( status != B_OK)
+	{
+		fprintf( stderr, "Archiver: can't compress (%s)\n", strerror( status));
+		return 1;
+	}
+	return 0;
+}
@@ -0,0 +1,79 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __SEEKABLE_GZIP_H_
+#define __SEEKABLE_GZIP_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <SupportDefs.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+// seekable gzip is ordinary multi-member gzip, each member holds one block of data
+// after last block go empty members with seek table in their extra field ("AS" subfield, 8000 blocks each)
+// and one empty member with offset of table ("AF" subfield) - it has fixed size, so it's found from the end
+#define	SEEKABLE_GZIP_BLOCK_SIZE		(1024 * 1024)	// default uncompressed size of one block
+#define	SEEKABLE_GZIP_TABLE_ID			"AS"			// Archiver Seek table
+#define	SEEKABLE_GZIP_FOOTER_ID			"AF"			// Archiver Footer
+#define	SEEKABLE_GZIP_TABLE_ENTRIES		8000			// per member, each is 4 bytes compressed and 4 bytes uncompressed size
+#define	SEEKABLE_GZIP_FOOTER_SIZE		42
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Seek table - where each block starts, compressed and uncompressed
+//	there is one more entry than blocks, with end of last block
+//---------------------------------------------------
+struct seekable_gzip_table
+{
+	int32		count;			// of blocks
+	uint64		*compressed;
+	uint64		*uncompressed;
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+status_t	seekable_gzip_write( int in_fd, int out_fd, int32 level, size_t blockSize, int32 *blocks = NULL);
+status_t	seekable_gzip_read_table( int fd, seekable_gzip_table *table);
+void		seekable_gzip_free_table( seekable_gzip_table *table);
+int32		seekable_gzip_find_block( const seekable_gzip_table *table, uint64 position);
+int			seekable_gzip_main( int argc, char **argv);
+
+#endif /*__SEEKABLE_GZIP_H_*/
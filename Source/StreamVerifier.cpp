@@ -0,0 +1,310 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "StreamVerifier.h"
+#include "ArchiveIndex.h"
+#include "Archiver.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <zlib.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: StreamVerifier
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+StreamVerifier::StreamVerifier()
+	:aIn( -1),
+	aOut( -1),
+	aCheckIn( -1),
+	aCheckOut( -1),
+	aTool( -1),
+	aCopyResult( B_OK),
+	aCheckResult( B_OK),
+	aFormat( NULL),
+	aCheckTime( 0)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+StreamVerifier::~StreamVerifier()
+{
+	Wait();
+}
+
+//---------------------------------------------------
+//	Start copying in_fd to out_fd, both are closed when copying is finished
+//---------------------------------------------------
+status_t
+StreamVerifier::Start( int in_fd, int out_fd)
+{
+	aIn = in_fd;
+	aOut = out_fd;
+	WorkerPool::Default()->SubmitBlocking( &aTasks, CopyTask, this);
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Wait until all data is written and verified
+//	returns error of writing archive, or B_BAD_DATA if archive is damaged
+//---------------------------------------------------
+status_t
+StreamVerifier::Wait()
+{
+	// copying task starts checking one, so it's in group before copying is done
+	aTasks.Wait();
+
+	return aCopyResult != B_OK ? aCopyResult : aCheckResult;
+}
+
+//---------------------------------------------------
+//	Task functions - data is pointer to StreamVerifier
+//---------------------------------------------------
+int32
+StreamVerifier::CopyTask( void *data)
+{
+	StreamVerifier *verifier = (StreamVerifier*)data;
+	verifier->aCopyResult = verifier->Copy();
+	return 0;
+}
+
+int32
+StreamVerifier::CheckTask( void *data)
+{
+	StreamVerifier *verifier = (StreamVerifier*)data;
+	verifier->aCheckResult = verifier->aTool >= B_OK ? verifier->CheckTool() : verifier->CheckGzip();
+	return 0;
+}
+
+//---------------------------------------------------
+//	Copy data to archive, and to verifier through pipe
+//	when verifier stops reading (it found error), archive is still written
+//---------------------------------------------------
+status_t
+StreamVerifier::Copy()
+{
+	uint8 *buffer = (uint8*)malloc( STREAM_VERIFIER_BUFFER_SIZE);
+	status_t status = buffer != NULL ? B_OK : B_NO_MEMORY;
+	bool first = true;
+	while( status == B_OK)
+	{
+		ssize_t size = read( aIn, buffer, STREAM_VERIFIER_BUFFER_SIZE);
+		if( size < 0 && errno == EINTR)
+			continue;
+		if( size < 0)
+			status = errno;
+		if( size <= 0)
+			break;
+
+		// format is known from first bytes
+		if( first)
+		{
+			first = false;
+			StartCheck( buffer, size);
+		}
+
+		for( ssize_t written = 0; status == B_OK && written < size; )
+		{
+			ssize_t bytes = write( aOut, buffer + written, size - written);
+			if( bytes < 0 && errno == EINTR)
+				continue;
+			if( bytes < 0)
+				status = errno;
+			else
+				written += bytes;
+		}
+
+		for( ssize_t written = 0; aCheckOut >= 0 && written < size; )
+		{
+			ssize_t bytes = write( aCheckOut, buffer + written, size - written);
+			if( bytes < 0 && errno == EINTR)
+				continue;
+			if( bytes < 0)
+			{
+				close( aCheckOut);
+				aCheckOut = -1;
+			}
+			else
+				written += bytes;
+		}
+	}
+	free( buffer);
+
+	// closing input makes last stage fail, if archive couldn't be written
+	close( aIn);
+	if( close( aOut) != 0 && status == B_OK)
+		status = errno;
+	if( aCheckOut >= 0)
+		close( aCheckOut);
+	aIn = aOut = aCheckOut = -1;
+	return status;
+}
+
+//---------------------------------------------------
+//	Start verifier for data starting with given bytes - zlib for gzip, "tool -t" for others
+//---------------------------------------------------
+status_t
+StreamVerifier::StartCheck( const uint8 *magic, size_t size)
+{
+	const char *tool = archive_decompressor( magic, size);
+	bool gzip = size >= 2 && magic[0] == 0x1f && magic[1] == 0x8b;
+	if( !gzip && tool == NULL)
+		return B_NOT_SUPPORTED;
+
+	// made under launch_tool()'s lock, so no tool loaded meanwhile inherits it
+	int fds[2];
+	status_t status = make_pipe( fds);
+	if( status != B_OK)
+		return status;
+
+	if( !gzip)
+	{
+		const char *arg_v[] = { tool, "-t", NULL };
+		aTool = launch_tool( 2, arg_v, fds[0], -1);
+		close( fds[0]);
+		fds[0] = -1;
+		if( aTool < B_OK)
+		{
+			close( fds[1]);
+			return aTool;
+		}
+	}
+
+	aCheckIn = fds[0];
+	aCheckOut = fds[1];
+	if( aTool >= B_OK)
+		resume_thread( aTool);
+	WorkerPool::Default()->SubmitBlocking( &aTasks, CheckTask, this, B_LOW_PRIORITY);
+
+	// tool is one of constant paths, it's name can be kept
+	const char *leaf = gzip ? NULL : strrchr( tool, '/');
+	aFormat = gzip ? "gzip" : leaf != NULL ? leaf + 1 : tool;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Inflate all gzip members, zlib checks CRC and size of each of them
+//---------------------------------------------------
+status_t
+StreamVerifier::CheckGzip()
+{
+	// thread of WorkerPool may have run other tasks before, only CPU time from now on counts
+	thread_info info;
+	bigtime_t started = 0;
+	if( get_thread_info( find_thread( NULL), &info) == B_OK)
+		started = info.user_time + info.kernel_time;
+
+	uint8 *input = (uint8*)malloc( STREAM_VERIFIER_BUFFER_SIZE);
+	uint8 *output = (uint8*)malloc( STREAM_VERIFIER_BUFFER_SIZE);
+	z_stream stream;
+	memset( &stream, 0, sizeof( stream));
+	status_t status = B_OK;
+	if( input == NULL || output == NULL || inflateInit2( &stream, 15 + 16) != Z_OK)
+		status = B_NO_MEMORY;
+
+	bool ended = false;
+	while( status == B_OK)
+	{
+		if( stream.avail_in == 0)
+		{
+			ssize_t size = read( aCheckIn, input, STREAM_VERIFIER_BUFFER_SIZE);
+			if( size < 0 && errno == EINTR)
+				continue;
+			if( size < 0)
+				status = errno;
+			if( size <= 0)
+				break;
+			stream.next_in = input;
+			stream.avail_in = size;
+		}
+
+		// next member
+		if( ended)
+		{
+			inflateReset( &stream);
+			ended = false;
+		}
+
+		stream.next_out = output;
+		stream.avail_out = STREAM_VERIFIER_BUFFER_SIZE;
+		int result = inflate( &stream, Z_NO_FLUSH);
+		if( result == Z_STREAM_END)
+			ended = true;
+		else if( result != Z_OK && result != Z_BUF_ERROR)
+			status = B_BAD_DATA;
+	}
+
+	// archive must not end in the middle of member
+	if( status == B_OK && !ended)
+		status = B_BAD_DATA;
+
+	inflateEnd( &stream);
+	free( input);
+	free( output);
+	close( aCheckIn);
+	aCheckIn = -1;
+
+	if( get_thread_info( find_thread( NULL), &info) == B_OK)
+		aCheckTime = info.user_time + info.kernel_time - started;
+	return status;
+}
+
+//---------------------------------------------------
+//	Wait for "tool -t", sample it's CPU time meanwhile
+//---------------------------------------------------
+status_t
+StreamVerifier::CheckTool()
+{
+	while( true)
+	{
+		team_usage_info usage;
+		if( get_team_usage_info( aTool, B_TEAM_USAGE_SELF, &usage) == B_OK)
+			aCheckTime = usage.user_time + usage.kernel_time;
+
+		status_t result;
+		status_t status = wait_for_thread_etc( aTool, B_RELATIVE_TIMEOUT, ARCHIVER_STAGE_POLL, &result);
+		if( status == B_OK)
+			return result == 0 ? B_OK : B_BAD_DATA;
+		if( status != B_TIMED_OUT && status != B_INTERRUPTED)
+			return status;
+	}
+}
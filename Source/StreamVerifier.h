@@ -0,0 +1,91 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __STREAM_VERIFIER_H_
+#define __STREAM_VERIFIER_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <OS.h>
+#include <SupportDefs.h>
+
+#include "WorkerPool.h"
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	STREAM_VERIFIER_BUFFER_SIZE		(256 * 1024)
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Writes output of last stage of pipeline to archive and, at the same time,
+//	decompresses it in another task of WorkerPool (or with "tool -t") to check it's CRCs
+//	so archive doesn't have to be read again to test it
+//---------------------------------------------------
+class StreamVerifier
+{
+	public:
+							StreamVerifier();
+							~StreamVerifier();
+
+		status_t			Start( int in_fd, int out_fd);
+		status_t			Wait();
+
+		const char			*Format() const { return aFormat; };	// NULL if data wasn't recognized, so it wasn't verified
+		bigtime_t			CheckTime() const { return aCheckTime; };	// CPU time used by verification
+
+	private:
+		static int32		CopyTask( void *data);
+		static int32		CheckTask( void *data);
+		status_t			Copy();
+		status_t			StartCheck( const uint8 *magic, size_t size);
+		status_t			CheckGzip();
+		status_t			CheckTool();
+
+		int					aIn;
+		int					aOut;
+		int					aCheckIn;		// decompressed by verifier
+		int					aCheckOut;		// written by copying task
+
+		TaskGroup			aTasks;			// copying and checking, they wait for pipes
+		thread_id			aTool;
+		status_t			aCopyResult;
+		status_t			aCheckResult;
+
+		const char			*aFormat;
+		bigtime_t			aCheckTime;
+};
+
+#endif /*__STREAM_VERIFIER_H_*/
@@ -0,0 +1,697 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "TarArchive.h"
+#include "ZipArchive.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: helpers
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Numbers are octal text, or big endian binary with high bit set if they don't fit (GNU)
+//---------------------------------------------------
+uint64
+tar_get_number( const char *field, size_t size)
+{
+	uint64 value = 0;
+	if( field[0] & 0x80)
+	{
+		value = field[0] & 0x7f;
+		for( size_t index = 1; index < size; index++)
+			value = (value << 8) | (uint8)field[index];
+		return value;
+	}
+
+	size_t index = 0;
+	while( index < size && field[index] == ' ')
+		index++;
+	for( ; index < size && field[index] >= '0' && field[index] <= '7'; index++)
+		value = (value << 3) | (field[index] - '0');
+	return value;
+}
+
+static void
+tar_put_number( char *field, size_t size, uint64 value)
+{
+	if( value < (1ULL << (3 * (size - 1))))
+	{
+		for( size_t index = size - 1; index-- > 0; value >>= 3)
+			field[index] = '0' + (value & 7);
+		field[size-1] = 0;
+		return;
+	}
+
+	for( size_t index = size; index-- > 1; value >>= 8)
+		field[index] = value & 0xff;
+	field[0] = (char)0x80;
+}
+
+//---------------------------------------------------
+//	Sum of header bytes, with checksum field counted as spaces
+//---------------------------------------------------
+uint32
+tar_checksum( const char *header)
+{
+	uint32 sum = 0;
+	for( int32 index = 0; index < TAR_BLOCK_SIZE; index++)
+		sum += ( index >= 148 && index < 156) ? ' ' : (uint8)header[index];
+	return sum;
+}
+
+//---------------------------------------------------
+//	Record of POSIX extended header - "length key=value\n", length counts it's own digits too
+//---------------------------------------------------
+static size_t
+tar_pax_record( char *record, const char *key, const char *value)
+{
+	size_t size = strlen( key) + strlen( value) + 3;
+	size_t digits = 1;
+	for( size_t limit = 10; size + digits >= limit; limit *= 10)
+		digits++;
+	return sprintf( record, "%d %s=%s\n", (int)( size + digits), key, value);
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: TarArchive
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+TarArchive::TarArchive()
+	:aFd( -1),
+	aDevice( 0),
+	aNode( 0),
+	aCount( 0),
+	aAppendOffset( 0),
+	aOldEnd( 0),
+	aOldSize( 0),
+	aProgress( NULL),
+	aSharing( NULL)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+TarArchive::~TarArchive()
+{
+	Close();
+}
+
+//---------------------------------------------------
+//	Close archive (doesn't Commit())
+//---------------------------------------------------
+void
+TarArchive::Close()
+{
+	if( aFd >= 0)
+		close( aFd);
+	aFd = -1;
+	aCount = 0;
+}
+
+//---------------------------------------------------
+//	Open existing archive and find where it ends
+//---------------------------------------------------
+status_t
+TarArchive::Open( const char *path)
+{
+	Close();
+
+	aFd = open( path, O_RDWR | O_CLOEXEC);
+	if( aFd < 0)
+		return errno;
+
+	struct stat st;
+	if( fstat( aFd, &st) != 0)
+		return errno;
+	aDevice = st.st_dev;
+	aNode = st.st_ino;
+	aOldSize = st.st_size;
+
+	status_t status = FindEnd();
+	if( status != B_OK)
+		Close();
+	return status;
+}
+
+//---------------------------------------------------
+//	Create new, empty archive
+//---------------------------------------------------
+status_t
+TarArchive::Create( const char *path)
+{
+	Close();
+
+	aFd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if( aFd < 0)
+		return errno;
+
+	struct stat st;
+	if( fstat( aFd, &st) != 0)
+		return errno;
+	aDevice = st.st_dev;
+	aNode = st.st_ino;
+
+	aAppendOffset = aOldEnd = aOldSize = 0;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Walk headers (skipping data) up to end-of-archive blocks
+//---------------------------------------------------
+status_t
+TarArchive::FindEnd()
+{
+	char header[TAR_BLOCK_SIZE];
+	off_t offset = 0;
+	int64 paxSize = -1;		// "size" of POSIX extended header - members of 8GB and more have it only there
+
+	// some tools don't write end-of-archive blocks, archive just ends after last member
+	while( offset + TAR_BLOCK_SIZE <= aOldSize)
+	{
+		status_t status = zip_read_at( aFd, offset, header, TAR_BLOCK_SIZE);
+		if( status != B_OK)
+			return status;
+
+		if( header[0] == 0)
+			break;
+
+		if( tar_get_number( header + 148, 8) != tar_checksum( header))
+			return B_BAD_DATA;
+
+		char type = header[156];
+		bool member = type != TAR_TYPE_LONG_NAME && type != TAR_TYPE_LONG_LINK && type != TAR_TYPE_PAX && type != TAR_TYPE_PAX_GLOBAL;
+		uint64 size = tar_get_number( header + 124, 12);
+		if( member)
+		{
+			aCount++;
+			if( paxSize >= 0)
+				size = paxSize;
+			paxSize = -1;
+		}
+
+		// records are "length key=value\n", only "size" is needed here
+		if( type == TAR_TYPE_PAX && size <= 1024 * 1024 && offset + TAR_BLOCK_SIZE + (off_t)size <= aOldSize)
+		{
+			char *data = (char*)malloc( size + 1);
+			if( data == NULL)
+				return B_NO_MEMORY;
+			status = zip_read_at( aFd, offset + TAR_BLOCK_SIZE, data, size);
+			data[size] = 0;
+			for( char *record = data; status == B_OK && record < data + size; )
+			{
+				long length = strtol( record, NULL, 10);
+				char *key = strchr( record, ' ');
+				if( length <= 0 || record + length > data + size || key == NULL || key >= record + length)
+					break;
+				if( !strncmp( key + 1, "size=", 5))
+					paxSize = strtoll( key + 6, NULL, 10);
+				record += length;
+			}
+			free( data);
+			if( status != B_OK)
+				return status;
+		}
+
+		offset += TAR_BLOCK_SIZE + ((size + TAR_BLOCK_SIZE - 1) & ~(uint64)(TAR_BLOCK_SIZE - 1));
+	}
+
+	if( offset > aOldSize)
+		return B_BAD_DATA;
+
+	aAppendOffset = aOldEnd = offset;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Write at aAppendOffset and move it
+//---------------------------------------------------
+status_t
+TarArchive::Write( const void *buffer, size_t size)
+{
+	status_t status = zip_write_at( aFd, aAppendOffset, buffer, size);
+	if( status == B_OK)
+		aAppendOffset += size;
+	if( status == B_OK && aProgress != NULL)
+		aProgress->AddOut( size);
+	return status;
+}
+
+//---------------------------------------------------
+//	GNU long name (or link) record, for names which don't fit into ustar header
+//---------------------------------------------------
+status_t
+TarArchive::WriteLongName( const char *name, char type)
+{
+	size_t size = strlen( name) + 1;
+	char header[TAR_BLOCK_SIZE];
+	memset( header, 0, sizeof( header));
+
+	strcpy( header, "././@LongLink");
+	tar_put_number( header + 100, 8, 0644);
+	tar_put_number( header + 108, 8, 0);
+	tar_put_number( header + 116, 8, 0);
+	tar_put_number( header + 124, 12, size);
+	tar_put_number( header + 136, 12, 0);
+	header[156] = type;
+	memcpy( header + 257, "ustar  ", 8);
+	sprintf( header + 148, "%06o", (unsigned int)tar_checksum( header));
+	header[155] = ' ';
+
+	status_t status = Write( header, TAR_BLOCK_SIZE);
+	if( status == B_OK)
+		status = WritePadded( name, size);
+	return status;
+}
+
+//---------------------------------------------------
+//	Write data of record which isn't file (long name, extended header, sparse map) and pad it to full block
+//---------------------------------------------------
+status_t
+TarArchive::WritePadded( const void *buffer, size_t size)
+{
+	char padding[TAR_BLOCK_SIZE];
+	memset( padding, 0, sizeof( padding));
+
+	status_t status = Write( buffer, size);
+	if( status == B_OK && size % TAR_BLOCK_SIZE != 0)
+		status = Write( padding, TAR_BLOCK_SIZE - size % TAR_BLOCK_SIZE);
+	return status;
+}
+
+//---------------------------------------------------
+//	Write ustar header, preceded by long name records if needed - size is of member's data
+//---------------------------------------------------
+status_t
+TarArchive::WriteHeader( const char *name, const struct stat *st, char type, const char *link, off_t size)
+{
+	char header[TAR_BLOCK_SIZE];
+	memset( header, 0, sizeof( header));
+
+	status_t status = B_OK;
+	size_t length = strlen( name);
+	if( length < 100)
+		memcpy( header, name, length);
+	else
+	{
+		// try to split name into prefix and name, as ustar wants
+		const char *slash = NULL;
+		if( length <= 255)
+		{
+			for( const char *separator = strchr( name, '/'); separator != NULL; separator = strchr( separator + 1, '/'))
+			{
+				if( separator - name <= 155 && length - (separator - name) - 1 < 100 && separator[1] != 0)
+				{
+					slash = separator;
+					break;
+				}
+			}
+		}
+
+		if( slash != NULL)
+		{
+			memcpy( header + 345, name, slash - name);
+			memcpy( header, slash + 1, length - (slash - name) - 1);
+		}
+		else
+		{
+			status = WriteLongName( name, TAR_TYPE_LONG_NAME);
+			memcpy( header, name, 99);
+		}
+	}
+
+	if( status == B_OK && link != NULL)
+	{
+		if( strlen( link) < 100)
+			memcpy( header + 157, link, strlen( link));
+		else
+		{
+			status = WriteLongName( link, TAR_TYPE_LONG_LINK);
+			memcpy( header + 157, link, 99);
+		}
+	}
+	if( status != B_OK)
+		return status;
+
+	tar_put_number( header + 100, 8, st->st_mode & 07777);
+	tar_put_number( header + 108, 8, st->st_uid);
+	tar_put_number( header + 116, 8, st->st_gid);
+	tar_put_number( header + 124, 12, size);
+	tar_put_number( header + 136, 12, st->st_mtime);
+	header[156] = type;
+	memcpy( header + 257, "ustar", 6);
+	memcpy( header + 263, "00", 2);
+	sprintf( header + 148, "%06o", (unsigned int)tar_checksum( header));
+	header[155] = ' ';
+
+	return Write( header, TAR_BLOCK_SIZE);
+}
+
+//---------------------------------------------------
+//	Add file, directory (with all it's contents) or symlink
+//	name is name of member in archive
+//---------------------------------------------------
+status_t
+TarArchive::AddPath( const char *path, const char *name, int32 *cancel)
+{
+	if( cancel != NULL && *cancel)
+		return B_CANCELED;
+
+	struct stat st;
+	if( lstat( path, &st) != 0)
+		return errno;
+
+	// don't try to put archive into itself
+	if( st.st_dev == aDevice && st.st_ino == aNode)
+		return B_OK;
+
+	if( S_ISLNK( st.st_mode))
+	{
+		char target[B_PATH_NAME_LENGTH];
+		ssize_t size = readlink( path, target, sizeof( target) - 1);
+		if( size < 0)
+			return errno;
+		target[size] = 0;
+
+		aCount++;
+		return WriteHeader( name, &st, TAR_TYPE_SYMLINK, target, 0);
+	}
+
+	// other hard link of file stored before, or file with the same content, is hard link to it
+	if( S_ISREG( st.st_mode))
+	{
+		const char *first = aSharing != NULL ? aSharing->FindCopy( path, &st, cancel) : NULL;
+		if( first != NULL)
+		{
+			aCount++;
+			return WriteHeader( name, &st, TAR_TYPE_HARDLINK, first, 0);
+		}
+
+		status_t status = AddFile( path, name, &st, cancel);
+		if( status == B_OK && aSharing != NULL)
+			aSharing->Added( path, name, &st);
+		return status;
+	}
+
+	if( !S_ISDIR( st.st_mode))
+		return B_OK;
+
+	char *dirName = (char*)malloc( strlen( name) + 2);
+	sprintf( dirName, "%s/", name);
+	status_t status = WriteHeader( dirName, &st, TAR_TYPE_DIRECTORY, NULL, 0);
+	free( dirName);
+	if( status != B_OK)
+		return status;
+	aCount++;
+
+	DIR *dir = opendir( path);
+	if( dir == NULL)
+		return errno;
+
+	struct dirent *dirent;
+	while( status == B_OK && ( dirent = readdir( dir)) != NULL)
+	{
+		if( !strcmp( dirent->d_name, ".") || !strcmp( dirent->d_name, ".."))
+			continue;
+
+		size_t pathSize = strlen( path) + strlen( dirent->d_name) + 2;
+		size_t nameSize = strlen( name) + strlen( dirent->d_name) + 2;
+		char *childPath = (char*)malloc( pathSize);
+		char *childName = (char*)malloc( nameSize);
+		sprintf( childPath, "%s/%s", path, dirent->d_name);
+		sprintf( childName, "%s/%s", name, dirent->d_name);
+
+		status = AddPath( childPath, childName, cancel);
+
+		free( childPath);
+		free( childName);
+	}
+	closedir( dir);
+
+	return status;
+}
+
+//---------------------------------------------------
+//	Add regular file - header, data, padding
+//---------------------------------------------------
+status_t
+TarArchive::AddFile( const char *path, const char *name, const struct stat *st, int32 *cancel)
+{
+	int fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0)
+		return errno;
+
+	off_t headerOffset = aAppendOffset;
+	status_t status = B_OK;
+	uint8 *buffer = (uint8*)malloc( TAR_BUFFER_SIZE);
+	if( buffer == NULL)
+		status = B_NO_MEMORY;
+
+	// only data segments of sparse file are read and stored
+	off_t *segments = NULL;
+	off_t holes = 0;
+	int32 count = aSharing != NULL ? FileSharing::DataSegments( fd, st->st_size, &segments, &holes) : 0;
+	if( status == B_OK && count > 0)
+	{
+		status = AddSparseFile( fd, name, st, segments, count, buffer, cancel);
+		if( status == B_OK)
+			aSharing->AddHoles( holes);
+	}
+	else if( status == B_OK)
+		status = WriteHeader( name, st, TAR_TYPE_FILE, NULL, st->st_size);
+	free( segments);
+
+	// size is already in header, so write exactly that much
+	off_t left = count > 0 ? 0 : st->st_size;
+	while( status == B_OK && left > 0)
+	{
+		if( cancel != NULL && *cancel)
+		{
+			status = B_CANCELED;
+			break;
+		}
+
+		ssize_t bytes = read( fd, buffer, left < TAR_BUFFER_SIZE ? left : TAR_BUFFER_SIZE);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes < 0)
+		{
+			status = errno;
+			break;
+		}
+		// file shrunk while reading it
+		if( bytes == 0)
+		{
+			status = B_FILE_ERROR;
+			break;
+		}
+
+		status = Write( buffer, bytes);
+		left -= bytes;
+		if( aProgress != NULL)
+		{
+			aProgress->AddIn( bytes);
+			aProgress->WaitWhilePaused();
+		}
+	}
+
+	if( status == B_OK && count == 0 && st->st_size % TAR_BLOCK_SIZE != 0)
+	{
+		memset( buffer, 0, TAR_BLOCK_SIZE);
+		status = Write( buffer, TAR_BLOCK_SIZE - st->st_size % TAR_BLOCK_SIZE);
+	}
+
+	free( buffer);
+	close( fd);
+
+	if( status != B_OK)
+	{
+		aAppendOffset = headerOffset;
+		return status;
+	}
+
+	aCount++;
+	if( aProgress != NULL)
+		aProgress->FileDone();
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Add sparse file as GNU tar does (PAX format 1.0) - extended header has it's real name and size,
+//	data of member is map of segments (count, then offset and size of each, one number on line)
+//	padded to full block, followed by data of segments - holes are neither read nor stored
+//---------------------------------------------------
+status_t
+TarArchive::AddSparseFile( int fd, const char *name, const struct stat *st, const off_t *segments, int32 count,
+	uint8 *buffer, int32 *cancel)
+{
+	char *map = (char*)malloc( 16 + count * 2 * 22);
+	char *pax = (char*)malloc( 2 * strlen( name) + 256);
+	char *sparseName = (char*)malloc( strlen( name) + sizeof( TAR_SPARSE_DIRECTORY) + 2);
+	if( map == NULL || pax == NULL || sparseName == NULL)
+	{
+		free( map);
+		free( pax);
+		free( sparseName);
+		return B_NO_MEMORY;
+	}
+
+	size_t mapSize = sprintf( map, "%" B_PRId32 "\n", count);
+	off_t dataSize = 0;
+	for( int32 index = 0; index < count; index++)
+	{
+		mapSize += sprintf( map + mapSize, "%" B_PRIdOFF "\n%" B_PRIdOFF "\n", segments[index * 2], segments[index * 2 + 1]);
+		dataSize += segments[index * 2 + 1];
+	}
+	off_t storedSize = ( ( mapSize + TAR_BLOCK_SIZE - 1) & ~(size_t)( TAR_BLOCK_SIZE - 1)) + dataSize;
+
+	char realSize[32];
+	sprintf( realSize, "%" B_PRIdOFF, st->st_size);
+	size_t paxSize = tar_pax_record( pax, "GNU.sparse.major", "1");
+	paxSize += tar_pax_record( pax + paxSize, "GNU.sparse.minor", "0");
+	paxSize += tar_pax_record( pax + paxSize, "GNU.sparse.name", name);
+	paxSize += tar_pax_record( pax + paxSize, "GNU.sparse.realsize", realSize);
+
+	// "dir/GNUSparseFile.0/file" - tar which doesn't know sparse files extracts it there, as it is stored
+	const char *leaf = strrchr( name, '/');
+	if( leaf != NULL)
+		sprintf( sparseName, "%.*s/%s/%s", (int)( leaf - name), name, TAR_SPARSE_DIRECTORY, leaf + 1);
+	else
+		sprintf( sparseName, "%s/%s", TAR_SPARSE_DIRECTORY, name);
+
+	status_t status = WriteHeader( "././@PaxHeader", st, TAR_TYPE_PAX, NULL, paxSize);
+	if( status == B_OK)
+		status = WritePadded( pax, paxSize);
+	if( status == B_OK)
+		status = WriteHeader( sparseName, st, TAR_TYPE_FILE, NULL, storedSize);
+	if( status == B_OK)
+		status = WritePadded( map, mapSize);
+	free( map);
+	free( pax);
+	free( sparseName);
+
+	for( int32 index = 0; status == B_OK && index < count; index++)
+	{
+		off_t offset = segments[index * 2];
+		off_t left = segments[index * 2 + 1];
+		while( status == B_OK && left > 0)
+		{
+			if( cancel != NULL && *cancel)
+			{
+				status = B_CANCELED;
+				break;
+			}
+
+			ssize_t bytes = pread( fd, buffer, left < TAR_BUFFER_SIZE ? left : TAR_BUFFER_SIZE, offset);
+			if( bytes < 0 && errno == EINTR)
+				continue;
+			if( bytes < 0)
+			{
+				status = errno;
+				break;
+			}
+			if( bytes == 0)
+			{
+				status = B_FILE_ERROR;
+				break;
+			}
+
+			status = Write( buffer, bytes);
+			offset += bytes;
+			left -= bytes;
+			if( aProgress != NULL)
+			{
+				aProgress->AddIn( bytes);
+				aProgress->WaitWhilePaused();
+			}
+		}
+	}
+
+	if( status == B_OK && dataSize % TAR_BLOCK_SIZE != 0)
+	{
+		memset( buffer, 0, TAR_BLOCK_SIZE);
+		status = Write( buffer, TAR_BLOCK_SIZE - dataSize % TAR_BLOCK_SIZE);
+	}
+	return status;
+}
+
+//---------------------------------------------------
+//	Write end-of-archive blocks after last member
+//---------------------------------------------------
+status_t
+TarArchive::Commit()
+{
+	char end[2 * TAR_BLOCK_SIZE];
+	memset( end, 0, sizeof( end));
+
+	status_t status = zip_write_at( aFd, aAppendOffset, end, sizeof( end));
+	if( status == B_OK && ftruncate( aFd, aAppendOffset + sizeof( end)) != 0)
+		status = errno;
+	if( status == B_OK)
+	{
+		fsync( aFd);
+		aOldEnd = aAppendOffset;
+		aOldSize = aAppendOffset + sizeof( end);
+	}
+	return status;
+}
+
+//---------------------------------------------------
+//	Adding failed or was cancelled - archive ends where it ended when it was opened
+//---------------------------------------------------
+status_t
+TarArchive::Rollback()
+{
+	if( aFd < 0)
+		return B_NO_INIT;
+
+	// cut appended members, then extend back to old size - that brings back zeroed end blocks
+	aAppendOffset = aOldEnd;
+	if( ftruncate( aFd, aOldEnd) != 0 || ftruncate( aFd, aOldSize) != 0)
+		return errno;
+	return B_OK;
+}
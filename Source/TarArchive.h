@@ -0,0 +1,122 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __TAR_ARCHIVE_H_
+#define __TAR_ARCHIVE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <SupportDefs.h>
+
+#include <sys/stat.h>
+
+#include "FileSharing.h"
+#include "Progress.h"
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	TAR_BLOCK_SIZE				512
+#define	TAR_BUFFER_SIZE				(256 * 1024)
+
+#define	TAR_TYPE_FILE				'0'
+#define	TAR_TYPE_HARDLINK			'1'		// link is name of member stored before
+#define	TAR_TYPE_SYMLINK			'2'
+#define	TAR_TYPE_DIRECTORY			'5'
+#define	TAR_TYPE_LONG_NAME			'L'		// GNU
+#define	TAR_TYPE_LONG_LINK			'K'		// GNU
+#define	TAR_TYPE_PAX				'x'		// POSIX extended header of next member
+#define	TAR_TYPE_PAX_GLOBAL			'g'
+#define	TAR_TYPE_GNU_SPARSE			'S'		// old GNU sparse member, map is in header (and extension blocks after it)
+#define	TAR_SPARSE_DIRECTORY		"GNUSparseFile.0"	// ustar name of sparse member (PAX 1.0), real one is in extended header
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Uncompressed TAR archive - finds end of archive and appends members there
+//---------------------------------------------------
+class TarArchive
+{
+	public:
+							TarArchive();
+							~TarArchive();
+
+		status_t			Open( const char *path);
+		status_t			Create( const char *path);
+		void				Close();
+
+		int32				CountEntries() const { return aCount; };
+		int					FileDescriptor() const { return aFd; };
+		off_t				DataEnd() const { return aAppendOffset; };
+		void				SetProgress( JobProgress *progress) { aProgress = progress; };
+		void				SetSharing( FileSharing *sharing) { aSharing = sharing; };
+
+		status_t			AddPath( const char *path, const char *name, int32 *cancel);
+
+		status_t			Commit();
+		status_t			Rollback();
+
+	private:
+		status_t			FindEnd();
+		status_t			WriteHeader( const char *name, const struct stat *st, char type, const char *link, off_t size);
+		status_t			WriteLongName( const char *name, char type);
+		status_t			WritePadded( const void *buffer, size_t size);
+		status_t			Write( const void *buffer, size_t size);
+		status_t			AddFile( const char *path, const char *name, const struct stat *st, int32 *cancel);
+		status_t			AddSparseFile( int fd, const char *name, const struct stat *st, const off_t *segments, int32 count,
+								uint8 *buffer, int32 *cancel);
+
+		int					aFd;
+		dev_t				aDevice;
+		ino_t				aNode;
+		int32				aCount;
+
+		off_t				aAppendOffset;	// first of end-of-archive blocks
+		off_t				aOldEnd;
+		off_t				aOldSize;
+
+		JobProgress			*aProgress;		// of job archive is changed by, if any
+		FileSharing			*aSharing;		// hard links, copies and holes which aren't stored again, if any
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+uint64		tar_get_number( const char *field, size_t size);
+uint32		tar_checksum( const char *header);
+
+#endif /*__TAR_ARCHIVE_H_*/
@@ -0,0 +1,412 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "Throttle.h"
+#include "Archiver.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <Locker.h>
+#include <Messenger.h>
+
+#define	THROTTLE_MAX_CPUS		64
+
+static int32 sThrottledJobs = 0;	// jobs sharing global write limit
+static BLocker sDirectoriesLock( "throttle_directories");
+static BMessage sDirectories;		// directory of each throttled job's archive, files created there are shared between them
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: Throttle
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor - limits are read from settings, path is archive created by job
+//---------------------------------------------------
+Throttle::Throttle( BMessage *settings, ACompressView *view, const char *path)
+	:aView( view),
+	aPath( path),
+	aActive( false),
+	aWriteLimit( 0),
+	aGlobalWriteLimit( 0),
+	aCpuShare( 0),
+	aPauseWhenBusy( false),
+	aCpuCount( 1),
+	aStart( system_time()),
+	aStartWritten( 0),
+	aStartCpu( 0),
+	aStartSeconds( time( NULL)),
+	aCreated( 0),
+	aLastScan( 0),
+	aProbeFd( -1),
+	aLastProbe( 0),
+	aLatency( 0),
+	aLastSample( 0),
+	aLastActive( 0),
+	aLastToolsCpu( 0),
+	aLastOwnCpu( 0),
+	aQuiet( false),
+	aPaused( false),
+	aBusy( false),
+	aFinished( false),
+	aPausedUntil( 0),
+	aPausedAt( 0),
+	aPausedTime( 0)
+{
+	int32 value = 0;
+	if( settings->FindInt32( ARCHIVER_SETTINGS_WRITE_LIMIT, &value) == B_OK && value > 0)
+		aWriteLimit = (int64)value * 1024 * 1024;
+	value = 0;
+	if( settings->FindInt32( ARCHIVER_SETTINGS_GLOBAL_WRITE_LIMIT, &value) == B_OK && value > 0)
+		aGlobalWriteLimit = (int64)value * 1024 * 1024;
+	if( settings->FindInt32( ARCHIVER_SETTINGS_CPU_SHARE, &aCpuShare) != B_OK || aCpuShare >= 100)
+		aCpuShare = 0;
+	settings->FindBool( ARCHIVER_SETTINGS_PAUSE_BUSY, &aPauseWhenBusy);
+
+	aActive = aWriteLimit > 0 || aGlobalWriteLimit > 0 || aCpuShare > 0 || aPauseWhenBusy;
+	if( !aActive)
+		return;
+	atomic_add( &sThrottledJobs, 1);
+
+	system_info info;
+	if( get_system_info( &info) == B_OK)
+		aCpuCount = info.cpu_count < THROTTLE_MAX_CPUS ? info.cpu_count : THROTTLE_MAX_CPUS;
+
+	// tools may write to temporary file next to archive (zip does), new files there count too
+	aDirectory.SetTo( path);
+	int32 slash = aDirectory.FindLast( '/');
+	aLeaf.SetTo( slash >= 0 ? path + slash + 1 : path);
+	aDirectory.Truncate( slash > 0 ? slash : 0);
+	if( aDirectory.Length() == 0)
+		aDirectory.SetTo( slash == 0 ? "/" : ".");
+
+	BAutolock locker( &sDirectoriesLock);
+	sDirectories.AddString( "directory", aDirectory.String());
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+Throttle::~Throttle()
+{
+	Finish();
+}
+
+//---------------------------------------------------
+//	Job is done - tools mustn't stay suspended
+//---------------------------------------------------
+void
+Throttle::Finish()
+{
+	if( !aActive || aFinished)
+		return;
+	aFinished = true;
+
+	aBusy = false;
+	Resume();
+	if( aProbeFd >= 0)
+		close( aProbeFd);
+	aProbeFd = -1;
+	atomic_add( &sThrottledJobs, -1);
+
+	BAutolock locker( &sDirectoriesLock);
+	const char *directory;
+	for( int32 index = 0; sDirectories.FindString( "directory", index, &directory) == B_OK; index++)
+	{
+		if( aDirectory == directory)
+		{
+			sDirectories.RemoveData( "directory", index);
+			break;
+		}
+	}
+}
+
+//---------------------------------------------------
+//	Bytes written by job - archive's size, or it's share of files created next to it if that's more
+//	(other programs, and other jobs, writing elsewhere on the volume don't count)
+//---------------------------------------------------
+off_t
+Throttle::Written()
+{
+	off_t written = 0;
+	struct stat st;
+	if( stat( aPath.String(), &st) == 0)
+		written = st.st_size;
+
+	off_t created = CreatedFiles();
+	return created > written ? created : written;
+}
+
+//---------------------------------------------------
+//	Bytes of files created in archive's directory since job started (archive itself too),
+//	divided between throttled jobs writing there - whose temporary file is whose can't be known
+//---------------------------------------------------
+off_t
+Throttle::CreatedFiles()
+{
+	bigtime_t now = system_time();
+	if( aLastScan > 0 && now - aLastScan < THROTTLE_SCAN_INTERVAL)
+		return aCreated;
+	aLastScan = now;
+
+	DIR *dir = opendir( aDirectory.String());
+	if( dir == NULL)
+		return aCreated;
+
+	off_t bytes = 0;
+	struct dirent *entry;
+	while( ( entry = readdir( dir)) != NULL)
+	{
+		BString child( aDirectory);
+		child << "/" << entry->d_name;
+		struct stat st;
+		if( lstat( child.String(), &st) == 0 && S_ISREG( st.st_mode) && st.st_crtime >= aStartSeconds)
+			bytes += st.st_size;
+	}
+	closedir( dir);
+
+	int32 jobs = 0;
+	BAutolock locker( &sDirectoriesLock);
+	const char *directory;
+	for( int32 index = 0; sDirectories.FindString( "directory", index, &directory) == B_OK; index++)
+	{
+		if( aDirectory == directory)
+			jobs++;
+	}
+	aCreated = bytes / ( jobs > 0 ? jobs : 1);
+	return aCreated;
+}
+
+//---------------------------------------------------
+//	How long synchronous write of few KB to archive's volume takes now
+//---------------------------------------------------
+bigtime_t
+Throttle::ProbeLatency()
+{
+	static char buffer[THROTTLE_PROBE_SIZE];
+
+	// probe file is removed at once, so nothing is left behind
+	if( aProbeFd < 0)
+	{
+		BString probe( aPath);
+		probe << ".probe-" << (int32)find_thread( NULL);
+		aProbeFd = open( probe.String(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+		if( aProbeFd < 0)
+			return 0;
+		unlink( probe.String());
+	}
+
+	bigtime_t start = system_time();
+	if( pwrite( aProbeFd, buffer, sizeof( buffer), 0) != (ssize_t)sizeof( buffer) || fsync( aProbeFd) != 0)
+		return 0;
+	return system_time() - start;
+}
+
+//---------------------------------------------------
+//	% of all CPUs used by other programs since last call - job's tools and Archiver's own threads don't count
+//---------------------------------------------------
+int32
+Throttle::OthersLoad( bigtime_t toolsCpu, bigtime_t now)
+{
+	cpu_info info[THROTTLE_MAX_CPUS];
+	if( get_cpu_info( 0, aCpuCount, info) != B_OK)
+		return 0;
+
+	bigtime_t active = 0;
+	for( int32 cpu = 0; cpu < aCpuCount; cpu++)
+		active += info[cpu].active_time;
+
+	bigtime_t ownCpu = 0;
+	team_usage_info usage;
+	if( get_team_usage_info( B_CURRENT_TEAM, B_TEAM_USAGE_SELF, &usage) == B_OK)
+		ownCpu = usage.user_time + usage.kernel_time;
+
+	int32 load = 0;
+	if( aLastSample > 0 && now > aLastSample)
+	{
+		bigtime_t others = ( active - aLastActive) - ( toolsCpu - aLastToolsCpu) - ( ownCpu - aLastOwnCpu);
+		load = others > 0 ? others * 100 / ( ( now - aLastSample) * aCpuCount) : 0;
+	}
+	aLastSample = now;
+	aLastActive = active;
+	aLastToolsCpu = toolsCpu;
+	aLastOwnCpu = ownCpu;
+	return load;
+}
+
+//---------------------------------------------------
+//	Suspend tools until given time (0 - until Resume()), reason is shown in window
+//---------------------------------------------------
+void
+Throttle::Pause( bigtime_t until, const char *reason)
+{
+	aPausedUntil = until;
+	if( aPaused)
+		return;
+
+	aView->SuspendTools();
+	aPaused = true;
+	aPausedAt = system_time();
+
+	// rate limits make many short pauses, only long ones are shown
+	if( reason != NULL)
+	{
+		BMessage msg( ARCHIVER_MSG_THROTTLE);
+		msg.AddString( "reason", reason);
+		BMessenger( aView).SendMessage( &msg);
+	}
+}
+
+//---------------------------------------------------
+//	Resume tools, if they were paused
+//---------------------------------------------------
+void
+Throttle::Resume()
+{
+	if( !aPaused)
+		return;
+
+	aView->ResumeTools();
+	aPaused = false;
+	aPausedTime += system_time() - aPausedAt;
+	if( aPausedUntil == 0)
+	{
+		BMessage msg( ARCHIVER_MSG_THROTTLE);
+		BMessenger( aView).SendMessage( &msg);
+	}
+}
+
+//---------------------------------------------------
+//	Limits are counted from now on - after long pause job shouldn't run faster to catch up
+//---------------------------------------------------
+void
+Throttle::Restart( bigtime_t toolsCpu)
+{
+	aStart = system_time();
+	aStartWritten = Written();
+	aStartCpu = toolsCpu;
+}
+
+//---------------------------------------------------
+//	Called each time pipeline is sampled, with CPU time tools used so far
+//	pauses tools when job is over it's limits or system is busy, resumes them when it's time
+//---------------------------------------------------
+void
+Throttle::Check( bigtime_t toolsCpu)
+{
+	if( !aActive || aFinished)
+		return;
+
+	bigtime_t now = system_time();
+
+	// short pause for limits goes on until it's time
+	if( aPaused && !aBusy)
+	{
+		if( now < aPausedUntil)
+			return;
+
+		// pause to see disk without job's own writes - it's probed before tools go on
+		if( aQuiet)
+		{
+			aLatency = ProbeLatency();
+			aLastProbe = now;
+		}
+		Resume();
+	}
+
+	// busy system - pause until it's idle again (with some margin, so job doesn't keep switching)
+	if( aPauseWhenBusy)
+	{
+		int32 load = OthersLoad( toolsCpu, now);
+		bool quiet = aQuiet;
+		aQuiet = false;
+		if( !quiet && now - aLastProbe >= THROTTLE_PROBE_INTERVAL)
+		{
+			aLatency = ProbeLatency();
+			aLastProbe = now;
+		}
+
+		// while job is paused, probes don't wait for it's writes
+		if( aBusy)
+		{
+			if( load >= THROTTLE_IDLE_LOAD || aLatency >= THROTTLE_IDLE_LATENCY)
+				return;
+			aBusy = false;
+			Resume();
+			Restart( toolsCpu);
+		}
+		else if( load > THROTTLE_BUSY_LOAD || ( quiet && aLatency > THROTTLE_BUSY_LATENCY))
+		{
+			aBusy = true;
+			Pause( 0, load > THROTTLE_BUSY_LOAD ? "system is busy" : "disk is busy");
+			return;
+		}
+		else if( aLatency > THROTTLE_BUSY_LATENCY)
+		{
+			// slow write may be waiting for job's own writes - tools are paused for a moment, and it's probed again
+			aQuiet = true;
+			Pause( now + THROTTLE_QUIET_TIME, NULL);
+			return;
+		}
+	}
+
+	// how long job has to wait to be back under limits
+	bigtime_t elapsed = now - aStart;
+	bigtime_t wait = 0;
+
+	int64 limit = aWriteLimit;
+	int32 jobs = atomic_get( &sThrottledJobs);
+	if( aGlobalWriteLimit > 0 && jobs > 0 && ( limit == 0 || aGlobalWriteLimit / jobs < limit))
+		limit = aGlobalWriteLimit / jobs;
+	if( limit > 0)
+	{
+		bigtime_t needed = ( Written() - aStartWritten) * 1000000 / limit;
+		if( needed - elapsed > wait)
+			wait = needed - elapsed;
+	}
+
+	if( aCpuShare > 0)
+	{
+		bigtime_t needed = ( toolsCpu - aStartCpu) * 100 / ( aCpuShare * aCpuCount);
+		if( needed - elapsed > wait)
+			wait = needed - elapsed;
+	}
+
+	if( wait > 0)
+		Pause( now + ( wait < THROTTLE_MAX_PAUSE ? wait : THROTTLE_MAX_PAUSE), NULL);
+}
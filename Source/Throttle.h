@@ -0,0 +1,126 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __THROTTLE_H_
+#define __THROTTLE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <Message.h>
+#include <OS.h>
+#include <String.h>
+
+#include <sys/types.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	THROTTLE_MAX_PAUSE			2000000		// longest single pause for rate limits (µs)
+#define	THROTTLE_PROBE_INTERVAL		1000000		// how often disk latency is measured (µs)
+#define	THROTTLE_PROBE_SIZE			4096
+#define	THROTTLE_BUSY_LOAD			90			// % of CPUs used by others, above which job is paused
+#define	THROTTLE_IDLE_LOAD			60			// ... and below which it's resumed
+#define	THROTTLE_BUSY_LATENCY		100000		// synchronous 4KB write slower than this pauses job (µs)
+#define	THROTTLE_IDLE_LATENCY		30000		// ... faster than this resumes it
+#define	THROTTLE_QUIET_TIME			300000		// slow write is probed again after tools were paused this long (µs)
+#define	THROTTLE_SCAN_INTERVAL		1000000		// how often archive's directory is looked through for new files (µs)
+
+class ACompressView;
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Keeps pipeline of one job under limits from settings - MB/s written by job and by all jobs,
+//	share of CPUs - and pauses it while system is busy
+//	tools are suspended for a while, the same way Stop() suspends them while it asks user
+//---------------------------------------------------
+class Throttle
+{
+	public:
+							Throttle( BMessage *settings, ACompressView *view, const char *path);
+							~Throttle();
+
+		bool				IsActive() const { return aActive; };
+		void				Check( bigtime_t toolsCpu);
+		void				Finish();
+		bigtime_t			PausedTime() const { return aPausedTime; };
+
+	private:
+		off_t				Written();
+		off_t				CreatedFiles();
+		bigtime_t			ProbeLatency();
+		int32				OthersLoad( bigtime_t toolsCpu, bigtime_t now);
+		void				Pause( bigtime_t until, const char *reason);
+		void				Resume();
+		void				Restart( bigtime_t toolsCpu);
+
+		ACompressView		*aView;
+		BString				aPath;
+		bool				aActive;
+		BString				aDirectory;			// of archive
+		BString				aLeaf;
+
+		int64				aWriteLimit;		// bytes per second, 0 if none
+		int64				aGlobalWriteLimit;
+		int32				aCpuShare;			// % of all CPUs
+		bool				aPauseWhenBusy;
+		int32				aCpuCount;
+
+		// limits are kept from here (job start, or end of pause for busy system)
+		bigtime_t			aStart;
+		off_t				aStartWritten;
+		bigtime_t			aStartCpu;
+		time_t				aStartSeconds;		// files in archive's directory created since then are job's too
+
+		off_t				aCreated;			// share of their bytes, counted at most once per THROTTLE_SCAN_INTERVAL
+		bigtime_t			aLastScan;
+
+		int					aProbeFd;
+		bigtime_t			aLastProbe;
+		bigtime_t			aLatency;
+		bigtime_t			aLastSample;
+		bigtime_t			aLastActive;		// CPU time of all CPUs at last sample
+		bigtime_t			aLastToolsCpu;
+		bigtime_t			aLastOwnCpu;		// of Archiver's threads, they aren't others
+		bool				aQuiet;				// tools are paused to probe disk without job's own writes
+
+		bool				aPaused;
+		bool				aBusy;				// paused because system is busy, until it's idle again
+		bool				aFinished;
+		bigtime_t			aPausedUntil;
+		bigtime_t			aPausedAt;
+		bigtime_t			aPausedTime;
+};
+
+#endif /*__THROTTLE_H_*/
@@ -0,0 +1,644 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "WorkerPool.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <Autolock.h>
+
+#include <zlib.h>
+
+// pool and queue of thread running this code, if it's one of CPU workers
+static __thread WorkerPool *sCurrentPool = NULL;
+static __thread int32 sCurrentWorker = -1;
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: TaskGroup
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+TaskGroup::TaskGroup()
+	:aPending( 0)
+{
+	aDone = create_sem( 0, "Archiver_task_group");
+}
+
+//---------------------------------------------------
+//	Destructor - tasks may still use group, so they have to be finished
+//---------------------------------------------------
+TaskGroup::~TaskGroup()
+{
+	Wait();
+	delete_sem( aDone);
+}
+
+//---------------------------------------------------
+//	Task of group finished - last one wakes whoever waits
+//---------------------------------------------------
+void
+TaskGroup::Done()
+{
+	// group may be gone as soon as it's empty, so nothing of it is used after that
+	sem_id done = aDone;
+	if( atomic_add( &aPending, -1) == 1)
+		release_sem( done);
+}
+
+//---------------------------------------------------
+//	Wait until all tasks of group are finished
+//	CPU worker runs other tasks meanwhile, so pool can't run out of threads when tasks wait for tasks
+//---------------------------------------------------
+void
+TaskGroup::Wait()
+{
+	if( sCurrentPool != NULL)
+	{
+		sCurrentPool->Help( sCurrentWorker, this);
+		return;
+	}
+
+	while( Pending() > 0)
+		acquire_sem( aDone);
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: TaskQueue
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+TaskQueue::TaskQueue()
+	:aLock( "Archiver_task_queue"),
+	aTasks( NULL),
+	aSize( 0),
+	aHead( 0),
+	aCount( 0)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+TaskQueue::~TaskQueue()
+{
+	free( aTasks);
+}
+
+//---------------------------------------------------
+//	Add task at back, returns false if there is no memory for it
+//---------------------------------------------------
+bool
+TaskQueue::Push( const worker_task &task)
+{
+	BAutolock lock( aLock);
+
+	if( aCount == aSize)
+	{
+		int32 size = aSize > 0 ? aSize * 2 : WORKER_QUEUE_SIZE;
+		worker_task *tasks = (worker_task*)malloc( size * sizeof( worker_task));
+		if( tasks == NULL)
+			return false;
+		for( int32 index = 0; index < aCount; index++)
+			tasks[index] = aTasks[( aHead + index) % aSize];
+		free( aTasks);
+		aTasks = tasks;
+		aSize = size;
+		aHead = 0;
+	}
+
+	aTasks[( aHead + aCount) % aSize] = task;
+	aCount++;
+	return true;
+}
+
+//---------------------------------------------------
+//	Take newest task - owner of queue does it, data it just used is still in cache
+//---------------------------------------------------
+bool
+TaskQueue::PopBack( worker_task *task)
+{
+	BAutolock lock( aLock);
+
+	if( aCount == 0)
+		return false;
+	aCount--;
+	*task = aTasks[( aHead + aCount) % aSize];
+	return true;
+}
+
+//---------------------------------------------------
+//	Take oldest task - others steal it, it's usually the biggest piece of work left
+//---------------------------------------------------
+bool
+TaskQueue::PopFront( worker_task *task)
+{
+	BAutolock lock( aLock);
+
+	if( aCount == 0)
+		return false;
+	*task = aTasks[aHead];
+	aHead = ( aHead + 1) % aSize;
+	aCount--;
+	return true;
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: WorkerPool
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor - starts CPU workers, threads for blocking tasks are started when needed
+//---------------------------------------------------
+WorkerPool::WorkerPool( int32 workers)
+	:aWorkerCount( 0),
+	aQueueCount( workers),
+	aStarted( 0),
+	aQuit( 0),
+	aSteals( 0),
+	aBlockingThreads( 0),
+	aIdleBlockingThreads( 0)
+{
+	if( aQueueCount <= 0)
+	{
+		system_info info;
+		aQueueCount = get_system_info( &info) == B_OK ? info.cpu_count : 1;
+	}
+	if( aQueueCount < 1)
+		aQueueCount = 1;
+	if( aQueueCount > WORKER_POOL_MAX_WORKERS)
+		aQueueCount = WORKER_POOL_MAX_WORKERS;
+
+	aWork = create_sem( 0, "Archiver_work");
+	aBlockingWork = create_sem( 0, "Archiver_blocking_work");
+
+	// queues have to be there before any worker starts stealing
+	for( int32 index = 0; index < aQueueCount; index++)
+		aQueues[index] = new TaskQueue();
+
+	// workers run at low priority, like tools do, so they don't make desktop slow
+	for( int32 index = 0; index < aQueueCount; index++)
+	{
+		aWorkers[aWorkerCount] = spawn_thread( WorkerThread, "Archiver_worker", B_LOW_PRIORITY, (void*)this);
+		if( aWorkers[aWorkerCount] < B_OK || resume_thread( aWorkers[aWorkerCount]) != B_OK)
+			break;
+		aWorkerCount++;
+	}
+}
+
+//---------------------------------------------------
+//	Destructor - tasks still in queues are dropped, running ones are finished
+//---------------------------------------------------
+WorkerPool::~WorkerPool()
+{
+	atomic_set( &aQuit, 1);
+
+	release_sem_etc( aWork, aWorkerCount, 0);
+	for( int32 index = 0; index < aWorkerCount; index++)
+	{
+		status_t result;
+		wait_for_thread( aWorkers[index], &result);
+	}
+
+	// threads of blocking tasks aren't waited for by thread_id, idle ones may quit on their own
+	release_sem_etc( aBlockingWork, atomic_get( &aBlockingThreads), 0);
+	while( atomic_get( &aBlockingThreads) > 0)
+		snooze( WORKER_HELP_POLL);
+
+	for( int32 index = 0; index < aQueueCount; index++)
+		delete aQueues[index];
+	delete_sem( aWork);
+	delete_sem( aBlockingWork);
+}
+
+//---------------------------------------------------
+//	Pool shared by all jobs, one CPU worker for each CPU
+//	it's never deleted, jobs may still be running when application quits
+//---------------------------------------------------
+WorkerPool *
+WorkerPool::Default()
+{
+	static WorkerPool *sDefault = new WorkerPool();
+	return sDefault;
+}
+
+//---------------------------------------------------
+//	Run function( data) in one of CPU workers
+//	task submitted by worker goes to it's own queue, others can steal it from there
+//---------------------------------------------------
+void
+WorkerPool::Submit( TaskGroup *group, thread_func function, void *data)
+{
+	worker_task task;
+	task.function = function;
+	task.data = data;
+	task.group = group;
+	task.priority = B_LOW_PRIORITY;
+	if( group != NULL)
+		group->Add();
+
+	TaskQueue *queue = sCurrentPool == this ? aQueues[sCurrentWorker] : &aSubmitted;
+	if( aWorkerCount == 0 || !queue->Push( task))
+	{
+		// no workers (or memory) - caller does it itself
+		Run( task);
+		return;
+	}
+	release_sem_etc( aWork, 1, B_DO_NOT_RESCHEDULE);
+}
+
+//---------------------------------------------------
+//	Run function( data) in thread of it's own - for tasks which wait for pipes, processes, etc.
+//	idle thread is reused if there is one, thread is started otherwise
+//	each task gets it's thread at once, so tasks can wait for each other
+//---------------------------------------------------
+void
+WorkerPool::SubmitBlocking( TaskGroup *group, thread_func function, void *data, int32 priority)
+{
+	worker_task task;
+	task.function = function;
+	task.data = data;
+	task.group = group;
+	task.priority = priority;
+	if( group != NULL)
+		group->Add();
+
+	if( !aBlocking.Push( task))
+	{
+		Run( task);
+		return;
+	}
+
+	// take idle thread for this task, it can't quit now
+	for( ;;)
+	{
+		int32 idle = atomic_get( &aIdleBlockingThreads);
+		if( idle <= 0)
+			break;
+		if( atomic_test_and_set( &aIdleBlockingThreads, idle - 1, idle) == idle)
+		{
+			release_sem( aBlockingWork);
+			return;
+		}
+	}
+
+	// new thread takes task at once, without waiting on semaphore
+	if( !StartBlockingThread() && aBlocking.PopFront( &task))
+		Run( task);
+}
+
+//---------------------------------------------------
+//	Start thread for blocking tasks
+//---------------------------------------------------
+bool
+WorkerPool::StartBlockingThread()
+{
+	atomic_add( &aBlockingThreads, 1);
+	thread_id thread = spawn_thread( BlockingThread, "Archiver_task", B_NORMAL_PRIORITY, (void*)this);
+	if( thread < B_OK || resume_thread( thread) != B_OK)
+	{
+		atomic_add( &aBlockingThreads, -1);
+		return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------
+//	Run task and let it's group know it's done
+//---------------------------------------------------
+void
+WorkerPool::Run( const worker_task &task)
+{
+	task.function( task.data);
+	if( task.group != NULL)
+		task.group->Done();
+}
+
+//---------------------------------------------------
+//	Find task for worker - newest of it's own, oldest submitted from outside, or steal oldest of others
+//---------------------------------------------------
+bool
+WorkerPool::Take( int32 worker, worker_task *task)
+{
+	if( worker >= 0 && aQueues[worker]->PopBack( task))
+		return true;
+	if( aSubmitted.PopFront( task))
+		return true;
+
+	for( int32 index = 1; index <= aQueueCount; index++)
+	{
+		int32 victim = ( worker + index) % aQueueCount;
+		if( victim != worker && aQueues[victim]->PopFront( task))
+		{
+			atomic_add64( &aSteals, 1);
+			return true;
+		}
+	}
+	return false;
+}
+
+//---------------------------------------------------
+//	Worker waits for group - it runs any task it can find until group is done
+//---------------------------------------------------
+void
+WorkerPool::Help( int32 worker, TaskGroup *group)
+{
+	while( group->Pending() > 0)
+	{
+		worker_task task;
+		if( Take( worker, &task))
+			Run( task);
+		else
+			acquire_sem_etc( group->aDone, 1, B_RELATIVE_TIMEOUT, WORKER_HELP_POLL);
+	}
+}
+
+//---------------------------------------------------
+//	CPU worker - runs tasks, sleeps when there are none
+//	semaphore is released once for each task, so worker sleeping on it can't miss any
+//---------------------------------------------------
+int32
+WorkerPool::WorkerThread( void *data)
+{
+	WorkerPool *pool = (WorkerPool*)data;
+	int32 worker = atomic_add( &pool->aStarted, 1);
+	sCurrentPool = pool;
+	sCurrentWorker = worker;
+
+	while( atomic_get( &pool->aQuit) == 0)
+	{
+		worker_task task;
+		if( pool->Take( worker, &task))
+			pool->Run( task);
+		else
+			acquire_sem( pool->aWork);
+	}
+	return 0;
+}
+
+//---------------------------------------------------
+//	Thread for blocking tasks - runs them one after another
+//	after being idle for a while it quits, unless SubmitBlocking() has just taken it
+//---------------------------------------------------
+int32
+WorkerPool::BlockingThread( void *data)
+{
+	WorkerPool *pool = (WorkerPool*)data;
+	thread_id self = find_thread( NULL);
+
+	for( ;;)
+	{
+		worker_task task;
+		if( pool->aBlocking.PopFront( &task))
+		{
+			if( task.priority != B_NORMAL_PRIORITY)
+				set_thread_priority( self, task.priority);
+			pool->Run( task);
+			if( task.priority != B_NORMAL_PRIORITY)
+				set_thread_priority( self, B_NORMAL_PRIORITY);
+		}
+		if( atomic_get( &pool->aQuit))
+			break;
+
+		atomic_add( &pool->aIdleBlockingThreads, 1);
+		if( acquire_sem_etc( pool->aBlockingWork, 1, B_RELATIVE_TIMEOUT, WORKER_IDLE_TIMEOUT) == B_OK)
+			continue;
+
+		// timed out - quit, if thread can still stop being idle
+		bool taken = false;
+		for( ;;)
+		{
+			int32 idle = atomic_get( &pool->aIdleBlockingThreads);
+			if( idle <= 0)
+			{
+				taken = true;
+				break;
+			}
+			if( atomic_test_and_set( &pool->aIdleBlockingThreads, idle - 1, idle) == idle)
+				break;
+		}
+		if( !taken)
+			break;
+		acquire_sem( pool->aBlockingWork);
+	}
+
+	atomic_add( &pool->aBlockingThreads, -1);
+	return 0;
+}
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: Benchmark
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Block of data compressed by benchmark
+//---------------------------------------------------
+struct bench_block
+{
+	const uint8	*data;
+	size_t		size;
+	int64		*compressed;
+};
+
+//---------------------------------------------------
+//	Job of benchmark - file split into blocks, each block is a task
+//---------------------------------------------------
+struct bench_job
+{
+	WorkerPool	*pool;
+	const uint8	*data;
+	size_t		size;
+	size_t		blockSize;
+	int64		*compressed;
+};
+
+//---------------------------------------------------
+//	Task - deflate one block, like SeekableGzip does
+//---------------------------------------------------
+static int32
+bench_block_task( void *data)
+{
+	bench_block *block = (bench_block*)data;
+	uLongf size = compressBound( block->size);
+	Bytef *output = (Bytef*)malloc( size);
+	if( output != NULL && compress2( output, &size, block->data, block->size, 6) == Z_OK)
+		atomic_add64( block->compressed, size);
+	free( output);
+	return 0;
+}
+
+//---------------------------------------------------
+//	Task - split job into blocks, and wait for them
+//	blocks go to queue of worker running job, idle workers have to steal them
+//---------------------------------------------------
+static int32
+bench_job_task( void *data)
+{
+	bench_job *job = (bench_job*)data;
+	int32 count = ( job->size + job->blockSize - 1) / job->blockSize;
+	bench_block *blocks = new bench_block[count];
+
+	TaskGroup group;
+	for( int32 index = 0; index < count; index++)
+	{
+		blocks[index].data = job->data + index * job->blockSize;
+		blocks[index].size = index < count - 1 ? job->blockSize : job->size - index * job->blockSize;
+		blocks[index].compressed = job->compressed;
+		job->pool->Submit( &group, bench_block_task, (void*)&blocks[index]);
+	}
+	group.Wait();
+
+	delete[] blocks;
+	return 0;
+}
+
+//---------------------------------------------------
+//	"Archiver --bench-pool [MB]"
+//	how compression of blocks scales with number of workers, from 1 to number of CPUs
+//	even - blocks of 1MB submitted from outside; uneven - 4 jobs of 1/2, 1/4, 1/8 and 1/8 of data
+//	splitting themselves into blocks of 256KB, so workers have to steal
+//---------------------------------------------------
+int
+worker_pool_bench_main( int argc, char **argv)
+{
+	size_t size = ( argc > 0 ? atoi( argv[0]) : WORKER_BENCH_SIZE) * 1024 * 1024;
+	uint8 *data = size > 0 ? (uint8*)malloc( size) : NULL;
+	if( data == NULL)
+	{
+		fprintf( stderr, "usage: Archiver --bench-pool [MB]\n");
+		return 1;
+	}
+
+	// words of text, so deflate has as much work as with real files
+	static const char *words[] = { "archive", "file", "the", "of", "compressed", "data", "Haiku", "tar", "zip", "block", "a", "is", "to", "and", "directory", "size" };
+	uint32 seed = 1;
+	for( size_t index = 0; index < size; )
+	{
+		seed = seed * 1103515245 + 12345;
+		const char *word = words[( seed >> 16) % 16];
+		size_t length = strlen( word);
+		if( length > size - index - 1)
+			length = size - index - 1;
+		memcpy( data + index, word, length);
+		index += length;
+		data[index++] = ( seed >> 8) % 13 == 0 ? '\n' : ' ';
+	}
+
+	system_info info;
+	int32 cpus = get_system_info( &info) == B_OK ? info.cpu_count : 1;
+	if( cpus > WORKER_POOL_MAX_WORKERS)
+		cpus = WORKER_POOL_MAX_WORKERS;
+
+	printf( "%" B_PRId32 " MB, deflate -6\n", (int32)( size / 1024 / 1024));
+	printf( "workers    even MB/s  speedup   uneven MB/s  speedup    steals\n");
+
+	double even_base = 0, uneven_base = 0;
+	int64 expected = -1;
+	int result = 0;
+	for( int32 workers = 1; workers <= cpus; workers++)
+	{
+		WorkerPool pool( workers);
+
+		// even
+		int64 compressed = 0;
+		bigtime_t start = system_time();
+		{
+			bench_job job = { &pool, data, size, 1024 * 1024, &compressed };
+			int32 count = ( size + job.blockSize - 1) / job.blockSize;
+			bench_block *blocks = new bench_block[count];
+			TaskGroup group;
+			for( int32 index = 0; index < count; index++)
+			{
+				blocks[index].data = data + index * job.blockSize;
+				blocks[index].size = index < count - 1 ? job.blockSize : size - index * job.blockSize;
+				blocks[index].compressed = &compressed;
+				pool.Submit( &group, bench_block_task, (void*)&blocks[index]);
+			}
+			group.Wait();
+			delete[] blocks;
+		}
+		double even = size / (double)( system_time() - start);
+		int64 even_compressed = compressed;
+
+		// uneven
+		compressed = 0;
+		int64 steals = pool.CountSteals();
+		start = system_time();
+		{
+			size_t parts[4] = { size / 2, size / 4, size / 8, 0 };
+			parts[3] = size - parts[0] - parts[1] - parts[2];
+			bench_job jobs[4];
+			TaskGroup group;
+			size_t offset = 0;
+			for( int32 index = 0; index < 4; index++)
+			{
+				jobs[index].pool = &pool;
+				jobs[index].data = data + offset;
+				jobs[index].size = parts[index];
+				jobs[index].blockSize = 256 * 1024;
+				jobs[index].compressed = &compressed;
+				offset += parts[index];
+				pool.Submit( &group, bench_job_task, (void*)&jobs[index]);
+			}
+			group.Wait();
+		}
+		double uneven = size / (double)( system_time() - start);
+		steals = pool.CountSteals() - steals;
+
+		if( workers == 1)
+		{
+			even_base = even;
+			uneven_base = uneven;
+			expected = even_compressed;
+		}
+		if( even_compressed != expected)
+			result = 1;
+
+		printf( "%7" B_PRId32 "  %11.1f  %6.2fx  %12.1f  %6.2fx  %8" B_PRId64 "\n", workers,
+			even, even / even_base, uneven, uneven / uneven_base, steals);
+	}
+	free( data);
+
+	if( result != 0)
+		fprintf( stderr, "Archiver: blocks were compressed differently!\n");
+	return result;
+}
@@ -0,0 +1,162 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+#ifndef __WORKER_POOL_H_
+#define __WORKER_POOL_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <Locker.h>
+#include <OS.h>
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	WORKER_POOL_MAX_WORKERS		64
+#define	WORKER_QUEUE_SIZE			64			// first size of each worker's queue, it grows when needed
+#define	WORKER_IDLE_TIMEOUT			10000000	// thread for blocking tasks quits after being idle this long (µs)
+#define	WORKER_HELP_POLL			1000		// worker waiting for group looks for tasks this often (µs)
+#define	WORKER_BENCH_SIZE			256			// MB compressed by "--bench-pool"
+
+class WorkerPool;
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Tasks submitted together, so they can be waited for
+//---------------------------------------------------
+class TaskGroup
+{
+	public:
+							TaskGroup();
+							~TaskGroup();
+
+		int32				Pending() const { return atomic_get( (int32*)&aPending); };
+		void				Wait();
+
+	private:
+		friend class WorkerPool;
+		void				Add() { atomic_add( &aPending, 1); };
+		void				Done();
+
+		int32				aPending;
+		sem_id				aDone;
+};
+
+//---------------------------------------------------
+//	One task - function is called with data, in one of pool's threads
+//---------------------------------------------------
+struct worker_task
+{
+	thread_func			function;
+	void				*data;
+	TaskGroup			*group;
+	int32				priority;		// blocking tasks only
+};
+
+//---------------------------------------------------
+//	Double ended queue of tasks - owner takes newest ones from back, others steal oldest from front
+//---------------------------------------------------
+class TaskQueue
+{
+	public:
+							TaskQueue();
+							~TaskQueue();
+
+		bool				Push( const worker_task &task);
+		bool				PopBack( worker_task *task);
+		bool				PopFront( worker_task *task);
+
+	private:
+		BLocker				aLock;
+		worker_task			*aTasks;
+		int32				aSize;
+		int32				aHead;
+		int32				aCount;
+};
+
+//---------------------------------------------------
+//	Threads shared by all jobs
+//	CPU tasks (member of ZIP, block of data) run on one thread per CPU, each with it's own queue
+//	idle thread steals from others, so CPUs are kept busy however uneven jobs are
+//	blocking tasks (job waiting for it's tools, copying pipes) get parked thread of their own,
+//	they spend most of the time waiting and mustn't take CPU threads from work
+//---------------------------------------------------
+class WorkerPool
+{
+	public:
+							WorkerPool( int32 workers = 0);	// 0 - one for each CPU
+							~WorkerPool();
+
+		static WorkerPool	*Default();
+
+		int32				CountWorkers() const { return aWorkerCount; };
+		int64				CountSteals() const { return atomic_get64( (int64*)&aSteals); };
+
+		void				Submit( TaskGroup *group, thread_func function, void *data);
+		void				SubmitBlocking( TaskGroup *group, thread_func function, void *data, int32 priority = B_NORMAL_PRIORITY);
+
+	private:
+		friend class TaskGroup;
+		static int32		WorkerThread( void *data);
+		static int32		BlockingThread( void *data);
+		bool				Take( int32 worker, worker_task *task);
+		void				Help( int32 worker, TaskGroup *group);
+		void				Run( const worker_task &task);
+		bool				StartBlockingThread();
+
+		int32				aWorkerCount;	// threads running
+		int32				aQueueCount;
+		int32				aStarted;
+		thread_id			aWorkers[WORKER_POOL_MAX_WORKERS];
+		TaskQueue			*aQueues[WORKER_POOL_MAX_WORKERS];
+		TaskQueue			aSubmitted;		// tasks from threads outside of pool
+		sem_id				aWork;
+		int32				aQuit;
+		int64				aSteals;
+
+		TaskQueue			aBlocking;
+		sem_id				aBlockingWork;
+		int32				aBlockingThreads;
+		int32				aIdleBlockingThreads;
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+int			worker_pool_bench_main( int argc, char **argv);
+
+#endif /*__WORKER_POOL_H_*/
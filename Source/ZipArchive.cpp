@@ -0,0 +1,1842 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include "ZipArchive.h"
+#include "Checksum.h"
+#include "ParallelDeflate.h"
+#include "WorkerPool.h"
+
+
+#include <stdio.h>
+#include <string.h>
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <stdlib.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <OS.h>
+
+#include <zlib.h>
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: helpers
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Little endian values, ZIP doesn't care about alignment
+//---------------------------------------------------
+uint16
+zip_get16( const uint8 *data)
+{
+	return data[0] | (data[1] << 8);
+}
+
+uint32
+zip_get32( const uint8 *data)
+{
+	return data[0] | (data[1] << 8) | (data[2] << 16) | ((uint32)data[3] << 24);
+}
+
+uint64
+zip_get64( const uint8 *data)
+{
+	return zip_get32( data) | ((uint64)zip_get32( data + 4) << 32);
+}
+
+void
+zip_put16( uint8 *data, uint16 value)
+{
+	data[0] = value & 0xff;
+	data[1] = value >> 8;
+}
+
+void
+zip_put32( uint8 *data, uint32 value)
+{
+	zip_put16( data, value & 0xffff);
+	zip_put16( data + 2, value >> 16);
+}
+
+void
+zip_put64( uint8 *data, uint64 value)
+{
+	zip_put32( data, value & 0xffffffff);
+	zip_put32( data + 4, value >> 32);
+}
+
+//---------------------------------------------------
+//	pread()/pwrite() whole buffer
+//---------------------------------------------------
+status_t
+zip_read_at( int fd, off_t offset, void *buffer, size_t size)
+{
+	uint8 *data = (uint8*)buffer;
+	while( size > 0)
+	{
+		ssize_t bytes = pread( fd, data, size, offset);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes < 0)
+			return errno;
+		if( bytes == 0)
+			return B_BAD_DATA;
+		data += bytes;
+		offset += bytes;
+		size -= bytes;
+	}
+	return B_OK;
+}
+
+status_t
+zip_write_at( int fd, off_t offset, const void *buffer, size_t size)
+{
+	const uint8 *data = (const uint8*)buffer;
+	while( size > 0)
+	{
+		ssize_t bytes = pwrite( fd, data, size, offset);
+		if( bytes < 0 && errno == EINTR)
+			continue;
+		if( bytes <= 0)
+			return bytes < 0 ? errno : B_IO_ERROR;
+		data += bytes;
+		offset += bytes;
+		size -= bytes;
+	}
+	return B_OK;
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: ZipEntry
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+ZipEntry::ZipEntry()
+	:aName( NULL),
+	aExtra( NULL),
+	aExtraSize( 0),
+	aComment( NULL),
+	aCommentSize( 0),
+	aVersionMadeBy( (3 << 8) | 20),	// unix, 2.0
+	aVersionNeeded( 20),
+	aFlags( 0),
+	aMethod( ZIP_METHOD_STORED),
+	aTime( 0),
+	aDate( 0),
+	aCrc( 0),
+	aCompressedSize( 0),
+	aSize( 0),
+	aInternalAttributes( 0),
+	aExternalAttributes( 0),
+	aOffset( 0),
+	aNameCapacity( 0),
+	aExtraCapacity( 0),
+	aCommentCapacity( 0)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+ZipEntry::~ZipEntry()
+{
+	free( aName);
+	free( aExtra);
+	free( aComment);
+}
+
+//---------------------------------------------------
+//	Buffer of at least size bytes, it only grows
+//---------------------------------------------------
+static bool
+reserve( void **buffer, size_t *capacity, size_t size)
+{
+	if( size <= *capacity && *buffer != NULL)
+		return true;
+
+	size_t newCapacity = *capacity > 0 ? *capacity : 64;
+	while( newCapacity < size)
+		newCapacity *= 2;
+	void *newBuffer = realloc( *buffer, newCapacity);
+	if( newBuffer == NULL)
+		return false;
+	*buffer = newBuffer;
+	*capacity = newCapacity;
+	return true;
+}
+
+//---------------------------------------------------
+//	Setters - make copies
+//	name may be given in two parts (and doesn't have to end with 0)
+//---------------------------------------------------
+void
+ZipEntry::SetName( const char *name)
+{
+	SetName( name, strlen( name));
+}
+
+void
+ZipEntry::SetName( const char *name, size_t length, const char *suffix, size_t suffixLength)
+{
+	if( !reserve( (void**)&aName, &aNameCapacity, length + suffixLength + 1))
+		return;
+	memmove( aName, name, length);
+	memcpy( aName + length, suffix, suffixLength);
+	aName[length + suffixLength] = 0;
+}
+
+void
+ZipEntry::SetExtra( const uint8 *extra, uint16 size)
+{
+	aExtraSize = 0;
+	if( size > 0 && reserve( (void**)&aExtra, &aExtraCapacity, size))
+	{
+		memmove( aExtra, extra, size);
+		aExtraSize = size;
+	}
+}
+
+void
+ZipEntry::SetComment( const char *comment, uint16 size)
+{
+	aCommentSize = 0;
+	if( size > 0 && reserve( (void**)&aComment, &aCommentCapacity, size))
+	{
+		memmove( aComment, comment, size);
+		aCommentSize = size;
+	}
+}
+
+//---------------------------------------------------
+//	Type of entry - from unix mode if archive was made on unix, or from name
+//---------------------------------------------------
+bool
+ZipEntry::IsDirectory() const
+{
+	if( (aVersionMadeBy >> 8) == 3 && (aExternalAttributes >> 16) != 0)
+		return S_ISDIR( aExternalAttributes >> 16);
+
+	size_t length = strlen( aName);
+	return ( length > 0 && aName[length-1] == '/') || (aExternalAttributes & 0x10);
+}
+
+bool
+ZipEntry::IsSymLink() const
+{
+	return (aVersionMadeBy >> 8) == 3 && S_ISLNK( aExternalAttributes >> 16);
+}
+
+mode_t
+ZipEntry::Mode() const
+{
+	if( (aVersionMadeBy >> 8) == 3 && (aExternalAttributes >> 16) != 0)
+		return aExternalAttributes >> 16;
+
+	return IsDirectory() ? (S_IFDIR | 0755) : (S_IFREG | 0644);
+}
+
+//---------------------------------------------------
+//	MS-DOS date and time used by ZIP <-> time_t
+//---------------------------------------------------
+time_t
+ZipEntry::ModificationTime() const
+{
+	struct tm tm;
+	memset( &tm, 0, sizeof( tm));
+	tm.tm_year = ((aDate >> 9) & 0x7f) + 80;
+	tm.tm_mon = ((aDate >> 5) & 0x0f) - 1;
+	tm.tm_mday = aDate & 0x1f;
+	tm.tm_hour = (aTime >> 11) & 0x1f;
+	tm.tm_min = (aTime >> 5) & 0x3f;
+	tm.tm_sec = (aTime & 0x1f) * 2;
+	tm.tm_isdst = -1;
+	return mktime( &tm);
+}
+
+void
+ZipEntry::SetModificationTime( time_t time)
+{
+	struct tm tm;
+	localtime_r( &time, &tm);
+
+	// MS-DOS time starts in 1980
+	if( tm.tm_year < 80)
+	{
+		aTime = 0;
+		aDate = (1 << 5) | 1;
+		return;
+	}
+
+	aTime = (tm.tm_hour << 11) | (tm.tm_min << 5) | (tm.tm_sec / 2);
+	aDate = ((tm.tm_year - 80) << 9) | ((tm.tm_mon + 1) << 5) | tm.tm_mday;
+}
+
+
+//----------------------------------------------------------------------------
+//
+//	Functions :: ZipArchive
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	Constructor
+//---------------------------------------------------
+ZipArchive::ZipArchive()
+	:aFd( -1),
+	aDevice( 0),
+	aNode( 0),
+	aWritable( false),
+	aAppendOffset( 0),
+	aOldDirectory( NULL),
+	aOldDirectorySize( 0),
+	aOldDirectoryOffset( 0),
+	aOldSize( 0),
+	aProgress( NULL),
+	aSharing( NULL)
+{
+}
+
+//---------------------------------------------------
+//	Destructor
+//---------------------------------------------------
+ZipArchive::~ZipArchive()
+{
+	Close();
+}
+
+//---------------------------------------------------
+//	Close archive and forget all entries (doesn't Commit())
+//---------------------------------------------------
+void
+ZipArchive::Close()
+{
+	if( aFd >= 0)
+		close( aFd);
+	aFd = -1;
+
+	aEntries.MakeEmpty();
+
+	free( aOldDirectory);
+	aOldDirectory = NULL;
+	aOldDirectorySize = 0;
+}
+
+//---------------------------------------------------
+//	Open existing archive and read it's central directory
+//---------------------------------------------------
+status_t
+ZipArchive::Open( const char *path, bool write)
+{
+	Close();
+
+	aWritable = write;
+	aFd = open( path, (write ? O_RDWR : O_RDONLY) | O_CLOEXEC);
+	if( aFd < 0)
+		return errno;
+
+	struct stat st;
+	if( fstat( aFd, &st) != 0)
+		return errno;
+	aDevice = st.st_dev;
+	aNode = st.st_ino;
+
+	status_t status = ReadCentralDirectory();
+	if( status != B_OK)
+		Close();
+	return status;
+}
+
+//---------------------------------------------------
+//	Create new, empty archive
+//---------------------------------------------------
+status_t
+ZipArchive::Create( const char *path)
+{
+	Close();
+
+	aWritable = true;
+	aFd = open( path, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+	if( aFd < 0)
+		return errno;
+
+	struct stat st;
+	if( fstat( aFd, &st) != 0)
+		return errno;
+	aDevice = st.st_dev;
+	aNode = st.st_ino;
+
+	aAppendOffset = 0;
+	aOldDirectoryOffset = 0;
+	aOldSize = 0;
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Find end of central directory (ZIP64 too) and parse all entries
+//---------------------------------------------------
+status_t
+ZipArchive::ReadCentralDirectory()
+{
+	struct stat st;
+	if( fstat( aFd, &st) != 0)
+		return errno;
+
+	off_t size = st.st_size;
+	if( size < ZIP_END_SIZE)
+		return B_BAD_DATA;
+
+	// end of central directory is at the end, followed only by comment (max 64kB)
+	size_t tailSize = size < 0xffff + ZIP_END_SIZE ? size : 0xffff + ZIP_END_SIZE;
+	off_t tailOffset = size - tailSize;
+	uint8 *tail = (uint8*)malloc( tailSize);
+	if( tail == NULL)
+		return B_NO_MEMORY;
+
+	status_t status = zip_read_at( aFd, tailOffset, tail, tailSize);
+	if( status != B_OK)
+	{
+		free( tail);
+		return status;
+	}
+
+	ssize_t endPos;
+	for( endPos = tailSize - ZIP_END_SIZE; endPos >= 0; endPos--)
+	{
+		if( zip_get32( tail + endPos) == ZIP_END_SIG
+			&& endPos + ZIP_END_SIZE + zip_get16( tail + endPos + 20) <= (ssize_t)tailSize)
+			break;
+	}
+	if( endPos < 0)
+	{
+		free( tail);
+		return B_BAD_DATA;
+	}
+
+	uint64 count = zip_get16( tail + endPos + 10);
+	uint64 directorySize = zip_get32( tail + endPos + 12);
+	uint64 directoryOffset = zip_get32( tail + endPos + 16);
+	off_t endOffset = tailOffset + endPos;
+	free( tail);
+
+	// ZIP64 end of central directory locator is right before end of central directory
+	if( endOffset >= ZIP64_LOCATOR_SIZE)
+	{
+		uint8 locator[ZIP64_LOCATOR_SIZE];
+		if( zip_read_at( aFd, endOffset - ZIP64_LOCATOR_SIZE, locator, sizeof( locator)) == B_OK
+			&& zip_get32( locator) == ZIP64_LOCATOR_SIG)
+		{
+			uint8 end64[ZIP64_END_SIZE];
+			status = zip_read_at( aFd, zip_get64( locator + 8), end64, sizeof( end64));
+			if( status != B_OK || zip_get32( end64) != ZIP64_END_SIG)
+				return B_BAD_DATA;
+
+			count = zip_get64( end64 + 32);
+			directorySize = zip_get64( end64 + 40);
+			directoryOffset = zip_get64( end64 + 48);
+		}
+	}
+
+	if( directoryOffset + directorySize > (uint64)size)
+		return B_BAD_DATA;
+
+	// read whole central directory at once
+	uint8 *directory = (uint8*)malloc( directorySize > 0 ? directorySize : 1);
+	if( directory == NULL)
+		return B_NO_MEMORY;
+
+	status = zip_read_at( aFd, directoryOffset, directory, directorySize);
+	if( status != B_OK)
+	{
+		free( directory);
+		return status;
+	}
+
+	// one entry and one buffer for extra field are filled again for each member
+	ZipEntry entry;
+	uint8 *kept = (uint8*)malloc( 0xffff);
+	if( kept == NULL)
+		status = B_NO_MEMORY;
+
+	uint8 *data = directory;
+	uint8 *dataEnd = directory + directorySize;
+	for( uint64 index = 0; status == B_OK && index < count; index++)
+	{
+		if( data + ZIP_CENTRAL_HEADER_SIZE > dataEnd || zip_get32( data) != ZIP_CENTRAL_HEADER_SIG)
+		{
+			status = B_BAD_DATA;
+			break;
+		}
+
+		uint16 nameSize = zip_get16( data + 28);
+		uint16 extraSize = zip_get16( data + 30);
+		uint16 commentSize = zip_get16( data + 32);
+		if( data + ZIP_CENTRAL_HEADER_SIZE + nameSize + extraSize + commentSize > dataEnd)
+		{
+			status = B_BAD_DATA;
+			break;
+		}
+
+		entry.aVersionMadeBy = zip_get16( data + 4);
+		entry.aVersionNeeded = zip_get16( data + 6);
+		entry.aFlags = zip_get16( data + 8);
+		entry.aMethod = zip_get16( data + 10);
+		entry.aTime = zip_get16( data + 12);
+		entry.aDate = zip_get16( data + 14);
+		entry.aCrc = zip_get32( data + 16);
+		entry.aCompressedSize = zip_get32( data + 20);
+		entry.aSize = zip_get32( data + 24);
+		entry.aInternalAttributes = zip_get16( data + 36);
+		entry.aExternalAttributes = zip_get32( data + 38);
+		entry.aOffset = zip_get32( data + 42);
+
+		entry.SetName( (char*)data + ZIP_CENTRAL_HEADER_SIZE, nameSize);
+
+		// pick ZIP64 values out of extra field, keep the rest as it is
+		uint8 *extra = data + ZIP_CENTRAL_HEADER_SIZE + nameSize;
+		uint8 *extraEnd = extra + extraSize;
+		uint16 keptSize = 0;
+		while( extra + 4 <= extraEnd)
+		{
+			uint16 id = zip_get16( extra);
+			uint16 size = zip_get16( extra + 2);
+			if( extra + 4 + size > extraEnd)
+				break;
+
+			if( id == ZIP64_EXTRA_ID)
+			{
+				uint8 *value = extra + 4;
+				uint8 *valueEnd = value + size;
+				if( entry.aSize == 0xffffffff && value + 8 <= valueEnd)
+				{
+					entry.aSize = zip_get64( value);
+					value += 8;
+				}
+				if( entry.aCompressedSize == 0xffffffff && value + 8 <= valueEnd)
+				{
+					entry.aCompressedSize = zip_get64( value);
+					value += 8;
+				}
+				if( entry.aOffset == 0xffffffff && value + 8 <= valueEnd)
+					entry.aOffset = zip_get64( value);
+			}
+			else
+			{
+				memcpy( kept + keptSize, extra, 4 + size);
+				keptSize += 4 + size;
+			}
+			extra += 4 + size;
+		}
+		entry.SetExtra( kept, keptSize);
+
+		entry.SetComment( (char*)data + ZIP_CENTRAL_HEADER_SIZE + nameSize + extraSize, commentSize);
+
+		status = AddEntry( &entry);
+
+		data += ZIP_CENTRAL_HEADER_SIZE + nameSize + extraSize + commentSize;
+	}
+	free( kept);
+	free( directory);
+
+	if( status != B_OK)
+		return status;
+
+	// new members will overwrite old central directory - keep it, in case adding fails
+	aAppendOffset = directoryOffset;
+	aOldDirectoryOffset = directoryOffset;
+	aOldSize = size;
+	if( aWritable)
+	{
+		aOldDirectorySize = size - directoryOffset;
+		aOldDirectory = (uint8*)malloc( aOldDirectorySize > 0 ? aOldDirectorySize : 1);
+		if( aOldDirectory == NULL)
+			return B_NO_MEMORY;
+		status = zip_read_at( aFd, directoryOffset, aOldDirectory, aOldDirectorySize);
+	}
+
+	return status;
+}
+
+//---------------------------------------------------
+//	Add copy of entry to table, it's found by name from now on
+//---------------------------------------------------
+status_t
+ZipArchive::AddEntry( const ZipEntry *entry)
+{
+	return aEntries.Add( entry);
+}
+
+//---------------------------------------------------
+//	Write at aAppendOffset and move it
+//---------------------------------------------------
+status_t
+ZipArchive::Write( const void *buffer, size_t size)
+{
+	status_t status = zip_write_at( aFd, aAppendOffset, buffer, size);
+	if( status == B_OK)
+		aAppendOffset += size;
+	if( status == B_OK && aProgress != NULL)
+		aProgress->AddOut( size);
+	return status;
+}
+
+//---------------------------------------------------
+//	Write local header for entry at aAppendOffset
+//	sizes and CRC are patched when data is written, or follow data in descriptor
+//---------------------------------------------------
+status_t
+ZipArchive::WriteLocalHeader( ZipEntry *entry, bool zip64, const uint8 *extra, uint16 extraSize)
+{
+	size_t nameSize = strlen( entry->aName);
+	bool descriptor = entry->aFlags & ZIP_FLAG_DATA_DESCRIPTOR;
+	uint8 header[ZIP_LOCAL_HEADER_SIZE + 20];
+
+	zip_put32( header, ZIP_LOCAL_HEADER_SIG);
+	zip_put16( header + 4, entry->aVersionNeeded);
+	zip_put16( header + 6, entry->aFlags);
+	zip_put16( header + 8, entry->aMethod);
+	zip_put16( header + 10, entry->aTime);
+	zip_put16( header + 12, entry->aDate);
+	zip_put32( header + 14, descriptor ? 0 : entry->aCrc);
+	zip_put32( header + 18, zip64 ? 0xffffffff : descriptor ? 0 : entry->aCompressedSize);
+	zip_put32( header + 22, zip64 ? 0xffffffff : descriptor ? 0 : entry->aSize);
+	zip_put16( header + 26, nameSize);
+	zip_put16( header + 28, (zip64 ? 20 : 0) + extraSize);
+
+	entry->aOffset = aAppendOffset;
+
+	status_t status = Write( header, ZIP_LOCAL_HEADER_SIZE);
+	if( status == B_OK)
+		status = Write( entry->aName, nameSize);
+
+	if( status == B_OK && zip64)
+	{
+		uint8 *zip64Extra = header + ZIP_LOCAL_HEADER_SIZE;
+		zip_put16( zip64Extra, ZIP64_EXTRA_ID);
+		zip_put16( zip64Extra + 2, 16);
+		zip_put64( zip64Extra + 4, descriptor ? 0 : entry->aSize);
+		zip_put64( zip64Extra + 12, descriptor ? 0 : entry->aCompressedSize);
+		status = Write( zip64Extra, 20);
+	}
+	if( status == B_OK && extraSize > 0)
+		status = Write( extra, extraSize);
+	return status;
+}
+
+//---------------------------------------------------
+//	Add file, directory (with all it's contents) or symlink
+//	name is name of member in archive
+//---------------------------------------------------
+status_t
+ZipArchive::AddPath( const char *path, const char *name, int32 level, int32 *cancel)
+{
+	if( cancel != NULL && *cancel)
+		return B_CANCELED;
+
+	struct stat st;
+	if( lstat( path, &st) != 0)
+		return errno;
+
+	// don't try to put archive into itself
+	if( st.st_dev == aDevice && st.st_ino == aNode)
+		return B_OK;
+
+	if( S_ISLNK( st.st_mode))
+		return AddSymLink( path, name, &st);
+
+	// ZIP has no hard links - copy of file stored before is symlink to it, relative so archive can be moved
+	if( S_ISREG( st.st_mode))
+	{
+		const char *first = aSharing != NULL ? aSharing->FindCopy( path, &st, cancel) : NULL;
+		if( first != NULL)
+		{
+			char *target = FileSharing::RelativePath( name, first);
+			if( target == NULL)
+				return B_NO_MEMORY;
+			struct stat link = st;
+			link.st_mode = S_IFLNK | 0777;
+			status_t status = AddLink( name, target, strlen( target), &link);
+			free( target);
+			return status;
+		}
+
+		status_t status = AddFile( path, name, &st, level, cancel);
+		if( status == B_OK && aSharing != NULL)
+			aSharing->Added( path, name, &st);
+		return status;
+	}
+
+	if( !S_ISDIR( st.st_mode))
+		return B_OK;
+
+	status_t status = AddDirectory( name, &st);
+	if( status != B_OK)
+		return status;
+
+	DIR *dir = opendir( path);
+	if( dir == NULL)
+		return errno;
+
+	struct dirent *dirent;
+	while( status == B_OK && ( dirent = readdir( dir)) != NULL)
+	{
+		if( !strcmp( dirent->d_name, ".") || !strcmp( dirent->d_name, ".."))
+			continue;
+
+		size_t pathSize = strlen( path) + strlen( dirent->d_name) + 2;
+		size_t nameSize = strlen( name) + strlen( dirent->d_name) + 2;
+		char *childPath = (char*)malloc( pathSize);
+		char *childName = (char*)malloc( nameSize);
+		sprintf( childPath, "%s/%s", path, dirent->d_name);
+		sprintf( childName, "%s/%s", name, dirent->d_name);
+
+		status = AddPath( childPath, childName, level, cancel);
+
+		free( childPath);
+		free( childName);
+	}
+	closedir( dir);
+
+	return status;
+}
+
+//---------------------------------------------------
+//	Add directory entry ("name/")
+//---------------------------------------------------
+status_t
+ZipArchive::AddDirectory( const char *name, const struct stat *st)
+{
+	ZipEntry entry;
+	entry.SetName( name, strlen( name), "/", 1);
+	entry.aFlags = ZIP_FLAG_UTF8;
+	entry.aExternalAttributes = ((uint32)st->st_mode << 16) | 0x10;
+	entry.SetModificationTime( st->st_mtime);
+
+	status_t status = WriteLocalHeader( &entry, false);
+	if( status != B_OK)
+		return status;
+
+	int32 old = FindEntry( entry.aName);
+	status = AddEntry( &entry);
+	if( status == B_OK && old >= 0)
+		RemoveEntry( old);
+	return status;
+}
+
+//---------------------------------------------------
+//	Add symlink - it's target is stored as data
+//---------------------------------------------------
+status_t
+ZipArchive::AddSymLink( const char *path, const char *name, const struct stat *st)
+{
+	char target[B_PATH_NAME_LENGTH];
+	ssize_t size = readlink( path, target, sizeof( target));
+	if( size < 0)
+		return errno;
+
+	return AddLink( name, target, size, st);
+}
+
+//---------------------------------------------------
+//	Add symlink member with target (which doesn't have to be terminated)
+//---------------------------------------------------
+status_t
+ZipArchive::AddLink( const char *name, const char *target, size_t size, const struct stat *st)
+{
+	ZipEntry entry;
+	entry.SetName( name);
+	entry.aFlags = ZIP_FLAG_UTF8;
+	entry.aExternalAttributes = (uint32)st->st_mode << 16;
+	entry.SetModificationTime( st->st_mtime);
+	entry.aCrc = checksum_crc32( 0, target, size);
+	entry.aSize = entry.aCompressedSize = size;
+
+	status_t status = WriteLocalHeader( &entry, false);
+	if( status == B_OK)
+		status = Write( target, size);
+	if( status != B_OK)
+		return status;
+
+	int32 old = FindEntry( entry.aName);
+	status = AddEntry( &entry);
+	if( status == B_OK && old >= 0)
+		RemoveEntry( old);
+	return status;
+}
+
+//---------------------------------------------------
+//	Fill buffer from file being added (less only at it's end) - holes of sparse file are zeros which aren't read
+//---------------------------------------------------
+static status_t
+zip_read_file( void *cookie, void *buffer, size_t size, size_t *bytes)
+{
+	zip_file_source *source = (zip_file_source*)cookie;
+	*bytes = 0;
+	while( *bytes < size)
+	{
+		uint8 *data = (uint8*)buffer + *bytes;
+		size_t wanted = size - *bytes;
+		off_t dataEnd = source->size;
+		off_t hole = source->count > 0 ? FileSharing::HoleAt( source->segments, source->count, &source->segment,
+			source->position, source->size, &dataEnd) : 0;
+		if( hole > 0)
+		{
+			size_t zeros = hole < (off_t)wanted ? hole : wanted;
+			memset( data, 0, zeros);
+			if( lseek( source->fd, source->position + zeros, SEEK_SET) < 0)
+				return errno;
+			source->sharing->AddHoles( zeros);
+			source->position += zeros;
+			*bytes += zeros;
+			continue;
+		}
+
+		// data segment is read up to it's end, next read starts with hole
+		if( dataEnd > source->position && dataEnd - source->position < (off_t)wanted)
+			wanted = dataEnd - source->position;
+		ssize_t got = read( source->fd, data, wanted);
+		if( got < 0 && errno == EINTR)
+			continue;
+		if( got < 0)
+			return errno;
+		if( got == 0)
+			break;
+		source->position += got;
+		*bytes += got;
+		if( source->progress != NULL)
+		{
+			source->progress->AddIn( got);
+			source->progress->WaitWhilePaused();
+		}
+	}
+	return B_OK;
+}
+
+//---------------------------------------------------
+//	Write data of member - writer of ParallelDeflate
+//---------------------------------------------------
+status_t
+ZipArchive::WriteData( void *archive, const void *buffer, size_t size)
+{
+	return ((ZipArchive*)archive)->Write( buffer, size);
+}
+
+//---------------------------------------------------
+//	Store or deflate file in one thread, block after block
+//---------------------------------------------------
+status_t
+ZipArchive::DeflateFile( zip_file_source *source, const ZipEntry *entry, uint32 *crc, uint64 *size, int32 level, int32 *cancel)
+{
+	status_t status = B_OK;
+	z_stream stream;
+	memset( &stream, 0, sizeof( stream));
+	if( entry->aMethod == ZIP_METHOD_DEFLATED && deflateInit2( &stream, level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+		return B_NO_MEMORY;
+
+	uint8 *input = (uint8*)malloc( ZIP_BUFFER_SIZE);
+	uint8 *output = (uint8*)malloc( ZIP_BUFFER_SIZE);
+	if( input == NULL || output == NULL)
+		status = B_NO_MEMORY;
+
+	bool done = false;
+	while( status == B_OK && !done)
+	{
+		if( cancel != NULL && *cancel)
+		{
+			status = B_CANCELED;
+			break;
+		}
+
+		size_t bytes = 0;
+		status = zip_read_file( source, input, ZIP_BUFFER_SIZE, &bytes);
+		if( status != B_OK)
+			break;
+		done = bytes < ZIP_BUFFER_SIZE;
+		*crc = checksum_crc32( *crc, input, bytes);
+		*size += bytes;
+
+		if( entry->aMethod == ZIP_METHOD_STORED)
+		{
+			status = Write( input, bytes);
+			continue;
+		}
+
+		stream.next_in = input;
+		stream.avail_in = bytes;
+		do
+		{
+			stream.next_out = output;
+			stream.avail_out = ZIP_BUFFER_SIZE;
+			deflate( &stream, done ? Z_FINISH : Z_NO_FLUSH);
+			status = Write( output, ZIP_BUFFER_SIZE - stream.avail_out);
+		}
+		while( status == B_OK && stream.avail_out == 0);
+	}
+
+	if( entry->aMethod == ZIP_METHOD_DEFLATED)
+		deflateEnd( &stream);
+	free( input);
+	free( output);
+	return status;
+}
+
+//---------------------------------------------------
+//	Add regular file, deflate it if level > 0
+//---------------------------------------------------
+status_t
+ZipArchive::AddFile( const char *path, const char *name, const struct stat *st, int32 level, int32 *cancel)
+{
+	int fd = open( path, O_RDONLY | O_CLOEXEC);
+	if( fd < 0)
+		return errno;
+
+	ZipEntry entry;
+	entry.SetName( name);
+	entry.aFlags = ZIP_FLAG_UTF8;
+	entry.aExternalAttributes = (uint32)st->st_mode << 16;
+	entry.SetModificationTime( st->st_mtime);
+	entry.aMethod = level > 0 ? ZIP_METHOD_DEFLATED : ZIP_METHOD_STORED;
+
+	// local header of big files gets ZIP64 extra field, compressed size isn't known yet
+	// so leave some room for data which doesn't compress
+	bool zip64 = st->st_size >= 0xffffffffLL - 0x100000;
+	if( zip64)
+		entry.aVersionNeeded = 45;
+
+	off_t headerOffset = aAppendOffset;
+	status_t status = WriteLocalHeader( &entry, zip64);
+
+	// holes of sparse file aren't read, ZIP has no holes so they are compressed as zeros
+	zip_file_source source;
+	memset( &source, 0, sizeof( source));
+	source.fd = fd;
+	source.size = st->st_size;
+	source.sharing = aSharing;
+	source.progress = aProgress;
+	off_t holes = 0;
+	source.count = aSharing != NULL ? FileSharing::DataSegments( fd, st->st_size, &source.segments, &holes) : 0;
+
+	off_t dataOffset = aAppendOffset;
+	uint32 crc = 0;
+	uint64 size = 0;
+
+	// big file is deflated on all CPUs - chunks make one deflate stream, so member is like any other
+	if( status == B_OK && entry.aMethod == ZIP_METHOD_DEFLATED && st->st_size >= PARALLEL_DEFLATE_MINIMUM
+		&& WorkerPool::Default()->CountWorkers() > 1)
+	{
+		ParallelDeflate deflater( level);
+		status = deflater.Run( zip_read_file, &source, WriteData, this, cancel);
+		crc = deflater.Crc();
+		size = deflater.InputSize();
+	}
+	else if( status == B_OK)
+		status = DeflateFile( &source, &entry, &crc, &size, level, cancel);
+
+	free( source.segments);
+	close( fd);
+
+	entry.aCrc = crc;
+	entry.aSize = size;
+	entry.aCompressedSize = aAppendOffset - dataOffset;
+
+	// file grew or didn't compress enough while it was being compressed, and doesn't fit anymore
+	if( status == B_OK && !zip64 && ( entry.aSize >= 0xffffffff || entry.aCompressedSize >= 0xffffffff))
+		status = B_FILE_ERROR;
+
+	// now CRC and sizes are known - patch local header
+	if( status == B_OK)
+	{
+		uint8 patch[12];
+		zip_put32( patch, entry.aCrc);
+		zip_put32( patch + 4, zip64 ? 0xffffffff : entry.aCompressedSize);
+		zip_put32( patch + 8, zip64 ? 0xffffffff : entry.aSize);
+		status = zip_write_at( aFd, headerOffset + 14, patch, sizeof( patch));
+	}
+	if( status == B_OK && zip64)
+	{
+		uint8 patch[16];
+		zip_put64( patch, entry.aSize);
+		zip_put64( patch + 8, entry.aCompressedSize);
+		status = zip_write_at( aFd, headerOffset + ZIP_LOCAL_HEADER_SIZE + strlen( entry.aName) + 4, patch, sizeof( patch));
+	}
+
+	if( status != B_OK)
+	{
+		aAppendOffset = headerOffset;
+		return status;
+	}
+
+	int32 old = FindEntry( entry.aName);
+	status = AddEntry( &entry);
+	if( status == B_OK && old >= 0)
+		RemoveEntry( old);
+	if( status == B_OK && aProgress != NULL)
+		aProgress->FileDone();
+	return status;
+}
+
+//---------------------------------------------------
+//	Copy member of other archive as it is - compressed data isn't touched,
+//	only headers are made again
+//---------------------------------------------------
+status_t
+ZipArchive::CopyEntry( const ZipArchive *source, int32 index, int32 *cancel)
+{
+	// copy of source's entry becomes new one, only it's offset changes
+	ZipEntry entry;
+	status_t status = source->GetEntry( index, &entry);
+	if( status != B_OK)
+		return status;
+	uint64 from = entry.aOffset;
+
+	// data starts after local header, which may have different extra field than central directory
+	uint8 local[ZIP_LOCAL_HEADER_SIZE];
+	status = zip_read_at( source->aFd, from, local, sizeof( local));
+	if( status != B_OK)
+		return status;
+	if( zip_get32( local) != ZIP_LOCAL_HEADER_SIG)
+		return B_BAD_DATA;
+
+	uint16 localNameSize = zip_get16( local + 26);
+	uint16 localExtraSize = zip_get16( local + 28);
+	off_t dataOffset = from + ZIP_LOCAL_HEADER_SIZE + localNameSize + localExtraSize;
+
+	// keep local extra field (timestamps, unix ids...), but without ZIP64 record - new one is made if needed
+	uint8 *extra = (uint8*)malloc( localExtraSize > 0 ? localExtraSize * 2 : 1);
+	uint16 extraSize = 0;
+	if( extra == NULL)
+		return B_NO_MEMORY;
+	if( localExtraSize > 0)
+	{
+		uint8 *field = extra + localExtraSize;
+		status = zip_read_at( source->aFd, from + ZIP_LOCAL_HEADER_SIZE + localNameSize, field, localExtraSize);
+		uint8 *fieldEnd = field + localExtraSize;
+		while( status == B_OK && field + 4 <= fieldEnd)
+		{
+			uint16 size = zip_get16( field + 2);
+			if( field + 4 + size > fieldEnd)
+				break;
+			if( zip_get16( field) != ZIP64_EXTRA_ID)
+			{
+				memmove( extra + extraSize, field, 4 + size);
+				extraSize += 4 + size;
+			}
+			field += 4 + size;
+		}
+	}
+
+	bool zip64 = entry.aSize >= 0xffffffff || entry.aCompressedSize >= 0xffffffff;
+	if( zip64 && entry.aVersionNeeded < 45)
+		entry.aVersionNeeded = 45;
+
+	off_t headerOffset = aAppendOffset;
+	if( status == B_OK)
+		status = WriteLocalHeader( &entry, zip64, extra, extraSize);
+	free( extra);
+
+	uint8 *buffer = (uint8*)malloc( ZIP_COPY_BUFFER_SIZE);
+	if( buffer == NULL)
+		status = B_NO_MEMORY;
+
+	uint64 left = entry.aCompressedSize;
+	while( status == B_OK && left > 0)
+	{
+		if( cancel != NULL && *cancel)
+		{
+			status = B_CANCELED;
+			break;
+		}
+
+		size_t size = left < ZIP_COPY_BUFFER_SIZE ? left : ZIP_COPY_BUFFER_SIZE;
+		status = zip_read_at( source->aFd, dataOffset, buffer, size);
+		if( status == B_OK)
+			status = Write( buffer, size);
+		dataOffset += size;
+		left -= size;
+		if( aProgress != NULL)
+			aProgress->WaitWhilePaused();
+	}
+	free( buffer);
+
+	// member was streamed (or encrypted) with sizes after data - they stay there
+	if( status == B_OK && (entry.aFlags & ZIP_FLAG_DATA_DESCRIPTOR))
+	{
+		uint8 descriptor[24];
+		zip_put32( descriptor, ZIP_DESCRIPTOR_SIG);
+		zip_put32( descriptor + 4, entry.aCrc);
+		if( zip64)
+		{
+			zip_put64( descriptor + 8, entry.aCompressedSize);
+			zip_put64( descriptor + 16, entry.aSize);
+		}
+		else
+		{
+			zip_put32( descriptor + 8, entry.aCompressedSize);
+			zip_put32( descriptor + 12, entry.aSize);
+		}
+		status = Write( descriptor, zip64 ? 24 : 16);
+	}
+
+	if( status != B_OK)
+	{
+		aAppendOffset = headerOffset;
+		return status;
+	}
+
+	int32 old = FindEntry( entry.aName);
+	status = AddEntry( &entry);
+	if( status == B_OK && old >= 0)
+		RemoveEntry( old);
+	return status;
+}
+
+//---------------------------------------------------
+//	Make output from members of inputs, without recompressing anything
+//	if there are more members with the same name, the last one goes to output (later archives replace earlier ones)
+//	members matching any of remove patterns are left out
+//	output may be one of inputs, it's replaced only when new archive is complete
+//---------------------------------------------------
+status_t
+ZipArchive::Merge( const char *output, const char **inputs, int32 inputCount,
+	const char **remove, int32 removeCount, int32 *cancel, int32 *copied, off_t *bytes)
+{
+	ZipArchive *sources = new ZipArchive[inputCount];
+	status_t status = B_OK;
+	for( int32 index = 0; status == B_OK && index < inputCount; index++)
+		status = sources[index].Open( inputs[index], false);
+
+	char temp[B_PATH_NAME_LENGTH + 8];
+	snprintf( temp, sizeof( temp), "%s.part", output);
+
+	ZipArchive target;
+	if( status == B_OK)
+		status = target.Create( temp);
+
+	int32 count = 0;
+	off_t total = 0;
+	ZipEntry entry;
+	for( int32 input = 0; status == B_OK && input < inputCount; input++)
+	{
+		for( int32 index = 0; status == B_OK && index < sources[input].CountEntries(); index++)
+		{
+			if( sources[input].GetEntry( index, &entry) != B_OK)
+				continue;
+			const char *name = entry.aName;
+
+			// is it replaced by other member with the same name?
+			bool replaced = sources[input].FindEntry( name) != index;
+			for( int32 later = input + 1; !replaced && later < inputCount; later++)
+				replaced = sources[later].FindEntry( name) >= 0;
+			if( replaced)
+				continue;
+
+			bool removed = false;
+			for( int32 pattern = 0; !removed && pattern < removeCount; pattern++)
+				removed = fnmatch( remove[pattern], name, 0) == 0;
+			if( removed)
+				continue;
+
+			status = target.CopyEntry( &sources[input], index, cancel);
+			count++;
+			total += sources[input].Entries()->CompressedSize( index);
+		}
+	}
+
+	if( status == B_OK)
+		status = target.Commit();
+	bool created = target.FileDescriptor() >= 0;
+	target.Close();
+	delete [] sources;
+
+	if( status == B_OK && rename( temp, output) != 0)
+		status = errno;
+	if( status != B_OK && created)
+		unlink( temp);
+
+	if( copied != NULL)
+		*copied = count;
+	if( bytes != NULL)
+		*bytes = total;
+	return status;
+}
+
+//---------------------------------------------------
+//	"Archiver --merge output.zip input.zip..."
+//	"Archiver --delete archive.zip pattern..."
+//	"Archiver --replace archive.zip source.zip..."
+//---------------------------------------------------
+int
+ZipArchive::EditMain( int argc, char **argv)
+{
+	const char	*mode = argc > 0 ? argv[0] : "";
+	const char	*output = argc > 1 ? argv[1] : NULL;
+	const char	**inputs = (const char**)argv + 2;
+	int32		inputCount = argc - 2;
+	const char	**remove = NULL;
+	int32		removeCount = 0;
+
+	if( !strcmp( mode, "--delete"))
+	{
+		inputs = (const char**)argv + 1;
+		inputCount = 1;
+		remove = (const char**)argv + 2;
+		removeCount = argc - 2;
+	}
+	else if( !strcmp( mode, "--replace"))
+	{
+		inputs = (const char**)argv + 1;
+		inputCount = argc - 1;
+	}
+
+	if( argc < 3)
+	{
+		fprintf( stderr, "usage: Archiver --merge output.zip input.zip...\n"
+			"       Archiver --delete archive.zip pattern...\n"
+			"       Archiver --replace archive.zip source.zip...\n");
+		return 1;
+	}
+
+	int32 copied = 0;
+	off_t bytes = 0;
+	bigtime_t start = system_time();
+	status_t status = Merge( output, inputs, inputCount, remove, removeCount, NULL, &copied, &bytes);
+	bigtime_t time = system_time() - start;
+
+	if( status != B_OK)
+	{
+		fprintf( stderr, "Archiver: can't make %s (%s)\n", output, strerror( status));
+		return 1;
+	}
+
+	printf( "%s: %" B_PRId32 " members, %.1f MB copied in %.2fs (%.1f MB/s)\n", output, copied,
+		bytes / 1048576.0, time / 1000000.0, time > 0 ? bytes / 1048576.0 / (time / 1000000.0) : 0.0);
+	return 0;
+}
+
+//---------------------------------------------------
+//	Name of member is safe to extract - it's relative and doesn't go up
+//---------------------------------------------------
+static bool
+safe_name( const char *name)
+{
+	if( name[0] == '/' || name[0] == 0)
+		return false;
+
+	for( const char *part = name; part != NULL; part = strchr( part, '/'))
+	{
+		if( *part == '/')
+			part++;
+		if( part[0] == '.' && part[1] == '.' && ( part[2] == '/' || part[2] == 0))
+			return false;
+	}
+	return true;
+}
+
+//---------------------------------------------------
+//	Extract one member (not directory) to destination, directories it's in must already exist
+//	input and output are ZIP_BUFFER_SIZE buffers of calling thread
+//---------------------------------------------------
+status_t
+ZipArchive::ExtractEntry( int32 index, const char *destination, uint8 *input, uint8 *output)
+{
+	ZipEntry entry;
+	if( GetEntry( index, &entry) != B_OK)
+		return B_BAD_INDEX;
+	if( entry.IsDirectory())
+		return B_OK;
+	if( !safe_name( entry.aName))
+		return B_NOT_ALLOWED;
+	if( entry.aFlags & 0x0001)	// encrypted
+		return B_NOT_SUPPORTED;
+	if( entry.aMethod != ZIP_METHOD_STORED && entry.aMethod != ZIP_METHOD_DEFLATED)
+		return B_NOT_SUPPORTED;
+
+	uint8 local[ZIP_LOCAL_HEADER_SIZE];
+	status_t status = zip_read_at( aFd, entry.aOffset, local, sizeof( local));
+	if( status != B_OK)
+		return status;
+	if( zip_get32( local) != ZIP_LOCAL_HEADER_SIG)
+		return B_BAD_DATA;
+	off_t dataOffset = entry.aOffset + ZIP_LOCAL_HEADER_SIZE + zip_get16( local + 26) + zip_get16( local + 28);
+
+	char path[B_PATH_NAME_LENGTH];
+	if( snprintf( path, sizeof( path), "%s/%s", destination, entry.aName) >= (int)sizeof( path))
+		return B_NAME_TOO_LONG;
+
+	// symlink target is small, it's read whole into output buffer
+	int fd = -1;
+	bool link = entry.IsSymLink();
+	if( link)
+	{
+		if( entry.aSize >= B_PATH_NAME_LENGTH)
+			return B_BAD_DATA;
+	}
+	else
+	{
+		// file is made anew - existing one (or symlink) is removed, not written through
+		mode_t mode = entry.Mode() & 0777;
+		if( unlink( path) != 0 && errno != ENOENT)
+			return errno;
+		fd = open( path, O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, mode ? mode : 0644);
+		if( fd < 0)
+			return errno;
+	}
+
+	z_stream stream;
+	memset( &stream, 0, sizeof( stream));
+	if( entry.aMethod == ZIP_METHOD_DEFLATED && inflateInit2( &stream, -MAX_WBITS) != Z_OK)
+		status = B_NO_MEMORY;
+
+	uint32 crc = 0;
+	uint64 left = entry.aCompressedSize;
+	uint64 written = 0;
+	bool done = false;
+	while( status == B_OK && !done)
+	{
+		size_t size = left < ZIP_BUFFER_SIZE ? left : ZIP_BUFFER_SIZE;
+		if( size > 0)
+			status = zip_read_at( aFd, dataOffset, input, size);
+		dataOffset += size;
+		left -= size;
+		if( status != B_OK)
+			break;
+		if( aProgress != NULL)
+		{
+			aProgress->AddIn( size);
+			aProgress->WaitWhilePaused();
+		}
+
+		uint8 *data = input;
+		size_t dataSize = size;
+		if( entry.aMethod == ZIP_METHOD_DEFLATED)
+		{
+			stream.next_in = input;
+			stream.avail_in = size;
+		}
+
+		do
+		{
+			if( entry.aMethod == ZIP_METHOD_DEFLATED)
+			{
+				stream.next_out = output;
+				stream.avail_out = ZIP_BUFFER_SIZE;
+				int result = inflate( &stream, Z_NO_FLUSH);
+				if( result != Z_OK && result != Z_STREAM_END && result != Z_BUF_ERROR)
+				{
+					status = B_BAD_DATA;
+					break;
+				}
+				if( result == Z_STREAM_END)
+					done = true;
+				data = output;
+				dataSize = ZIP_BUFFER_SIZE - stream.avail_out;
+			}
+
+			if( written + dataSize > entry.aSize || ( link && written + dataSize >= B_PATH_NAME_LENGTH))
+			{
+				status = B_BAD_DATA;
+				break;
+			}
+
+			crc = checksum_crc32( crc, data, dataSize);
+			if( link && data != output)
+				memcpy( output + written, data, dataSize);
+			else if( !link && dataSize > 0)
+				status = zip_write_at( fd, written, data, dataSize);
+			written += dataSize;
+			if( aProgress != NULL)
+				aProgress->AddOut( dataSize);
+		}
+		while( status == B_OK && entry.aMethod == ZIP_METHOD_DEFLATED && stream.avail_out == 0);
+
+		if( left == 0 && entry.aMethod == ZIP_METHOD_STORED)
+			done = true;
+		// compressed data ended before deflate stream did
+		if( status == B_OK && !done && left == 0)
+			status = B_BAD_DATA;
+	}
+
+	if( entry.aMethod == ZIP_METHOD_DEFLATED)
+		inflateEnd( &stream);
+
+	if( status == B_OK && ( written != entry.aSize || crc != entry.aCrc))
+		status = B_BAD_DATA;
+
+	if( link)
+	{
+		if( status == B_OK)
+		{
+			output[written] = 0;
+			unlink( path);
+			if( symlink( (char*)output, path) != 0)
+				status = errno;
+		}
+		return status;
+	}
+
+	// modification time from archive
+	if( status == B_OK)
+	{
+		struct timeval times[2];
+		times[0].tv_sec = times[1].tv_sec = entry.ModificationTime();
+		times[0].tv_usec = times[1].tv_usec = 0;
+		futimes( fd, times);
+	}
+	close( fd);
+
+	if( status != B_OK)
+		unlink( path);
+	else if( aProgress != NULL)
+		aProgress->FileDone();
+	return status;
+}
+
+//---------------------------------------------------
+//	Extract job shared by extracting tasks
+//---------------------------------------------------
+struct zip_extract_job
+{
+	ZipArchive	*archive;
+	const char	*destination;
+	int32		*order;
+	int32		count;
+	int32		next;		// next index of order to take
+	int32		*cancel;
+	int32		status;
+	int32		extracted;
+};
+
+//---------------------------------------------------
+//	Extracting task - takes next member until there is none left
+//---------------------------------------------------
+static int32
+zip_extract_task( void *data)
+{
+	zip_extract_job *job = (zip_extract_job*)data;
+	uint8 *input = (uint8*)malloc( ZIP_BUFFER_SIZE);
+	uint8 *output = (uint8*)malloc( ZIP_BUFFER_SIZE + 1);
+	if( input == NULL || output == NULL)
+		atomic_test_and_set( &job->status, B_NO_MEMORY, B_OK);
+
+	while( atomic_get( &job->status) == B_OK)
+	{
+		if( job->cancel != NULL && *job->cancel)
+		{
+			atomic_test_and_set( &job->status, B_CANCELED, B_OK);
+			break;
+		}
+
+		int32 next = atomic_add( &job->next, 1);
+		if( next >= job->count)
+			break;
+
+		status_t status = job->archive->ExtractEntry( job->order[next], job->destination, input, output);
+		if( status != B_OK)
+			atomic_test_and_set( &job->status, status, B_OK);
+		else
+			atomic_add( &job->extracted, 1);
+	}
+
+	free( input);
+	free( output);
+	return 0;
+}
+
+//---------------------------------------------------
+//	Sort members from biggest to smallest, so no thread is left with big one at the end
+//	sizes are copied next to indexes, so sort needs no archive (jobs extract at once)
+//---------------------------------------------------
+struct zip_sort_key
+{
+	uint64		size;
+	int32		index;
+};
+
+static int
+compare_by_size( const void *first, const void *second)
+{
+	uint64 firstSize = ((const zip_sort_key*)first)->size;
+	uint64 secondSize = ((const zip_sort_key*)second)->size;
+	return firstSize < secondSize ? 1 : firstSize > secondSize ? -1 : 0;
+}
+
+static int
+compare_names( const void *first, const void *second)
+{
+	return strcmp( *(const char**)first, *(const char**)second);
+}
+
+//---------------------------------------------------
+//	Extract all members to destination directory
+//	directories are made first, all at once, then files are inflated and written by tasks of WorkerPool,
+//	symlinks are made last, so no file is written through them
+//	only last member of each name is extracted, so no two tasks write the same file
+//---------------------------------------------------
+status_t
+ZipArchive::Extract( const char *destination, int32 threads, int32 *cancel, int32 *extracted, off_t *bytes)
+{
+	int32 count = CountEntries();
+	if( mkdir( destination, 0755) != 0 && errno != EEXIST)
+		return errno;
+
+	// every directory member and every directory files are in, sorted so parents come first
+	char **directories = (char**)malloc( sizeof( char*) * (count + 1));
+	int32 *order = (int32*)malloc( sizeof( int32) * (count + 1));
+	if( directories == NULL || order == NULL)
+	{
+		free( directories);
+		free( order);
+		return B_NO_MEMORY;
+	}
+
+	// symlinks are put at the end of order, files at it's start
+	int32 directoryCount = 0;
+	int32 fileCount = 0;
+	int32 linkCount = 0;
+	off_t total = 0;
+	status_t status = B_OK;
+	ZipEntry entry;
+	for( int32 index = 0; index < count; index++)
+	{
+		if( aEntries.IsDeleted( index) || GetEntry( index, &entry) != B_OK)
+			continue;
+		if( !safe_name( entry.aName))
+		{
+			status = B_NOT_ALLOWED;
+			break;
+		}
+		if( FindEntry( entry.aName) != index)
+			continue;
+
+		const char *slash = strrchr( entry.aName, '/');
+		if( entry.IsDirectory())
+			directories[directoryCount++] = strdup( entry.aName);
+		else
+		{
+			if( entry.IsSymLink())
+				order[count - ++linkCount] = index;
+			else
+				order[fileCount++] = index;
+			total += entry.aSize;
+			if( slash != NULL)
+				directories[directoryCount++] = strndup( entry.aName, slash - entry.aName);
+		}
+	}
+
+	qsort( directories, directoryCount, sizeof( char*), compare_names);
+	const char *previous = "";
+	for( int32 index = 0; status == B_OK && index < directoryCount; index++)
+	{
+		// names of directories end with "/" or not, so compare without it
+		size_t length = strlen( directories[index]);
+		if( length > 0 && directories[index][length-1] == '/')
+			directories[index][--length] = 0;
+		if( !strcmp( previous, directories[index]))
+			continue;
+		previous = directories[index];
+
+		// make it with all parents (parents of file's directory may not be in archive)
+		char path[B_PATH_NAME_LENGTH];
+		if( snprintf( path, sizeof( path), "%s/%s", destination, directories[index]) >= (int)sizeof( path))
+		{
+			status = B_NAME_TOO_LONG;
+			break;
+		}
+		for( char *slash = path + strlen( destination) + 1; status == B_OK; slash++)
+		{
+			slash = strchr( slash, '/');
+			if( slash != NULL)
+				*slash = 0;
+			if( mkdir( path, 0755) != 0 && errno != EEXIST)
+				status = errno;
+			if( slash == NULL)
+				break;
+			*slash = '/';
+		}
+	}
+	for( int32 index = 0; index < directoryCount; index++)
+		free( directories[index]);
+	free( directories);
+
+	// files - biggest first, by as many tasks as there are CPU workers
+	zip_extract_job job;
+	job.archive = this;
+	job.destination = destination;
+	job.order = order;
+	job.count = fileCount;
+	job.next = 0;
+	job.cancel = cancel;
+	job.status = status;
+	job.extracted = 0;
+
+	zip_sort_key *keys = (zip_sort_key*)malloc( sizeof( zip_sort_key) * (fileCount + 1));
+	if( keys != NULL)
+	{
+		for( int32 index = 0; index < fileCount; index++)
+		{
+			keys[index].size = aEntries.CompressedSize( order[index]);
+			keys[index].index = order[index];
+		}
+		qsort( keys, fileCount, sizeof( zip_sort_key), compare_by_size);
+		for( int32 index = 0; index < fileCount; index++)
+			order[index] = keys[index].index;
+		free( keys);
+	}
+
+	// pool's workers are shared with other jobs, more tasks than workers would only wait in queue
+	WorkerPool *pool = WorkerPool::Default();
+	if( threads > pool->CountWorkers())
+		threads = pool->CountWorkers();
+	if( threads < 1)
+		threads = 1;
+	if( threads > ZIP_MAX_EXTRACT_THREADS)
+		threads = ZIP_MAX_EXTRACT_THREADS;
+	if( threads > fileCount)
+		threads = fileCount > 0 ? fileCount : 1;
+
+	TaskGroup tasks;
+	for( int32 index = 0; index < threads; index++)
+		pool->Submit( &tasks, zip_extract_task, (void*)&job);
+	tasks.Wait();
+
+	// symlinks - in this thread, after all files are written
+	if( linkCount > 0 && job.status == B_OK)
+	{
+		uint8 *input = (uint8*)malloc( ZIP_BUFFER_SIZE);
+		uint8 *output = (uint8*)malloc( ZIP_BUFFER_SIZE + 1);
+		if( input == NULL || output == NULL)
+			job.status = B_NO_MEMORY;
+		for( int32 index = count - linkCount; job.status == B_OK && index < count; index++)
+		{
+			if( cancel != NULL && *cancel)
+				job.status = B_CANCELED;
+			else if( ( job.status = ExtractEntry( order[index], destination, input, output)) == B_OK)
+				job.extracted++;
+		}
+		free( input);
+		free( output);
+	}
+	free( order);
+
+	// directories get their times last, files written into them changed them
+	for( int32 index = 0; job.status == B_OK && index < count; index++)
+	{
+		if( aEntries.IsDeleted( index) || GetEntry( index, &entry) != B_OK || !entry.IsDirectory())
+			continue;
+
+		char path[B_PATH_NAME_LENGTH];
+		snprintf( path, sizeof( path), "%s/%s", destination, entry.aName);
+		struct timeval times[2];
+		times[0].tv_sec = times[1].tv_sec = entry.ModificationTime();
+		times[0].tv_usec = times[1].tv_usec = 0;
+		utimes( path, times);
+	}
+
+	if( extracted != NULL)
+		*extracted = job.extracted;
+	if( bytes != NULL)
+		*bytes = total;
+	return job.status;
+}
+
+//---------------------------------------------------
+//	Write central directory and end of central directory after last member
+//---------------------------------------------------
+status_t
+ZipArchive::Commit()
+{
+	uint8 *buffer = (uint8*)malloc( ZIP_BUFFER_SIZE);
+	if( buffer == NULL)
+		return B_NO_MEMORY;
+
+	off_t directoryOffset = aAppendOffset;
+	size_t used = 0;
+	uint64 count = 0;
+	status_t status = B_OK;
+
+	ZipEntry entry;
+	for( int32 index = 0; status == B_OK && index < CountEntries(); index++)
+	{
+		if( aEntries.IsDeleted( index))
+			continue;
+		status = GetEntry( index, &entry);
+		if( status != B_OK)
+			break;
+
+		size_t nameSize = strlen( entry.aName);
+		bool zip64 = entry.aSize >= 0xffffffff || entry.aCompressedSize >= 0xffffffff || entry.aOffset >= 0xffffffff;
+		size_t extraSize = entry.aExtraSize + (zip64 ? 28 : 0);
+		size_t size = ZIP_CENTRAL_HEADER_SIZE + nameSize + extraSize + entry.aCommentSize;
+
+		if( used + size > ZIP_BUFFER_SIZE)
+		{
+			status = Write( buffer, used);
+			used = 0;
+			if( status != B_OK)
+				break;
+		}
+		if( size > ZIP_BUFFER_SIZE)
+		{
+			status = B_BAD_DATA;
+			break;
+		}
+
+		uint8 *header = buffer + used;
+		zip_put32( header, ZIP_CENTRAL_HEADER_SIG);
+		zip_put16( header + 4, entry.aVersionMadeBy);
+		zip_put16( header + 6, zip64 && entry.aVersionNeeded < 45 ? 45 : entry.aVersionNeeded);
+		zip_put16( header + 8, entry.aFlags);
+		zip_put16( header + 10, entry.aMethod);
+		zip_put16( header + 12, entry.aTime);
+		zip_put16( header + 14, entry.aDate);
+		zip_put32( header + 16, entry.aCrc);
+		zip_put32( header + 20, zip64 ? 0xffffffff : entry.aCompressedSize);
+		zip_put32( header + 24, zip64 ? 0xffffffff : entry.aSize);
+		zip_put16( header + 28, nameSize);
+		zip_put16( header + 30, extraSize);
+		zip_put16( header + 32, entry.aCommentSize);
+		zip_put16( header + 34, 0);
+		zip_put16( header + 36, entry.aInternalAttributes);
+		zip_put32( header + 38, entry.aExternalAttributes);
+		zip_put32( header + 42, zip64 ? 0xffffffff : entry.aOffset);
+
+		uint8 *data = header + ZIP_CENTRAL_HEADER_SIZE;
+		memcpy( data, entry.aName, nameSize);
+		data += nameSize;
+		if( zip64)
+		{
+			zip_put16( data, ZIP64_EXTRA_ID);
+			zip_put16( data + 2, 24);
+			zip_put64( data + 4, entry.aSize);
+			zip_put64( data + 12, entry.aCompressedSize);
+			zip_put64( data + 20, entry.aOffset);
+			data += 28;
+		}
+		if( entry.aExtraSize > 0)
+			memcpy( data, entry.aExtra, entry.aExtraSize);
+		data += entry.aExtraSize;
+		if( entry.aCommentSize > 0)
+			memcpy( data, entry.aComment, entry.aCommentSize);
+
+		used += size;
+		count++;
+	}
+	if( status == B_OK && used > 0)
+		status = Write( buffer, used);
+	free( buffer);
+
+	if( status != B_OK)
+		return status;
+
+	uint64 directorySize = aAppendOffset - directoryOffset;
+	bool zip64 = count >= 0xffff || directorySize >= 0xffffffff || (uint64)directoryOffset >= 0xffffffff;
+
+	if( zip64)
+	{
+		uint8 end64[ZIP64_END_SIZE + ZIP64_LOCATOR_SIZE];
+		zip_put32( end64, ZIP64_END_SIG);
+		zip_put64( end64 + 4, ZIP64_END_SIZE - 12);
+		zip_put16( end64 + 12, (3 << 8) | 45);
+		zip_put16( end64 + 14, 45);
+		zip_put32( end64 + 16, 0);
+		zip_put32( end64 + 20, 0);
+		zip_put64( end64 + 24, count);
+		zip_put64( end64 + 32, count);
+		zip_put64( end64 + 40, directorySize);
+		zip_put64( end64 + 48, directoryOffset);
+
+		uint8 *locator = end64 + ZIP64_END_SIZE;
+		zip_put32( locator, ZIP64_LOCATOR_SIG);
+		zip_put32( locator + 4, 0);
+		zip_put64( locator + 8, aAppendOffset);
+		zip_put32( locator + 16, 1);
+
+		status = Write( end64, sizeof( end64));
+		if( status != B_OK)
+			return status;
+	}
+
+	uint8 end[ZIP_END_SIZE];
+	zip_put32( end, ZIP_END_SIG);
+	zip_put16( end + 4, 0);
+	zip_put16( end + 6, 0);
+	zip_put16( end + 8, zip64 ? 0xffff : count);
+	zip_put16( end + 10, zip64 ? 0xffff : count);
+	zip_put32( end + 12, zip64 ? 0xffffffff : directorySize);
+	zip_put32( end + 16, zip64 ? 0xffffffff : directoryOffset);
+	zip_put16( end + 20, 0);
+
+	status = Write( end, sizeof( end));
+	if( status == B_OK && ftruncate( aFd, aAppendOffset) != 0)
+		status = errno;
+	if( status == B_OK)
+		fsync( aFd);
+
+	// old central directory isn't needed anymore, but new members go before new one
+	if( status == B_OK)
+	{
+		free( aOldDirectory);
+		aOldDirectory = NULL;
+		aOldDirectorySize = 0;
+		aOldSize = aAppendOffset;
+		aAppendOffset = directoryOffset;
+		aOldDirectoryOffset = directoryOffset;
+	}
+
+	return status;
+}
+
+//---------------------------------------------------
+//	Adding failed or was cancelled - put back central directory archive had when it was opened
+//---------------------------------------------------
+status_t
+ZipArchive::Rollback()
+{
+	if( aFd < 0 || !aWritable)
+		return B_NO_INIT;
+
+	status_t status = B_OK;
+	if( aOldDirectory != NULL)
+		status = zip_write_at( aFd, aOldDirectoryOffset, aOldDirectory, aOldDirectorySize);
+	if( status == B_OK && ftruncate( aFd, aOldSize) != 0)
+		status = errno;
+
+	aAppendOffset = aOldDirectoryOffset;
+	return status;
+}
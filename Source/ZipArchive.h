@@ -0,0 +1,219 @@
+/*
+
+Copyright (c) 2002 Marcin 'Shard' Konicki
+
+Permission is hereby granted, free of charge, to any person obtaining a copy
+of this software and associated documentation files (the "Software"), to deal
+in the Software without restriction, including without limitation the rights
+to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+copies of the Software, and to permit persons to whom the Software is
+furnished to do so, subject to the following conditions:
+The above copyright notice and this permission notice shall be included in all
+copies or substantial portions of the Software.
+
+THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+SOFTWARE
+
+*/
+
+#ifndef __ZIP_ARCHIVE_H_
+#define __ZIP_ARCHIVE_H_
+
+//----------------------------------------------------------------------------
+//
+//	Include
+//
+//----------------------------------------------------------------------------
+
+#include <SupportDefs.h>
+
+#include <sys/stat.h>
+
+#include "EntryTable.h"
+#include "FileSharing.h"
+#include "Progress.h"
+
+//----------------------------------------------------------------------------
+//
+//	Define
+//
+//----------------------------------------------------------------------------
+
+#define	ZIP_LOCAL_HEADER_SIG		0x04034b50
+#define	ZIP_CENTRAL_HEADER_SIG		0x02014b50
+#define	ZIP_END_SIG					0x06054b50
+#define	ZIP64_END_SIG				0x06064b50
+#define	ZIP64_LOCATOR_SIG			0x07064b50
+
+#define	ZIP_LOCAL_HEADER_SIZE		30
+#define	ZIP_CENTRAL_HEADER_SIZE		46
+#define	ZIP_END_SIZE				22
+#define	ZIP64_END_SIZE				56
+#define	ZIP64_LOCATOR_SIZE			20
+
+#define	ZIP64_EXTRA_ID				0x0001
+#define	ZIP_METHOD_STORED			0
+#define	ZIP_METHOD_DEFLATED			8
+#define	ZIP_FLAG_DATA_DESCRIPTOR	0x0008
+#define	ZIP_FLAG_UTF8				0x0800
+#define	ZIP_DESCRIPTOR_SIG			0x08074b50
+
+#define	ZIP_BUFFER_SIZE				(256 * 1024)
+#define	ZIP_COPY_BUFFER_SIZE		(1024 * 1024)	// members copied without recompressing go in big chunks
+#define	ZIP_MAX_EXTRACT_THREADS		32		// most tasks one Extract() gives to WorkerPool
+
+//----------------------------------------------------------------------------
+//
+//	Classes
+//
+//----------------------------------------------------------------------------
+
+//---------------------------------------------------
+//	File being added - it's read from start to end, holes (of sparse file) are skipped
+//---------------------------------------------------
+struct zip_file_source
+{
+	int					fd;
+	off_t				size;
+	off_t				position;
+	off_t				*segments;		// data segments of sparse file, NULL if it's read whole
+	int32				count;
+	int32				segment;
+	FileSharing			*sharing;
+	JobProgress			*progress;
+};
+
+//---------------------------------------------------
+//	One member of ZIP archive, as described by central directory
+//	archive keeps them in EntryTable, this is copy of one - it's buffers are reused when it's filled again
+//---------------------------------------------------
+class ZipEntry
+{
+	public:
+							ZipEntry();
+							~ZipEntry();
+
+		void				SetName( const char *name);
+		void				SetName( const char *name, size_t length, const char *suffix = "", size_t suffixLength = 0);
+		void				SetExtra( const uint8 *extra, uint16 size);
+		void				SetComment( const char *comment, uint16 size);
+		bool				IsDirectory() const;
+		bool				IsSymLink() const;
+		mode_t				Mode() const;
+		time_t				ModificationTime() const;
+		void				SetModificationTime( time_t time);
+
+		char				*aName;
+		uint8				*aExtra;		// central directory extra field without ZIP64 record
+		uint16				aExtraSize;
+		char				*aComment;
+		uint16				aCommentSize;
+
+		uint16				aVersionMadeBy;
+		uint16				aVersionNeeded;
+		uint16				aFlags;
+		uint16				aMethod;
+		uint16				aTime;
+		uint16				aDate;
+		uint32				aCrc;
+		uint64				aCompressedSize;
+		uint64				aSize;
+		uint16				aInternalAttributes;
+		uint32				aExternalAttributes;
+		uint64				aOffset;		// of local header
+
+	private:
+		size_t				aNameCapacity;
+		size_t				aExtraCapacity;
+		size_t				aCommentCapacity;
+};
+
+//---------------------------------------------------
+//	ZIP archive - reads central directory, appends members and rewrites central directory
+//---------------------------------------------------
+class ZipArchive
+{
+	public:
+							ZipArchive();
+							~ZipArchive();
+
+		status_t			Open( const char *path, bool write);
+		status_t			Create( const char *path);
+		void				Close();
+
+		int32				CountEntries() const { return aEntries.CountEntries(); };
+		status_t			GetEntry( int32 index, ZipEntry *entry) const { return aEntries.Get( index, entry); };
+		const EntryTable	*Entries() const { return &aEntries; };
+		int32				FindEntry( const char *name) const { return aEntries.Find( name); };
+		void				RemoveEntry( int32 index) { aEntries.SetDeleted( index); };
+		int					FileDescriptor() const { return aFd; };
+		off_t				DataEnd() const { return aAppendOffset; };
+		void				SetProgress( JobProgress *progress) { aProgress = progress; };
+		void				SetSharing( FileSharing *sharing) { aSharing = sharing; };
+
+		status_t			AddPath( const char *path, const char *name, int32 level, int32 *cancel);
+		status_t			AddFile( const char *path, const char *name, const struct stat *st, int32 level, int32 *cancel);
+		status_t			AddDirectory( const char *name, const struct stat *st);
+		status_t			AddSymLink( const char *path, const char *name, const struct stat *st);
+		status_t			AddLink( const char *name, const char *target, size_t size, const struct stat *st);
+		status_t			CopyEntry( const ZipArchive *source, int32 index, int32 *cancel);
+
+		status_t			Commit();
+		status_t			Rollback();
+
+		status_t			Extract( const char *destination, int32 threads, int32 *cancel, int32 *extracted = NULL, off_t *bytes = NULL);
+		status_t			ExtractEntry( int32 index, const char *destination, uint8 *input, uint8 *output);
+
+		static status_t		Merge( const char *output, const char **inputs, int32 inputCount,
+								const char **remove, int32 removeCount, int32 *cancel, int32 *copied = NULL, off_t *bytes = NULL);
+		static int			EditMain( int argc, char **argv);
+
+	private:
+		status_t			ReadCentralDirectory();
+		status_t			WriteLocalHeader( ZipEntry *entry, bool zip64, const uint8 *extra = NULL, uint16 extraSize = 0);
+		status_t			Write( const void *buffer, size_t size);
+		status_t			AddEntry( const ZipEntry *entry);
+		status_t			DeflateFile( zip_file_source *source, const ZipEntry *entry, uint32 *crc, uint64 *size, int32 level, int32 *cancel);
+		static status_t		WriteData( void *archive, const void *buffer, size_t size);
+
+		int					aFd;
+		dev_t				aDevice;
+		ino_t				aNode;
+		bool				aWritable;
+
+		EntryTable			aEntries;		// replaced and removed are there too, marked as deleted
+
+		off_t				aAppendOffset;	// where new member (or central directory) goes
+
+		// central directory as it was when archive was opened, to restore it if adding fails
+		uint8				*aOldDirectory;
+		size_t				aOldDirectorySize;
+		off_t				aOldDirectoryOffset;
+		off_t				aOldSize;
+
+		JobProgress			*aProgress;		// of job archive is changed by, if any
+		FileSharing			*aSharing;		// copies which are stored as links, and holes which aren't read, if any
+};
+
+//----------------------------------------------------------------------------
+//
+//	Functions
+//
+//----------------------------------------------------------------------------
+
+uint16		zip_get16( const uint8 *data);
+uint32		zip_get32( const uint8 *data);
+uint64		zip_get64( const uint8 *data);
+void		zip_put16( uint8 *data, uint16 value);
+void		zip_put32( uint8 *data, uint32 value);
+void		zip_put64( uint8 *data, uint64 value);
+
+status_t	zip_read_at( int fd, off_t offset, void *buffer, size_t size);
+status_t	zip_write_at( int fd, off_t offset, const void *buffer, size_t size);
+
+#endif /*__ZIP_ARCHIVE_H_*/